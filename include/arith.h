@@ -0,0 +1,55 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+#include "value.h"
+#include "ast.h"
+
+namespace ti {
+
+// Auto/Exact keep exact rationals; Approximate turns them into decimals
+enum class calc_mode {
+    Auto,
+    Exact,
+    Approximate,
+};
+
+// TI's complex format: in Real, functions of real arguments with no real
+// value (sqrt(-1), ln(-1)) are not extended to complex results; Polar
+// only changes how disp shows complex numbers
+enum class complex_format {
+    Real,
+    Rectangular,
+    Polar,
+};
+
+// kernel computing `l op r` for one fixed pair of operand kinds; the caller
+// guarantees the dynamic types match the kinds the kernel was looked up for
+using binary_kernel = valptr_t (*)(const value &l, const value &r);
+
+// nullptr if the operator is not defined for the kind pair
+binary_kernel findKernel(ast::binary_op op, value_kind l, value_kind r);
+
+// look up the kernel for the operands' kinds and apply it
+valptr_t applyBinary(ast::binary_op op, const valptr_t &l, const valptr_t &r);
+
+// exact num/den in lowest terms: an integer when den divides num, else a fraction
+valptr_t makeRational(const BigInt &num, const BigInt &den);
+
+// convert a result to the representation the mode asks for
+valptr_t applyMode(const valptr_t &v, calc_mode mode);
+
+// integer, fraction or decimal
+bool isNumeric(value_kind k);
+double toDouble(const value &v);
+
+// condition check for If/While/when; throws unless v is a boolean
+bool isTrue(const valptr_t &v);
+
+// For-loop test: cur <= end for a non-negative step, cur >= end otherwise
+bool forContinues(const valptr_t &cur, const valptr_t &end, const valptr_t &step);
+
+BigInt gcd(BigInt a, BigInt b);
+
+} // namespace ti
+
+#endif // ARITH_H
@@ -1,14 +1,20 @@
 #ifndef AST_H
 #define AST_H
 
+#include <atomic>
 #include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 
 #include "value.h" // must define ti::valptr_t
 
 // forward-declare runtime_env to avoid cycles
-namespace ti { class runtime_env; }
+namespace ti {
+class runtime_env;
+struct function;
+using binary_kernel = valptr_t (*)(const value &l, const value &r); // see arith.h
+}
 
 namespace ast {
 
@@ -16,9 +22,26 @@ struct node {
     virtual ~node() = default;
 };
 
+// tag for the concrete node type, so evaluators can switch instead of dynamic_cast
+enum class node_kind {
+    Literal,
+    Var,
+    Assign,
+    Call,
+    Local,
+    Block,
+    If,
+    For,
+    While,
+    Let,
+    Temp,
+    BinaryOp,
+};
+
 struct exprnode : node {
     // evaluate an expression in the given runtime environment
     virtual ti::valptr_t eval(ti::runtime_env &env) = 0;
+    virtual node_kind kind() const = 0;
 };
 
 // Concrete nodes
@@ -26,12 +49,14 @@ struct literal_node : exprnode {
     ti::valptr_t val;
     literal_node(const ti::valptr_t &v) : val(v) {}
     ti::valptr_t eval(ti::runtime_env & /*env*/) override { return val; }
+    node_kind kind() const override { return node_kind::Literal; }
 };
 
 struct var_node : exprnode {
     std::string name;
     var_node(std::string n) : name(std::move(n)) {}
     ti::valptr_t eval(ti::runtime_env &env) override;
+    node_kind kind() const override { return node_kind::Var; }
 };
 
 struct assign_node : exprnode {
@@ -40,6 +65,7 @@ struct assign_node : exprnode {
     assign_node(std::string n, std::unique_ptr<exprnode> r)
         : name(std::move(n)), rhs(std::move(r)) {}
     ti::valptr_t eval(ti::runtime_env &env) override;
+    node_kind kind() const override { return node_kind::Assign; }
 };
 
 struct call_node : exprnode {
@@ -48,6 +74,95 @@ struct call_node : exprnode {
     call_node(std::unique_ptr<exprnode> c, std::vector<std::unique_ptr<exprnode>> a)
         : callee(std::move(c)), args(std::move(a)) {}
     ti::valptr_t eval(ti::runtime_env &env) override;
+    node_kind kind() const override { return node_kind::Call; }
+
+    // the callee, through a monomorphic inline cache that is valid while
+    // the env and its function version are unchanged; throws if undefined
+    ti::function* resolve(ti::runtime_env &env) const;
+
+private:
+    // threads evaluating the same tree share the cache: its fields are
+    // written under icSeq, odd while a writer is in, and a read counts only
+    // if icSeq was even and unchanged around it
+    mutable std::atomic<unsigned> icSeq{0};
+    mutable std::atomic<const ti::runtime_env*> icEnv{nullptr};
+    mutable std::atomic<size_t> icVersion{0};
+    mutable std::atomic<ti::function*> icFn{nullptr};
+};
+
+// Local a, b, ...: declares variables in the innermost call frame
+struct local_node : exprnode {
+    std::vector<std::string> names;
+    local_node(std::vector<std::string> n) : names(std::move(n)) {}
+    ti::valptr_t eval(ti::runtime_env &env) override;
+    node_kind kind() const override { return node_kind::Local; }
+};
+
+// a sequence of statements (function/program body); yields the last value
+struct block_node : exprnode {
+    std::vector<std::unique_ptr<exprnode>> stmts;
+    block_node(std::vector<std::unique_ptr<exprnode>> s) : stmts(std::move(s)) {}
+    ti::valptr_t eval(ti::runtime_env &env) override;
+    node_kind kind() const override { return node_kind::Block; }
+};
+
+// If cond Then ... Else ... EndIf; a missing else branch yields none
+struct if_node : exprnode {
+    std::unique_ptr<exprnode> cond;
+    std::unique_ptr<exprnode> then_branch;
+    std::unique_ptr<exprnode> else_branch; // may be null
+    if_node(std::unique_ptr<exprnode> c, std::unique_ptr<exprnode> t, std::unique_ptr<exprnode> e = nullptr)
+        : cond(std::move(c)), then_branch(std::move(t)), else_branch(std::move(e)) {}
+    ti::valptr_t eval(ti::runtime_env &env) override;
+    node_kind kind() const override { return node_kind::If; }
+};
+
+// For var, start, end[, step] ... EndFor; bounds and step are evaluated once
+struct for_node : exprnode {
+    std::string var;
+    std::unique_ptr<exprnode> start;
+    std::unique_ptr<exprnode> end;
+    std::unique_ptr<exprnode> step; // may be null (step 1)
+    std::unique_ptr<exprnode> body;
+    for_node(std::string v, std::unique_ptr<exprnode> s, std::unique_ptr<exprnode> e,
+             std::unique_ptr<exprnode> st, std::unique_ptr<exprnode> b)
+        : var(std::move(v)), start(std::move(s)), end(std::move(e)), step(std::move(st)), body(std::move(b)) {}
+    ti::valptr_t eval(ti::runtime_env &env) override;
+    node_kind kind() const override { return node_kind::For; }
+};
+
+// While cond ... EndWhile
+struct while_node : exprnode {
+    std::unique_ptr<exprnode> cond;
+    std::unique_ptr<exprnode> body;
+    while_node(std::unique_ptr<exprnode> c, std::unique_ptr<exprnode> b)
+        : cond(std::move(c)), body(std::move(b)) {}
+    ti::valptr_t eval(ti::runtime_env &env) override;
+    node_kind kind() const override { return node_kind::While; }
+};
+
+// Optimizer-generated scope for shared subexpressions (CSE, loop-invariant
+// hoisting). Each temp is computed at most once per evaluation of the
+// let_node, on first use by a temp_node inside `body`.
+struct let_node : exprnode {
+    std::vector<std::unique_ptr<exprnode>> temps;
+    std::unique_ptr<exprnode> body;
+    let_node(std::vector<std::unique_ptr<exprnode>> t, std::unique_ptr<exprnode> b)
+        : temps(std::move(t)), body(std::move(b)) {}
+    ti::valptr_t eval(ti::runtime_env &env) override;
+    node_kind kind() const override { return node_kind::Let; }
+};
+
+// reference to temp `index` of `owner`; `depth` is the owner's let-nesting
+// depth within its function body (or top-level statement), which locates
+// the owner's temps on the runtime temp stack
+struct temp_node : exprnode {
+    const let_node* owner;
+    size_t index;
+    size_t depth = 0;
+    temp_node(const let_node* o, size_t i) : owner(o), index(i) {}
+    ti::valptr_t eval(ti::runtime_env &env) override;
+    node_kind kind() const override { return node_kind::Temp; }
 };
 
 enum class binary_op {
@@ -55,6 +170,13 @@ enum class binary_op {
     Sub,
     Mul,
     Div,
+    Pow,
+    Eq,
+    Ne,
+    Lt,
+    Le,
+    Gt,
+    Ge,
     // extend as needed
 };
 
@@ -65,8 +187,38 @@ struct binary_op_node : exprnode {
     binary_op_node(binary_op op_, std::unique_ptr<exprnode> l, std::unique_ptr<exprnode> r)
         : op(op_), left(std::move(l)), right(std::move(r)) {}
     ti::valptr_t eval(ti::runtime_env &env) override;
+    node_kind kind() const override { return node_kind::BinaryOp; }
+
+    // apply the operator, dispatching through a polymorphic inline cache of
+    // the operand kind pairs seen at this site (mode is not applied)
+    ti::valptr_t apply(const ti::valptr_t &l, const ti::valptr_t &r) const;
+
+private:
+    static constexpr size_t IC_SIZE = 4;
+    struct ic_entry {
+        std::atomic<ti::value_kind> left{};
+        std::atomic<ti::value_kind> right{};
+        std::atomic<ti::binary_kernel> kernel{nullptr};
+    };
+    // shared between threads under icSeq, as in call_node
+    mutable std::atomic<unsigned> icSeq{0};
+    mutable ic_entry ic[IC_SIZE];
+    mutable std::atomic<size_t> icCount{0};
 };
 
+// every owned child slot of a node, in evaluation order (callee first for calls)
+std::vector<std::unique_ptr<exprnode>*> children(exprnode &n);
+std::vector<std::unique_ptr<exprnode>*> children(const exprnode &n);
+
+// a deep copy of a tree, for keeping an expression past the statement that
+// owns it; temp nodes are pointed at the copies of their let nodes
+std::unique_ptr<exprnode> clone(const exprnode &n);
+
+const char* opName(binary_op op);
+
+// print an indented tree, one node per line
+void dump(const exprnode &n, std::ostream &os, int indent = 0);
+
 } // namespace ast
 
 #endif // AST_H
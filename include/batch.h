@@ -0,0 +1,60 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "value.h"
+#include "ast.h"
+
+namespace ti {
+
+class runtime_env;
+struct function;
+
+// Evaluates one expression at many values of a variable, a column at a
+// time: every node processes a block of doubles with SIMD kernels instead
+// of boxing each intermediate. Each result equals what the interpreter
+// returns with `var` set to decimal(x). Exact constants stay exact until
+// they meet a column, If conditions split the block so each branch only
+// sees its own elements, and anything not numeric (strings, exact branch
+// results, non-inlinable calls) drops to per-element evaluation.
+//
+// Supported: literals, variables, operators, If, optimizer temps, pure
+// builtins and pure user functions. Bodies of the latter are inlined when
+// they are expressions over their parameters. Large inputs are split
+// across the shared thread pool when nothing needs the env's call stack.
+class batch_evaluator {
+private:
+    const ast::exprnode &expr;
+    std::vector<std::string> vars;
+    runtime_env &env;
+    bool ok;
+    bool threadSafe = true;
+    std::unordered_map<const function*, bool> inlinable;
+
+    friend struct batch_runner;
+
+public:
+    batch_evaluator(const ast::exprnode &expr, std::string var, runtime_env &env);
+    // several variables, each fed its own column of n values
+    batch_evaluator(const ast::exprnode &expr, std::vector<std::string> vars, runtime_env &env);
+
+    // false if expr is outside the supported subset; eval then throws
+    bool supported() const { return ok; }
+    // true if blocks can be evaluated concurrently: every user function
+    // involved is inlined, so nothing touches the env's call stack
+    bool parallel() const { return threadSafe; }
+
+    // one value per input; throws like the interpreter if any element does
+    std::vector<valptr_t> eval(const double* xs, size_t n);
+    std::vector<valptr_t> eval(const std::vector<const double*> &cols, size_t n);
+    // false (out unspecified) if some result is not a decimal
+    bool evalNumeric(const double* xs, size_t n, double* out);
+    bool evalNumeric(const std::vector<const double*> &cols, size_t n, double* out);
+};
+
+} // namespace ti
+
+#endif // BATCH_H
@@ -8,6 +8,7 @@
 #include <stdexcept>
 #include <cmath>
 #include <climits>
+#include <cstdint>
 
 class BigInt {
 private:
@@ -21,6 +22,12 @@ private:
     void remove_leading_zeros();
     void normalize();
     int compare_magnitude(const BigInt& other) const;
+    static void divide(const BigInt& a, const BigInt& b, BigInt& quotient, BigInt& remainder);
+    // |a| * |b| on raw limbs: schoolbook below a threshold, Karatsuba above
+    static std::vector<int> multiply_magnitudes(const int* a, size_t n, const int* b, size_t m);
+    // about BASE^(2k) / (the top k limbs of b) for b > 0, by Newton's
+    // iteration at doubling precision
+    static BigInt newton_reciprocal(const BigInt& b, size_t k);
     
 public:
     // Constructors
@@ -67,7 +74,31 @@ public:
     std::string to_string() const;
     long long to_long_long() const;
     bool is_zero() const;
+    int sign() const;
+    double to_double() const;
     BigInt abs() const;
+    size_t hash() const;
+    size_t limb_count() const { return digits.size(); } // base 10^9 limbs
+    // times 10^(9k), or for negative k divided by 10^(-9k) toward zero
+    BigInt shift_limbs(long long k) const;
+
+    // Kronecker substitution: packs the sum of coeffs[i] * 10^(9*slot*i)
+    // into one number, so a product of packed numbers holds the product
+    // polynomial's coefficients. Coefficients may be negative but must be
+    // below 10^(9*slot) / 2 in magnitude, which unpack relies on to split
+    // the packed value back into balanced digits.
+    static BigInt kronecker_pack(const std::vector<BigInt>& coeffs, size_t slot);
+    static std::vector<BigInt> kronecker_unpack(const BigInt& packed, size_t slot, size_t count);
+
+    // |*this| in base 2^64, least significant word first, for word-level
+    // modular arithmetic; from_words is the inverse and is never negative
+    std::vector<uint64_t> to_words() const;
+    static BigInt from_words(const std::vector<uint64_t>& words);
+
+    // the raw base 10^9 limbs, least significant first, for serialization;
+    // from_limbs is the inverse and throws on a limb outside [0, 10^9)
+    const std::vector<int>& limbs() const { return digits; }
+    static BigInt from_limbs(std::vector<int> limbs, bool negative);
     
     // Memory efficient functions
     void shrink_to_fit();
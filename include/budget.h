@@ -0,0 +1,99 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace ti {
+
+// What an evaluation ran out of
+enum class budget_kind {
+    Time,
+    Memory,
+    Steps,
+    Cancelled, // interrupted from outside (eval_control::cancel)
+};
+
+class limit_exceeded : public std::runtime_error {
+private:
+    budget_kind which;
+
+public:
+    limit_exceeded(budget_kind which, const std::string &what) : std::runtime_error(what), which(which) {}
+    budget_kind kind() const { return which; }
+};
+
+// Shared between an evaluation and whoever started it: another thread
+// may cancel it and read how far it has got.
+struct eval_control {
+    std::atomic<bool> cancelled{false};
+    std::atomic<unsigned long long> steps{0}; // calls and loop iterations so far
+
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+};
+
+// Limits on one evaluation, checked by the evaluator at every call and
+// loop iteration (see runtime_env::checkBudget) and by long kernels
+// through checkpoint(). Memory is what the evaluating thread allocates
+// beyond what it held when the budget was set.
+struct eval_budget {
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point deadline = clock::time_point::max();
+    long long memoryLimit = 0;        // bytes; 0: unlimited
+    long long memoryBase = 0;         // threadAllocatedBytes() at the start
+    unsigned long long stepLimit = 0; // calls and loop iterations; 0: unlimited
+    std::shared_ptr<eval_control> control;
+
+    bool limited() const {
+        return deadline != clock::time_point::max() || memoryLimit > 0 || stepLimit > 0 || control;
+    }
+
+    // a budget of `seconds` from now (0: no deadline), `bytes` (0: no cap)
+    // and `steps` (0: no cap)
+    static eval_budget starting(double seconds, size_t bytes, unsigned long long steps = 0);
+    // throws limit_exceeded if cancelled or the time or memory limit is passed
+    void check() const;
+};
+
+// The budget kernels outside the evaluator check against: the one
+// installed on this thread by the innermost budget_scope, or null.
+const eval_budget* currentBudget();
+
+// Installs a budget for the calling thread for the scope's lifetime
+// (null: none); parallelFor carries it over to its worker threads. Only
+// while a budget with a memory limit is installed are the thread's
+// allocations counted (see threadAllocatedBytes).
+class budget_scope {
+private:
+    const eval_budget* saved;
+    bool savedCounting;
+
+public:
+    explicit budget_scope(const eval_budget* b);
+    ~budget_scope();
+    budget_scope(const budget_scope&) = delete;
+    budget_scope& operator=(const budget_scope&) = delete;
+};
+
+// Cancellation point for long-running kernels: throws limit_exceeded if
+// the current budget is spent or cancelled. Cheap with no budget.
+inline void checkpoint() {
+    if (const eval_budget* b = currentBudget()) b->check();
+}
+
+// Bytes allocated through operator new on the calling thread, while a
+// memory-limited budget_scope was active, minus bytes freed the same way.
+// Only differences within one scope mean anything: a block freed outside
+// the scope that allocated it, or on another thread, is credited to
+// whichever counting thread frees it (or to none), so the total drifts.
+// Always 0 where the C library cannot report allocation sizes.
+long long threadAllocatedBytes();
+
+} // namespace ti
+
+#endif // BUDGET_H
@@ -0,0 +1,107 @@
+#ifndef COMPLEXNUM_H
+#define COMPLEXNUM_H
+
+#include <complex>
+#include <string>
+#include <vector>
+
+#include "value.h"
+#include "arith.h"
+
+namespace ti {
+
+class runtime_env;
+
+// a + b i. Exact when both parts are integers or fractions (a Gaussian
+// rational), else both parts are doubles. A result whose imaginary part
+// is zero is returned as a real number instead (see makeComplex).
+class complex_number : public value {
+private:
+    valptr_t re, im;       // exact parts
+    std::complex<double> z; // approximate value
+    bool exact;
+
+public:
+    complex_number(valptr_t re, valptr_t im);
+    explicit complex_number(std::complex<double> z);
+
+    bool isExact() const { return exact; }
+    // the parts as values: exact, or decimals
+    valptr_t real() const;
+    valptr_t imag() const;
+    std::complex<double> toComplex() const;
+
+    std::string toString() const override;
+    value_kind kind() const override { return value_kind::Complex; }
+    size_t hash() const override;
+    bool equals(const value &other) const override;
+};
+
+// A list (cols == 0) or rows x cols matrix of approximate complex numbers
+// stored as two columns of doubles, real parts and imaginary parts
+// (structure of arrays), so elementwise arithmetic maps straight onto SIMD
+// lanes without shuffling interleaved pairs.
+class complex_array : public value {
+private:
+    double_buffer re, im;
+    size_t rows, cols;
+
+public:
+    complex_array(double_buffer re, double_buffer im, size_t cols = 0);
+
+    size_t size() const { return re.size(); }
+    size_t rowCount() const { return rows; }
+    size_t colCount() const { return cols; }
+    const double_buffer &reals() const { return re; }
+    const double_buffer &imags() const { return im; }
+    // element i (row-major), boxed
+    valptr_t at(size_t i) const;
+
+    std::string toString() const override;
+    value_kind kind() const override { return value_kind::ComplexArray; }
+    size_t hash() const override;
+    bool equals(const value &other) const override;
+};
+
+// re + im i for exact parts; re itself when im is zero
+valptr_t makeComplex(const valptr_t &re, const valptr_t &im);
+// z, or a decimal when its imaginary part is zero
+valptr_t makeComplex(std::complex<double> z);
+
+// i
+valptr_t imaginaryUnit();
+
+// integer, fraction, decimal or complex number
+bool isComplexScalar(value_kind k);
+std::complex<double> toComplex(const value &v);
+
+// l op r when either is a complex number and the other a number; exact
+// operands give exact results (powers only for integer exponents)
+valptr_t complexArith(ast::binary_op op, const value &l, const value &r);
+
+// l op r elementwise when either is a complex array; the other may be an
+// array of the same shape, a list of numbers of the same length, or a
+// number, which pairs with every element
+valptr_t complexArrayArith(ast::binary_op op, const value &l, const value &r);
+
+// a complex number v in approximate form (for calc_mode::Approximate)
+valptr_t approximateComplex(const valptr_t &v);
+
+// sqrt, exp, ln, sin, ... of a complex number or array, or nullptr if
+// there is no complex version of fn
+valptr_t complexCall(const std::string &fn, const value &arg);
+
+// |z| (exact when the mode allows, like sqrt) and arg(z) of a complex
+// number or array; for arrays, lists of decimals
+valptr_t complexAbs(const value &v, calc_mode mode = calc_mode::Auto);
+valptr_t complexAngle(const value &v);
+
+// (r∠θ), as TI displays complex results in Polar format
+std::string polarString(const value &v);
+
+// complex, polar, real, imag, conj, angle, toPolar
+void register_complex_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // COMPLEXNUM_H
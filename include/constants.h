@@ -0,0 +1,36 @@
+#ifndef CONSTANTS_H
+#define CONSTANTS_H
+
+#include <cstddef>
+#include <string>
+
+#include "bigint.h"
+
+namespace ti {
+
+class runtime_env;
+
+enum class math_constant {
+    Pi,    // Chudnovsky series
+    E,     // sum of 1/k!
+    Ln2,   // 18 atanh(1/26) - 2 atanh(1/4801) + 8 atanh(1/8749)
+    Sqrt2, // Newton's method
+};
+
+// Series are summed by binary splitting, so the work is a tree of BigInt
+// products whose independent halves run on the shared thread pool. Each
+// constant is cached at the highest precision computed so far; asking for
+// fewer digits truncates the cached value.
+
+// floor(c * 10^digits)
+BigInt constantDigits(math_constant c, size_t digits);
+
+// c with `digits` digits after the point (truncated)
+std::string constantString(math_constant c, size_t digits);
+
+// constDigits
+void register_constant_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // CONSTANTS_H
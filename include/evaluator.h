@@ -0,0 +1,53 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <vector>
+
+#include "value.h"
+#include "ast.h"
+
+namespace ti {
+
+class runtime_env;
+struct function;
+
+// Evaluates expression trees with an explicit, heap-allocated continuation
+// stack instead of recursing through exprnode::eval, so user-function
+// recursion depth is limited only by runtime_env::getMaxCallDepth.
+// Calls in tail position (the result of a function body, through blocks and
+// If branches) reuse the caller's frame instead of pushing a new one.
+class evaluator {
+private:
+    // a pending piece of work: evaluate `node` (stage 0) or resume it
+    // after its children have pushed their values (stage > 0)
+    struct task {
+        const ast::exprnode* node; // null for a marker: stage 0 returns from
+                                   // a frame, stage 1 stores a memo result
+        size_t stage;
+        size_t mark;   // value stack height when the node started
+        bool tail;     // node's value is the enclosing function's result
+    };
+
+    runtime_env &env;
+    std::vector<task> tasks;
+    std::vector<valptr_t> vals;
+    // calls whose results are stored in the memo cache when they return
+    std::vector<std::pair<const function*, std::vector<valptr_t>>> memoPending;
+
+    void step(task t);
+    void enterCall(const ast::call_node &call, bool tail, std::vector<valptr_t> args);
+    void enterBody(const function &fn, const ast::exprnode &body, bool tail, std::vector<valptr_t> args);
+    valptr_t drain(size_t baseDepth);
+
+public:
+    explicit evaluator(runtime_env &env) : env(env) {}
+
+    // evaluate an expression from scratch
+    valptr_t run(const ast::exprnode &root);
+    // invoke a user function with already-evaluated arguments
+    valptr_t call(const function &fn, const std::vector<valptr_t> &args);
+};
+
+} // namespace ti
+
+#endif // EVALUATOR_H
@@ -0,0 +1,71 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "arith.h"
+#include "value.h"
+
+namespace ti {
+
+struct function;
+class runtime_env;
+
+// Native x86-64 code for one user function whose body is straight-line
+// double arithmetic: parameters, Locals, literals, + - * / ^, If on
+// comparisons, optimizer temps and builtins with a numericImpl. Constant
+// subexpressions are folded exactly at compile time, so a compiled call
+// returns the same value the interpreter would. Owns its executable pages.
+class jit_code {
+private:
+    // 0: result written to *out, 1: bail out to the interpreter,
+    // 2 + k: the result is consts[k]
+    using entry_fn = int (*)(const double* args, double* out);
+
+    void* mem = nullptr;
+    size_t size = 0;
+    entry_fn entry = nullptr;
+    size_t arity = 0;
+    std::vector<valptr_t> consts;
+
+public:
+    jit_code(const std::vector<unsigned char> &code, size_t arity, std::vector<valptr_t> consts);
+    ~jit_code();
+    jit_code(const jit_code&) = delete;
+    jit_code& operator=(const jit_code&) = delete;
+
+    // run on raw doubles; false if the interpreter must handle this call
+    bool invoke(const double* args, valptr_t &result) const;
+    // run on decimal arguments; false for any other argument kind, or when
+    // the code bails out (division by zero, or a NaN that is a complex
+    // result outside Real format) so the interpreter can handle it
+    bool invoke(const std::vector<valptr_t> &args, valptr_t &result) const;
+    size_t getArity() const { return arity; }
+};
+
+// a function's compilation and what it is valid for; replaced whole, so a
+// thread calling the function sees either the old entry or the new one
+struct jit_entry {
+    std::shared_ptr<jit_code> code; // null if not compilable
+    size_t version = 0;
+    calc_mode mode = calc_mode::Auto;
+    complex_format format = complex_format::Real;
+};
+
+// true when this build can emit native code
+bool jitSupported();
+
+// null if fn's body is outside the compilable subset
+std::shared_ptr<jit_code> jitCompile(const function &fn, runtime_env &env);
+
+// fn's compiled code, compiled on first use and cached on the function until
+// any function is redefined or the calc mode or complex format changes;
+// null if not compilable. The caller's reference keeps the code alive while
+// it runs, whatever another thread caches meanwhile.
+std::shared_ptr<jit_code> jitCodeFor(const function &fn, runtime_env &env);
+
+} // namespace ti
+
+#endif // JIT_H
@@ -0,0 +1,180 @@
+#ifndef LISTS_H
+#define LISTS_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "value.h"
+#include "arith.h"
+#include "ast.h"
+
+namespace ti {
+
+class runtime_env;
+
+using valuelist = list<valptr_t>;
+
+// A list of numbers kept as plain doubles, as bulk generators such as
+// rand(n) produce them: nothing is boxed until an element is read. When
+// integral, every element is an integer of magnitude below 2^53 and reads
+// back as an exact integer, so the array means the same as the list of
+// its boxed elements in every operation.
+class decimal_array : public value {
+private:
+    double_buffer xs;
+    bool integral;
+
+public:
+    explicit decimal_array(double_buffer xs, bool integral = false);
+
+    size_t size() const { return xs.size(); }
+    bool isIntegral() const { return integral; }
+    const double_buffer &values() const { return xs; }
+    // element i, boxed
+    valptr_t at(size_t i) const;
+    // every element boxed, as a valuelist
+    valptr_t boxed() const;
+
+    std::string toString() const override;
+    value_kind kind() const override { return value_kind::DecimalArray; }
+    size_t hash() const override;
+    bool equals(const value &other) const override;
+};
+
+// v, or v as a valuelist when it is a decimal_array or a lazy_seq
+valptr_t asList(const valptr_t &v);
+
+// l op r elementwise when either is a decimal_array, the other is one of
+// the same length or a number, and the results are decimals; nullptr when
+// the operation needs the boxed elements instead
+valptr_t decimalArrayArith(ast::binary_op op, const value &l, const value &r);
+
+// The values low, low+step, ... up to high that seq and its relatives bind
+// their index variable to: element i is low + i*step, computed exactly as
+// the interpreter would, then converted for the calc mode.
+struct index_range {
+    valptr_t low;
+    valptr_t step;
+    size_t count = 0;
+
+    valptr_t at(size_t i, calc_mode mode) const;
+    // true if every element is a decimal equal to low + i*step in double
+    // arithmetic, so the range can be fed to batch evaluation
+    bool decimal() const;
+    // true if low and step are integers and every element fits in a long
+    // long; element i is then lo + i*st
+    bool integral(long long &lo, long long &st) const;
+    double lowValue() const { return toDouble(*low); }
+    double stepValue() const { return toDouble(*step); }
+};
+
+// An expression in one variable compiled for evaluation away from the
+// interpreter: real numbers, the variable, other variables (read once, when
+// compiled), let temps and operators, with operators on two constants
+// folded. Only expressions that cannot fail on a real number are accepted:
+// division only by a nonzero constant, powers only to a natural constant,
+// a comparison only at the top. Evaluation reads nothing from the env, so
+// it is thread-safe and can be put off.
+class index_expr {
+public:
+    static constexpr size_t MAX_DEPTH = 32;
+
+private:
+    enum class step_kind { Const, Var, Op };
+    struct step {
+        step_kind kind;
+        ast::binary_op op = ast::binary_op::Add;
+        valptr_t constant;
+        long long intConstant = 0;
+        double realConstant = 0;
+        explicit step(step_kind k) : kind(k) {}
+    };
+    // postfix order: an Op applies to the two results before it
+    std::vector<step> steps;
+    calc_mode mode;
+    bool ok = false;
+    bool exactInts = true; // integers in, integers (or a comparison) out
+
+    bool compile(const ast::exprnode &n, const std::string &var, runtime_env &env, bool top);
+    bool pushConstant(const valptr_t &v);
+    // op on the operands at steps [leftStart, rightStart) and [rightStart, end)
+    bool pushOp(ast::binary_op op, size_t leftStart, size_t rightStart, bool top);
+    void finish();
+    bool evalInt(long long x, long long &out) const;
+    bool evalDecimal(double x, double &out) const;
+
+public:
+    // compiled under env's calc mode, which every element is computed in
+    index_expr(const ast::exprnode &expr, const std::string &var, runtime_env &env);
+
+    bool supported() const { return ok; }
+    calc_mode getMode() const { return mode; }
+    // true if the result is a comparison, true or false
+    bool condition() const;
+    // this expression with `op c` applied to its result (`c op` if cLeft);
+    // null if that would leave the supported subset
+    std::shared_ptr<const index_expr> combined(ast::binary_op op, const valptr_t &c, bool cLeft) const;
+
+    // expr with the variable set to x, as the interpreter computes it
+    valptr_t at(const valptr_t &x) const;
+    // the same at integer x in long long arithmetic; false for a condition
+    // or if a step leaves the integers or overflows
+    bool atInt(long long x, long long &out) const;
+    // the same at decimal(x) in double arithmetic; false unless the result
+    // is a decimal that depends on x
+    bool atDecimal(double x, double &out) const;
+    // a condition at integer x or decimal(x), false where at() is needed
+    bool testInt(long long x, bool &out) const;
+    bool testDecimal(double x, bool &out) const;
+};
+
+// throws unless all three are numbers and step is nonzero
+index_range makeRange(const valptr_t &low, const valptr_t &high, const valptr_t &step, calc_mode mode);
+
+// expr at every element of r with var bound to it (batched when possible)
+std::vector<valptr_t> evalOverRange(const ast::exprnode &expr, const std::string &var, const index_range &r,
+                                    runtime_env &env);
+
+// seq(expr, var, low, high[, step]) not computed yet: the reducers stream
+// it straight from its range, and anything else gets the elements from
+// materialized(), which builds the list once. Only an index_expr, which
+// cannot fail, is put off, so the result is the same as building it when
+// seq ran.
+class lazy_seq : public value {
+private:
+    std::shared_ptr<const index_expr> expr;
+    index_range range;
+    mutable std::once_flag built;
+    mutable valptr_t cached;
+
+public:
+    lazy_seq(std::shared_ptr<const index_expr> expr, index_range range);
+
+    const std::shared_ptr<const index_expr> &expression() const { return expr; }
+    const index_range &indices() const { return range; }
+    size_t size() const { return range.count; }
+    // the elements as a valuelist, built in parallel on first use
+    const valptr_t &materialized() const;
+
+    std::string toString() const override { return materialized()->toString(); }
+    value_kind kind() const override { return value_kind::LazySeq; }
+    size_t hash() const override { return materialized()->hash(); }
+    bool equals(const value &other) const override { return materialized()->equals(other); }
+};
+
+// every lazy_seq in args replaced by its list: builtins only ever see
+// materialized lists
+void materializeArgs(std::vector<valptr_t> &args);
+
+// f applied to every element, in parallel chunks; f must be thread-safe
+valptr_t mapList(const valuelist &l, const std::function<valptr_t(const valptr_t &)> &f);
+
+// seq, filter, sum, prod, max, min, cumSum, when
+void register_list_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // LISTS_H
@@ -0,0 +1,79 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "value.h"
+
+namespace ti {
+
+struct function;
+class runtime_env;
+
+// which user functions have their results cached
+enum class memo_policy {
+    Off,
+    OptIn, // only functions with function::memoize set
+    Auto,  // opt-in functions plus every function proven pure
+};
+
+struct memo_stats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+};
+
+// Bounded LRU cache of user-function results keyed by the function and the
+// structural hash/equality of its argument values.
+class memo_cache {
+private:
+    struct key {
+        const function* fn;
+        std::vector<valptr_t> args;
+        size_t hash;
+    };
+    struct key_hash {
+        size_t operator()(const key* k) const { return k->hash; }
+    };
+    struct key_equal {
+        bool operator()(const key* a, const key* b) const;
+    };
+    struct entry {
+        key k;
+        valptr_t result;
+    };
+
+    std::list<entry> lru; // most recently used first
+    std::unordered_map<const key*, std::list<entry>::iterator, key_hash, key_equal> index;
+    size_t capacity = 100000;
+    memo_stats stats;
+
+    static size_t hashArgs(const function* fn, const std::vector<valptr_t> &args);
+
+public:
+    // null on a miss
+    valptr_t lookup(const function* fn, const std::vector<valptr_t> &args);
+    void store(const function* fn, const std::vector<valptr_t> &args, const valptr_t &result);
+    void clear();
+
+    void setCapacity(size_t entries);
+    size_t getCapacity() const { return capacity; }
+    memo_stats getStats() const;
+    void resetStats();
+};
+
+// True if calling fn can neither observe nor change anything but its
+// arguments: it reads and writes only parameters and Locals, and calls only
+// pure builtins and (transitively) pure user functions. Cached on the
+// function until any function is redefined.
+bool isPureFunction(const function &fn, runtime_env &env);
+
+// memoize and memoStats
+void register_memo_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // MEMO_H
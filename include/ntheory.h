@@ -0,0 +1,84 @@
+#ifndef NTHEORY_H
+#define NTHEORY_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "bigint.h"
+#include "value.h"
+#include "arith.h"
+
+namespace ti {
+
+class runtime_env;
+
+// primes <= n, by a sieve over the odd numbers
+std::vector<uint32_t> primesUpTo(uint32_t n);
+
+// The product of the factors, multiplied pairwise up a balanced tree so
+// the operands of every product have about the same size, which is where
+// Karatsuba pays off. Factors (each below 2^63) are first packed into
+// word-sized partial products; large trees split across the thread pool.
+BigInt productTree(const std::vector<uint64_t> &factors);
+
+// n!, by Luschny's prime swing: n! = ((n/2)!)^2 * swing(n), where swing(n)
+// is a product of prime powers read off n's digits in each prime's base
+BigInt factorial(uint64_t n);
+
+// n choose k (n >= 0, 0 <= k <= n), from its prime factorization: by
+// Kummer's theorem p's exponent is the number of borrows in n - k in base p
+BigInt binomial(uint64_t n, uint64_t k);
+
+// n (n-1) ... (n-k+1) for n >= k >= 0
+BigInt fallingFactorial(uint64_t n, uint64_t k);
+
+// floor(sqrt(n)) for n >= 0: the root of n's top limbs, refined by one
+// Newton step and corrected with the remainder
+BigInt isqrt(const BigInt &n);
+
+// floor(n^(1/k)) for n >= 0 and k >= 1, by Newton's iteration from a
+// floating-point estimate; each step is one power and one division
+BigInt iroot(const BigInt &n, unsigned k);
+
+// whether n is a perfect k-th power (negative n only for odd k), storing
+// the root when asked. Most n that are not are turned away by their
+// residues modulo a few primes p = 1 (mod k), before any root is taken.
+bool isPower(const BigInt &n, unsigned k, BigInt *root = nullptr);
+
+// n = base^exp with exp as large as possible, for |n| >= 2; exp is 1 when
+// n is no perfect power
+std::pair<BigInt, unsigned> perfectPower(const BigInt &n);
+
+// (c, m) with c^k m = n for n > 0, moving every k-th power out of m that
+// n's small prime factors and a perfect power test find; below 2^64 n is
+// factored completely
+std::pair<BigInt, BigInt> extractRoot(const BigInt &n, unsigned k);
+
+// x^(1/k) for an integer or fraction x: exact when x is a perfect k-th
+// power, a radical with k-th powers taken out in Exact mode, and nullptr
+// otherwise (and for even roots of negative numbers), leaving the caller
+// to approximate
+valptr_t rootValue(const valptr_t &x, unsigned k, calc_mode mode);
+
+// b^e mod m for e >= 0 and m > 0, in [0, m). Odd moduli use Montgomery
+// multiplication on 64-bit words, so no step divides.
+BigInt powMod(const BigInt &b, const BigInt &e, const BigInt &m);
+
+// Miller-Rabin with a base set that is exact below 2^64; above that the
+// Baillie-PSW test (a strong probable prime to base 2 that is also a
+// strong Lucas probable prime), which has no known counterexample
+bool isPrime(const BigInt &n);
+
+// The prime factorization of |n| for n != 0 as (prime, exponent) pairs in
+// ascending order: trial division by a wheel, Pollard's rho with Brent's
+// cycle detection, then Lenstra's elliptic curve method, whose curves run
+// in parallel. Throws if ECM finds no factor within its largest bounds.
+std::vector<std::pair<BigInt, unsigned>> factor(const BigInt &n);
+
+// factorial, nCr, nPr, isPrime, factor, powMod, root
+void register_ntheory_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // NTHEORY_H
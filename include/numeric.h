@@ -0,0 +1,81 @@
+#ifndef NUMERIC_H
+#define NUMERIC_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+
+namespace ti {
+
+class runtime_env;
+class batch_evaluator;
+
+// what the last numeric calculus call (nInt, nDeriv, nSolve, fMin, fMax) did
+struct numeric_report {
+    std::string method;       // e.g. "gauss-kronrod", "tanh-sinh", "brent"
+    size_t evaluations = 0;   // points the expression was evaluated at
+    double errorEstimate = 0; // absolute, in the units of the result
+    bool converged = true;    // false if the tolerance was not reached
+};
+
+// An expression as a real function of one variable. Points are evaluated
+// a batch at a time through the batch evaluator when the expression allows
+// it, else one by one with the variable bound; either way every value
+// equals what the interpreter gives for decimal(x). With `minus`, the
+// function is expr - minus (nSolve on an equation).
+class sampled_function {
+private:
+    const ast::exprnode &expr;
+    const ast::exprnode* minus;
+    std::string var;
+    runtime_env &env;
+    const char* caller;
+    std::unique_ptr<batch_evaluator> batch, minusBatch;
+    size_t count = 0;
+
+    void evalTerm(const ast::exprnode &e, batch_evaluator* b, const std::vector<double> &xs, std::vector<double> &ys);
+
+public:
+    sampled_function(const ast::exprnode &expr, std::string var, runtime_env &env, const char* caller,
+                     const ast::exprnode* minus = nullptr);
+    ~sampled_function();
+
+    // ys[i] = f(xs[i]); throws if a value is not a real number
+    void eval(const std::vector<double> &xs, std::vector<double> &ys);
+    size_t evaluations() const { return count; }
+};
+
+// f at a batch of points: ys[i] = f(xs[i])
+using sampler = std::function<void(const std::vector<double> &xs, std::vector<double> &ys)>;
+
+// The solvers below fill report.method, errorEstimate and converged; the
+// caller knows the evaluation count. Tolerances are relative to the result
+// with a small absolute floor.
+
+// adaptive 15-point Gauss-Kronrod on [a, b] (either bound may be
+// infinite): every interval that misses its share of the tolerance is
+// split, and all new intervals are evaluated as one batch. Falls back to
+// tanh-sinh, which tolerates endpoint singularities, when that does better.
+double integrate(const sampler &f, double a, double b, numeric_report &report);
+
+// central differences at steps h, h/2, ... extrapolated with Richardson's
+// tableau; all points are evaluated as one batch
+double derivative(const sampler &f, double x, double h, numeric_report &report);
+
+// a root in [a, b], where fa = f(a) and fb = f(b) differ in sign, by
+// Brent's method (one point per step)
+double findRoot(const sampler &f, double a, double b, double fa, double fb, numeric_report &report);
+
+// a local minimum in [a, b] and its value fx, by Brent's method (golden
+// section with parabolic steps, one point per step)
+double minimize(const sampler &f, double a, double b, double &fx, numeric_report &report);
+
+// nInt, nDeriv, nSolve, fMin, fMax and numericReport
+void register_numeric_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // NUMERIC_H
@@ -0,0 +1,76 @@
+#ifndef ODE_H
+#define ODE_H
+
+#include <cstddef>
+#include <vector>
+
+namespace ti {
+
+class runtime_env;
+
+// right-hand side of y' = f(t, y) for an n-dimensional state, evaluated at
+// many (t, y) points per call so a batch-capable f pays its dispatch once
+class ode_rhs {
+public:
+    virtual ~ode_rhs() = default;
+    virtual size_t dim() const = 0;
+    // dy[i*dim ..] = f(t[i], y[i*dim ..]) for every i < count
+    virtual void eval(size_t count, const double* t, const double* y, double* dy) = 0;
+};
+
+enum class ode_method {
+    DormandPrince, // explicit RK5(4), for non-stiff problems
+    Rosenbrock,    // linearly implicit, order 2(3) (as in ode23s), for stiff ones
+};
+
+struct ode_options {
+    ode_method method = ode_method::DormandPrince;
+    double rtol = 1e-6;
+    double atol = 1e-9;
+    size_t maxSteps = 100000; // per trajectory
+};
+
+// The accepted steps of one trajectory with what the method's continuous
+// extension needs, so y can be sampled anywhere in [t0, t1] without
+// restricting the step sizes.
+class ode_solution {
+private:
+    friend class ode_integrator;
+
+    size_t n = 0;
+    ode_method method = ode_method::DormandPrince;
+    std::vector<double> starts; // t at the start of each step, then the final t
+    std::vector<double> steps;  // signed step sizes
+    std::vector<double> states; // n values per entry of starts
+    std::vector<double> slopes; // per step: 7n (Dormand-Prince) or 2n (Rosenbrock)
+
+public:
+    size_t dim() const { return n; }
+    size_t stepCount() const { return steps.size(); }
+    double t0() const { return starts.front(); }
+    double t1() const { return starts.back(); }
+    const double* finalState() const { return states.data() + n * steps.size(); }
+
+    // y(t) into out[0..n); t must lie between t0 and t1
+    void at(double t, double* out) const;
+};
+
+struct ode_stats {
+    size_t evaluations = 0; // (t, y) points f was evaluated at
+    size_t accepted = 0;
+    size_t rejected = 0;
+};
+
+// Integrates every initial state (y0s holds dim() values per trajectory)
+// from t0 to t1, which may be below t0. Trajectories advance in lockstep,
+// one step each per round with their own step sizes, so every stage of a
+// round is a single f.eval over all unfinished trajectories.
+std::vector<ode_solution> solveOde(ode_rhs &f, double t0, double t1, const std::vector<double> &y0s,
+                                   const ode_options &opts, ode_stats &stats);
+
+// odeSolve, odeField
+void register_ode_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // ODE_H
@@ -0,0 +1,33 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <memory>
+
+#include "ast.h"
+
+namespace ti {
+
+class runtime_env;
+
+struct opt_options {
+    bool foldConstants = true;   // evaluate operators on literal operands
+    bool simplify = true;        // x+0, x*1, x/1, x^1, constant reassociation, for exact x
+    bool eliminateCommon = true; // share repeated subexpressions within a statement
+    bool hoistInvariants = true; // compute loop-invariant expressions once per loop
+};
+
+// Rewrite a freshly parsed tree before it is executed. Folding follows the
+// env's calc mode, so a tree optimized in one mode should not be run in
+// another (the REPL optimizes function bodies again from their source when
+// the mode changes). When env.getDumpOptimized() is set the result is
+// printed to std::cerr.
+std::unique_ptr<ast::exprnode> optimize(std::unique_ptr<ast::exprnode> root, runtime_env &env,
+                                        const opt_options &opts = opt_options());
+
+// structural hash/equality over expression trees (literals compare by value)
+size_t structuralHash(const ast::exprnode &n);
+bool structurallyEqual(const ast::exprnode &a, const ast::exprnode &b);
+
+} // namespace ti
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,36 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+
+namespace ti {
+
+class runtime_env;
+
+// One top-level statement of a REPL entry or script: an expression (which
+// may assign) or a function definition.
+struct statement {
+    bool definition = false;
+    // definitions only: Define name(params)=body, or name(params):=body
+    std::string name;
+    std::vector<std::string> params;
+    // the expression, or the definition's body
+    std::unique_ptr<ast::exprnode> body;
+};
+
+// Parses TI-Basic source: statements separated by newlines or ':', with
+// Define, Func/EndFunc, Prgm/EndPrgm, If/Then/ElseIf/Else/EndIf,
+// For/EndFor, While/EndWhile, Local, Return (as the last statement of a
+// function or of an If branch there), := and -> assignment, lists in
+// braces, strings, comparisons, and/or/xor/not, n! and implicit products
+// such as 2x. Names are case-insensitive. Throws std::runtime_error
+// naming the line of a syntax error.
+std::vector<statement> parse(const std::string &code, const runtime_env &env);
+
+} // namespace ti
+
+#endif // PARSER_H
@@ -0,0 +1,116 @@
+#ifndef POLY_H
+#define POLY_H
+
+#include <complex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "value.h"
+#include "ast.h"
+
+namespace ti {
+
+class runtime_env;
+
+// coefficient domain of a polynomial
+enum class poly_ring {
+    Integer,
+    Rational, // integers over a common denominator
+    Decimal,
+};
+
+// A polynomial in one named variable. Exact coefficients are integer
+// numerators over one positive common denominator in lowest terms, so
+// rational arithmetic is integer arithmetic plus a final gcd; approximate
+// ones are doubles. Coefficients are stored dense (index = exponent) or,
+// when most of them are zero, sparse with a parallel exponent vector. The
+// layout is picked from the coefficients after every operation, so equal
+// polynomials always have the same one.
+class polynomial : public value {
+private:
+    std::string var;
+    bool approx = false;
+    std::vector<size_t> exps; // sparse only: exponents, ascending
+    std::vector<BigInt> nums; // exact coefficients (numerators)
+    BigInt den = BigInt(1);
+    std::vector<double> dcoeffs; // approximate coefficients
+
+    void normalize();
+    template<typename C> std::vector<C> &coeffs();
+    template<typename C> const std::vector<C> &coeffs() const;
+    template<typename C> std::vector<C> dense() const;
+    // a + sign*b and a*b with both in the same domain
+    template<typename C> static polynomial combine(const polynomial &a, const polynomial &b, int sign);
+    template<typename C> static polynomial multiply(const polynomial &a, const polynomial &b);
+
+    // reads and rebuilds the raw parts when saving and loading (snapshot.cpp)
+    friend struct snapshot_codec;
+
+public:
+    // the zero polynomial
+    explicit polynomial(std::string var);
+    // dense coefficients, lowest degree first
+    polynomial(std::string var, std::vector<BigInt> nums, BigInt den = BigInt(1));
+    polynomial(std::string var, std::vector<double> coeffs);
+    // c * var^exp for an integer, fraction or decimal c
+    static polynomial monomial(std::string var, const value &c, size_t exp);
+
+    const std::string &getVar() const { return var; }
+    poly_ring ring() const;
+    bool isSparse() const { return !exps.empty(); }
+    bool isZero() const { return approx ? dcoeffs.empty() : nums.empty(); }
+    size_t degree() const; // 0 for the zero polynomial
+    size_t termCount() const; // nonzero coefficients
+    valptr_t coefficient(size_t exp) const;
+    polynomial toDecimal() const;
+
+    polynomial operator+(const polynomial &other) const;
+    polynomial operator-(const polynomial &other) const;
+    polynomial operator*(const polynomial &other) const;
+    polynomial operator-() const;
+    polynomial pow(size_t exp) const;
+    // times or divided by an integer, fraction or decimal
+    polynomial scaled(const value &c, bool divide = false) const;
+    polynomial derivative() const;
+    // c(x) at a value, by Horner's rule with the interpreter's arithmetic
+    valptr_t evaluate(const valptr_t &x) const;
+
+    // a = q*b + r with deg r < deg b, over the rationals or the reals
+    static void divide(const polynomial &a, const polynomial &b, polynomial &q, polynomial &r);
+    // primitive integer gcd with a positive leading coefficient, by the
+    // subresultant algorithm after a modular test for coprimality;
+    // exact polynomials only
+    static polynomial gcd(const polynomial &a, const polynomial &b);
+    // primitive, pairwise coprime square-free factors with their
+    // multiplicities, such that this = unit * product of factor^mult
+    std::vector<std::pair<polynomial, size_t>> squareFree(valptr_t &unit) const;
+    // all complex roots with multiplicity, by Aberth-Ehrlich iteration
+    // (exact polynomials are split into square-free factors first)
+    std::vector<std::complex<double>> roots() const;
+    // the real roots in ascending order with multiplicity; for exact
+    // polynomials, approximations rounding left near the axis count only
+    // when an exact sign change confirms them
+    std::vector<double> realRoots() const;
+
+    std::string toString() const override;
+    value_kind kind() const override { return value_kind::Polynomial; }
+    size_t hash() const override;
+    bool equals(const value &other) const override;
+};
+
+// expr as a polynomial in var: sums, differences and products of
+// polynomial parts, quotients by and powers to subexpressions free of var
+// (which are evaluated, and may themselves be polynomial values)
+polynomial polyFromExpr(const ast::exprnode &expr, const std::string &var, runtime_env &env);
+
+// l op r when either is a polynomial and the other a polynomial or number
+valptr_t polyArith(ast::binary_op op, const value &l, const value &r);
+
+// expand, polyCoeffs, polyDegree, polyEval, polyGcd, polyQuotient,
+// polyRemainder, polyRoots, polySqrFree
+void register_poly_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // POLY_H
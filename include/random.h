@@ -0,0 +1,33 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ti {
+
+class runtime_env;
+
+// Where the random builtins are in their stream. Every variate is a pure
+// function of (seed, position): a Philox4x32-10 block keyed by the seed
+// with the position as its counter, plus an attempt number for variates
+// drawn by rejection. Values therefore do not depend on how many threads
+// generate them or whether SIMD is used, and RandSeed replays them
+// exactly. Each value a call returns takes the next position.
+struct random_state {
+    uint64_t seed = 0;
+    uint64_t position = 0;
+};
+
+// the next n variates of s: uniform in (0, 1), standard normal
+// (ziggurat), or uniform integers in [lo, hi]
+void randomUniform(random_state &s, double* out, size_t n);
+void randomNormal(random_state &s, double* out, size_t n);
+void randomIntegers(random_state &s, int64_t lo, int64_t hi, int64_t* out, size_t n);
+
+// RandSeed, rand, randInt, randNorm, randSamp
+void register_random_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // RANDOM_H
@@ -1,11 +1,14 @@
 #ifndef REPL_H
 #define REPL_H
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <set>
 #include <unordered_map>
 #include "colors.h"
+#include "parser.h"
+#include "runtimeenv.h"
 
 namespace ti {
 
@@ -19,8 +22,24 @@ struct cmdres {
 class repl {
 private:
     std::vector<std::string> history;
+    runtime_env env;
+    double timeBudget = 0;             // seconds per statement; 0: none
+    unsigned long long stepBudget = 0; // calls and loop iterations per statement; 0: none
+
+    // expr under the statement budgets, cancellable through control (may
+    // be null); a spent budget or cancellation becomes an error result
+    cmdres evaluate(const std::string& code, const std::shared_ptr<eval_control>& control);
+    // the calc mode function bodies were last optimized in
+    calc_mode functionMode = calc_mode::Auto;
+
+    // defines s's function, or optimizes and runs its expression and
+    // formats the value
+    std::string execute(statement& s);
+    // optimizes every function defined by execute again from its source if
+    // the calc mode changed since, so folding follows the current mode
+    void refreshFunctions();
 public:
-    repl() = default;
+    repl();
     repl(const repl&) = default;
     repl(repl&&) = default;
     repl& operator=(const repl&) = default;
@@ -28,11 +47,27 @@ public:
     
     ~repl() = default;
     
+    runtime_env& environment() { return env; }
+
     void clear();
     std::string input(const std::string& prompt);
+    // Parses and runs code, one statement after another. A syntax or
+    // runtime error stops it and is the result, with exit code 1; a spent
+    // budget propagates as limit_exceeded.
     cmdres expr(const std::string& code);
 
+    void setTimeBudget(double seconds) { timeBudget = seconds; }
+    void setStepBudget(unsigned long long steps) { stepBudget = steps; }
+
+    // Reads and evaluates statements until exit. Each statement runs on a
+    // worker thread: Ctrl-C interrupts it (at the next loop iteration, call
+    // or kernel checkpoint) and returns to the prompt with the session
+    // intact, and a long one shows its progress on a terminal's stderr.
     void run();
+    // Runs a script (path "-" for stdin) without prompts or colors, one
+    // result per line, buffered. Returns 0, 1 if any statement failed, or
+    // 2 if the script could not be read or the output written.
+    int runBatch(const std::string& path);
 
 };
 
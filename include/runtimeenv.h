@@ -9,9 +9,17 @@
 
 #include "value.h" // must define ti::valptr_t and value types
 #include "ast.h"   // forward-declared runtime_env in ast.h, safe to include
+#include "arith.h"
+#include "budget.h"
+#include "memo.h"
+#include "jit.h"
+#include "numeric.h"
+#include "random.h"
 
 namespace ti {
 
+class sequence;
+
 // function object stored in environment
 struct function {
     // parameter names, empty for builtins that accept variadic args
@@ -19,12 +27,39 @@ struct function {
 
     // Body: AST node to execute for user functions (may be null for builtins)
     std::shared_ptr<ast::node> body; // typically an exprnode or block node
+    // user functions defined in the REPL: the body as parsed, which the
+    // REPL optimizes again when the calc mode changes
+    std::shared_ptr<const ast::exprnode> source;
 
     // builtin flag and implementation
     bool isBuiltin = false;
     // builtin receives args vector and runtime_env reference
     std::function<valptr_t(const std::vector<valptr_t>&, runtime_env&)> builtinImpl;
 
+    // builtins: no side effects, result depends only on the arguments
+    bool pure = false;
+    // user functions: cache results even when purity can't be proven
+    bool memoize = false;
+    // builtins that take their argument trees unevaluated and evaluate them
+    // as they see fit (seq binds a variable while evaluating an expression);
+    // takes precedence over builtinImpl at call sites
+    std::function<valptr_t(const ast::call_node&, runtime_env&)> formImpl;
+    // unary builtins: the same operation on a bare double, callable from
+    // JIT-compiled code
+    double (*numericImpl)(double) = nullptr;
+    // builtins made by defineSequence: the sequence, which snapshots save
+    std::shared_ptr<sequence> sequenceDef;
+
+    // isPureFunction's cached verdict, valid while purityVersion matches
+    // runtime_env::getFunctionVersion()
+    mutable bool purityKnown = false;
+    mutable bool purityResult = false;
+    mutable size_t purityVersion = 0;
+
+    // jitCodeFor's cached compilation, null until the first; read and
+    // replaced with std::atomic_load and std::atomic_store
+    mutable std::shared_ptr<const jit_entry> jitEntry;
+
     function() = default;
 
     // user function
@@ -36,28 +71,189 @@ struct function {
         : params(), body(nullptr), isBuiltin(true), builtinImpl(std::move(impl)) {}
 };
 
+// a named variable slot owned by a call frame
+struct slot {
+    std::string name;
+    valptr_t value;
+};
+
+// one activation record on the call stack. Its parameters and locals live
+// contiguously in runtime_env::slots starting at `base`.
+struct callframe {
+    const function* fn = nullptr;
+    size_t base = 0;
+    size_t tempBase = 0; // temp groups active when the frame was entered
+};
+
 class runtime_env {
 private:
     std::unordered_map<std::string, valptr_t> variables;
     std::unordered_map<std::string, function> functions;
 
+    // call stack: frames index into one contiguous slot array, so a call
+    // costs O(params) regardless of how many globals are defined
+    std::vector<slot> slots;
+    std::vector<callframe> frames;
+    size_t maxCallDepth = 10000000;
+
+    // lazily computed optimizer temps, one group per active let_node
+    std::vector<valptr_t> temps;
+    std::vector<size_t> tempBases;
+
+    calc_mode mode = calc_mode::Auto;
+    complex_format complexFormat = complex_format::Real;
+    bool dumpOptimized = false;
+    bool jitEnabled = false;
+
+    // changes whenever a function is (re)defined; values are unique across
+    // all envs, so (env, version) inline-cache keys never collide
+    size_t functionVersion = freshVersion();
+    memo_cache memo;
+    memo_policy memoPolicy = memo_policy::OptIn;
+    numeric_report numericReport;
+    random_state rng;
+
+    // limits on the evaluation in progress; the clock is read only every
+    // BUDGET_INTERVAL steps
+    static constexpr size_t BUDGET_INTERVAL = 64;
+    eval_budget budget;
+    bool budgeted = false; // budget.limited(), cached
+    unsigned long long budgetSteps = 0;
+
+    void spendSteps(unsigned long long n);
+    slot* findLocal(const std::string &name);
+    const slot* findLocal(const std::string &name) const;
+    static size_t freshVersion();
+
 public:
     runtime_env() = default;
 
-    // variables
+    // variables (locals of the innermost frame shadow globals); an
+    // undefined name evaluates to a symbol
     valptr_t getVariable(const std::string &name) const;
     void setVariable(const std::string &name, const valptr_t &value);
+    void declareLocal(const std::string &name);
+    // null instead of throwing when name is undefined
+    valptr_t lookupVariable(const std::string &name) const;
+    // make name undefined again (a local slot is kept, emptied)
+    void unsetVariable(const std::string &name);
+
+    // call stack
+    void pushFrame(const function &fn, const std::vector<valptr_t> &args);
+    void popFrame();
+    size_t callDepth() const { return frames.size(); }
+    void setMaxCallDepth(size_t depth) { maxCallDepth = depth; }
+    size_t getMaxCallDepth() const { return maxCallDepth; }
+
+    // optimizer temps (see ast::let_node)
+    void pushTemps(size_t count);
+    void popTemps();
+    valptr_t &temp(size_t depth, size_t index);
+    size_t tempDepth() const { return tempBases.size(); }
+
+    // settings
+    calc_mode getMode() const { return mode; }
+    // cached results may depend on the mode and format, so a change drops them
+    void setMode(calc_mode m) {
+        if (m != mode) memo.clear();
+        mode = m;
+    }
+    complex_format getComplexFormat() const { return complexFormat; }
+    void setComplexFormat(complex_format f) {
+        if (f != complexFormat) memo.clear();
+        complexFormat = f;
+    }
+    bool getDumpOptimized() const { return dumpOptimized; }
+    void setDumpOptimized(bool on) { dumpOptimized = on; }
+    // compile numeric user functions to native code (see jit.h)
+    bool getJitEnabled() const { return jitEnabled; }
+    void setJitEnabled(bool on) { jitEnabled = on; }
+    // threads per parallel builtin, including the caller (0: one per
+    // hardware thread); the pool is shared, so this is process-wide
+    size_t getMaxThreads() const;
+    void setMaxThreads(size_t n);
 
     // functions
     void defineFunction(const std::string &name, const function &fn);
+    // remove name's definition, if any
+    void undefineFunction(const std::string &name);
     bool hasFunction(const std::string &name) const;
     function* getFunction(const std::string &name);
     valptr_t callFunction(const std::string &name, const std::vector<valptr_t> &args);
+    valptr_t callFunction(const function &fn, const std::vector<valptr_t> &args);
+
+    size_t getFunctionVersion() const { return functionVersion; }
+
+    // memoization of user-function results
+    memo_cache &memoCache() { return memo; }
+    memo_policy getMemoPolicy() const { return memoPolicy; }
+    void setMemoPolicy(memo_policy p) { memoPolicy = p; }
+    bool shouldMemoize(const function &fn);
+
+    // how the last nInt/nDeriv/nSolve/fMin/fMax call went
+    const numeric_report &getNumericReport() const { return numericReport; }
+    void setNumericReport(const numeric_report &r) { numericReport = r; }
 
-    // helper for registering builtin
-    void registerBuiltin(const std::string &name, std::function<valptr_t(const std::vector<valptr_t>&, runtime_env&)> impl);
+    // the stream of rand, randInt, randNorm and randSamp (see random.h)
+    random_state &randomState() { return rng; }
+    const random_state &randomState() const { return rng; }
+
+    // the global variables and every function, builtins included, for
+    // saving and restoring the workspace (see snapshot.h)
+    const std::unordered_map<std::string, valptr_t> &globals() const { return variables; }
+    void setGlobal(const std::string &name, const valptr_t &value) { variables[name] = value; }
+    const std::unordered_map<std::string, function> &functionTable() const { return functions; }
+
+    // time, memory and step limits and cancellation of evaluation (see
+    // budget.h); setting a budget restarts the step count
+    const eval_budget &getBudget() const { return budget; }
+    void setBudget(const eval_budget &b);
+    // called by the evaluator at each call and loop iteration; throws
+    // limit_exceeded once the budget is spent or the evaluation cancelled
+    void checkBudget() {
+        if (budgeted) spendSteps(1);
+    }
+    // n steps at once, for elements computed in bulk
+    void checkBudget(unsigned long long n) {
+        if (budgeted && n > 0) spendSteps(n);
+    }
+
+    // helper for registering builtin; `pure` marks it side-effect free
+    void registerBuiltin(const std::string &name, std::function<valptr_t(const std::vector<valptr_t>&, runtime_env&)> impl,
+                         bool pure = false);
+    // pure one-argument builtin on numbers, returning a decimal
+    void registerNumericBuiltin(const std::string &name, double (*impl)(double));
+    // builtin receiving its arguments unevaluated (see function::formImpl)
+    void registerForm(const std::string &name, std::function<valptr_t(const ast::call_node&, runtime_env&)> impl,
+                      bool pure = false);
 };
 
+// Gives a variable a temporary value, as seq and sum do with their index
+// variable: the previous value (or its absence) is restored on destruction.
+// The innermost frame's local is used if there is one, else the global.
+class scoped_variable {
+private:
+    runtime_env &env;
+    std::string name;
+    valptr_t saved;
+
+public:
+    scoped_variable(runtime_env &env, std::string name);
+    ~scoped_variable();
+    scoped_variable(const scoped_variable&) = delete;
+    scoped_variable& operator=(const scoped_variable&) = delete;
+
+    void set(const valptr_t &v) { env.setVariable(name, v); }
+};
+
+// the name a form binds in argument `index` (seq's index variable);
+// throws unless that argument is a plain variable
+const std::string &formVariable(const ast::call_node &c, size_t index, const char* form);
+
+// disp, setMode and getMode, the elementary math functions, the list
+// builtins and numeric calculus
+void register_default_builtins(runtime_env &env);
+
 } // namespace ti
 
 #endif // RUNTIMEENV_H
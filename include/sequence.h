@@ -0,0 +1,85 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "runtimeenv.h"
+#include "value.h"
+
+namespace ti {
+
+// A sequence given by its first terms u(n0), u(n0+1), ... and a rule for
+// u(n) in terms of n and earlier terms, which the rule reads by calling the
+// sequence's own name. Terms are kept in a dense table that grows only as
+// far as asked, so each is computed once instead of by exponential
+// recursion. The table lives as long as no function is redefined, or, when
+// the rule reads globals or impure functions, for one top-level call.
+//
+// A rule of the form c0 + c1 u(n-1) + ... + cd u(n-d) with exact constant
+// coefficients is a linear recurrence: a term far past the table is
+// sum r_i u(i) over a window of d (d+1 if c0 != 0) known terms, where
+// r(x) = x^N mod the characteristic polynomial (Fiduccia), found with
+// O(log N) polynomial products.
+class sequence {
+private:
+    std::string name;
+    std::string var;
+    std::shared_ptr<ast::exprnode> rule;
+    long long n0;
+    size_t given;                // initial terms
+    std::vector<valptr_t> table; // u(n0 + i)
+    function ruleFn;             // the rule as a function of var, for the purity check
+
+    // the function version and mode the table and analysis belong to
+    size_t version = 0;
+    calc_mode mode = calc_mode::Auto;
+    bool pure = false;
+    size_t depth = 0;     // term() calls in progress
+    bool busy = false;    // fill() is running the rule for u(filling)
+    long long filling = 0;
+
+    // what the rule is, found on first use
+    bool analyzed = false;
+    bool selfRef = false;    // the rule reads earlier terms
+    size_t order = 0;        // d: the furthest term back the rule reads
+    std::vector<valptr_t> recurrence; // homogeneous a_1..a_D if linear
+
+    // while probing the rule's coefficients, u(at - k) is probe[k - 1]
+    const std::vector<valptr_t>* probe = nullptr;
+    long long probeAt = 0;
+
+    void validate(runtime_env &env);
+    valptr_t evalRule(long long index, runtime_env &env);
+    valptr_t probeRule(const std::vector<valptr_t> &terms, runtime_env &env);
+    void fill(size_t count, runtime_env &env);
+    void analyze(runtime_env &env);
+    valptr_t jump(size_t i, runtime_env &env);
+
+public:
+    sequence(std::string name, std::string var, std::shared_ptr<ast::exprnode> rule, std::vector<valptr_t> initial,
+             long long n0 = 1);
+
+    const std::string &getName() const { return name; }
+    const std::string &getVar() const { return var; }
+    const ast::exprnode &getRule() const { return *rule; }
+    long long getFirstIndex() const { return n0; }
+    // u(n0), u(n0+1), ... as given at definition
+    std::vector<valptr_t> initialTerms() const;
+    // whether the rule reads only n and terms, and calls only pure functions
+    bool isPure(runtime_env &env) const;
+    // u(n); throws before n0 or when the rule needs a term it cannot have
+    valptr_t term(long long n, runtime_env &env);
+};
+
+// makes seq's name a function of the index (or a list of indices)
+void defineSequence(runtime_env &env, std::shared_ptr<sequence> seq);
+
+// seqDefine, seqGen
+void register_sequence_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // SEQUENCE_H
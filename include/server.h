@@ -0,0 +1,72 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ti {
+
+struct server_options {
+    std::string socketPath;
+    size_t workers = 0;      // evaluation threads (0: one per hardware thread)
+    double timeLimit = 0;    // seconds per request (0: none)
+    size_t memoryLimit = 0;  // bytes per request (0: none)
+};
+
+// Serves many sessions from one process over a Unix domain socket. Each
+// connection is a session with its own repl and runtime_env, created once
+// and kept for the life of the connection.
+//
+// Protocol: every message is a frame of a 4-byte little-endian payload
+// length, a 1-byte type and the payload. Requests: 'E' (statement text).
+// Responses, one per request and in request order: 'R' result, 'X' error,
+// 'T' time limit exceeded, 'M' memory limit exceeded. A client may send
+// any number of requests before reading the responses.
+//
+// One thread multiplexes the sockets and splits incoming bytes into
+// requests; a session with requests waiting is queued for the worker
+// threads, which run one request at a time per session, so a session's
+// requests stay in order while different sessions run in parallel. A
+// worker never waits for a client to read: responses the socket can't
+// take yet wait in the session's outbox for the socket thread.
+class server {
+private:
+    struct session;
+
+    server_options options;
+    int listenFd = -1;
+    int wakeFds[2] = {-1, -1}; // self-pipe waking the socket thread for stop()
+    std::atomic<bool> stopping{false};
+
+    std::vector<std::thread> workers;
+    std::deque<std::shared_ptr<session>> ready; // sessions with requests, not running
+    std::mutex lock;
+    std::condition_variable wake;
+
+    void workerLoop();
+    void serve(session &s, const std::string &request);
+    void wakeSocketThread();
+    // queue s if it has requests and is neither running nor queued; lock held
+    void schedule(const std::shared_ptr<session> &s);
+
+public:
+    explicit server(server_options options);
+    ~server();
+    server(const server&) = delete;
+    server& operator=(const server&) = delete;
+
+    // accepts and serves connections until stop(); returns the exit status
+    int run();
+    // makes run() return; safe to call from a signal handler
+    void stop();
+};
+
+} // namespace ti
+
+#endif // SERVER_H
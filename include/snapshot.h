@@ -0,0 +1,48 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <string>
+
+namespace ti {
+
+class runtime_env;
+
+// Session snapshots: the workspace of a runtime_env (global variables,
+// user functions with their trees, sequences by their rules and initial
+// terms, the calc settings and the random stream) in a versioned binary
+// file.
+//
+// Layout (version 2, little-endian): a 64-byte header (magic, version,
+// byte-order mark, string table offset and count, file size), then the
+// records, then the string table. Every name and string value is stored
+// once in the table and referred to by index. Integers are sign plus raw
+// base 10^9 limbs; symbolic expressions are their node DAG with shared
+// subexpressions written once. The doubles of decimal and complex arrays,
+// and of lists holding only decimals, are written contiguously at 64-byte aligned offsets, so a loaded file can
+// lend them out in place.
+//
+// Loading maps the file and adopts large arrays zero-copy: they keep the
+// mapping alive and read straight from it, so the restore costs time in
+// the number of values rather than in their bytes. Saving writes a
+// temporary file and renames it over `path`, which leaves any earlier
+// mapping of the old file intact.
+struct snapshot_stats {
+    size_t variables = 0;
+    size_t functions = 0;
+    size_t sequences = 0;
+    size_t borrowedBytes = 0; // array bytes adopted from the mapping
+};
+
+// throws std::runtime_error if a value cannot be saved or the file written
+snapshot_stats saveSnapshot(const runtime_env &env, const std::string &path);
+// adds the file's variables, functions and sequences to env, replacing those of the
+// same names; throws std::runtime_error on a missing, foreign or damaged file
+snapshot_stats loadSnapshot(runtime_env &env, const std::string &path);
+
+// saveSnapshot, loadSnapshot
+void register_snapshot_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // SNAPSHOT_H
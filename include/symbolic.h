@@ -0,0 +1,125 @@
+#ifndef SYMBOLIC_H
+#define SYMBOLIC_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "value.h"
+#include "ast.h"
+
+namespace ti {
+
+class runtime_env;
+
+enum class sym_kind {
+    Number, // an integer, fraction or decimal
+    Symbol, // an undefined variable
+    Add,
+    Mul,
+    Pow,    // base, exponent
+    Call,   // a builtin applied to symbolic arguments
+};
+
+class sym_node;
+using symptr = std::shared_ptr<const sym_node>;
+
+// One node of the symbolic expression DAG. Nodes are hash-consed: every
+// constructor goes through one intern table, so structurally identical
+// expressions are the same node, shared subexpressions are stored once and
+// equality is pointer comparison. Nodes are immutable and the table holds
+// them weakly, so a node lives as long as some value or parent uses it.
+// Simplified forms and derivatives are memoized on the node they were
+// computed from.
+class sym_node {
+private:
+    sym_kind k;
+    valptr_t num;              // Number
+    std::string label;         // Symbol, Call
+    std::vector<symptr> operands;
+    size_t hashValue = 0;
+
+    // guarded by the memo lock in symbolic.cpp; simplified forms never
+    // point back at their source, but derivatives can cycle (d/dx e^x), so
+    // those are held weakly
+    mutable bool canonical = false;
+    mutable symptr simplifiedMemo;
+    mutable std::vector<std::pair<std::weak_ptr<const sym_node>, std::weak_ptr<const sym_node>>> derivativeMemo; // var, d/dvar
+
+    sym_node(sym_kind k, valptr_t num, std::string label, std::vector<symptr> operands);
+    static symptr intern(sym_node &&candidate);
+
+    friend symptr simplify(const symptr &n);
+    friend symptr derivative(const symptr &n, const symptr &var);
+
+public:
+    // the interned node for each shape; no simplification happens here
+    static symptr number(valptr_t v);
+    static symptr symbol(const std::string &name);
+    static symptr add(std::vector<symptr> terms);
+    static symptr mul(std::vector<symptr> factors);
+    static symptr pow(symptr base, symptr exp);
+    static symptr call(const std::string &fn, std::vector<symptr> args);
+
+    sym_kind kind() const { return k; }
+    const valptr_t &number() const { return num; }
+    const std::string &name() const { return label; }
+    const std::vector<symptr> &args() const { return operands; }
+    size_t hash() const { return hashValue; }
+
+    // live nodes in the intern table
+    static size_t liveCount();
+};
+
+// canonical form: sums and products flattened, like terms and powers of a
+// common base collected, constants folded and operands in a fixed order
+symptr simplify(const symptr &n);
+// d n / d var for a symbol var, simplified; memoized per (node, var)
+symptr derivative(const symptr &n, const symptr &var);
+
+// An expression in undefined variables. The node is always simplified, so
+// equal values hold the same node.
+class symbolic : public value {
+private:
+    symptr node;
+
+public:
+    explicit symbolic(symptr node);
+
+    const symptr &getNode() const { return node; }
+
+    std::string toString() const override;
+    value_kind kind() const override { return value_kind::Symbolic; }
+    size_t hash() const override;
+    bool equals(const value &other) const override;
+};
+
+// what an undefined variable evaluates to
+valptr_t makeSymbol(const std::string &name);
+
+// l op r when either is symbolic and the other symbolic or a number; a
+// result that simplifies to a constant comes back as a plain number
+valptr_t symArith(ast::binary_op op, const value &l, const value &r);
+
+// base^exp for numbers or expressions, kept exact: a root of an exact
+// number stays a radical, with perfect powers taken out of it
+valptr_t symPower(const valptr_t &base, const valptr_t &exp);
+
+// the builtin fn applied to a symbolic argument
+valptr_t symCall(const std::string &fn, const valptr_t &arg);
+
+// every number in v as a decimal, and v itself as one when its only
+// variables are π and e
+valptr_t symApproximate(const symbolic &v);
+
+// v as a decimal when its only variables are the constants π and e; null
+// if it has any other, or no real value
+valptr_t symConstantValue(const symbolic &v);
+
+// d
+void register_symbolic_builtins(runtime_env &env);
+
+} // namespace ti
+
+#endif // SYMBOLIC_H
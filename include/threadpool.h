@@ -0,0 +1,62 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ti {
+
+// Work-stealing scheduler for data-parallel builtins. A parallel call
+// splits its task indices into one contiguous range per participating
+// thread (the caller is one of them); a thread that finishes its range
+// steals from the others, so uneven tasks still balance. Calls may nest:
+// a caller always works on its own job, so it never waits on a busy pool.
+class thread_pool {
+private:
+    struct job;
+
+    std::vector<std::thread> workers;
+    std::deque<std::shared_ptr<job>> jobs; // jobs that may still take helpers
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+    size_t maxThreads;
+
+    void workerLoop();
+    static void participate(job &j);
+
+public:
+    // total threads including the caller; the pool starts threads - 1 workers
+    explicit thread_pool(size_t threads);
+    ~thread_pool();
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    // the pool every runtime_env shares, one thread per hardware thread
+    static thread_pool &shared();
+
+    // upper bound on threads per parallel call, including the caller
+    // (0: one per hardware thread); raising it past the pool size starts
+    // more workers
+    void setMaxThreads(size_t n);
+    size_t getMaxThreads() const { return maxThreads; }
+
+    // run body(i) for every i in [0, tasks) and wait for all of them. If
+    // tasks throw, the exception of the lowest failing index is rethrown,
+    // as a serial loop would; tasks after it may be skipped. Tasks run
+    // under the caller's budget (see budget.h), minus its memory limit.
+    void run(size_t tasks, const std::function<void(size_t)> &body);
+};
+
+// body(begin, end) over [0, n) in chunks of `grain` on the shared pool;
+// chunk boundaries depend only on n and grain, never on the thread count
+void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)> &body);
+
+} // namespace ti
+
+#endif // THREADPOOL_H
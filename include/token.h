@@ -1,6 +1,7 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <set>
@@ -117,56 +118,87 @@ namespace tk {
         return false;
     };
 
-    auto find_block_start = [](const std::string& line) -> std::string {
-        std::string f = get_first_token(line);
-        if (f.empty()) return std::string();
+    // a line's tokens split into its ':'-separated statements (the ':' of
+    // ':=' is an assignment, not a separator)
+    auto split_statements = [](const std::vector<std::string> &toks) -> std::vector<std::vector<std::string>> {
+        std::vector<std::vector<std::string>> out(1);
+        for (size_t i = 0; i < toks.size(); ++i) {
+            if (toks[i] == ":" && (i + 1 == toks.size() || toks[i + 1] != "=")) out.emplace_back();
+            else out.back().push_back(toks[i]);
+        }
+        return out;
+    };
+
+    // the end keyword a statement opens a block for: For, While, ... lead
+    // it, If only when it ends in Then (If cond alone guards the next
+    // statement), and Define f(x)=Func / =Prgm ends with the keyword
+    auto find_block_start = [](const std::vector<std::string> &toks) -> std::string {
+        if (toks.empty()) return std::string();
+        const std::string &f = toks.front();
+        if (f == "if") return toks.back() == "then" ? "endif" : std::string();
         for (const auto& p : tk::blockKwPairs) {
             if (f == p.first) return p.second;
         }
+        if (toks.back() == "func") return "endfunc";
+        if (toks.back() == "prgm") return "endprgm";
         return std::string();
     };
 
-    auto find_end_kw = [](const std::string& line) -> std::string {
-        std::string f = get_first_token(line);
-        if (f.empty()) return std::string();
+    auto find_end_kw = [](const std::vector<std::string> &toks) -> std::string {
+        if (toks.empty()) return std::string();
         for (const auto& kw : tk::endReadlnKwds) {
-            if (f == kw) return kw;
+            if (toks.front() == kw) return kw;
         }
         return std::string();
     };
 
-    auto recompute_stack = [](const std::string &all) -> std::vector<std::string> {
-        std::vector<std::string> st;
-        size_t pos = 0;
-        while (pos <= all.size()) {
-            size_t next = all.find('\n', pos);
-            std::string line = (next == std::string::npos) ? all.substr(pos) : all.substr(pos, next - pos);
+    // The open blocks of a program read one line at a time. Each line is
+    // looked at once when it arrives, so entering N lines costs O(total
+    // length) instead of re-scanning everything entered so far per line.
+    struct block_tracker {
+        std::vector<std::string> stack; // end keywords of the open blocks, innermost last
+        std::string lastLine;           // last non-empty line, trimmed
+
+        void feed(const std::string &line) {
             std::string tline = tk::trim(line);
-            if (!tline.empty()) {
-                std::string nb = tk::find_block_start(tline);
+            if (tline.empty()) return;
+            // For i,1,3:Disp i:EndFor opens and closes its block on one line
+            for (const auto &stmt : tk::split_statements(tk::tokenize(tline))) {
+                std::string nb = tk::find_block_start(stmt);
                 if (!nb.empty()) {
-                    st.push_back(nb);
-                    pos = (next == std::string::npos) ? all.size() + 1 : next + 1;
+                    stack.push_back(nb);
                     continue;
                 }
-                std::string fe = tk::find_end_kw(tline);
-                if (!fe.empty()) {
-                    // pop until match
-                    if (!st.empty() && st.back() == fe) {
-                        st.pop_back();
-                    } else {
-                        auto it = std::find(st.rbegin(), st.rend(), fe);
-                        if (it != st.rend()) {
-                            while (!st.empty() && st.back() != fe) st.pop_back();
-                            if (!st.empty() && st.back() == fe) st.pop_back();
-                        }
+                std::string fe = tk::find_end_kw(stmt);
+                if (fe.empty()) continue;
+                // pop until match
+                if (!stack.empty() && stack.back() == fe) {
+                    stack.pop_back();
+                } else {
+                    auto it = std::find(stack.rbegin(), stack.rend(), fe);
+                    if (it != stack.rend()) {
+                        while (!stack.empty() && stack.back() != fe) stack.pop_back();
+                        if (!stack.empty() && stack.back() == fe) stack.pop_back();
                     }
                 }
             }
+            lastLine = std::move(tline);
+        }
+
+        // true while a block is open or the last line asks to continue
+        bool open() const { return !stack.empty() || tk::is_continue_only(lastLine); }
+    };
+
+    auto recompute_stack = [](const std::string &all) -> std::vector<std::string> {
+        block_tracker blocks;
+        size_t pos = 0;
+        while (pos <= all.size()) {
+            size_t next = all.find('\n', pos);
+            blocks.feed(next == std::string::npos ? all.substr(pos) : all.substr(pos, next - pos));
             if (next == std::string::npos) break;
             pos = next + 1;
         }
-        return st;
+        return blocks.stack;
     };
 
     auto is_line_empty = [](const std::string &line) {
@@ -175,25 +207,33 @@ namespace tk {
         return start == std::string::npos;
     };
 
+    // Groups lines into statements the way the REPL reads them: a statement
+    // goes on while a block is open or its last line asks to continue, and
+    // two empty lines in a row end it regardless.
+    struct statement_splitter {
+        block_tracker blocks;
+        int consecutiveEmpty = 0;
+        size_t lines = 0;
+
+        // adds the statement's next line; true if that completes it
+        bool feed(const std::string &line) {
+            consecutiveEmpty = tk::is_line_empty(line) ? consecutiveEmpty + 1 : 0;
+            if (++lines > 1 && consecutiveEmpty >= 2) return true;
+            blocks.feed(line);
+            return !blocks.open();
+        }
+    };
+
     // Trim trailing empty lines the user may have entered to force break
     auto trim_trailing_empty = [](std::string &s) {
-        
-        while (true) {
-            // find last line
-            size_t pos = s.find_last_of('\n');
-            std::string last = (pos == std::string::npos) ? s : s.substr(pos + 1);
-            if (is_line_empty(last)) {
-                // remove last line and its preceding newline if any
-                if (pos == std::string::npos) {
-                    s.clear();
-                    break;
-                } else {
-                    s.erase(pos); // remove from last '\n' onwards
-                    continue;
-                }
-            }
-            break;
+        // cut at the end of the last line holding more than whitespace
+        size_t last = s.find_last_not_of(" \t\r\n");
+        if (last == std::string::npos) {
+            s.clear();
+            return;
         }
+        size_t eol = s.find('\n', last);
+        if (eol != std::string::npos) s.erase(eol);
     };
 
 };
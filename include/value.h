@@ -1,6 +1,7 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <cmath>
@@ -20,11 +21,35 @@ namespace ti {
 class fraction;
 class decimal;
 
+// runtime type tag, used for cheap type dispatch in arithmetic
+enum class value_kind {
+    Void,
+    Boolean,
+    Integer,
+    Decimal,
+    Fraction,
+    String,
+    List,
+    Polynomial,
+    Symbolic,
+    Complex,      // complex_number (complexnum.h)
+    ComplexArray, // complex_array
+    DecimalArray, // decimal_array (lists.h)
+    LazySeq,      // lazy_seq (lists.h)
+    Other,
+};
+
 class value {
 public:
     value() = default;
     virtual ~value() = default;
     virtual std::string toString() const;
+    virtual value_kind kind() const { return value_kind::Other; }
+
+    // structural hash/equality (used as memo keys); values of different
+    // types are never equal, so 2, 2.0 and 4/2 are distinct keys
+    virtual size_t hash() const;
+    virtual bool equals(const value &other) const;
     
     friend std::ostream& operator<<(std::ostream& os, const value& obj);
 };
@@ -37,10 +62,75 @@ public:
     ~void_t() override = default;
 
     std::string toString() const override;
+    value_kind kind() const override { return value_kind::Void; }
+    size_t hash() const override;
+    bool equals(const value &other) const override;
 };
 
 inline const valptr_t none = std::make_shared<ti::void_t>();
 
+// The read-only doubles of a bulk numeric value (decimal_array,
+// complex_array): owned, or borrowed from memory kept alive by `owner`,
+// such as a mapped snapshot file (see snapshot.h). Copying a borrowed
+// buffer shares the memory instead of duplicating it.
+class double_buffer {
+private:
+    std::vector<double> owned;
+    const double* ptr = nullptr;
+    size_t count = 0;
+    std::shared_ptr<const void> owner;
+
+public:
+    double_buffer() = default;
+    double_buffer(std::vector<double> xs) : owned(std::move(xs)), ptr(owned.data()), count(owned.size()) {}
+    double_buffer(const double* data, size_t n, std::shared_ptr<const void> owner)
+        : ptr(data), count(n), owner(std::move(owner)) {}
+    double_buffer(const double_buffer &o)
+        : owned(o.owned), ptr(o.owner ? o.ptr : owned.data()), count(o.count), owner(o.owner) {}
+    double_buffer(double_buffer &&o) noexcept
+        : owned(std::move(o.owned)), ptr(o.ptr), count(o.count), owner(std::move(o.owner)) {
+        o.ptr = nullptr;
+        o.count = 0;
+    }
+    double_buffer &operator=(double_buffer o) noexcept {
+        owned = std::move(o.owned);
+        ptr = o.ptr;
+        count = o.count;
+        owner = std::move(o.owner);
+        o.ptr = nullptr;
+        o.count = 0;
+        return *this;
+    }
+
+    const double* data() const { return ptr; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    double operator[](size_t i) const { return ptr[i]; }
+    const double* begin() const { return ptr; }
+    const double* end() const { return ptr + count; }
+    // true when the doubles live in someone else's memory
+    bool borrowed() const { return owner != nullptr; }
+
+    bool operator==(const double_buffer &o) const {
+        return count == o.count && std::equal(begin(), end(), o.begin());
+    }
+};
+
+
+class boolean : public value {
+private:
+    bool value;
+
+public:
+    explicit boolean(bool value);
+    ~boolean() override = default;
+
+    bool getValue() const;
+    std::string toString() const override;
+    value_kind kind() const override { return value_kind::Boolean; }
+    size_t hash() const override;
+    bool equals(const ti::value &other) const override;
+};
 
 class integer : public value {
 private:
@@ -53,6 +143,9 @@ public:
 
     BigInt getValue() const;
     std::string toString() const override;
+    value_kind kind() const override { return value_kind::Integer; }
+    size_t hash() const override;
+    bool equals(const ti::value &other) const override;
 };
 
 class decimal : public value {
@@ -67,6 +160,9 @@ public:
     fraction toFraction(double precision = 5e-16, int max_cycles = 100);
     fraction toFraction(const decimal& precision, int max_cycles = 100);
     std::string toString() const override;
+    value_kind kind() const override { return value_kind::Decimal; }
+    size_t hash() const override;
+    bool equals(const ti::value &other) const override;
 };
 
 class fraction : public value {
@@ -84,6 +180,9 @@ public:
     decimal getDecimalValue() const;
     std::tuple<BigInt, BigInt> toTuple() const;
     std::string toString() const override;
+    value_kind kind() const override { return value_kind::Fraction; }
+    size_t hash() const override;
+    bool equals(const ti::value &other) const override;
 };
 
 class string : public value {
@@ -94,6 +193,9 @@ public:
     
     std::string getValue() const;
     std::string toString() const override;
+    value_kind kind() const override { return value_kind::String; }
+    size_t hash() const override;
+    bool equals(const ti::value &other) const override;
 };
 
 template<typename T> 
@@ -106,6 +208,10 @@ template<typename T>
 inline constexpr bool is_2d_vector_v = _is_2d_vector<T>::value;
 
 
+// Type trait to detect if a type is a std::variant 
+template<typename T> struct is_variant : std::false_type {}; 
+template<typename... Ts> struct is_variant<std::variant<Ts...>> : std::true_type {}; template<typename T> inline constexpr bool is_variant_v = is_variant<T>::value;
+
 // === collection base ===
 template<typename T>
 class collection : public value {
@@ -115,21 +221,70 @@ protected:
 public:
     collection() = default;
     explicit collection(const std::vector<T>& values) : values(values) {}
+    explicit collection(std::vector<T>&& values) : values(std::move(values)) {}
     collection(const collection<T>& other) = default;
     virtual ~collection() = default;
 
     T operator[](size_t i) const { return values[i]; }
     std::vector<T> getValues() const { return values; }
+    const std::vector<T> &elements() const { return values; }
     size_t size() const { return values.size(); }
 
     // subclasses must override formatting
     virtual std::string toString() const override = 0;
+
+protected:
+    static size_t hashElement(const T &v) {
+        if constexpr (std::is_same_v<T, std::shared_ptr<value>>) {
+            return v ? v->hash() : 0;
+        } else if constexpr (is_variant_v<T>) {
+            return std::visit([](const auto &arg) -> size_t {
+                if constexpr (std::is_same_v<std::decay_t<decltype(arg)>, std::shared_ptr<value>>) {
+                    return arg ? arg->hash() : 0;
+                } else {
+                    return arg.hash();
+                }
+            }, v);
+        } else {
+            return v.hash();
+        }
+    }
+
+    static bool equalElement(const T &a, const T &b) {
+        if constexpr (std::is_same_v<T, std::shared_ptr<value>>) {
+            return a && b ? a->equals(*b) : a == b;
+        } else if constexpr (is_variant_v<T>) {
+            if (a.index() != b.index()) return false;
+            return std::visit([&b](const auto &x) -> bool {
+                using U = std::decay_t<decltype(x)>;
+                const U &y = std::get<U>(b);
+                if constexpr (std::is_same_v<U, std::shared_ptr<value>>) {
+                    return x && y ? x->equals(*y) : x == y;
+                } else {
+                    return x.equals(y);
+                }
+            }, a);
+        } else {
+            return a.equals(b);
+        }
+    }
+
+    size_t hashElements(size_t seed) const {
+        size_t h = seed;
+        for (const auto &v : values) h ^= hashElement(v) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        return h;
+    }
+
+    bool equalElements(const collection<T> &other) const {
+        if (values.size() != other.values.size()) return false;
+        for (size_t i = 0; i < values.size(); i++) {
+            if (!equalElement(values[i], other.values[i])) return false;
+        }
+        return true;
+    }
 };
 
 
-// Type trait to detect if a type is a std::variant 
-template<typename T> struct is_variant : std::false_type {}; 
-template<typename... Ts> struct is_variant<std::variant<Ts...>> : std::true_type {}; template<typename T> inline constexpr bool is_variant_v = is_variant<T>::value;
 
 // === list ===
 template<typename T>
@@ -138,6 +293,16 @@ public:
     using collection<T>::collection; // inherit constructors
     list(const list<T>& other) = default;
 
+    // only lists of boxed values take part in arithmetic
+    value_kind kind() const override {
+        return std::is_same_v<T, std::shared_ptr<value>> ? value_kind::List : value_kind::Other;
+    }
+    size_t hash() const override { return this->hashElements(0x6c697374); }
+    bool equals(const value &other) const override {
+        auto o = dynamic_cast<const list<T>*>(&other);
+        return o && this->equalElements(*o);
+    }
+
     std::string toString() const override {
         std::stringstream ss;
         ss << "{";
@@ -171,6 +336,12 @@ public:
     vector(const vector<T>& other) = default;
     vector(const list<T>& l) : collection<T>(l.getValues()) {}
 
+    size_t hash() const override { return this->hashElements(0x76656374); }
+    bool equals(const value &other) const override {
+        auto o = dynamic_cast<const vector<T>*>(&other);
+        return o && this->equalElements(*o);
+    }
+
     std::string toString() const override {
         std::stringstream ss;
         ss << "[";
@@ -0,0 +1,352 @@
+#include "../include/arith.h"
+#include "../include/complexnum.h"
+#include "../include/lists.h"
+#include "../include/ntheory.h"
+#include "../include/poly.h"
+#include "../include/symbolic.h"
+#include "../include/threadpool.h"
+#include <cmath>
+#include <stdexcept>
+
+namespace ti {
+
+using ast::binary_op;
+
+namespace {
+
+const valptr_t trueValue = std::make_shared<boolean>(true);
+const valptr_t falseValue = std::make_shared<boolean>(false);
+
+valptr_t makeBool(bool b) {
+    return b ? trueValue : falseValue;
+}
+
+bool isComparison(binary_op op) {
+    return op == binary_op::Eq || op == binary_op::Ne || op == binary_op::Lt ||
+           op == binary_op::Le || op == binary_op::Gt || op == binary_op::Ge;
+}
+
+template<binary_op Op, typename T>
+bool compare(const T &l, const T &r) {
+    if constexpr (Op == binary_op::Eq) return l == r;
+    else if constexpr (Op == binary_op::Ne) return l != r;
+    else if constexpr (Op == binary_op::Lt) return l < r;
+    else if constexpr (Op == binary_op::Le) return l <= r;
+    else if constexpr (Op == binary_op::Gt) return l > r;
+    else return l >= r;
+}
+
+// exact num/den of an integer or fraction
+void toRational(const value &v, BigInt &num, BigInt &den) {
+    if (v.kind() == value_kind::Integer) {
+        num = static_cast<const integer &>(v).getValue();
+        den = BigInt(1);
+    } else {
+        std::tie(num, den) = static_cast<const fraction &>(v).toTuple();
+    }
+}
+
+BigInt intPow(BigInt base, BigInt exp) {
+    BigInt result(1);
+    const BigInt two(2);
+    while (!exp.is_zero()) {
+        if (!(exp % two).is_zero()) result *= base;
+        exp /= two;
+        if (!exp.is_zero()) base *= base;
+    }
+    return result;
+}
+
+// largest root index tried for an exact result of a fractional power
+constexpr long long MAX_EXACT_ROOT = 1 << 16;
+
+valptr_t ratPow(const BigInt &num, const BigInt &den, const BigInt &exp) {
+    if (exp.sign() >= 0) return makeRational(intPow(num, exp), intPow(den, exp));
+    if (num.is_zero()) throw std::domain_error("division by zero");
+    BigInt e = exp.abs();
+    return makeRational(intPow(den, e), intPow(num, e));
+}
+
+// --- kernels ---
+
+template<binary_op Op>
+valptr_t intKernel(const value &l, const value &r) {
+    const BigInt &a = static_cast<const integer &>(l).getValue();
+    const BigInt &b = static_cast<const integer &>(r).getValue();
+    if constexpr (Op == binary_op::Add) return std::make_shared<integer>(a + b);
+    else if constexpr (Op == binary_op::Sub) return std::make_shared<integer>(a - b);
+    else if constexpr (Op == binary_op::Mul) return std::make_shared<integer>(a * b);
+    else if constexpr (Op == binary_op::Div) return makeRational(a, b);
+    else if constexpr (Op == binary_op::Pow) return ratPow(a, BigInt(1), b);
+    else return makeBool(compare<Op>(a, b));
+}
+
+template<binary_op Op>
+valptr_t ratKernel(const value &l, const value &r) {
+    BigInt an, ad, bn, bd;
+    toRational(l, an, ad);
+    toRational(r, bn, bd);
+    if constexpr (Op == binary_op::Add) return makeRational(an * bd + bn * ad, ad * bd);
+    else if constexpr (Op == binary_op::Sub) return makeRational(an * bd - bn * ad, ad * bd);
+    else if constexpr (Op == binary_op::Mul) return makeRational(an * bn, ad * bd);
+    else if constexpr (Op == binary_op::Div) return makeRational(an * bd, ad * bn);
+    else if constexpr (Op == binary_op::Pow) {
+        if (r.kind() == value_kind::Integer) return ratPow(an, ad, bn);
+        // a perfect power keeps an exact result: 8^(2/3) = 4
+        BigInt rn, rd;
+        if (r.kind() == value_kind::Fraction && bd <= BigInt(MAX_EXACT_ROOT) &&
+            isPower(an, static_cast<unsigned>(bd.to_long_long()), &rn) &&
+            isPower(ad, static_cast<unsigned>(bd.to_long_long()), &rd)) {
+            return ratPow(rn, rd, bn);
+        }
+        return std::make_shared<decimal>(std::pow(toDouble(l), toDouble(r)));
+    }
+    // denominators are positive, so cross-multiplying preserves order
+    else return makeBool(compare<Op>(an * bd, bn * ad));
+}
+
+template<binary_op Op>
+valptr_t decKernel(const value &l, const value &r) {
+    double a = toDouble(l);
+    double b = toDouble(r);
+    if constexpr (Op == binary_op::Add) return std::make_shared<decimal>(a + b);
+    else if constexpr (Op == binary_op::Sub) return std::make_shared<decimal>(a - b);
+    else if constexpr (Op == binary_op::Mul) return std::make_shared<decimal>(a * b);
+    else if constexpr (Op == binary_op::Div) {
+        if (b == 0.0) throw std::domain_error("division by zero");
+        return std::make_shared<decimal>(a / b);
+    }
+    else if constexpr (Op == binary_op::Pow) return std::make_shared<decimal>(std::pow(a, b));
+    else return makeBool(compare<Op>(a, b));
+}
+
+template<binary_op Op>
+valptr_t strKernel(const value &l, const value &r) {
+    const std::string a = static_cast<const string &>(l).getValue();
+    const std::string b = static_cast<const string &>(r).getValue();
+    if constexpr (Op == binary_op::Add) return std::make_shared<string>(a + b);
+    else return makeBool(compare<Op>(a, b));
+}
+
+template<binary_op Op>
+valptr_t boolKernel(const value &l, const value &r) {
+    return makeBool(compare<Op>(static_cast<const boolean &>(l).getValue(),
+                                static_cast<const boolean &>(r).getValue()));
+}
+
+// a polynomial with a polynomial or a number
+template<binary_op Op>
+valptr_t polyKernel(const value &l, const value &r) {
+    return polyArith(Op, l, r);
+}
+
+// an expression with an expression or a number
+template<binary_op Op>
+valptr_t symKernel(const value &l, const value &r) {
+    return symArith(Op, l, r);
+}
+
+// elements per parallel task for elementwise list operations
+constexpr size_t LIST_GRAIN = 2048;
+
+// elementwise over lists; a non-list operand pairs with every element
+template<binary_op Op>
+valptr_t listKernel(const value &l, const value &r) {
+    using vlist = list<valptr_t>;
+    const vlist* a = l.kind() == value_kind::List ? static_cast<const vlist*>(&l) : nullptr;
+    const vlist* b = r.kind() == value_kind::List ? static_cast<const vlist*>(&r) : nullptr;
+    if (a && b && a->size() != b->size()) throw std::runtime_error("dimension mismatch");
+    const size_t n = a ? a->size() : b->size();
+    std::vector<valptr_t> out(n);
+    // kernels are stateless, so elements can be computed on any thread
+    parallelFor(n, LIST_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const value* lv = a ? a->elements()[i].get() : &l;
+            const value* rv = b ? b->elements()[i].get() : &r;
+            if (!lv || !rv) throw std::runtime_error("binary op on null");
+            binary_kernel k = findKernel(Op, lv->kind(), rv->kind());
+            if (!k) throw std::runtime_error("invalid operand types: " + lv->toString() + ", " + rv->toString());
+            out[i] = k(*lv, *rv);
+        }
+    });
+    return std::make_shared<vlist>(std::move(out));
+}
+
+// a complex number with a complex number or a real one
+template<binary_op Op>
+valptr_t complexKernel(const value &l, const value &r) {
+    return complexArith(Op, l, r);
+}
+
+// a packed complex array with an array, a list or a number
+template<binary_op Op>
+valptr_t complexArrayKernel(const value &l, const value &r) {
+    return complexArrayArith(Op, l, r);
+}
+
+// a lazy seq with anything: the same as its materialized list
+template<binary_op Op>
+valptr_t lazySeqKernel(const value &l, const value &r) {
+    auto list = [](const value &v) {
+        return v.kind() == value_kind::LazySeq ? static_cast<const lazy_seq &>(v).materialized() : valptr_t();
+    };
+    const valptr_t a = list(l), b = list(r);
+    const value &lv = a ? *a : l;
+    const value &rv = b ? *b : r;
+    binary_kernel k = findKernel(Op, lv.kind(), rv.kind());
+    if (!k) throw std::runtime_error("invalid operand types: " + lv.toString() + ", " + rv.toString());
+    return k(lv, rv);
+}
+
+// a decimal_array with an array or a number; anything that is not plain
+// decimal arithmetic works on the boxed elements like any list
+template<binary_op Op>
+valptr_t decimalArrayKernel(const value &l, const value &r) {
+    if (valptr_t v = decimalArrayArith(Op, l, r)) return v;
+    auto box = [](const value &v) {
+        return v.kind() == value_kind::DecimalArray ? static_cast<const decimal_array &>(v).boxed() : valptr_t();
+    };
+    const valptr_t a = box(l), b = box(r);
+    return listKernel<Op>(a ? *a : l, b ? *b : r);
+}
+
+template<binary_op Op>
+binary_kernel selectKernel(value_kind l, value_kind r) {
+    if (isComparison(Op) && Op != binary_op::Eq && Op != binary_op::Ne &&
+        (l == value_kind::Complex || r == value_kind::Complex || l == value_kind::ComplexArray ||
+         r == value_kind::ComplexArray)) {
+        return nullptr;
+    }
+    if (l == value_kind::LazySeq || r == value_kind::LazySeq) return &lazySeqKernel<Op>;
+    // before lists, so a list operand is packed rather than mapped over
+    if (l == value_kind::ComplexArray || r == value_kind::ComplexArray) return &complexArrayKernel<Op>;
+    if (l == value_kind::DecimalArray || r == value_kind::DecimalArray) return &decimalArrayKernel<Op>;
+    if (l == value_kind::List || r == value_kind::List) return &listKernel<Op>;
+    if ((l == value_kind::Complex && isComplexScalar(r)) || (r == value_kind::Complex && isNumeric(l))) {
+        return &complexKernel<Op>;
+    }
+    if ((l == value_kind::Polynomial && (r == value_kind::Polynomial || isNumeric(r))) ||
+        (r == value_kind::Polynomial && isNumeric(l))) {
+        if (Op == binary_op::Pow && l != value_kind::Polynomial) return nullptr;
+        if (isComparison(Op) && Op != binary_op::Eq && Op != binary_op::Ne) return nullptr;
+        return &polyKernel<Op>;
+    }
+    if ((l == value_kind::Symbolic && (r == value_kind::Symbolic || isNumeric(r))) ||
+        (r == value_kind::Symbolic && isNumeric(l))) {
+        // ordering only holds between constants such as π; symArith checks
+        return &symKernel<Op>;
+    }
+    if (isNumeric(l) && isNumeric(r)) {
+        if (l == value_kind::Decimal || r == value_kind::Decimal) return &decKernel<Op>;
+        if (l == value_kind::Integer && r == value_kind::Integer) return &intKernel<Op>;
+        return &ratKernel<Op>;
+    }
+    if (l == value_kind::String && r == value_kind::String) {
+        if (Op == binary_op::Add || isComparison(Op)) return &strKernel<Op>;
+        return nullptr;
+    }
+    if (l == value_kind::Boolean && r == value_kind::Boolean) {
+        if (Op == binary_op::Eq || Op == binary_op::Ne) return &boolKernel<Op>;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+bool isNumeric(value_kind k) {
+    return k == value_kind::Integer || k == value_kind::Fraction || k == value_kind::Decimal;
+}
+
+double toDouble(const value &v) {
+    switch (v.kind()) {
+        case value_kind::Integer: return static_cast<const integer &>(v).getValue().to_double();
+        case value_kind::Fraction: return static_cast<const fraction &>(v).getValue();
+        case value_kind::Decimal: return static_cast<const decimal &>(v).getValue();
+        default: throw std::runtime_error("expected a number, got " + v.toString());
+    }
+}
+
+bool forContinues(const valptr_t &cur, const valptr_t &end, const valptr_t &step) {
+    bool descending = toDouble(*step) < 0;
+    return isTrue(applyBinary(descending ? binary_op::Ge : binary_op::Le, cur, end));
+}
+
+BigInt gcd(BigInt a, BigInt b) {
+    a = a.abs();
+    b = b.abs();
+    while (!b.is_zero()) {
+        BigInt t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+valptr_t makeRational(const BigInt &num, const BigInt &den) {
+    if (den.is_zero()) throw std::domain_error("division by zero");
+    BigInt g = gcd(num, den);
+    BigInt n = num / g;
+    BigInt d = den / g;
+    if (d.sign() < 0) {
+        n = -n;
+        d = -d;
+    }
+    if (d == BigInt(1)) return std::make_shared<integer>(n);
+    return std::make_shared<fraction>(integer(n), integer(d));
+}
+
+binary_kernel findKernel(binary_op op, value_kind l, value_kind r) {
+    switch (op) {
+        case binary_op::Add: return selectKernel<binary_op::Add>(l, r);
+        case binary_op::Sub: return selectKernel<binary_op::Sub>(l, r);
+        case binary_op::Mul: return selectKernel<binary_op::Mul>(l, r);
+        case binary_op::Div: return selectKernel<binary_op::Div>(l, r);
+        case binary_op::Pow: return selectKernel<binary_op::Pow>(l, r);
+        case binary_op::Eq: return selectKernel<binary_op::Eq>(l, r);
+        case binary_op::Ne: return selectKernel<binary_op::Ne>(l, r);
+        case binary_op::Lt: return selectKernel<binary_op::Lt>(l, r);
+        case binary_op::Le: return selectKernel<binary_op::Le>(l, r);
+        case binary_op::Gt: return selectKernel<binary_op::Gt>(l, r);
+        case binary_op::Ge: return selectKernel<binary_op::Ge>(l, r);
+    }
+    return nullptr;
+}
+
+valptr_t applyBinary(binary_op op, const valptr_t &l, const valptr_t &r) {
+    if (!l || !r) throw std::runtime_error("binary op on null");
+    binary_kernel k = findKernel(op, l->kind(), r->kind());
+    if (!k) throw std::runtime_error("invalid operand types: " + l->toString() + ", " + r->toString());
+    return k(*l, *r);
+}
+
+valptr_t applyMode(const valptr_t &v, calc_mode mode) {
+    if (mode != calc_mode::Approximate || !v) return v;
+    if (v->kind() == value_kind::Fraction) return std::make_shared<decimal>(toDouble(*v));
+    if (v->kind() == value_kind::Polynomial) {
+        const auto &p = static_cast<const polynomial &>(*v);
+        if (p.ring() != poly_ring::Decimal) return std::make_shared<polynomial>(p.toDecimal());
+    }
+    if (v->kind() == value_kind::Symbolic) return symApproximate(static_cast<const symbolic &>(*v));
+    if (v->kind() == value_kind::Complex) return approximateComplex(v);
+    if (v->kind() == value_kind::List) {
+        // copy only lists that actually hold something to convert
+        const auto &elems = static_cast<const list<valptr_t> &>(*v).elements();
+        std::vector<valptr_t> out(elems.size());
+        bool changed = false;
+        for (size_t i = 0; i < elems.size(); ++i) {
+            out[i] = applyMode(elems[i], mode);
+            changed = changed || out[i] != elems[i];
+        }
+        if (changed) return std::make_shared<list<valptr_t>>(std::move(out));
+    }
+    return v;
+}
+
+bool isTrue(const valptr_t &v) {
+    if (!v || v->kind() != value_kind::Boolean) {
+        throw std::runtime_error("condition must evaluate to true or false");
+    }
+    return static_cast<const boolean &>(*v).getValue();
+}
+
+} // namespace ti
@@ -1,10 +1,36 @@
 #include "../include/ast.h"
 #include "../include/runtimeenv.h"
 #include "../include/value.h"
+#include "../include/arith.h"
 #include <stdexcept>
+#include <unordered_map>
 
 using namespace ast;
 
+namespace {
+
+// Inline cache writers: seq goes odd for the update and even again after.
+// A writer that finds another one in skips its update; the cache is only
+// a shortcut.
+bool beginCacheWrite(std::atomic<unsigned> &seq, unsigned &s) {
+    s = seq.load(std::memory_order_relaxed);
+    if ((s & 1) || !seq.compare_exchange_strong(s, s + 1, std::memory_order_relaxed)) return false;
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+}
+
+void endCacheWrite(std::atomic<unsigned> &seq, unsigned s) {
+    seq.store(s + 2, std::memory_order_release);
+}
+
+// whether the fields read since seq was s (even) belong together
+bool cacheReadValid(const std::atomic<unsigned> &seq, unsigned s) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq.load(std::memory_order_relaxed) == s;
+}
+
+} // namespace
+
 // var_node
 ti::valptr_t var_node::eval(ti::runtime_env &env) {
     return env.getVariable(name);
@@ -18,38 +44,382 @@ ti::valptr_t assign_node::eval(ti::runtime_env &env) {
 }
 
 // call_node
-ti::valptr_t call_node::eval(ti::runtime_env &env) {
-    // evaluate callee - support simple function name via var_node
-    // if callee eval returns something special, could be a first-class function; for now we expect callee to be a var_node
-    // if callee is var_node, we can extract name without evaluating it:
-    // Try dynamic_cast to var_node
-    if (var_node* vn = dynamic_cast<var_node*>(callee.get())) {
-        std::vector<ti::valptr_t> argvals;
-        argvals.reserve(args.size());
-        for (auto &a : args) argvals.push_back(a->eval(env));
-        return env.callFunction(vn->name, argvals);
-    } else {
+ti::function* call_node::resolve(ti::runtime_env &env) const {
+    const unsigned seq = icSeq.load(std::memory_order_acquire);
+    if (!(seq & 1)) {
+        const ti::runtime_env* cachedEnv = icEnv.load(std::memory_order_relaxed);
+        const size_t cachedVersion = icVersion.load(std::memory_order_relaxed);
+        ti::function* cachedFn = icFn.load(std::memory_order_relaxed);
+        if (cacheReadValid(icSeq, seq) && cachedEnv == &env && cachedVersion == env.getFunctionVersion()) {
+            return cachedFn;
+        }
+    }
+    if (callee->kind() != node_kind::Var) {
         // evaluate callee: it could return a function object in a value wrapper (not implemented here)
         throw std::runtime_error("call_node: only simple function-name calls supported right now");
     }
+    const std::string &name = static_cast<const var_node &>(*callee).name;
+    ti::function* fn = env.getFunction(name);
+    if (!fn) throw std::runtime_error("undefined function: " + name);
+    unsigned s;
+    if (beginCacheWrite(icSeq, s)) {
+        icEnv.store(&env, std::memory_order_relaxed);
+        icVersion.store(env.getFunctionVersion(), std::memory_order_relaxed);
+        icFn.store(fn, std::memory_order_relaxed);
+        endCacheWrite(icSeq, s);
+    }
+    return fn;
+}
+
+ti::valptr_t call_node::eval(ti::runtime_env &env) {
+    ti::function* fn = resolve(env);
+    if (fn->formImpl) return fn->formImpl(*this, env);
+    std::vector<ti::valptr_t> argvals;
+    argvals.reserve(args.size());
+    for (auto &a : args) argvals.push_back(a->eval(env));
+    return env.callFunction(*fn, argvals);
+}
+
+// local_node
+ti::valptr_t local_node::eval(ti::runtime_env &env) {
+    for (const auto &n : names) env.declareLocal(n);
+    return ti::none;
+}
+
+// block_node
+ti::valptr_t block_node::eval(ti::runtime_env &env) {
+    ti::valptr_t last = ti::none;
+    for (auto &s : stmts) last = s->eval(env);
+    return last;
+}
+
+// if_node
+ti::valptr_t if_node::eval(ti::runtime_env &env) {
+    if (ti::isTrue(cond->eval(env))) return then_branch->eval(env);
+    if (else_branch) return else_branch->eval(env);
+    return ti::none;
+}
+
+// for_node
+ti::valptr_t for_node::eval(ti::runtime_env &env) {
+    ti::valptr_t cur = start->eval(env);
+    ti::valptr_t last = end->eval(env);
+    ti::valptr_t inc = step ? step->eval(env) : std::make_shared<ti::integer>(1);
+    env.setVariable(var, cur);
+    while (ti::forContinues(cur, last, inc)) {
+        body->eval(env);
+        cur = ti::applyBinary(binary_op::Add, env.getVariable(var), inc);
+        env.setVariable(var, cur);
+    }
+    return ti::none;
+}
+
+// while_node
+ti::valptr_t while_node::eval(ti::runtime_env &env) {
+    while (ti::isTrue(cond->eval(env))) body->eval(env);
+    return ti::none;
+}
+
+// let_node
+ti::valptr_t let_node::eval(ti::runtime_env &env) {
+    struct temps_guard {
+        ti::runtime_env &env;
+        ~temps_guard() { env.popTemps(); }
+    };
+    env.pushTemps(temps.size());
+    temps_guard guard{env};
+    return body->eval(env);
+}
+
+// temp_node
+ti::valptr_t temp_node::eval(ti::runtime_env &env) {
+    ti::valptr_t v = env.temp(depth, index);
+    if (!v) {
+        v = owner->temps[index]->eval(env);
+        env.temp(depth, index) = v;
+    }
+    return v;
 }
 
 // binary_op_node
+ti::valptr_t binary_op_node::apply(const ti::valptr_t &l, const ti::valptr_t &r) const {
+    if (!l || !r) throw std::runtime_error("binary op on null");
+    const ti::value_kind lk = l->kind();
+    const ti::value_kind rk = r->kind();
+    const unsigned seq = icSeq.load(std::memory_order_acquire);
+    if (!(seq & 1)) {
+        const size_t n = icCount.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < n && i < IC_SIZE; ++i) {
+            if (ic[i].left.load(std::memory_order_relaxed) != lk || ic[i].right.load(std::memory_order_relaxed) != rk) {
+                continue;
+            }
+            const ti::binary_kernel k = ic[i].kernel.load(std::memory_order_relaxed);
+            if (cacheReadValid(icSeq, seq)) return k(*l, *r);
+            break;
+        }
+    }
+    ti::binary_kernel k = ti::findKernel(op, lk, rk);
+    if (!k) throw std::runtime_error("invalid operand types: " + l->toString() + ", " + r->toString());
+    unsigned s;
+    if (beginCacheWrite(icSeq, s)) {
+        // once the site has seen more pairs than fit, keep the newest in the last slot
+        const size_t n = icCount.load(std::memory_order_relaxed);
+        ic_entry &e = ic[n < IC_SIZE ? n : IC_SIZE - 1];
+        e.left.store(lk, std::memory_order_relaxed);
+        e.right.store(rk, std::memory_order_relaxed);
+        e.kernel.store(k, std::memory_order_relaxed);
+        if (n < IC_SIZE) icCount.store(n + 1, std::memory_order_relaxed);
+        endCacheWrite(icSeq, s);
+    }
+    return k(*l, *r);
+}
+
 ti::valptr_t binary_op_node::eval(ti::runtime_env &env) {
     auto l = left->eval(env);
     auto r = right->eval(env);
-    if (!l || !r) throw std::runtime_error("binary op on null");
+    return ti::applyMode(apply(l, r), env.getMode());
+}
+
+std::vector<std::unique_ptr<exprnode>*> ast::children(exprnode &n) {
+    using exprptr = std::unique_ptr<exprnode>;
+    std::vector<exprptr*> out;
+    switch (n.kind()) {
+        case node_kind::Assign:
+            out.push_back(&static_cast<assign_node &>(n).rhs);
+            break;
+        case node_kind::Call: {
+            auto &c = static_cast<call_node &>(n);
+            out.push_back(&c.callee);
+            for (auto &a : c.args) out.push_back(&a);
+            break;
+        }
+        case node_kind::Block:
+            for (auto &s : static_cast<block_node &>(n).stmts) out.push_back(&s);
+            break;
+        case node_kind::If: {
+            auto &i = static_cast<if_node &>(n);
+            out.push_back(&i.cond);
+            out.push_back(&i.then_branch);
+            if (i.else_branch) out.push_back(&i.else_branch);
+            break;
+        }
+        case node_kind::For: {
+            auto &f = static_cast<for_node &>(n);
+            out.push_back(&f.start);
+            out.push_back(&f.end);
+            if (f.step) out.push_back(&f.step);
+            out.push_back(&f.body);
+            break;
+        }
+        case node_kind::While: {
+            auto &w = static_cast<while_node &>(n);
+            out.push_back(&w.cond);
+            out.push_back(&w.body);
+            break;
+        }
+        case node_kind::Let: {
+            auto &l = static_cast<let_node &>(n);
+            for (auto &t : l.temps) out.push_back(&t);
+            out.push_back(&l.body);
+            break;
+        }
+        case node_kind::BinaryOp: {
+            auto &b = static_cast<binary_op_node &>(n);
+            out.push_back(&b.left);
+            out.push_back(&b.right);
+            break;
+        }
+        case node_kind::Literal:
+        case node_kind::Var:
+        case node_kind::Local:
+        case node_kind::Temp:
+            break;
+    }
+    return out;
+}
+
+std::vector<std::unique_ptr<exprnode>*> ast::children(const exprnode &n) {
+    return children(const_cast<exprnode &>(n));
+}
+
+namespace {
+
+using let_map = std::unordered_map<const let_node*, const let_node*>;
+
+std::unique_ptr<exprnode> cloneNode(const exprnode &n, let_map &lets);
+
+std::unique_ptr<exprnode> cloneOpt(const std::unique_ptr<exprnode> &n, let_map &lets) {
+    return n ? cloneNode(*n, lets) : nullptr;
+}
+
+std::vector<std::unique_ptr<exprnode>> cloneAll(const std::vector<std::unique_ptr<exprnode>> &ns, let_map &lets) {
+    std::vector<std::unique_ptr<exprnode>> out;
+    out.reserve(ns.size());
+    for (auto &n : ns) out.push_back(cloneNode(*n, lets));
+    return out;
+}
+
+std::unique_ptr<exprnode> cloneNode(const exprnode &n, let_map &lets) {
+    switch (n.kind()) {
+        case node_kind::Literal:
+            return std::make_unique<literal_node>(static_cast<const literal_node &>(n).val);
+        case node_kind::Var:
+            return std::make_unique<var_node>(static_cast<const var_node &>(n).name);
+        case node_kind::Assign: {
+            auto &a = static_cast<const assign_node &>(n);
+            return std::make_unique<assign_node>(a.name, cloneNode(*a.rhs, lets));
+        }
+        case node_kind::Call: {
+            auto &c = static_cast<const call_node &>(n);
+            return std::make_unique<call_node>(cloneNode(*c.callee, lets), cloneAll(c.args, lets));
+        }
+        case node_kind::Local:
+            return std::make_unique<local_node>(static_cast<const local_node &>(n).names);
+        case node_kind::Block:
+            return std::make_unique<block_node>(cloneAll(static_cast<const block_node &>(n).stmts, lets));
+        case node_kind::If: {
+            auto &i = static_cast<const if_node &>(n);
+            return std::make_unique<if_node>(cloneNode(*i.cond, lets), cloneNode(*i.then_branch, lets),
+                                             cloneOpt(i.else_branch, lets));
+        }
+        case node_kind::For: {
+            auto &f = static_cast<const for_node &>(n);
+            return std::make_unique<for_node>(f.var, cloneNode(*f.start, lets), cloneNode(*f.end, lets),
+                                              cloneOpt(f.step, lets), cloneNode(*f.body, lets));
+        }
+        case node_kind::While: {
+            auto &w = static_cast<const while_node &>(n);
+            return std::make_unique<while_node>(cloneNode(*w.cond, lets), cloneNode(*w.body, lets));
+        }
+        case node_kind::Let: {
+            // register the copy before its children, whose temps refer to it
+            auto &l = static_cast<const let_node &>(n);
+            auto copy = std::make_unique<let_node>(std::vector<std::unique_ptr<exprnode>>(), nullptr);
+            lets[&l] = copy.get();
+            copy->temps = cloneAll(l.temps, lets);
+            copy->body = cloneNode(*l.body, lets);
+            return copy;
+        }
+        case node_kind::Temp: {
+            auto &t = static_cast<const temp_node &>(n);
+            auto it = lets.find(t.owner);
+            auto copy = std::make_unique<temp_node>(it == lets.end() ? t.owner : it->second, t.index);
+            copy->depth = t.depth;
+            return copy;
+        }
+        case node_kind::BinaryOp: {
+            auto &b = static_cast<const binary_op_node &>(n);
+            return std::make_unique<binary_op_node>(b.op, cloneNode(*b.left, lets), cloneNode(*b.right, lets));
+        }
+    }
+    throw std::runtime_error("clone: unknown node kind");
+}
+
+} // namespace
+
+std::unique_ptr<exprnode> ast::clone(const exprnode &n) {
+    let_map lets;
+    return cloneNode(n, lets);
+}
+
+const char* ast::opName(binary_op op) {
+    switch (op) {
+        case binary_op::Add: return "+";
+        case binary_op::Sub: return "-";
+        case binary_op::Mul: return "*";
+        case binary_op::Div: return "/";
+        case binary_op::Pow: return "^";
+        case binary_op::Eq: return "=";
+        case binary_op::Ne: return "/=";
+        case binary_op::Lt: return "<";
+        case binary_op::Le: return "<=";
+        case binary_op::Gt: return ">";
+        case binary_op::Ge: return ">=";
+    }
+    return "?";
+}
 
-    // naive runtime type handling: try numeric addition/subtraction on decimals/integers
-    // You should add proper visitor/variant logic in your value classes. Below is a minimal example.
-    // Assume you have a decimal/integer types that expose toString() and numeric getters.
-
-    // For demo: produce a string value of concatenated toStrings for Add
-    if (op == binary_op::Add) {
-        // create a string value containing concatenation (replace with numeric add)
-        return std::make_shared<ti::string>(l->toString() + r->toString());
-    } else {
-        // not implemented
-        throw std::runtime_error("binary op not implemented");
+void ast::dump(const exprnode &n, std::ostream &os, int indent) {
+    const std::string pad(indent * 2, ' ');
+    switch (n.kind()) {
+        case node_kind::Literal: {
+            auto &v = static_cast<const literal_node &>(n).val;
+            os << pad << "literal " << (v ? v->toString() : "<null>") << "\n";
+            break;
+        }
+        case node_kind::Var:
+            os << pad << "var " << static_cast<const var_node &>(n).name << "\n";
+            break;
+        case node_kind::Assign: {
+            auto &a = static_cast<const assign_node &>(n);
+            os << pad << "assign " << a.name << "\n";
+            dump(*a.rhs, os, indent + 1);
+            break;
+        }
+        case node_kind::Call: {
+            auto &c = static_cast<const call_node &>(n);
+            os << pad << "call\n";
+            dump(*c.callee, os, indent + 1);
+            for (auto &a : c.args) dump(*a, os, indent + 1);
+            break;
+        }
+        case node_kind::Local: {
+            os << pad << "local";
+            for (auto &name : static_cast<const local_node &>(n).names) os << " " << name;
+            os << "\n";
+            break;
+        }
+        case node_kind::Block:
+            os << pad << "block\n";
+            for (auto &s : static_cast<const block_node &>(n).stmts) dump(*s, os, indent + 1);
+            break;
+        case node_kind::If: {
+            auto &i = static_cast<const if_node &>(n);
+            os << pad << "if\n";
+            dump(*i.cond, os, indent + 1);
+            dump(*i.then_branch, os, indent + 1);
+            if (i.else_branch) dump(*i.else_branch, os, indent + 1);
+            break;
+        }
+        case node_kind::For: {
+            auto &f = static_cast<const for_node &>(n);
+            os << pad << "for " << f.var << "\n";
+            dump(*f.start, os, indent + 1);
+            dump(*f.end, os, indent + 1);
+            if (f.step) dump(*f.step, os, indent + 1);
+            dump(*f.body, os, indent + 1);
+            break;
+        }
+        case node_kind::While: {
+            auto &w = static_cast<const while_node &>(n);
+            os << pad << "while\n";
+            dump(*w.cond, os, indent + 1);
+            dump(*w.body, os, indent + 1);
+            break;
+        }
+        case node_kind::Let: {
+            auto &l = static_cast<const let_node &>(n);
+            os << pad << "let\n";
+            for (size_t i = 0; i < l.temps.size(); ++i) {
+                os << pad << "  $" << i << " :=\n";
+                dump(*l.temps[i], os, indent + 2);
+            }
+            dump(*l.body, os, indent + 1);
+            break;
+        }
+        case node_kind::Temp: {
+            auto &t = static_cast<const temp_node &>(n);
+            os << pad << "temp $" << t.index;
+            if (t.depth) os << " (depth " << t.depth << ")";
+            os << "\n";
+            break;
+        }
+        case node_kind::BinaryOp: {
+            auto &b = static_cast<const binary_op_node &>(n);
+            os << pad << "binop " << opName(b.op) << "\n";
+            dump(*b.left, os, indent + 1);
+            dump(*b.right, os, indent + 1);
+            break;
+        }
     }
 }
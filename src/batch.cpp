@@ -0,0 +1,537 @@
+#include "../include/batch.h"
+#include "../include/runtimeenv.h"
+#include "../include/arith.h"
+#include "../include/memo.h"
+#include "../include/threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TI_BATCH_AVX 1
+#include <immintrin.h>
+#endif
+
+namespace ti {
+
+using namespace ast;
+
+namespace {
+
+// elements per block: large enough to amortize dispatch, small enough that
+// a whole expression's intermediates stay in cache
+constexpr size_t CHUNK = 2048;
+// below this many elements a parallel split costs more than it saves
+constexpr size_t PARALLEL_MIN = 4 * CHUNK;
+
+bool isComparisonOp(binary_op op) {
+    return op == binary_op::Eq || op == binary_op::Ne || op == binary_op::Lt ||
+           op == binary_op::Le || op == binary_op::Gt || op == binary_op::Ge;
+}
+
+// --- kernels: out[i] = a[i*sa] op b[i*sb], where a stride of 0 broadcasts ---
+
+#define TI_BATCH_LOOP(EXPR) \
+    for (; i < n; ++i) { \
+        const double x = a[i * sa], y = b[i * sb]; \
+        out[i] = (EXPR); \
+    }
+
+void arithScalar(binary_op op, const double* a, size_t sa, const double* b, size_t sb, double* out, size_t n) {
+    size_t i = 0;
+    switch (op) {
+        case binary_op::Add: TI_BATCH_LOOP(x + y) break;
+        case binary_op::Sub: TI_BATCH_LOOP(x - y) break;
+        case binary_op::Mul: TI_BATCH_LOOP(x * y) break;
+        case binary_op::Div: TI_BATCH_LOOP(x / y) break;
+        case binary_op::Pow: TI_BATCH_LOOP(std::pow(x, y)) break;
+        default: throw std::logic_error("batch: not an arithmetic operator");
+    }
+}
+
+void compareScalar(binary_op op, const double* a, size_t sa, const double* b, size_t sb, unsigned char* out, size_t n) {
+    size_t i = 0;
+    switch (op) {
+        case binary_op::Eq: TI_BATCH_LOOP(x == y) break;
+        case binary_op::Ne: TI_BATCH_LOOP(x != y) break;
+        case binary_op::Lt: TI_BATCH_LOOP(x < y) break;
+        case binary_op::Le: TI_BATCH_LOOP(x <= y) break;
+        case binary_op::Gt: TI_BATCH_LOOP(x > y) break;
+        case binary_op::Ge: TI_BATCH_LOOP(x >= y) break;
+        default: throw std::logic_error("batch: not a comparison");
+    }
+}
+
+#ifdef TI_BATCH_AVX
+
+#define TI_LOAD(p, s, i) ((s) ? _mm256_loadu_pd((p) + (i)) : _mm256_set1_pd(*(p)))
+#define TI_AVX_ARITH(INSN) \
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, INSN(TI_LOAD(a, sa, i), TI_LOAD(b, sb, i)))
+#define TI_AVX_CMP(PRED) \
+    for (; i + 4 <= n; i += 4) { \
+        const int bits = _mm256_movemask_pd(_mm256_cmp_pd(TI_LOAD(a, sa, i), TI_LOAD(b, sb, i), PRED)); \
+        out[i] = bits & 1; \
+        out[i + 1] = (bits >> 1) & 1; \
+        out[i + 2] = (bits >> 2) & 1; \
+        out[i + 3] = (bits >> 3) & 1; \
+    }
+
+// both return how many leading elements they handled
+__attribute__((target("avx")))
+size_t arithAvx(binary_op op, const double* a, size_t sa, const double* b, size_t sb, double* out, size_t n) {
+    size_t i = 0;
+    switch (op) {
+        case binary_op::Add: TI_AVX_ARITH(_mm256_add_pd); break;
+        case binary_op::Sub: TI_AVX_ARITH(_mm256_sub_pd); break;
+        case binary_op::Mul: TI_AVX_ARITH(_mm256_mul_pd); break;
+        case binary_op::Div: TI_AVX_ARITH(_mm256_div_pd); break;
+        default: break; // pow has no vector instruction
+    }
+    return i;
+}
+
+// ordered predicates, except Ne which (like the interpreter) holds for NaN
+__attribute__((target("avx")))
+size_t compareAvx(binary_op op, const double* a, size_t sa, const double* b, size_t sb, unsigned char* out, size_t n) {
+    size_t i = 0;
+    switch (op) {
+        case binary_op::Eq: TI_AVX_CMP(_CMP_EQ_OQ); break;
+        case binary_op::Ne: TI_AVX_CMP(_CMP_NEQ_UQ); break;
+        case binary_op::Lt: TI_AVX_CMP(_CMP_LT_OQ); break;
+        case binary_op::Le: TI_AVX_CMP(_CMP_LE_OQ); break;
+        case binary_op::Gt: TI_AVX_CMP(_CMP_GT_OQ); break;
+        case binary_op::Ge: TI_AVX_CMP(_CMP_GE_OQ); break;
+        default: break;
+    }
+    return i;
+}
+
+bool haveAvx() {
+    static const bool has = __builtin_cpu_supports("avx");
+    return has;
+}
+
+#endif // TI_BATCH_AVX
+
+void arith(binary_op op, const double* a, size_t sa, const double* b, size_t sb, double* out, size_t n) {
+    size_t done = 0;
+#ifdef TI_BATCH_AVX
+    if (haveAvx()) done = arithAvx(op, a, sa, b, sb, out, n);
+#endif
+    arithScalar(op, a + done * sa, sa, b + done * sb, sb, out + done, n - done);
+}
+
+void compare(binary_op op, const double* a, size_t sa, const double* b, size_t sb, unsigned char* out, size_t n) {
+    size_t done = 0;
+#ifdef TI_BATCH_AVX
+    if (haveAvx()) done = compareAvx(op, a, sa, b, sb, out, n);
+#endif
+    compareScalar(op, a + done * sa, sa, b + done * sb, sb, out + done, n - done);
+}
+
+// one value per element of the block
+struct column {
+    enum class form {
+        Const, // the same value everywhere, possibly exact
+        Num,   // a decimal everywhere
+        Boxed, // anything
+    };
+    form f = form::Const;
+    valptr_t constant;
+    std::vector<double> num;
+    std::vector<valptr_t> boxed;
+
+    static column of(const valptr_t &v) {
+        column c;
+        c.constant = v;
+        return c;
+    }
+
+    valptr_t at(size_t i) const {
+        switch (f) {
+            case form::Const: return constant;
+            case form::Num: return std::make_shared<decimal>(num[i]);
+            default: return boxed[i];
+        }
+    }
+
+    // a Num column, or a constant an operator would read through toDouble
+    bool numeric() const {
+        return f == form::Num || (f == form::Const && constant && isNumeric(constant->kind()));
+    }
+
+    // unbox when every element turned out to be a decimal
+    void normalize() {
+        if (f != form::Boxed) return;
+        for (const auto &v : boxed) {
+            if (!v || v->kind() != value_kind::Decimal) return;
+        }
+        num.resize(boxed.size());
+        for (size_t i = 0; i < boxed.size(); ++i) num[i] = static_cast<const decimal &>(*boxed[i]).getValue();
+        boxed.clear();
+        f = form::Num;
+    }
+
+    column gather(const std::vector<size_t> &idx) const {
+        column c;
+        c.f = f;
+        c.constant = constant;
+        if (f == form::Num) {
+            c.num.reserve(idx.size());
+            for (size_t i : idx) c.num.push_back(num[i]);
+        } else if (f == form::Boxed) {
+            c.boxed.reserve(idx.size());
+            for (size_t i : idx) c.boxed.push_back(boxed[i]);
+        }
+        return c;
+    }
+};
+
+// a numeric column as a pointer and stride for the kernels
+struct operand {
+    double scalar = 0;
+    const double* data = nullptr;
+    size_t stride = 1;
+
+    explicit operand(const column &c) {
+        if (c.f == column::form::Num) {
+            data = c.num.data();
+        } else {
+            scalar = toDouble(*c.constant);
+            data = &scalar;
+            stride = 0;
+        }
+    }
+    operand(const operand&) = delete;
+};
+
+// variables and temps visible to a block
+struct scope {
+    size_t n = 0;
+    std::unordered_map<std::string, column> vars; // the batch variable, or an inlined function's parameters
+    std::map<std::pair<const let_node*, size_t>, column> temps;
+
+    scope subset(const std::vector<size_t> &idx) const {
+        scope s;
+        s.n = idx.size();
+        for (const auto &[name, c] : vars) s.vars.emplace(name, c.gather(idx));
+        for (const auto &[key, c] : temps) s.temps.emplace(key, c.gather(idx));
+        return s;
+    }
+};
+
+} // namespace
+
+struct batch_runner {
+    batch_evaluator &be;
+    runtime_env &env;
+
+    explicit batch_runner(batch_evaluator &be) : be(be), env(be.env) {}
+
+    // --- static analysis ---
+
+    bool supported(const exprnode &n, const std::vector<std::string>* params) {
+        switch (n.kind()) {
+            case node_kind::Literal:
+            case node_kind::Temp:
+                return true;
+            case node_kind::Var:
+                return !params || std::find(params->begin(), params->end(),
+                                            static_cast<const var_node &>(n).name) != params->end();
+            case node_kind::BinaryOp:
+            case node_kind::If:
+            case node_kind::Let:
+                break;
+            case node_kind::Call: {
+                auto &c = static_cast<const call_node &>(n);
+                if (c.callee->kind() != node_kind::Var) return false;
+                function* fn = env.getFunction(static_cast<const var_node &>(*c.callee).name);
+                // results are computed out of order, so calls must be pure
+                if (!fn || fn->formImpl || !isPureFunction(*fn, env)) return false;
+                for (const auto &a : c.args) {
+                    if (!supported(*a, params)) return false;
+                }
+                // a user function that is not inlined runs on the env's
+                // call stack, which only one thread may use
+                if (!fn->isBuiltin && (c.args.size() != fn->params.size() || !isInlinable(*fn))) {
+                    be.threadSafe = false;
+                }
+                return true;
+            }
+            default:
+                return false; // statements and loops
+        }
+        for (auto* c : children(n)) {
+            if (!supported(**c, params)) return false;
+        }
+        return true;
+    }
+
+    bool isInlinable(const function &fn) {
+        auto it = be.inlinable.find(&fn);
+        if (it != be.inlinable.end()) return it->second;
+        // recursive functions are called per element, not inlined
+        be.inlinable[&fn] = false;
+        const exprnode* body = dynamic_cast<const exprnode*>(fn.body.get());
+        bool ok = body && supported(*body, &fn.params);
+        be.inlinable[&fn] = ok;
+        return ok;
+    }
+
+    // --- evaluation ---
+
+    column binary(binary_op op, const column &l, const column &r, size_t n) {
+        using form = column::form;
+        if (l.f == form::Const && r.f == form::Const) {
+            return column::of(applyMode(applyBinary(op, l.constant, r.constant), env.getMode()));
+        }
+        column res;
+        if (!l.numeric() || !r.numeric()) {
+            res.f = form::Boxed;
+            res.boxed.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                res.boxed[i] = applyMode(applyBinary(op, l.at(i), r.at(i)), env.getMode());
+            }
+            res.normalize();
+            return res;
+        }
+        operand a(l), b(r);
+        if (isComparisonOp(op)) {
+            std::vector<unsigned char> m(n);
+            compare(op, a.data, a.stride, b.data, b.stride, m.data(), n);
+            res.f = form::Boxed;
+            res.boxed.resize(n);
+            for (size_t i = 0; i < n; ++i) res.boxed[i] = std::make_shared<boolean>(m[i] != 0);
+            return res;
+        }
+        if (op == binary_op::Div) {
+            const size_t count = b.stride ? n : std::min<size_t>(n, 1);
+            for (size_t i = 0; i < count; ++i) {
+                if (b.data[i] == 0.0) throw std::domain_error("division by zero");
+            }
+        }
+        res.f = form::Num;
+        res.num.resize(n);
+        arith(op, a.data, a.stride, b.data, b.stride, res.num.data(), n);
+        return res;
+    }
+
+    // 1/0 when the condition is the same for the whole block, else -1 with
+    // one flag per element in m
+    int cond(const exprnode &n, scope &s, std::vector<unsigned char> &m) {
+        if (n.kind() == node_kind::BinaryOp && isComparisonOp(static_cast<const binary_op_node &>(n).op)) {
+            auto &b = static_cast<const binary_op_node &>(n);
+            column l = eval(*b.left, s);
+            column r = eval(*b.right, s);
+            if (l.f == column::form::Const && r.f == column::form::Const) {
+                return isTrue(applyBinary(b.op, l.constant, r.constant)) ? 1 : 0;
+            }
+            m.resize(s.n);
+            if (l.numeric() && r.numeric()) {
+                operand x(l), y(r);
+                compare(b.op, x.data, x.stride, y.data, y.stride, m.data(), s.n);
+            } else {
+                for (size_t i = 0; i < s.n; ++i) m[i] = isTrue(applyBinary(b.op, l.at(i), r.at(i)));
+            }
+            return -1;
+        }
+        column c = eval(n, s);
+        if (c.f == column::form::Const) return isTrue(c.constant) ? 1 : 0;
+        m.resize(s.n);
+        for (size_t i = 0; i < s.n; ++i) m[i] = isTrue(c.at(i)); // throws for numbers
+        return -1;
+    }
+
+    column evalIf(const if_node &n, scope &s) {
+        std::vector<unsigned char> m;
+        const int c = cond(*n.cond, s, m);
+        auto otherwise = [&](scope &sub) {
+            return n.else_branch ? eval(*n.else_branch, sub) : column::of(none);
+        };
+        if (c == 1) return eval(*n.then_branch, s);
+        if (c == 0) return otherwise(s);
+
+        std::vector<size_t> yes, no;
+        for (size_t i = 0; i < s.n; ++i) (m[i] ? yes : no).push_back(i);
+        if (no.empty()) return eval(*n.then_branch, s);
+        if (yes.empty()) return otherwise(s);
+
+        // each branch runs only on its own elements, as the interpreter would
+        scope ys = s.subset(yes);
+        column t = eval(*n.then_branch, ys);
+        scope ns = s.subset(no);
+        column e = otherwise(ns);
+
+        column res;
+        if (t.f == column::form::Num && e.f == column::form::Num) {
+            res.f = column::form::Num;
+            res.num.resize(s.n);
+            for (size_t i = 0; i < yes.size(); ++i) res.num[yes[i]] = t.num[i];
+            for (size_t i = 0; i < no.size(); ++i) res.num[no[i]] = e.num[i];
+        } else {
+            res.f = column::form::Boxed;
+            res.boxed.resize(s.n);
+            for (size_t i = 0; i < yes.size(); ++i) res.boxed[yes[i]] = t.at(i);
+            for (size_t i = 0; i < no.size(); ++i) res.boxed[no[i]] = e.at(i);
+        }
+        return res;
+    }
+
+    column evalCall(const call_node &c, scope &s) {
+        // a plain lookup: the call site's inline cache is not thread-safe
+        function* fn = env.getFunction(static_cast<const var_node &>(*c.callee).name);
+        std::vector<column> args;
+        args.reserve(c.args.size());
+        bool allConst = true;
+        for (const auto &a : c.args) {
+            args.push_back(eval(*a, s));
+            allConst = allConst && args.back().f == column::form::Const;
+        }
+
+        if (!fn->isBuiltin && args.size() == fn->params.size() && isInlinable(*fn)) {
+            scope inner;
+            inner.n = s.n;
+            for (size_t k = 0; k < args.size(); ++k) inner.vars[fn->params[k]] = std::move(args[k]);
+            return eval(static_cast<const exprnode &>(*fn->body), inner);
+        }
+        std::vector<valptr_t> vals(args.size());
+        if (allConst) {
+            // pure, so once stands for every element
+            for (size_t k = 0; k < args.size(); ++k) vals[k] = args[k].constant;
+            return column::of(env.callFunction(*fn, vals));
+        }
+        if (fn->isBuiltin && fn->numericImpl && args.size() == 1 && args[0].f == column::form::Num) {
+            column res;
+            res.f = column::form::Num;
+            res.num.resize(s.n);
+            for (size_t i = 0; i < s.n; ++i) res.num[i] = fn->numericImpl(args[0].num[i]);
+            return res;
+        }
+
+        column res;
+        res.f = column::form::Boxed;
+        res.boxed.resize(s.n);
+        for (size_t i = 0; i < s.n; ++i) {
+            for (size_t k = 0; k < args.size(); ++k) vals[k] = args[k].at(i);
+            res.boxed[i] = env.callFunction(*fn, vals);
+        }
+        res.normalize();
+        return res;
+    }
+
+    column eval(const exprnode &n, scope &s) {
+        switch (n.kind()) {
+            case node_kind::Literal:
+                return column::of(static_cast<const literal_node &>(n).val);
+            case node_kind::Var: {
+                auto &name = static_cast<const var_node &>(n).name;
+                auto it = s.vars.find(name);
+                if (it != s.vars.end()) return it->second;
+                return column::of(env.getVariable(name));
+            }
+            case node_kind::BinaryOp: {
+                auto &b = static_cast<const binary_op_node &>(n);
+                column l = eval(*b.left, s);
+                column r = eval(*b.right, s);
+                return binary(b.op, l, r, s.n);
+            }
+            case node_kind::If:
+                return evalIf(static_cast<const if_node &>(n), s);
+            case node_kind::Let: {
+                auto &l = static_cast<const let_node &>(n);
+                column res = eval(*l.body, s);
+                for (size_t i = 0; i < l.temps.size(); ++i) s.temps.erase({&l, i});
+                return res;
+            }
+            case node_kind::Temp: {
+                // lazy, like the interpreter: computed on first use in this block
+                auto &t = static_cast<const temp_node &>(n);
+                auto it = s.temps.find({t.owner, t.index});
+                if (it != s.temps.end()) return it->second;
+                column c = eval(*t.owner->temps[t.index], s);
+                s.temps[{t.owner, t.index}] = c;
+                return c;
+            }
+            case node_kind::Call:
+                return evalCall(static_cast<const call_node &>(n), s);
+            default:
+                throw std::logic_error("batch: unsupported node");
+        }
+    }
+
+    // elements [start, start + n) of every variable's column
+    column block(const std::vector<const double*> &cols, size_t start, size_t n) {
+        scope s;
+        s.n = n;
+        for (size_t k = 0; k < be.vars.size(); ++k) {
+            column x;
+            x.f = column::form::Num;
+            x.num.assign(cols[k] + start, cols[k] + start + n);
+            s.vars.emplace(be.vars[k], std::move(x));
+        }
+        return eval(be.expr, s);
+    }
+
+    // evaluates every block, on the shared pool when the expression allows
+    // it, and hands each result to emit(start, column)
+    template <typename Emit>
+    static void forEachBlock(batch_evaluator &be, const std::vector<const double*> &cols, size_t n, Emit emit) {
+        if (!be.ok) throw std::logic_error("batch: expression not supported");
+        if (cols.size() != be.vars.size()) throw std::logic_error("batch: one column per variable expected");
+        auto blocks = [&](size_t begin, size_t end) {
+            batch_runner run(be);
+            for (size_t start = begin; start < end; start += CHUNK) {
+                const size_t len = std::min(CHUNK, end - start);
+                column c = run.block(cols, start, len);
+                emit(start, len, c);
+            }
+        };
+        // blocks are independent and each writes only its own outputs
+        if (be.threadSafe && n >= PARALLEL_MIN) parallelFor(n, CHUNK, blocks);
+        else blocks(0, n);
+    }
+};
+
+batch_evaluator::batch_evaluator(const ast::exprnode &expr, std::string var, runtime_env &env)
+    : batch_evaluator(expr, std::vector<std::string>{std::move(var)}, env) {}
+
+batch_evaluator::batch_evaluator(const ast::exprnode &expr, std::vector<std::string> vars, runtime_env &env)
+    : expr(expr), vars(std::move(vars)), env(env) {
+    // fills `inlinable` for every reachable function, so evaluation only reads it
+    ok = batch_runner(*this).supported(expr, nullptr);
+    threadSafe = threadSafe && ok;
+}
+
+std::vector<valptr_t> batch_evaluator::eval(const double* xs, size_t n) {
+    return eval(std::vector<const double*>{xs}, n);
+}
+
+std::vector<valptr_t> batch_evaluator::eval(const std::vector<const double*> &cols, size_t n) {
+    std::vector<valptr_t> out(n);
+    batch_runner::forEachBlock(*this, cols, n, [&out](size_t start, size_t len, const column &c) {
+        for (size_t i = 0; i < len; ++i) out[start + i] = c.at(i);
+    });
+    return out;
+}
+
+bool batch_evaluator::evalNumeric(const double* xs, size_t n, double* out) {
+    return evalNumeric(std::vector<const double*>{xs}, n, out);
+}
+
+bool batch_evaluator::evalNumeric(const std::vector<const double*> &cols, size_t n, double* out) {
+    std::atomic<bool> numeric{true};
+    batch_runner::forEachBlock(*this, cols, n, [&](size_t start, size_t len, const column &c) {
+        if (c.f == column::form::Num) {
+            std::copy(c.num.begin(), c.num.end(), out + start);
+        } else if (c.f == column::form::Const && c.constant && c.constant->kind() == value_kind::Decimal) {
+            std::fill(out + start, out + start + len, toDouble(*c.constant));
+        } else {
+            numeric = false;
+        }
+    });
+    return numeric;
+}
+
+} // namespace ti
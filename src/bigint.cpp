@@ -1,4 +1,5 @@
 #include "../include/bigint.h"
+#include "../include/budget.h"
 
 // Constructors
 BigInt::BigInt() : is_negative(false) {
@@ -55,10 +56,11 @@ BigInt::BigInt(const std::string& str) : is_negative(false) {
     size_t total_digits = str.size() - start;
     digits.reserve((total_digits + BASE_DIGITS - 1) / BASE_DIGITS);
     
-    for (size_t i = str.size(); i > start; i -= BASE_DIGITS) {
-        int chunk_start = std::max(static_cast<int>(start), static_cast<int>(i) - BASE_DIGITS);
+    for (size_t i = str.size(); i > start;) {
+        size_t chunk_start = (i - start > static_cast<size_t>(BASE_DIGITS)) ? i - BASE_DIGITS : start;
         std::string chunk = str.substr(chunk_start, i - chunk_start);
         digits.push_back(std::stoi(chunk));
+        i = chunk_start;
     }
     
     normalize();
@@ -185,25 +187,310 @@ BigInt BigInt::operator-(const BigInt& other) const {
     return result;
 }
 
+namespace {
+
+// below this many limbs in the shorter operand, schoolbook beats Karatsuba
+constexpr size_t KARATSUBA_MIN = 64;
+// schoolbook rows at least this long check for cancellation (ti::checkpoint)
+// once per block of rows
+constexpr size_t CHECKPOINT_LIMBS = 4096;
+// long division checks once per this many quotient limbs
+constexpr size_t DIVIDE_CHECKPOINT = 64;
+
+// r[off..] += x, where r has room for the carry
+void addLimbs(std::vector<int>& r, size_t off, const std::vector<int>& x) {
+    long long carry = 0;
+    size_t i = 0;
+    for (; i < x.size() || carry; ++i) {
+        long long sum = r[off + i] + carry + (i < x.size() ? x[i] : 0);
+        carry = sum >= 1000000000 ? 1 : 0;
+        r[off + i] = static_cast<int>(sum - carry * 1000000000);
+    }
+}
+
+// r -= x, where r >= x
+void subLimbs(std::vector<int>& r, const std::vector<int>& x) {
+    int borrow = 0;
+    for (size_t i = 0; i < x.size() || borrow; ++i) {
+        int diff = r[i] - borrow - (i < x.size() ? x[i] : 0);
+        borrow = diff < 0 ? 1 : 0;
+        r[i] = diff + borrow * 1000000000;
+    }
+}
+
+std::vector<int> sumLimbs(const int* a, size_t n, const int* b, size_t m) {
+    std::vector<int> r(std::max(n, m) + 1, 0);
+    std::copy(a, a + n, r.begin());
+    addLimbs(r, 0, std::vector<int>(b, b + m));
+    return r;
+}
+
+} // namespace
+
+std::vector<int> BigInt::multiply_magnitudes(const int* a, size_t n, const int* b, size_t m) {
+    if (n < m) {
+        std::swap(a, b);
+        std::swap(n, m);
+    }
+    std::vector<int> result(n + m, 0);
+    if (m < KARATSUBA_MIN) {
+        // limb products are below 10^18, so sixteen of them fit in 64 bits
+        // on top of a normalized limb: carries are propagated once per
+        // sixteen rows instead of after every product
+        std::vector<unsigned long long> acc(n + m, 0);
+        for (size_t block = 0; block < m; block += 16) {
+            if (n >= CHECKPOINT_LIMBS) ti::checkpoint();
+            const size_t end = std::min(m, block + 16);
+            for (size_t i = block; i < end; ++i) {
+                const unsigned long long bi = static_cast<unsigned>(b[i]);
+                unsigned long long* row = acc.data() + i;
+                for (size_t j = 0; j < n; ++j) row[j] += bi * static_cast<unsigned>(a[j]);
+            }
+            unsigned long long carry = 0;
+            for (size_t t = block; t < n + m && (t < end + n || carry); ++t) {
+                acc[t] += carry;
+                carry = acc[t] / BASE;
+                acc[t] %= BASE;
+            }
+        }
+        std::copy(acc.begin(), acc.end(), result.begin());
+        return result;
+    }
+    if (n >= 2 * m) {
+        // unbalanced: m x m products of consecutive slices of a
+        for (size_t off = 0; off < n; off += m) {
+            std::vector<int> part = multiply_magnitudes(a + off, std::min(m, n - off), b, m);
+            while (part.size() > 1 && part.back() == 0) part.pop_back();
+            addLimbs(result, off, part);
+        }
+        return result;
+    }
+    // a = a0 + a1 B^k, b = b0 + b1 B^k, with k < m <= n
+    ti::checkpoint();
+    const size_t k = n / 2;
+    std::vector<int> z0 = multiply_magnitudes(a, k, b, k);
+    std::vector<int> z2 = multiply_magnitudes(a + k, n - k, b + k, m - k);
+    std::vector<int> sa = sumLimbs(a, k, a + k, n - k);
+    std::vector<int> sb = sumLimbs(b, k, b + k, m - k);
+    std::vector<int> z1 = multiply_magnitudes(sa.data(), sa.size(), sb.data(), sb.size());
+    subLimbs(z1, z0);
+    subLimbs(z1, z2);
+    while (z1.size() > 1 && z1.back() == 0) z1.pop_back();
+    while (z2.size() > 1 && z2.back() == 0) z2.pop_back();
+    std::copy(z0.begin(), z0.end(), result.begin());
+    addLimbs(result, 2 * k, z2);
+    addLimbs(result, k, z1);
+    return result;
+}
+
 BigInt BigInt::operator*(const BigInt& other) const {
     BigInt result;
     result.is_negative = is_negative != other.is_negative;
-    result.digits.resize(digits.size() + other.digits.size(), 0);
-    
-    for (size_t i = 0; i < digits.size(); ++i) {
-        long long carry = 0;
-        for (size_t j = 0; j < other.digits.size() || carry > 0; ++j) {
-            long long product = result.digits[i + j] + carry + 
-                               digits[i] * (j < other.digits.size() ? other.digits[j] : 0);
-            result.digits[i + j] = product % BASE;
-            carry = product / BASE;
-        }
+    result.digits = multiply_magnitudes(digits.data(), digits.size(), other.digits.data(), other.digits.size());
+    result.normalize();
+    return result;
+}
+
+BigInt BigInt::shift_limbs(long long k) const {
+    if (k == 0 || is_zero()) return *this;
+    BigInt result;
+    if (k > 0) {
+        result.digits.assign(static_cast<size_t>(k), 0);
+        result.digits.insert(result.digits.end(), digits.begin(), digits.end());
+    } else {
+        const size_t drop = static_cast<size_t>(-k);
+        if (drop >= digits.size()) return result;
+        result.digits.assign(digits.begin() + static_cast<std::ptrdiff_t>(drop), digits.end());
     }
-    
+    result.is_negative = is_negative;
     result.normalize();
     return result;
 }
 
+namespace {
+
+// below this many limbs, reciprocals are computed by long division
+constexpr size_t NEWTON_BASE_LIMBS = 64;
+// divisor and quotient size from which Newton division beats algorithm D
+constexpr size_t NEWTON_DIV_MIN = 2000;
+
+} // namespace
+
+BigInt BigInt::newton_reciprocal(const BigInt& b, size_t k) {
+    const long long kk = static_cast<long long>(k);
+    const BigInt top = b.shift_limbs(kk - static_cast<long long>(b.digits.size()));
+    const BigInt one = BigInt(1).shift_limbs(2 * kk);
+    if (k <= NEWTON_BASE_LIMBS) return one / top;
+    // y' = y + y (1 - top y), from a reciprocal good to about half the limbs
+    const size_t h = k / 2 + 1;
+    const BigInt y = newton_reciprocal(b, h).shift_limbs(kk - static_cast<long long>(h));
+    return y + (y * (one - top * y)).shift_limbs(-2 * kk);
+}
+
+// Truncating division (quotient rounds toward zero, remainder takes the
+// sign of the dividend). Multi-limb divisors use Knuth's algorithm D, or
+// when divisor and quotient are both large, a multiplication by a Newton
+// reciprocal corrected with the remainder.
+void BigInt::divide(const BigInt& a, const BigInt& b, BigInt& quotient, BigInt& remainder) {
+    if (b.is_zero()) {
+        throw std::domain_error("BigInt division by zero");
+    }
+    if (a.compare_magnitude(b) < 0) {
+        quotient = BigInt();
+        remainder = a;
+        return;
+    }
+
+    const size_t n = b.digits.size();
+    const size_t m = a.digits.size() - n;
+    if (n >= NEWTON_DIV_MIN && m >= NEWTON_DIV_MIN) {
+        const BigInt ua = a.abs(), ub = b.abs();
+        // the quotient has m or m + 1 limbs; one more guards the estimate
+        const size_t k = m + 2;
+        BigInt q = (ua * newton_reciprocal(ub, k)).shift_limbs(-static_cast<long long>(k + n));
+        BigInt r = ua - q * ub;
+        while (r.is_negative) {
+            q -= BigInt(1);
+            r += ub;
+        }
+        while (r.compare_magnitude(ub) >= 0) {
+            q += BigInt(1);
+            r -= ub;
+        }
+        q.is_negative = a.is_negative != b.is_negative;
+        q.normalize();
+        r.is_negative = a.is_negative;
+        r.normalize();
+        quotient = q;
+        remainder = r;
+        return;
+    }
+    BigInt q;
+    q.digits.assign(m + 1, 0);
+
+    if (n == 1) {
+        long long v = b.digits[0];
+        long long rem = 0;
+        for (size_t i = a.digits.size(); i-- > 0;) {
+            rem = rem * BASE + a.digits[i];
+            q.digits[i] = static_cast<int>(rem / v);
+            rem %= v;
+        }
+        remainder = BigInt(rem);
+    } else {
+        // normalize so the top divisor limb is at least BASE / 2
+        long long d = BASE / (static_cast<long long>(b.digits[n - 1]) + 1);
+        std::vector<long long> u(a.digits.size() + 1, 0), v(n, 0);
+        long long carry = 0;
+        for (size_t i = 0; i < a.digits.size(); ++i) {
+            long long cur = a.digits[i] * d + carry;
+            u[i] = cur % BASE;
+            carry = cur / BASE;
+        }
+        u[a.digits.size()] = carry;
+        carry = 0;
+        for (size_t i = 0; i < n; ++i) {
+            long long cur = b.digits[i] * d + carry;
+            v[i] = cur % BASE;
+            carry = cur / BASE;
+        }
+
+        for (size_t j = m + 1; j-- > 0;) {
+            if (j % DIVIDE_CHECKPOINT == 0) ti::checkpoint();
+            long long num = u[j + n] * BASE + u[j + n - 1];
+            long long qhat = num / v[n - 1];
+            long long rhat = num % v[n - 1];
+            while (qhat >= BASE || qhat * v[n - 2] > rhat * BASE + u[j + n - 2]) {
+                --qhat;
+                rhat += v[n - 1];
+                if (rhat >= BASE) break;
+            }
+
+            // u[j..j+n] -= qhat * v
+            long long borrow = 0;
+            carry = 0;
+            for (size_t i = 0; i < n; ++i) {
+                long long p = qhat * v[i] + carry;
+                carry = p / BASE;
+                long long t = u[i + j] - p % BASE - borrow;
+                borrow = t < 0 ? 1 : 0;
+                u[i + j] = t + borrow * BASE;
+            }
+            long long t = u[j + n] - carry - borrow;
+            u[j + n] = t;
+
+            if (t < 0) {
+                // qhat was one too large: add the divisor back
+                --qhat;
+                carry = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    long long sum = u[i + j] + v[i] + carry;
+                    u[i + j] = sum % BASE;
+                    carry = sum / BASE;
+                }
+                u[j + n] += carry;
+            }
+            q.digits[j] = static_cast<int>(qhat);
+        }
+
+        // un-normalize the remainder
+        BigInt r;
+        r.digits.assign(n, 0);
+        long long rem = 0;
+        for (size_t i = n; i-- > 0;) {
+            rem = rem * BASE + u[i];
+            r.digits[i] = static_cast<int>(rem / d);
+            rem %= d;
+        }
+        r.normalize();
+        remainder = r;
+    }
+
+    q.is_negative = a.is_negative != b.is_negative;
+    q.normalize();
+    quotient = q;
+    remainder.is_negative = a.is_negative;
+    remainder.normalize();
+}
+
+BigInt BigInt::operator/(const BigInt& other) const {
+    BigInt q, r;
+    divide(*this, other, q, r);
+    return q;
+}
+
+BigInt BigInt::operator%(const BigInt& other) const {
+    BigInt q, r;
+    divide(*this, other, q, r);
+    return r;
+}
+
+// Compound assignment operators
+BigInt& BigInt::operator+=(const BigInt& other) {
+    *this = *this + other;
+    return *this;
+}
+
+BigInt& BigInt::operator-=(const BigInt& other) {
+    *this = *this - other;
+    return *this;
+}
+
+BigInt& BigInt::operator*=(const BigInt& other) {
+    *this = *this * other;
+    return *this;
+}
+
+BigInt& BigInt::operator/=(const BigInt& other) {
+    *this = *this / other;
+    return *this;
+}
+
+BigInt& BigInt::operator%=(const BigInt& other) {
+    *this = *this % other;
+    return *this;
+}
+
 // Comparison operators
 bool BigInt::operator==(const BigInt& other) const {
     return is_negative == other.is_negative && digits == other.digits;
@@ -279,12 +566,132 @@ bool BigInt::is_zero() const {
     return digits.size() == 1 && digits[0] == 0;
 }
 
+int BigInt::sign() const {
+    if (is_zero()) return 0;
+    return is_negative ? -1 : 1;
+}
+
+double BigInt::to_double() const {
+    double result = 0.0;
+    for (size_t i = digits.size(); i-- > 0;) {
+        result = result * BASE + digits[i];
+    }
+    return is_negative ? -result : result;
+}
+
 BigInt BigInt::abs() const {
     BigInt result(*this);
     result.is_negative = false;
     return result;
 }
 
+BigInt BigInt::kronecker_pack(const std::vector<BigInt>& coeffs, size_t slot) {
+    // positive and negative coefficients go to separate numbers by placing
+    // their limbs, so the only arithmetic is one subtraction
+    BigInt pos, neg;
+    pos.digits.assign(coeffs.size() * slot + 1, 0);
+    neg.digits.assign(coeffs.size() * slot + 1, 0);
+    for (size_t i = 0; i < coeffs.size(); ++i) {
+        const BigInt& c = coeffs[i];
+        if (c.is_zero()) continue;
+        if (c.digits.size() > slot) throw std::overflow_error("kronecker_pack: coefficient exceeds its slot");
+        std::copy(c.digits.begin(), c.digits.end(), (c.is_negative ? neg : pos).digits.begin() + i * slot);
+    }
+    pos.normalize();
+    neg.normalize();
+    return pos - neg;
+}
+
+std::vector<BigInt> BigInt::kronecker_unpack(const BigInt& packed, size_t slot, size_t count) {
+    std::vector<BigInt> out(count);
+    const std::vector<int>& d = packed.digits;
+    BigInt full; // 10^(9*slot)
+    full.digits.assign(slot + 1, 0);
+    full.digits[slot] = 1;
+    int carry = 0;
+    for (size_t i = 0; i < count; ++i) {
+        BigInt c;
+        c.digits.assign(slot, 0);
+        for (size_t j = 0; j < slot && i * slot + j < d.size(); ++j) c.digits[j] = d[i * slot + j];
+        // add the borrow owed by the previous digit; a full slot wraps to 0
+        for (size_t j = 0; j < slot && carry; ++j) {
+            if (++c.digits[j] == BASE) c.digits[j] = 0;
+            else carry = 0;
+        }
+        // the top half of a slot stands for a negative digit
+        if (!carry && c.digits[slot - 1] >= BASE / 2) {
+            c.normalize();
+            c = c - full;
+            carry = 1;
+        } else {
+            c.normalize();
+        }
+        out[i] = packed.is_negative ? -c : c;
+    }
+    return out;
+}
+
+namespace {
+// GCC's 128-bit integer holds a full word product
+__extension__ typedef unsigned __int128 u128;
+}
+
+std::vector<uint64_t> BigInt::to_words() const {
+    // Horner's rule from the top limb: words = words * BASE + limb
+    std::vector<uint64_t> words(1, 0);
+    for (size_t i = digits.size(); i-- > 0;) {
+        u128 carry = static_cast<uint64_t>(digits[i]);
+        for (uint64_t& w : words) {
+            carry += static_cast<u128>(w) * BASE;
+            w = static_cast<uint64_t>(carry);
+            carry >>= 64;
+        }
+        if (carry) words.push_back(static_cast<uint64_t>(carry));
+    }
+    return words;
+}
+
+BigInt BigInt::from_words(const std::vector<uint64_t>& words) {
+    // the remainders of repeated division by BASE are the limbs
+    std::vector<uint64_t> rest(words);
+    if (rest.empty()) return BigInt();
+    while (rest.size() > 1 && rest.back() == 0) rest.pop_back();
+    BigInt result;
+    result.digits.clear();
+    while (rest.size() > 1 || rest[0] != 0) {
+        u128 r = 0;
+        for (size_t i = rest.size(); i-- > 0;) {
+            r = (r << 64) | rest[i];
+            rest[i] = static_cast<uint64_t>(r / BASE);
+            r %= BASE;
+        }
+        result.digits.push_back(static_cast<int>(r));
+        if (rest.size() > 1 && rest.back() == 0) rest.pop_back();
+    }
+    if (result.digits.empty()) result.digits.push_back(0);
+    return result;
+}
+
+BigInt BigInt::from_limbs(std::vector<int> limbs, bool negative) {
+    for (int d : limbs) {
+        if (d < 0 || d >= BASE) throw std::invalid_argument("BigInt limb out of range");
+    }
+    BigInt result;
+    if (limbs.empty()) return result;
+    result.digits = std::move(limbs);
+    result.is_negative = negative;
+    result.normalize();
+    return result;
+}
+
+size_t BigInt::hash() const {
+    size_t h = is_negative ? 0x9e3779b97f4a7c15ULL : 0;
+    for (int d : digits) {
+        h ^= static_cast<size_t>(d) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+    return h;
+}
+
 // Memory management
 void BigInt::shrink_to_fit() {
     digits.shrink_to_fit();
@@ -0,0 +1,89 @@
+#include "../include/budget.h"
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#define TI_BUDGET_ACCOUNTING 1
+#include <malloc.h>
+#endif
+
+namespace ti {
+
+namespace {
+
+thread_local long long allocatedBytes = 0;
+thread_local const eval_budget* activeBudget = nullptr;
+// allocations are counted only while a memory-limited budget is active
+thread_local bool countingBytes = false;
+
+} // namespace
+
+eval_budget eval_budget::starting(double seconds, size_t bytes, unsigned long long steps) {
+    eval_budget b;
+    if (seconds > 0) {
+        b.deadline = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+    }
+    b.memoryLimit = static_cast<long long>(bytes);
+    b.memoryBase = threadAllocatedBytes();
+    b.stepLimit = steps;
+    return b;
+}
+
+void eval_budget::check() const {
+    if (control && control->cancelled.load(std::memory_order_relaxed)) {
+        throw limit_exceeded(budget_kind::Cancelled, "interrupted");
+    }
+    if (clock::now() > deadline) throw limit_exceeded(budget_kind::Time, "time limit exceeded");
+    if (memoryLimit > 0 && threadAllocatedBytes() - memoryBase > memoryLimit) {
+        throw limit_exceeded(budget_kind::Memory, "memory limit exceeded");
+    }
+}
+
+const eval_budget* currentBudget() {
+    return activeBudget;
+}
+
+budget_scope::budget_scope(const eval_budget* b) : saved(activeBudget), savedCounting(countingBytes) {
+    activeBudget = b;
+    countingBytes = b && b->memoryLimit > 0;
+}
+
+budget_scope::~budget_scope() {
+    activeBudget = saved;
+    countingBytes = savedCounting;
+}
+
+long long threadAllocatedBytes() {
+    return allocatedBytes;
+}
+
+} // namespace ti
+
+#ifdef TI_BUDGET_ACCOUNTING
+
+// The replaceable allocation functions, counting usable bytes per thread
+// inside memory-limited budget scopes and costing a flag test elsewhere;
+// the array, nothrow and sized forms all forward to these two.
+void* operator new(std::size_t n) {
+    for (;;) {
+        if (void* p = std::malloc(n ? n : 1)) {
+            if (ti::countingBytes) ti::allocatedBytes += static_cast<long long>(malloc_usable_size(p));
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    if (ti::countingBytes) ti::allocatedBytes -= static_cast<long long>(malloc_usable_size(p));
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    ::operator delete(p);
+}
+
+#endif // TI_BUDGET_ACCOUNTING
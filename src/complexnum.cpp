@@ -0,0 +1,707 @@
+#include "../include/complexnum.h"
+#include "../include/lists.h"
+#include "../include/ntheory.h"
+#include "../include/runtimeenv.h"
+#include "../include/threadpool.h"
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TI_COMPLEX_AVX 1
+#include <immintrin.h>
+#endif
+
+namespace ti {
+
+using ast::binary_op;
+using cplx = std::complex<double>;
+
+namespace {
+
+// elements per parallel task for elementwise array operations
+constexpr size_t ARRAY_GRAIN = 4096;
+// integer powers of approximate numbers up to this are repeated products,
+// which keep (1+i)^2 = 2i exact where std::pow would not
+constexpr long long SMALL_POWER = 64;
+
+const valptr_t zeroValue = std::make_shared<integer>(0);
+const valptr_t oneValue = std::make_shared<integer>(1);
+
+bool isExactReal(value_kind k) {
+    return k == value_kind::Integer || k == value_kind::Fraction;
+}
+
+bool isExactOperand(const value &v) {
+    if (v.kind() == value_kind::Complex) return static_cast<const complex_number &>(v).isExact();
+    return isExactReal(v.kind());
+}
+
+valptr_t copyExact(const value &v) {
+    if (v.kind() == value_kind::Integer) return std::make_shared<integer>(static_cast<const integer &>(v));
+    return std::make_shared<fraction>(static_cast<const fraction &>(v));
+}
+
+// (re, im) of an exact operand
+std::pair<valptr_t, valptr_t> exactParts(const value &v) {
+    if (v.kind() == value_kind::Complex) {
+        const auto &z = static_cast<const complex_number &>(v);
+        return {z.real(), z.imag()};
+    }
+    return {copyExact(v), zeroValue};
+}
+
+bool isZero(const valptr_t &v) {
+    return v->equals(*zeroValue);
+}
+
+valptr_t add(const valptr_t &a, const valptr_t &b) { return applyBinary(binary_op::Add, a, b); }
+valptr_t sub(const valptr_t &a, const valptr_t &b) { return applyBinary(binary_op::Sub, a, b); }
+valptr_t mul(const valptr_t &a, const valptr_t &b) { return applyBinary(binary_op::Mul, a, b); }
+valptr_t div(const valptr_t &a, const valptr_t &b) { return applyBinary(binary_op::Div, a, b); }
+
+// (a + b i)^n for an integer n, by squaring
+valptr_t gaussianPower(valptr_t a, valptr_t b, BigInt n) {
+    if (n.sign() < 0) {
+        // 1 / (a + b i) = (a - b i) / (a^2 + b^2)
+        const valptr_t norm = add(mul(a, a), mul(b, b));
+        if (isZero(norm)) throw std::domain_error("division by zero");
+        a = div(a, norm);
+        b = div(sub(zeroValue, b), norm);
+        n = -n;
+    }
+    valptr_t re = oneValue, im = zeroValue;
+    const BigInt two(2);
+    while (!n.is_zero()) {
+        if (!(n % two).is_zero()) {
+            valptr_t r = sub(mul(re, a), mul(im, b));
+            im = add(mul(re, b), mul(im, a));
+            re = r;
+        }
+        n /= two;
+        if (!n.is_zero()) {
+            valptr_t r = sub(mul(a, a), mul(b, b));
+            b = mul(std::make_shared<integer>(2), mul(a, b));
+            a = r;
+        }
+    }
+    return makeComplex(re, im);
+}
+
+valptr_t exactArith(binary_op op, const value &l, const value &r) {
+    auto [a, b] = exactParts(l);
+    auto [c, d] = exactParts(r);
+    switch (op) {
+        case binary_op::Add: return makeComplex(add(a, c), add(b, d));
+        case binary_op::Sub: return makeComplex(sub(a, c), sub(b, d));
+        case binary_op::Mul: return makeComplex(sub(mul(a, c), mul(b, d)), add(mul(a, d), mul(b, c)));
+        case binary_op::Div: {
+            const valptr_t norm = add(mul(c, c), mul(d, d));
+            if (isZero(norm)) throw std::domain_error("division by zero");
+            return makeComplex(div(add(mul(a, c), mul(b, d)), norm), div(sub(mul(b, c), mul(a, d)), norm));
+        }
+        case binary_op::Pow:
+            return gaussianPower(a, b, static_cast<const integer &>(r).getValue());
+        case binary_op::Eq:
+            return std::make_shared<boolean>(a->equals(*c) && b->equals(*d));
+        case binary_op::Ne:
+            return std::make_shared<boolean>(!(a->equals(*c) && b->equals(*d)));
+        default:
+            throw std::runtime_error("complex numbers are not ordered");
+    }
+}
+
+cplx smallPower(cplx z, long long n) {
+    if (n < 0) {
+        z = 1.0 / z;
+        n = -n;
+    }
+    cplx r = 1.0;
+    for (; n > 0; n >>= 1) {
+        if (n & 1) r *= z;
+        if (n > 1) z *= z;
+    }
+    return r;
+}
+
+// b as an exponent smallPower takes: real, integral and at most SMALL_POWER
+bool smallExponent(cplx b, long long &n) {
+    if (b.imag() != 0.0 || std::abs(b.real()) > SMALL_POWER || b.real() != std::trunc(b.real())) return false;
+    n = static_cast<long long>(b.real());
+    return true;
+}
+
+valptr_t approxArith(binary_op op, const value &l, const value &r) {
+    const cplx a = toComplex(l);
+    const cplx b = toComplex(r);
+    switch (op) {
+        case binary_op::Add: return makeComplex(a + b);
+        case binary_op::Sub: return makeComplex(a - b);
+        case binary_op::Mul: return makeComplex(a * b);
+        case binary_op::Div:
+            if (b == 0.0) throw std::domain_error("division by zero");
+            return makeComplex(a / b);
+        case binary_op::Pow: {
+            long long n;
+            if (smallExponent(b, n)) return makeComplex(smallPower(a, n));
+            return makeComplex(std::pow(a, b));
+        }
+        case binary_op::Eq: return std::make_shared<boolean>(a == b);
+        case binary_op::Ne: return std::make_shared<boolean>(a != b);
+        default:
+            throw std::runtime_error("complex numbers are not ordered");
+    }
+}
+
+// === arrays ===
+
+// one operand of an elementwise operation: `stride` 0 broadcasts element 0
+struct column {
+    const double* re = nullptr;
+    const double* im = nullptr;
+    size_t stride = 1;
+    size_t n = 1;
+    size_t cols = 0;
+    bool array = false;
+    std::vector<double> ownRe, ownIm; // storage for packed lists and scalars
+};
+
+void packList(const valuelist &l, std::vector<double> &re, std::vector<double> &im) {
+    re.resize(l.size());
+    im.resize(l.size());
+    for (size_t i = 0; i < l.size(); ++i) {
+        const valptr_t &x = l.elements()[i];
+        if (!x || !isComplexScalar(x->kind())) throw std::runtime_error("expected a list of numbers, got " + l.toString());
+        const cplx z = toComplex(*x);
+        re[i] = z.real();
+        im[i] = z.imag();
+    }
+}
+
+column columnOf(const value &v) {
+    column c;
+    if (v.kind() == value_kind::ComplexArray) {
+        const auto &a = static_cast<const complex_array &>(v);
+        c.re = a.reals().data();
+        c.im = a.imags().data();
+        c.n = a.size();
+        c.cols = a.colCount();
+        c.array = true;
+    } else if (v.kind() == value_kind::DecimalArray) {
+        const auto &a = static_cast<const decimal_array &>(v);
+        c.re = a.values().data();
+        c.ownIm.assign(a.size(), 0.0);
+        c.im = c.ownIm.data();
+        c.n = a.size();
+        c.array = true;
+    } else if (v.kind() == value_kind::List) {
+        packList(static_cast<const valuelist &>(v), c.ownRe, c.ownIm);
+        c.re = c.ownRe.data();
+        c.im = c.ownIm.data();
+        c.n = c.ownRe.size();
+        c.array = true;
+    } else if (isComplexScalar(v.kind())) {
+        const cplx z = toComplex(v);
+        c.ownRe.assign(1, z.real());
+        c.ownIm.assign(1, z.imag());
+        c.re = c.ownRe.data();
+        c.im = c.ownIm.data();
+        c.stride = 0;
+    } else {
+        throw std::runtime_error("invalid operand for a complex list: " + v.toString());
+    }
+    return c;
+}
+
+#define TI_COMPLEX_LOOP(...) \
+    for (; i < end; ++i) { \
+        const double ar = a.re[i * a.stride], ai = a.im[i * a.stride]; \
+        const double br = b.re[i * b.stride], bi = b.im[i * b.stride]; \
+        double r, m; \
+        __VA_ARGS__ \
+        outRe[i] = r; \
+        outIm[i] = m; \
+    }
+
+void arithScalar(binary_op op, const column &a, const column &b, double* outRe, double* outIm, size_t i, size_t end) {
+    switch (op) {
+        case binary_op::Add: TI_COMPLEX_LOOP(r = ar + br; m = ai + bi;) break;
+        case binary_op::Sub: TI_COMPLEX_LOOP(r = ar - br; m = ai - bi;) break;
+        case binary_op::Mul: TI_COMPLEX_LOOP(r = ar * br - ai * bi; m = ar * bi + ai * br;) break;
+        case binary_op::Div:
+            TI_COMPLEX_LOOP(const double d = br * br + bi * bi; r = (ar * br + ai * bi) / d; m = (ai * br - ar * bi) / d;)
+            break;
+        case binary_op::Pow:
+            TI_COMPLEX_LOOP(long long k;
+                            const cplx z = smallExponent(cplx(br, bi), k) ? smallPower(cplx(ar, ai), k)
+                                                                          : std::pow(cplx(ar, ai), cplx(br, bi));
+                            r = z.real(); m = z.imag();)
+            break;
+        default: throw std::logic_error("complex array: not an arithmetic operator");
+    }
+}
+
+#ifdef TI_COMPLEX_AVX
+
+#define TI_CLOAD(p, s, i) ((s) ? _mm256_loadu_pd((p) + (i)) : _mm256_set1_pd(*(p)))
+#define TI_COMPLEX_AVX_LOOP(...) \
+    for (; i + 4 <= end; i += 4) { \
+        const __m256d ar = TI_CLOAD(a.re, a.stride, i), ai = TI_CLOAD(a.im, a.stride, i); \
+        const __m256d br = TI_CLOAD(b.re, b.stride, i), bi = TI_CLOAD(b.im, b.stride, i); \
+        __m256d r, m; \
+        __VA_ARGS__ \
+        _mm256_storeu_pd(outRe + i, r); \
+        _mm256_storeu_pd(outIm + i, m); \
+    }
+
+// how far from i it got; real and imaginary parts are separate columns,
+// so a complex product is four vertical multiplies and no shuffles
+__attribute__((target("avx")))
+size_t arithAvx(binary_op op, const column &a, const column &b, double* outRe, double* outIm, size_t i, size_t end) {
+    switch (op) {
+        case binary_op::Add: TI_COMPLEX_AVX_LOOP(r = _mm256_add_pd(ar, br); m = _mm256_add_pd(ai, bi);) break;
+        case binary_op::Sub: TI_COMPLEX_AVX_LOOP(r = _mm256_sub_pd(ar, br); m = _mm256_sub_pd(ai, bi);) break;
+        case binary_op::Mul:
+            TI_COMPLEX_AVX_LOOP(r = _mm256_sub_pd(_mm256_mul_pd(ar, br), _mm256_mul_pd(ai, bi));
+                                m = _mm256_add_pd(_mm256_mul_pd(ar, bi), _mm256_mul_pd(ai, br));)
+            break;
+        case binary_op::Div:
+            TI_COMPLEX_AVX_LOOP(const __m256d d = _mm256_add_pd(_mm256_mul_pd(br, br), _mm256_mul_pd(bi, bi));
+                                r = _mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(ar, br), _mm256_mul_pd(ai, bi)), d);
+                                m = _mm256_div_pd(_mm256_sub_pd(_mm256_mul_pd(ai, br), _mm256_mul_pd(ar, bi)), d);)
+            break;
+        default: break; // pow has no vector instruction
+    }
+    return i;
+}
+
+// |z| = sqrt(re^2 + im^2)
+__attribute__((target("avx")))
+size_t absAvx(const double* re, const double* im, double* out, size_t i, size_t end) {
+    for (; i + 4 <= end; i += 4) {
+        const __m256d x = _mm256_loadu_pd(re + i), y = _mm256_loadu_pd(im + i);
+        _mm256_storeu_pd(out + i, _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y))));
+    }
+    return i;
+}
+
+bool haveAvx() {
+    static const bool has = __builtin_cpu_supports("avx");
+    return has;
+}
+
+#endif // TI_COMPLEX_AVX
+
+void arith(binary_op op, const column &a, const column &b, double* outRe, double* outIm, size_t begin, size_t end) {
+#ifdef TI_COMPLEX_AVX
+    if (haveAvx()) begin = arithAvx(op, a, b, outRe, outIm, begin, end);
+#endif
+    arithScalar(op, a, b, outRe, outIm, begin, end);
+}
+
+void absRange(const double* re, const double* im, double* out, size_t begin, size_t end) {
+#ifdef TI_COMPLEX_AVX
+    if (haveAvx()) begin = absAvx(re, im, out, begin, end);
+#endif
+    for (size_t i = begin; i < end; ++i) out[i] = std::sqrt(re[i] * re[i] + im[i] * im[i]);
+}
+
+valptr_t boxDecimals(const double* xs, size_t n) {
+    std::vector<valptr_t> out(n);
+    parallelFor(n, ARRAY_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) out[i] = std::make_shared<decimal>(xs[i]);
+    });
+    return std::make_shared<valuelist>(std::move(out));
+}
+
+// f on every element of an array
+valptr_t mapArray(const complex_array &a, cplx (*f)(const cplx &)) {
+    std::vector<double> re(a.size()), im(a.size());
+    parallelFor(a.size(), ARRAY_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const cplx z = f(cplx(a.reals()[i], a.imags()[i]));
+            re[i] = z.real();
+            im[i] = z.imag();
+        }
+    });
+    return std::make_shared<complex_array>(std::move(re), std::move(im), a.colCount());
+}
+
+std::string decimalString(double x) {
+    return decimal(x).toString();
+}
+
+} // namespace
+
+// === complex_number ===
+
+complex_number::complex_number(valptr_t re, valptr_t im) : re(std::move(re)), im(std::move(im)), exact(true) {
+    z = cplx(toDouble(*this->re), toDouble(*this->im));
+}
+
+complex_number::complex_number(std::complex<double> z) : z(z), exact(false) {}
+
+valptr_t complex_number::real() const {
+    return exact ? re : std::make_shared<decimal>(z.real());
+}
+
+valptr_t complex_number::imag() const {
+    return exact ? im : std::make_shared<decimal>(z.imag());
+}
+
+std::complex<double> complex_number::toComplex() const {
+    return z;
+}
+
+std::string complex_number::toString() const {
+    const bool negative = exact ? isTrue(applyBinary(binary_op::Lt, im, zeroValue)) : std::signbit(z.imag());
+    std::string imagPart;
+    if (exact) {
+        const valptr_t mag = negative ? sub(zeroValue, im) : im;
+        imagPart = mag->equals(*oneValue) ? "i" : mag->toString() + "*i";
+    } else {
+        imagPart = decimalString(std::fabs(z.imag())) + "*i";
+    }
+    const bool realZero = exact ? isZero(re) : z.real() == 0.0;
+    if (realZero) return (negative ? "-" : "") + imagPart;
+    return real()->toString() + (negative ? "-" : "+") + imagPart;
+}
+
+size_t complex_number::hash() const {
+    if (exact) return re->hash() * 31 + im->hash() + 0x636f6d70;
+    return std::hash<double>()(z.real()) * 31 + std::hash<double>()(z.imag());
+}
+
+bool complex_number::equals(const value &other) const {
+    if (other.kind() != value_kind::Complex) return false;
+    const auto &o = static_cast<const complex_number &>(other);
+    if (exact != o.exact) return false;
+    return exact ? re->equals(*o.re) && im->equals(*o.im) : z == o.z;
+}
+
+// === complex_array ===
+
+complex_array::complex_array(double_buffer re, double_buffer im, size_t cols)
+    : re(std::move(re)), im(std::move(im)), cols(cols) {
+    if (this->re.size() != this->im.size()) throw std::logic_error("complex_array: parts differ in length");
+    if (cols != 0 && this->re.size() % cols != 0) throw std::logic_error("complex_array: ragged matrix");
+    rows = cols == 0 ? this->re.size() : this->re.size() / cols;
+}
+
+valptr_t complex_array::at(size_t i) const {
+    return makeComplex(cplx(re[i], im[i]));
+}
+
+std::string complex_array::toString() const {
+    std::string s = "{";
+    for (size_t i = 0; i < re.size(); ++i) {
+        if (cols != 0 && i % cols == 0) s += i == 0 ? "{" : "}, {";
+        else if (i != 0) s += ", ";
+        s += at(i)->toString();
+    }
+    if (cols != 0 && !re.empty()) s += "}";
+    return s + "}";
+}
+
+size_t complex_array::hash() const {
+    size_t h = 0x63617272 + cols;
+    for (size_t i = 0; i < re.size(); ++i) {
+        h ^= std::hash<double>()(re[i]) * 31 + std::hash<double>()(im[i]) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+    return h;
+}
+
+bool complex_array::equals(const value &other) const {
+    if (other.kind() != value_kind::ComplexArray) return false;
+    const auto &o = static_cast<const complex_array &>(other);
+    return cols == o.cols && re == o.re && im == o.im;
+}
+
+// === arithmetic ===
+
+valptr_t makeComplex(const valptr_t &re, const valptr_t &im) {
+    if (isZero(im)) return re;
+    return std::make_shared<complex_number>(re, im);
+}
+
+valptr_t makeComplex(std::complex<double> z) {
+    if (z.imag() == 0.0) return std::make_shared<decimal>(z.real());
+    return std::make_shared<complex_number>(z);
+}
+
+valptr_t imaginaryUnit() {
+    static const valptr_t unit = std::make_shared<complex_number>(zeroValue, oneValue);
+    return unit;
+}
+
+bool isComplexScalar(value_kind k) {
+    return isNumeric(k) || k == value_kind::Complex;
+}
+
+std::complex<double> toComplex(const value &v) {
+    if (v.kind() == value_kind::Complex) return static_cast<const complex_number &>(v).toComplex();
+    return toDouble(v);
+}
+
+valptr_t complexArith(binary_op op, const value &l, const value &r) {
+    const bool exact = isExactOperand(l) && isExactOperand(r);
+    if (exact && (op != binary_op::Pow || r.kind() == value_kind::Integer)) return exactArith(op, l, r);
+    return approxArith(op, l, r);
+}
+
+valptr_t complexArrayArith(binary_op op, const value &l, const value &r) {
+    const column a = columnOf(l);
+    const column b = columnOf(r);
+    if (a.array && b.array && (a.n != b.n || a.cols != b.cols)) throw std::runtime_error("dimension mismatch");
+    const size_t n = a.array ? a.n : b.n;
+    const size_t cols = a.array ? a.cols : b.cols;
+    if (op == binary_op::Eq || op == binary_op::Ne) {
+        std::vector<valptr_t> out(n);
+        for (size_t i = 0; i < n; ++i) {
+            const bool same = a.re[i * a.stride] == b.re[i * b.stride] && a.im[i * a.stride] == b.im[i * b.stride];
+            out[i] = std::make_shared<boolean>(same == (op == binary_op::Eq));
+        }
+        return std::make_shared<valuelist>(std::move(out));
+    }
+    if (op == binary_op::Div) {
+        for (size_t i = 0; i < (b.stride ? n : 1); ++i) {
+            if (b.re[i] == 0.0 && b.im[i] == 0.0) throw std::domain_error("division by zero");
+        }
+    }
+    std::vector<double> re(n), im(n);
+    parallelFor(n, ARRAY_GRAIN, [&](size_t begin, size_t end) { arith(op, a, b, re.data(), im.data(), begin, end); });
+    return std::make_shared<complex_array>(std::move(re), std::move(im), cols);
+}
+
+valptr_t approximateComplex(const valptr_t &v) {
+    const auto &z = static_cast<const complex_number &>(*v);
+    return z.isExact() ? makeComplex(z.toComplex()) : v;
+}
+
+valptr_t complexCall(const std::string &fn, const value &arg) {
+    using cfn = cplx (*)(const cplx &);
+    static const std::unordered_map<std::string, cfn> fns = {
+        {"sqrt", [](const cplx &z) { return std::sqrt(z); }},
+        {"exp", [](const cplx &z) { return std::exp(z); }},
+        {"ln", [](const cplx &z) { return std::log(z); }},
+        {"log", [](const cplx &z) { return std::log10(z); }},
+        {"sin", [](const cplx &z) { return std::sin(z); }},
+        {"cos", [](const cplx &z) { return std::cos(z); }},
+        {"tan", [](const cplx &z) { return std::tan(z); }},
+        {"arcsin", [](const cplx &z) { return std::asin(z); }},
+        {"arccos", [](const cplx &z) { return std::acos(z); }},
+        {"arctan", [](const cplx &z) { return std::atan(z); }},
+        {"sinh", [](const cplx &z) { return std::sinh(z); }},
+        {"cosh", [](const cplx &z) { return std::cosh(z); }},
+        {"tanh", [](const cplx &z) { return std::tanh(z); }},
+    };
+    auto it = fns.find(fn);
+    if (it == fns.end()) return nullptr;
+    if (arg.kind() == value_kind::ComplexArray) return mapArray(static_cast<const complex_array &>(arg), it->second);
+    return makeComplex(it->second(toComplex(arg)));
+}
+
+valptr_t complexAbs(const value &v, calc_mode mode) {
+    if (v.kind() == value_kind::ComplexArray) {
+        const auto &a = static_cast<const complex_array &>(v);
+        std::vector<double> out(a.size());
+        parallelFor(a.size(), ARRAY_GRAIN, [&](size_t begin, size_t end) {
+            absRange(a.reals().data(), a.imags().data(), out.data(), begin, end);
+        });
+        return boxDecimals(out.data(), out.size());
+    }
+    const auto &z = static_cast<const complex_number &>(v);
+    if (z.isExact()) {
+        // |3+4i| = 5, and in Exact mode |1+i| = sqrt(2)
+        const valptr_t norm = add(mul(z.real(), z.real()), mul(z.imag(), z.imag()));
+        if (valptr_t root = rootValue(norm, 2, mode)) return root;
+    }
+    return std::make_shared<decimal>(std::abs(z.toComplex()));
+}
+
+valptr_t complexAngle(const value &v) {
+    if (v.kind() == value_kind::ComplexArray) {
+        const auto &a = static_cast<const complex_array &>(v);
+        std::vector<double> out(a.size());
+        parallelFor(a.size(), ARRAY_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) out[i] = std::atan2(a.imags()[i], a.reals()[i]);
+        });
+        return boxDecimals(out.data(), out.size());
+    }
+    if (isExactReal(v.kind()) && !isTrue(applyBinary(binary_op::Lt, copyExact(v), zeroValue))) return zeroValue;
+    return std::make_shared<decimal>(std::arg(toComplex(v)));
+}
+
+std::string polarString(const value &v) {
+    if (v.kind() == value_kind::ComplexArray) {
+        const auto &a = static_cast<const complex_array &>(v);
+        std::string s = "{";
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (i != 0) s += ", ";
+            s += polarString(*std::make_shared<complex_number>(cplx(a.reals()[i], a.imags()[i])));
+        }
+        return s + "}";
+    }
+    const cplx z = toComplex(v);
+    return "(" + decimalString(std::abs(z)) + "∠" + decimalString(std::arg(z)) + ")";
+}
+
+// === builtins ===
+
+namespace {
+
+// numbers in v, which is a number, a list of numbers or a list of equally
+// long lists of numbers (a matrix, whose row length goes to cols)
+void flatten(const valptr_t &v, std::vector<double> &out, size_t &cols, const char* name) {
+    auto number = [name](const valptr_t &x) {
+        if (!x || !isNumeric(x->kind())) throw std::runtime_error(std::string(name) + " expects real numbers");
+        return toDouble(*x);
+    };
+    if (v && v->kind() == value_kind::DecimalArray) {
+        const double_buffer &xs = static_cast<const decimal_array &>(*v).values();
+        out.insert(out.end(), xs.begin(), xs.end());
+        return;
+    }
+    if (!v || v->kind() != value_kind::List) {
+        out.push_back(number(v));
+        return;
+    }
+    const auto &rows = static_cast<const valuelist &>(*v).elements();
+    const bool matrix = !rows.empty() && rows[0] && rows[0]->kind() == value_kind::List;
+    cols = matrix ? static_cast<const valuelist &>(*rows[0]).size() : 0;
+    for (auto &row : rows) {
+        if (!matrix) {
+            out.push_back(number(row));
+            continue;
+        }
+        if (!row || row->kind() != value_kind::List || static_cast<const valuelist &>(*row).size() != cols) {
+            throw std::runtime_error(std::string(name) + ": rows differ in length");
+        }
+        for (auto &x : static_cast<const valuelist &>(*row).elements()) out.push_back(number(x));
+    }
+}
+
+bool isArrayArg(const valptr_t &v) {
+    return v->kind() == value_kind::List || v->kind() == value_kind::DecimalArray;
+}
+
+// a complex array from two real arguments, one of which is a list, a
+// decimal_array or a matrix; f combines each pair of elements
+valptr_t arrayFromParts(const valptr_t &x, const valptr_t &y, cplx (*f)(double, double), const char* name) {
+    std::vector<double> xs, ys;
+    size_t xcols = 0, ycols = 0;
+    flatten(x, xs, xcols, name);
+    flatten(y, ys, ycols, name);
+    const bool xList = isArrayArg(x), yList = isArrayArg(y);
+    if (xList && yList && (xs.size() != ys.size() || xcols != ycols)) throw std::runtime_error("dimension mismatch");
+    const size_t n = xList ? xs.size() : ys.size();
+    std::vector<double> re(n), im(n);
+    parallelFor(n, ARRAY_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const cplx z = f(xs[xList ? i : 0], ys[yList ? i : 0]);
+            re[i] = z.real();
+            im[i] = z.imag();
+        }
+    });
+    return std::make_shared<complex_array>(std::move(re), std::move(im), xList ? xcols : ycols);
+}
+
+void checkArgs(const std::vector<valptr_t> &args, size_t n, const char* usage) {
+    if (args.size() != n) throw std::runtime_error(usage);
+    for (auto &a : args) {
+        if (!a) throw std::runtime_error(usage);
+    }
+}
+
+// f on a number, each element of a list, or (via onArray) a complex array
+valptr_t mapNumbers(const valptr_t &v, const std::function<valptr_t(const value &)> &f,
+                    const std::function<valptr_t(const complex_array &)> &onArray, const char* name) {
+    if (v->kind() == value_kind::ComplexArray) return onArray(static_cast<const complex_array &>(*v));
+    auto apply = [&f, name](const valptr_t &x) -> valptr_t {
+        if (!x || !isComplexScalar(x->kind())) throw std::runtime_error(std::string(name) + " expects a number");
+        return f(*x);
+    };
+    const valptr_t list = asList(v);
+    if (list->kind() == value_kind::List) return mapList(static_cast<const valuelist &>(*list), apply);
+    return apply(v);
+}
+
+} // namespace
+
+void register_complex_builtins(runtime_env &env) {
+    // complex(re, im) is re + im i, exact for exact parts; with a list or
+    // matrix for either part, or complex(list) of a list of numbers, the
+    // result is a packed complex array
+    env.registerBuiltin("complex", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        if (args.size() == 1 && args[0] && args[0]->kind() == value_kind::List) {
+            std::vector<double> re, im;
+            packList(static_cast<const valuelist &>(*args[0]), re, im);
+            return std::make_shared<complex_array>(std::move(re), std::move(im));
+        }
+        if (args.size() == 1 && args[0] && args[0]->kind() == value_kind::DecimalArray) {
+            const auto &a = static_cast<const decimal_array &>(*args[0]);
+            return std::make_shared<complex_array>(a.values(), std::vector<double>(a.size(), 0.0));
+        }
+        checkArgs(args, 2, "complex expects (re, im)");
+        if (isArrayArg(args[0]) || isArrayArg(args[1])) {
+            return arrayFromParts(args[0], args[1], [](double x, double y) { return cplx(x, y); }, "complex");
+        }
+        if (!isNumeric(args[0]->kind()) || !isNumeric(args[1]->kind())) throw std::runtime_error("complex expects real numbers");
+        if (isExactReal(args[0]->kind()) && isExactReal(args[1]->kind())) return makeComplex(args[0], args[1]);
+        return makeComplex(cplx(toDouble(*args[0]), toDouble(*args[1])));
+    }, true);
+    // polar(r, theta) is r e^(theta i)
+    env.registerBuiltin("polar", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        checkArgs(args, 2, "polar expects (r, theta)");
+        auto f = [](double r, double t) { return std::polar(r, t); };
+        if (isArrayArg(args[0]) || isArrayArg(args[1])) {
+            return arrayFromParts(args[0], args[1], f, "polar");
+        }
+        if (!isNumeric(args[0]->kind()) || !isNumeric(args[1]->kind())) throw std::runtime_error("polar expects real numbers");
+        if (isExactReal(args[1]->kind()) && toDouble(*args[1]) == 0.0) return args[0];
+        return makeComplex(f(toDouble(*args[0]), toDouble(*args[1])));
+    }, true);
+    env.registerBuiltin("real", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        checkArgs(args, 1, "real expects one number");
+        return mapNumbers(args[0], [](const value &x) -> valptr_t {
+            if (x.kind() == value_kind::Complex) return static_cast<const complex_number &>(x).real();
+            return isExactReal(x.kind()) ? copyExact(x) : std::make_shared<decimal>(toDouble(x));
+        }, [](const complex_array &a) { return boxDecimals(a.reals().data(), a.size()); }, "real");
+    }, true);
+    env.registerBuiltin("imag", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        checkArgs(args, 1, "imag expects one number");
+        return mapNumbers(args[0], [](const value &x) -> valptr_t {
+            if (x.kind() == value_kind::Complex) return static_cast<const complex_number &>(x).imag();
+            return isExactReal(x.kind()) ? zeroValue : std::make_shared<decimal>(0.0);
+        }, [](const complex_array &a) { return boxDecimals(a.imags().data(), a.size()); }, "imag");
+    }, true);
+    env.registerBuiltin("conj", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        checkArgs(args, 1, "conj expects one number");
+        return mapNumbers(args[0], [](const value &x) -> valptr_t {
+            if (x.kind() != value_kind::Complex) return isExactReal(x.kind()) ? copyExact(x) : std::make_shared<decimal>(toDouble(x));
+            const auto &z = static_cast<const complex_number &>(x);
+            if (z.isExact()) return makeComplex(z.real(), sub(zeroValue, z.imag()));
+            return makeComplex(std::conj(z.toComplex()));
+        }, [](const complex_array &a) -> valptr_t {
+            std::vector<double> im(a.imags().begin(), a.imags().end());
+            for (double &y : im) y = -y;
+            return std::make_shared<complex_array>(a.reals(), std::move(im), a.colCount());
+        }, "conj");
+    }, true);
+    env.registerBuiltin("angle", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        checkArgs(args, 1, "angle expects one number");
+        return mapNumbers(args[0], [](const value &x) { return complexAngle(x); },
+                          [](const complex_array &a) { return complexAngle(a); }, "angle");
+    }, true);
+    // toPolar(z): z's polar form as a string, (r∠θ)
+    env.registerBuiltin("toPolar", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        checkArgs(args, 1, "toPolar expects one number");
+        if (args[0]->kind() != value_kind::ComplexArray && !isComplexScalar(args[0]->kind())) {
+            throw std::runtime_error("toPolar expects one number");
+        }
+        return std::make_shared<string>(polarString(*args[0]));
+    }, true);
+}
+
+} // namespace ti
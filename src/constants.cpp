@@ -0,0 +1,229 @@
+#include "../include/constants.h"
+#include "../include/ntheory.h"
+#include "../include/runtimeenv.h"
+#include "../include/threadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace ti {
+
+namespace {
+
+constexpr size_t LIMB_DIGITS = 9;
+// limbs carried past the requested precision to absorb truncation errors
+constexpr size_t GUARD_LIMBS = 2;
+// terms from which the halves of a binary split run concurrently
+constexpr size_t PARALLEL_TERMS = 1024;
+// limbs from which the products merging two halves run concurrently
+constexpr size_t PARALLEL_LIMBS = 2048;
+
+// sum over n of a(n) / b(n) * (p(0) ... p(n)) / (q(0) ... q(n))
+struct series {
+    // sets term n's factors; b is preset to 1
+    std::function<void(size_t n, BigInt &a, BigInt &b, BigInt &p, BigInt &q)> term;
+    bool hasB = false; // some b(n) != 1
+};
+
+// For terms [lo, hi): P, Q and B are the products of p, q and b, and the
+// partial sum is T / (B Q).
+struct split_sums {
+    BigInt p, q, b, t;
+};
+
+split_sums split(const series &s, size_t lo, size_t hi) {
+    split_sums r;
+    if (hi - lo == 1) {
+        BigInt a;
+        r.b = BigInt(1);
+        s.term(lo, a, r.b, r.p, r.q);
+        r.t = a * r.p;
+        return r;
+    }
+    const size_t mid = lo + (hi - lo) / 2;
+    split_sums l, h;
+    if (hi - lo >= PARALLEL_TERMS) {
+        thread_pool::shared().run(2, [&](size_t i) {
+            if (i == 0) l = split(s, lo, mid);
+            else h = split(s, mid, hi);
+        });
+    } else {
+        l = split(s, lo, mid);
+        h = split(s, mid, hi);
+    }
+    // T = Bh Qh Tl + Bl Pl Th
+    BigInt left, right;
+    auto product = [&](size_t i) {
+        switch (i) {
+            case 0: r.p = l.p * h.p; break;
+            case 1: r.q = l.q * h.q; break;
+            case 2: left = s.hasB ? h.b * h.q * l.t : h.q * l.t; break;
+            case 3: right = s.hasB ? l.b * l.p * h.t : l.p * h.t; break;
+            case 4: r.b = l.b * h.b; break;
+        }
+    };
+    const size_t products = s.hasB ? 5 : 4;
+    if (l.q.limb_count() >= PARALLEL_LIMBS) {
+        thread_pool::shared().run(products, product);
+    } else {
+        for (size_t i = 0; i < products; ++i) product(i);
+    }
+    if (!s.hasB) r.b = BigInt(1);
+    r.t = left + right;
+    return r;
+}
+
+// t / d * BASE^limbs for positive t and d; low limbs that cannot affect
+// the result are dropped from both first
+BigInt fixedRatio(BigInt t, BigInt d, size_t limbs) {
+    const long long drop = static_cast<long long>(d.limb_count()) - static_cast<long long>(limbs + GUARD_LIMBS);
+    if (drop > 0) {
+        t = t.shift_limbs(-drop);
+        d = d.shift_limbs(-drop);
+    }
+    return t.shift_limbs(static_cast<long long>(limbs)) / d;
+}
+
+// atanh(1/x) * BASE^limbs
+BigInt atanhInverse(long long x, size_t limbs) {
+    const double digits = static_cast<double>(limbs * LIMB_DIGITS);
+    const size_t terms = static_cast<size_t>(digits / (2 * std::log10(static_cast<double>(x)))) + 2;
+    series s;
+    s.hasB = true;
+    s.term = [x](size_t n, BigInt &a, BigInt &b, BigInt &p, BigInt &q) {
+        a = BigInt(1);
+        b = BigInt(static_cast<long long>(2 * n + 1));
+        p = BigInt(1);
+        q = n == 0 ? BigInt(x) : BigInt(x) * BigInt(x);
+    };
+    split_sums r = split(s, 0, terms);
+    return fixedRatio(r.t, r.b * r.q, limbs);
+}
+
+BigInt computePi(size_t limbs) {
+    // Chudnovsky: each term adds about 14.18 digits
+    const size_t terms = static_cast<size_t>(static_cast<double>(limbs * LIMB_DIGITS) / 14.181647462725477) + 2;
+    series s;
+    s.term = [](size_t n, BigInt &a, BigInt & /*b*/, BigInt &p, BigInt &q) {
+        const long long k = static_cast<long long>(n);
+        a = BigInt(13591409) + BigInt(545140134) * BigInt(k);
+        if (n == 0) {
+            p = BigInt(1);
+            q = BigInt(1);
+            return;
+        }
+        p = -(BigInt(6 * k - 5) * BigInt(2 * k - 1) * BigInt(6 * k - 1));
+        // 640320^3 / 24
+        q = BigInt(k) * BigInt(k) * BigInt(k) * BigInt(10939058860032000LL);
+    };
+    split_sums r = split(s, 0, terms);
+    // pi = 426880 sqrt(10005) Q / T
+    const BigInt root = isqrt(BigInt(10005).shift_limbs(2 * static_cast<long long>(limbs)));
+    return (fixedRatio(BigInt(426880) * r.q, r.t, limbs) * root).shift_limbs(-static_cast<long long>(limbs));
+}
+
+BigInt computeE(size_t limbs) {
+    // enough terms that the first one left out, 1/N!, is below 10^-digits
+    const double digits = static_cast<double>(limbs * LIMB_DIGITS);
+    size_t terms = 2;
+    while (std::lgamma(static_cast<double>(terms) + 1) / std::log(10.0) < digits + 1) terms *= 2;
+    for (size_t step = terms / 4; step > 0; step /= 2) {
+        if (std::lgamma(static_cast<double>(terms - step) + 1) / std::log(10.0) >= digits + 1) terms -= step;
+    }
+    series s;
+    s.term = [](size_t n, BigInt &a, BigInt & /*b*/, BigInt &p, BigInt &q) {
+        a = BigInt(1);
+        p = BigInt(1);
+        q = BigInt(n == 0 ? 1 : static_cast<long long>(n));
+    };
+    split_sums r = split(s, 0, terms + 1);
+    return fixedRatio(r.t, r.q, limbs);
+}
+
+BigInt computeLn2(size_t limbs) {
+    const long long xs[3] = {26, 4801, 8749};
+    BigInt parts[3];
+    thread_pool::shared().run(3, [&](size_t i) { parts[i] = atanhInverse(xs[i], limbs); });
+    return BigInt(18) * parts[0] - BigInt(2) * parts[1] + BigInt(8) * parts[2];
+}
+
+BigInt compute(math_constant c, size_t limbs) {
+    switch (c) {
+        case math_constant::Pi: return computePi(limbs);
+        case math_constant::E: return computeE(limbs);
+        case math_constant::Ln2: return computeLn2(limbs);
+        case math_constant::Sqrt2: return isqrt(BigInt(2).shift_limbs(2 * static_cast<long long>(limbs)));
+    }
+    throw std::runtime_error("unknown constant");
+}
+
+struct cached_constant {
+    size_t limbs = 0;
+    BigInt value; // c * BASE^limbs
+};
+
+std::mutex cacheLock;
+std::map<math_constant, cached_constant> cache;
+
+// c * BASE^limbs, from the cache when it holds at least that many limbs
+BigInt fixedConstant(math_constant c, size_t limbs) {
+    {
+        std::lock_guard<std::mutex> guard(cacheLock);
+        auto it = cache.find(c);
+        if (it != cache.end() && it->second.limbs >= limbs) {
+            return it->second.value.shift_limbs(static_cast<long long>(limbs) - static_cast<long long>(it->second.limbs));
+        }
+    }
+    BigInt v = compute(c, limbs);
+    std::lock_guard<std::mutex> guard(cacheLock);
+    cached_constant &entry = cache[c];
+    if (limbs > entry.limbs) {
+        entry.limbs = limbs;
+        entry.value = v;
+    }
+    return v;
+}
+
+} // namespace
+
+BigInt constantDigits(math_constant c, size_t digits) {
+    const size_t limbs = (digits + LIMB_DIGITS - 1) / LIMB_DIGITS + GUARD_LIMBS;
+    const size_t excess = limbs * LIMB_DIGITS - digits;
+    long long scale = 1;
+    for (size_t i = 0; i < excess % LIMB_DIGITS; ++i) scale *= 10;
+    return fixedConstant(c, limbs).shift_limbs(-static_cast<long long>(excess / LIMB_DIGITS)) / BigInt(scale);
+}
+
+std::string constantString(math_constant c, size_t digits) {
+    std::string s = constantDigits(c, digits).to_string();
+    if (s.size() <= digits) s.insert(0, digits + 1 - s.size(), '0');
+    if (digits > 0) s.insert(s.size() - digits, ".");
+    return s;
+}
+
+void register_constant_builtins(runtime_env &env) {
+    // constDigits(name, n): the constant to n digits after the point, as a
+    // string
+    env.registerBuiltin("constDigits", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        if (args.size() != 2 || !args[0] || args[0]->kind() != value_kind::String || !args[1] ||
+            args[1]->kind() != value_kind::Integer) {
+            throw std::runtime_error("constDigits expects (name, digits)");
+        }
+        static const std::map<std::string, math_constant> names = {
+            {"pi", math_constant::Pi},
+            {"e", math_constant::E},
+            {"ln2", math_constant::Ln2},
+            {"sqrt2", math_constant::Sqrt2},
+        };
+        auto it = names.find(static_cast<const string &>(*args[0]).getValue());
+        if (it == names.end()) throw std::runtime_error("constDigits: unknown constant " + args[0]->toString());
+        const BigInt &n = static_cast<const integer &>(*args[1]).getValue();
+        if (n.sign() < 0 || n > BigInt(1000000000)) throw std::runtime_error("constDigits: digits out of range");
+        return std::make_shared<string>(constantString(it->second, static_cast<size_t>(n.to_long_long())));
+    }, true);
+}
+
+} // namespace ti
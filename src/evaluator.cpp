@@ -0,0 +1,289 @@
+#include "../include/evaluator.h"
+#include "../include/runtimeenv.h"
+#include "../include/arith.h"
+#include "../include/jit.h"
+#include "../include/lists.h"
+#include <stdexcept>
+
+namespace ti {
+
+using namespace ast;
+
+valptr_t evaluator::run(const exprnode &root) {
+    tasks.push_back(task{&root, 0, vals.size(), false});
+    return drain(env.callDepth());
+}
+
+valptr_t evaluator::call(const function &fn, const std::vector<valptr_t> &args) {
+    const exprnode* body = dynamic_cast<const exprnode*>(fn.body.get());
+    if (!body) return valptr_t();
+    const size_t depth = env.callDepth();
+    enterBody(fn, *body, false, args);
+    return drain(depth);
+}
+
+valptr_t evaluator::drain(size_t baseDepth) {
+    const size_t baseTemps = env.tempDepth();
+    try {
+        while (!tasks.empty()) {
+            task t = tasks.back();
+            tasks.pop_back();
+            step(t);
+        }
+    } catch (...) {
+        // drop frames this run pushed so the env is usable after an error
+        while (env.callDepth() > baseDepth) env.popFrame();
+        while (env.tempDepth() > baseTemps) env.popTemps();
+        tasks.clear();
+        vals.clear();
+        memoPending.clear();
+        throw;
+    }
+    valptr_t result = vals.back();
+    vals.pop_back();
+    return result;
+}
+
+void evaluator::step(task t) {
+    if (!t.node) {
+        // the body's value is already on the value stack
+        if (t.stage == 0) {
+            env.popFrame();
+        } else {
+            env.memoCache().store(memoPending.back().first, memoPending.back().second, vals.back());
+            memoPending.pop_back();
+        }
+        return;
+    }
+
+    switch (t.node->kind()) {
+        case node_kind::Literal:
+            vals.push_back(static_cast<const literal_node*>(t.node)->val);
+            break;
+
+        case node_kind::Var:
+            vals.push_back(env.getVariable(static_cast<const var_node*>(t.node)->name));
+            break;
+
+        case node_kind::Assign: {
+            auto n = static_cast<const assign_node*>(t.node);
+            if (t.stage == 0) {
+                tasks.push_back(task{n, 1, vals.size(), false});
+                tasks.push_back(task{n->rhs.get(), 0, vals.size(), false});
+            } else {
+                env.setVariable(n->name, vals.back());
+            }
+            break;
+        }
+
+        case node_kind::Local: {
+            for (const auto &name : static_cast<const local_node*>(t.node)->names) env.declareLocal(name);
+            vals.push_back(none);
+            break;
+        }
+
+        case node_kind::Block: {
+            auto n = static_cast<const block_node*>(t.node);
+            const size_t count = n->stmts.size();
+            if (count == 0) {
+                vals.push_back(none);
+                break;
+            }
+            // stage k: statements [0, k) are done; only the last value is kept
+            if (t.stage > 0) vals.pop_back();
+            const bool last = t.stage + 1 == count;
+            if (!last) tasks.push_back(task{n, t.stage + 1, t.mark, t.tail});
+            tasks.push_back(task{n->stmts[t.stage].get(), 0, vals.size(), t.tail && last});
+            break;
+        }
+
+        case node_kind::If: {
+            auto n = static_cast<const if_node*>(t.node);
+            if (t.stage == 0) {
+                tasks.push_back(task{n, 1, vals.size(), t.tail});
+                tasks.push_back(task{n->cond.get(), 0, vals.size(), false});
+            } else {
+                valptr_t c = vals.back();
+                vals.pop_back();
+                // the chosen branch inherits our tail position
+                if (isTrue(c)) tasks.push_back(task{n->then_branch.get(), 0, vals.size(), t.tail});
+                else if (n->else_branch) tasks.push_back(task{n->else_branch.get(), 0, vals.size(), t.tail});
+                else vals.push_back(none);
+            }
+            break;
+        }
+
+        case node_kind::For: {
+            // value stack while looping: [end, step, body result]
+            auto n = static_cast<const for_node*>(t.node);
+            if (t.stage == 0) {
+                tasks.push_back(task{n, 1, vals.size(), false});
+                if (n->step) tasks.push_back(task{n->step.get(), 0, vals.size(), false});
+                tasks.push_back(task{n->end.get(), 0, vals.size(), false});
+                tasks.push_back(task{n->start.get(), 0, vals.size(), false});
+                break;
+            }
+            if (t.stage == 1) {
+                if (!n->step) vals.push_back(std::make_shared<integer>(1));
+                valptr_t start = vals[t.mark];
+                vals.erase(vals.begin() + t.mark);
+                env.setVariable(n->var, start);
+            } else {
+                vals.pop_back();
+                env.setVariable(n->var, applyBinary(binary_op::Add, env.getVariable(n->var), vals[t.mark + 1]));
+            }
+            env.checkBudget();
+            if (forContinues(env.getVariable(n->var), vals[t.mark], vals[t.mark + 1])) {
+                tasks.push_back(task{n, 2, t.mark, false});
+                tasks.push_back(task{n->body.get(), 0, vals.size(), false});
+            } else {
+                vals.resize(t.mark);
+                vals.push_back(none);
+            }
+            break;
+        }
+
+        case node_kind::While: {
+            auto n = static_cast<const while_node*>(t.node);
+            if (t.stage == 2) vals.pop_back(); // body result
+            if (t.stage == 0 || t.stage == 2) {
+                env.checkBudget();
+                tasks.push_back(task{n, 1, vals.size(), false});
+                tasks.push_back(task{n->cond.get(), 0, vals.size(), false});
+                break;
+            }
+            valptr_t c = vals.back();
+            vals.pop_back();
+            if (isTrue(c)) {
+                tasks.push_back(task{n, 2, vals.size(), false});
+                tasks.push_back(task{n->body.get(), 0, vals.size(), false});
+            } else {
+                vals.push_back(none);
+            }
+            break;
+        }
+
+        case node_kind::Let: {
+            // the body is never in tail position: the temps must be popped
+            // after it returns
+            auto n = static_cast<const let_node*>(t.node);
+            if (t.stage == 0) {
+                env.pushTemps(n->temps.size());
+                tasks.push_back(task{n, 1, vals.size(), false});
+                tasks.push_back(task{n->body.get(), 0, vals.size(), false});
+            } else {
+                env.popTemps();
+            }
+            break;
+        }
+
+        case node_kind::Temp: {
+            auto n = static_cast<const temp_node*>(t.node);
+            if (t.stage == 0) {
+                valptr_t v = env.temp(n->depth, n->index);
+                if (v) {
+                    vals.push_back(v);
+                } else {
+                    tasks.push_back(task{n, 1, vals.size(), false});
+                    tasks.push_back(task{n->owner->temps[n->index].get(), 0, vals.size(), false});
+                }
+            } else {
+                env.temp(n->depth, n->index) = vals.back();
+            }
+            break;
+        }
+
+        case node_kind::BinaryOp: {
+            auto n = static_cast<const binary_op_node*>(t.node);
+            if (t.stage == 0) {
+                tasks.push_back(task{n, 1, vals.size(), false});
+                tasks.push_back(task{n->right.get(), 0, vals.size(), false});
+                tasks.push_back(task{n->left.get(), 0, vals.size(), false});
+            } else {
+                valptr_t r = vals.back();
+                vals.pop_back();
+                valptr_t l = vals.back();
+                vals.pop_back();
+                vals.push_back(applyMode(n->apply(l, r), env.getMode()));
+            }
+            break;
+        }
+
+        case node_kind::Call: {
+            auto n = static_cast<const call_node*>(t.node);
+            if (t.stage == 0) {
+                function* fn = n->resolve(env);
+                if (fn->formImpl) {
+                    vals.push_back(fn->formImpl(*n, env));
+                    break;
+                }
+                tasks.push_back(task{n, 1, vals.size(), t.tail});
+                // pushed in reverse so arguments evaluate left to right
+                for (size_t i = n->args.size(); i-- > 0;) {
+                    tasks.push_back(task{n->args[i].get(), 0, vals.size(), false});
+                }
+            } else {
+                std::vector<valptr_t> args(std::make_move_iterator(vals.begin() + t.mark),
+                                           std::make_move_iterator(vals.end()));
+                vals.resize(t.mark);
+                enterCall(*n, t.tail, std::move(args));
+            }
+            break;
+        }
+    }
+}
+
+void evaluator::enterCall(const call_node &call, bool tail, std::vector<valptr_t> args) {
+    function* fn = call.resolve(env);
+    if (fn->isBuiltin) {
+        materializeArgs(args);
+        vals.push_back(fn->builtinImpl(args, env));
+        return;
+    }
+    const exprnode* body = dynamic_cast<const exprnode*>(fn->body.get());
+    if (!body) {
+        vals.push_back(valptr_t());
+        return;
+    }
+
+    enterBody(*fn, *body, tail, std::move(args));
+}
+
+void evaluator::enterBody(const function &fn, const exprnode &body, bool tail, std::vector<valptr_t> args) {
+    env.checkBudget();
+    if (env.getJitEnabled()) {
+        // native code needs no frame; it declines anything but decimals
+        if (const std::shared_ptr<jit_code> code = jitCodeFor(fn, env)) {
+            valptr_t result;
+            if (code->invoke(args, result)) {
+                vals.push_back(result);
+                return;
+            }
+        }
+    }
+
+    const bool memoize = env.shouldMemoize(fn);
+    if (memoize) {
+        if (valptr_t hit = env.memoCache().lookup(&fn, args)) {
+            vals.push_back(hit);
+            return;
+        }
+    }
+
+    if (tail) {
+        // nothing is pending in the caller's frame: replace it, and let the
+        // caller's return marker pop the callee's frame instead
+        env.popFrame();
+        env.pushFrame(fn, args);
+    } else {
+        env.pushFrame(fn, args);
+        tasks.push_back(task{nullptr, 0, 0, false});
+    }
+    if (memoize) {
+        tasks.push_back(task{nullptr, 1, 0, false});
+        memoPending.emplace_back(&fn, std::move(args));
+    }
+    tasks.push_back(task{&body, 0, vals.size(), true});
+}
+
+} // namespace ti
@@ -0,0 +1,552 @@
+#include "../include/jit.h"
+#include "../include/runtimeenv.h"
+#include "../include/arith.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define TI_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace ti {
+
+using namespace ast;
+
+// === jit_code ===
+
+jit_code::jit_code(const std::vector<unsigned char> &code, size_t arity, std::vector<valptr_t> consts)
+    : arity(arity), consts(std::move(consts)) {
+#ifdef TI_JIT_X86_64
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size = (code.size() + page - 1) / page * page;
+    mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        mem = nullptr;
+        throw std::runtime_error("jit: cannot map code pages");
+    }
+    std::memcpy(mem, code.data(), code.size());
+    // never writable and executable at the same time
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        mem = nullptr;
+        throw std::runtime_error("jit: cannot make code pages executable");
+    }
+    entry = reinterpret_cast<entry_fn>(mem);
+#else
+    (void)code;
+    throw std::runtime_error("jit: not supported on this platform");
+#endif
+}
+
+jit_code::~jit_code() {
+#ifdef TI_JIT_X86_64
+    if (mem) munmap(mem, size);
+#endif
+}
+
+bool jit_code::invoke(const double* args, valptr_t &result) const {
+    double out = 0.0;
+    const int status = entry(args, &out);
+    if (status == 1) return false;
+    if (status == 0) result = std::make_shared<decimal>(out);
+    else result = consts[static_cast<size_t>(status - 2)];
+    return true;
+}
+
+bool jit_code::invoke(const std::vector<valptr_t> &args, valptr_t &result) const {
+    if (args.size() != arity) return false;
+    double small[8];
+    std::vector<double> large;
+    double* raw = small;
+    if (arity > 8) {
+        large.resize(arity);
+        raw = large.data();
+    }
+    for (size_t i = 0; i < arity; ++i) {
+        if (!args[i] || args[i]->kind() != value_kind::Decimal) return false;
+        raw[i] = static_cast<const decimal &>(*args[i]).getValue();
+    }
+    return invoke(raw, result);
+}
+
+#ifdef TI_JIT_X86_64
+
+namespace {
+
+// condition codes for the two-byte Jcc rel32 forms
+constexpr unsigned char JB = 0x82, JE = 0x84, JNE = 0x85, JBE = 0x86, JP = 0x8A;
+
+// just the instructions the compiler needs; values travel in xmm0 (left
+// operand / result) and xmm1 (right operand), variables live at [rbp + disp32]
+struct assembler {
+    std::vector<unsigned char> code;
+
+    size_t here() const { return code.size(); }
+    void emit(std::initializer_list<unsigned char> bytes) { code.insert(code.end(), bytes); }
+    void imm32(int32_t v) {
+        unsigned char b[4];
+        std::memcpy(b, &v, 4);
+        code.insert(code.end(), b, b + 4);
+    }
+    void imm64(uint64_t v) {
+        unsigned char b[8];
+        std::memcpy(b, &v, 8);
+        code.insert(code.end(), b, b + 8);
+    }
+
+    // jumps return the offset of their rel32 for bind()
+    size_t jcc(unsigned char cc) {
+        emit({0x0F, cc});
+        imm32(0);
+        return here() - 4;
+    }
+    size_t jmp() {
+        emit({0xE9});
+        imm32(0);
+        return here() - 4;
+    }
+    void bind(size_t at) {
+        int32_t rel = static_cast<int32_t>(here() - (at + 4));
+        std::memcpy(&code[at], &rel, 4);
+    }
+
+    void loadSlot(int32_t disp) { emit({0xF2, 0x0F, 0x10, 0x85}); imm32(disp); }   // movsd xmm0, [rbp+d]
+    void storeSlot(int32_t disp) { emit({0xF2, 0x0F, 0x11, 0x85}); imm32(disp); }  // movsd [rbp+d], xmm0
+    void loadArg(int32_t disp) { emit({0xF2, 0x0F, 0x10, 0x87}); imm32(disp); }    // movsd xmm0, [rdi+d]
+    void loadConst(double d, bool toXmm1) {
+        uint64_t bits;
+        std::memcpy(&bits, &d, 8);
+        emit({0x48, 0xB8});                                       // mov rax, imm64
+        imm64(bits);
+        emit({0x66, 0x48, 0x0F, 0x6E, static_cast<unsigned char>(toXmm1 ? 0xC8 : 0xC0)}); // movq xmm0/1, rax
+    }
+    // spill xmm0, keeping rsp 16-byte aligned for calls
+    void push() { emit({0x48, 0x83, 0xEC, 0x10, 0xF2, 0x0F, 0x11, 0x04, 0x24}); }
+    void pop() { emit({0xF2, 0x0F, 0x10, 0x04, 0x24, 0x48, 0x83, 0xC4, 0x10}); }
+    void moveToXmm1() { emit({0x66, 0x0F, 0x28, 0xC8}); }          // movapd xmm1, xmm0
+    void call(uint64_t target) {
+        emit({0x48, 0xB8});                                       // mov rax, imm64
+        imm64(target);
+        emit({0xFF, 0xD0});                                       // call rax
+    }
+    void returnStatus(int32_t status) {
+        if (status == 0) emit({0x31, 0xC0});                      // xor eax, eax
+        else { emit({0xB8}); imm32(status); }                     // mov eax, imm32
+        emit({0xC9, 0xC3});                                       // leave; ret
+    }
+};
+
+double powKernel(double a, double b) { return std::pow(a, b); }
+
+struct reject {};
+
+// where a variable or temp's current value lives
+struct binding {
+    bool assigned = false;
+    bool isConst = false;
+    valptr_t value;   // when isConst
+    int32_t disp = 0; // stack slot, once it has held a runtime value
+};
+
+enum class res_kind { Const, Dynamic, Returned };
+
+// a Const result is known at compile time; a Dynamic one is a double in
+// xmm0; Returned means the code already returned on every path
+struct result {
+    res_kind kind;
+    valptr_t value;
+};
+
+bool isComparisonOp(binary_op op) {
+    return op == binary_op::Eq || op == binary_op::Ne || op == binary_op::Lt ||
+           op == binary_op::Le || op == binary_op::Gt || op == binary_op::Ge;
+}
+
+class compiler {
+private:
+    runtime_env &env;
+    assembler a;
+    std::unordered_map<std::string, binding> vars;
+    std::map<std::pair<const let_node*, size_t>, binding> temps;
+    std::vector<valptr_t> consts;
+    std::vector<size_t> bails;
+    int32_t frameBytes = 8; // [rbp-8] holds the result pointer
+
+    int32_t newSlot() {
+        frameBytes += 8;
+        return -frameBytes;
+    }
+
+    // exactly what the interpreter would compute from constant operands;
+    // anything that would throw is left to the interpreter
+    valptr_t fold(binary_op op, const valptr_t &l, const valptr_t &r) {
+        try {
+            return applyMode(applyBinary(op, l, r), env.getMode());
+        } catch (const std::exception &) {
+            throw reject();
+        }
+    }
+
+    // sqrt(-4) is NaN as a double but 2i outside Real format: let the
+    // interpreter produce it
+    void bailOnComplex() {
+        if (env.getComplexFormat() == complex_format::Real) return;
+        a.emit({0x66, 0x0F, 0x2E, 0xC0});                              // ucomisd xmm0, xmm0
+        bails.push_back(a.jcc(JP));
+    }
+
+    // a constant meeting a runtime double goes through decKernel, which
+    // accepts only numbers and sees them through toDouble
+    double numeric(const valptr_t &v) {
+        if (!v || !isNumeric(v->kind())) throw reject();
+        return toDouble(*v);
+    }
+
+    void bind(binding &b, const result &r) {
+        b.assigned = true;
+        if (r.kind == res_kind::Const) {
+            b.isConst = true;
+            b.value = r.value;
+        } else {
+            b.isConst = false;
+            b.value.reset();
+            if (b.disp == 0) b.disp = newSlot();
+            a.storeSlot(b.disp);
+        }
+    }
+
+    result read(const binding &b) {
+        if (!b.assigned) throw reject();
+        if (b.isConst) return result{res_kind::Const, b.value};
+        a.loadSlot(b.disp);
+        return result{res_kind::Dynamic, nullptr};
+    }
+
+    void finish(const result &r) {
+        if (r.kind == res_kind::Returned) return;
+        if (r.kind == res_kind::Const) {
+            consts.push_back(r.value);
+            a.returnStatus(static_cast<int32_t>(consts.size() + 1));
+            return;
+        }
+        a.emit({0x48, 0x8B, 0x8D});    // mov rcx, [rbp-8]
+        a.imm32(-8);
+        a.emit({0xF2, 0x0F, 0x11, 0x01}); // movsd [rcx], xmm0
+        a.returnStatus(0);
+    }
+
+    // evaluate both operands; true if both are constants, otherwise the
+    // left value is left in xmm0 and the right in xmm1
+    bool operands(const binary_op_node &n, bool guarded, valptr_t &lc, valptr_t &rc) {
+        result l = gen(*n.left, false, guarded);
+        const size_t beforePush = a.here();
+        if (l.kind == res_kind::Dynamic) a.push();
+        const size_t afterPush = a.here();
+        result r = gen(*n.right, false, guarded);
+        if (l.kind == res_kind::Const && r.kind == res_kind::Const) {
+            lc = l.value;
+            rc = r.value;
+            return true;
+        }
+        if (l.kind == res_kind::Dynamic && r.kind == res_kind::Dynamic) {
+            a.moveToXmm1();
+            a.pop();
+        } else if (l.kind == res_kind::Dynamic) {
+            double rv = numeric(r.value);
+            if (a.here() == afterPush) a.code.resize(beforePush);
+            else a.pop();
+            a.loadConst(rv, true);
+        } else {
+            double lv = numeric(l.value);
+            a.moveToXmm1();
+            a.loadConst(lv, false);
+        }
+        return false;
+    }
+
+    result genBinary(const binary_op_node &n, bool guarded) {
+        // booleans only exist as If conditions
+        if (isComparisonOp(n.op)) {
+            valptr_t lc, rc;
+            if (!operands(n, guarded, lc, rc)) throw reject();
+            return result{res_kind::Const, fold(n.op, lc, rc)};
+        }
+        valptr_t lc, rc;
+        if (operands(n, guarded, lc, rc)) return result{res_kind::Const, fold(n.op, lc, rc)};
+        switch (n.op) {
+            case binary_op::Add: a.emit({0xF2, 0x0F, 0x58, 0xC1}); break; // addsd xmm0, xmm1
+            case binary_op::Sub: a.emit({0xF2, 0x0F, 0x5C, 0xC1}); break; // subsd
+            case binary_op::Mul: a.emit({0xF2, 0x0F, 0x59, 0xC1}); break; // mulsd
+            case binary_op::Div:
+                // the interpreter throws on a zero divisor: let it
+                a.emit({0x66, 0x0F, 0x57, 0xD2});                          // xorpd xmm2, xmm2
+                a.emit({0x66, 0x0F, 0x2E, 0xCA});                          // ucomisd xmm1, xmm2
+                bails.push_back(a.jcc(JE));
+                a.emit({0xF2, 0x0F, 0x5E, 0xC1});                          // divsd
+                break;
+            case binary_op::Pow:
+                a.call(reinterpret_cast<uint64_t>(&powKernel));
+                bailOnComplex();
+                break;
+            default:
+                throw reject();
+        }
+        return result{res_kind::Dynamic, nullptr};
+    }
+
+    // compile a condition: 1/0 if known at compile time, else -1 after
+    // emitting jumps (appended to falseJumps) taken when it is false
+    int genCond(const exprnode &n, bool guarded, std::vector<size_t> &falseJumps) {
+        if (n.kind() == node_kind::BinaryOp) {
+            auto &b = static_cast<const binary_op_node &>(n);
+            if (isComparisonOp(b.op)) {
+                valptr_t lc, rc;
+                if (operands(b, guarded, lc, rc)) return truth(fold(b.op, lc, rc));
+                switch (b.op) {
+                    case binary_op::Lt:
+                        a.emit({0x66, 0x0F, 0x2E, 0xC8}); // ucomisd xmm1, xmm0
+                        falseJumps.push_back(a.jcc(JBE));
+                        break;
+                    case binary_op::Le:
+                        a.emit({0x66, 0x0F, 0x2E, 0xC8});
+                        falseJumps.push_back(a.jcc(JB));
+                        break;
+                    case binary_op::Gt:
+                        a.emit({0x66, 0x0F, 0x2E, 0xC1}); // ucomisd xmm0, xmm1
+                        falseJumps.push_back(a.jcc(JBE));
+                        break;
+                    case binary_op::Ge:
+                        a.emit({0x66, 0x0F, 0x2E, 0xC1});
+                        falseJumps.push_back(a.jcc(JB));
+                        break;
+                    case binary_op::Eq:
+                        a.emit({0x66, 0x0F, 0x2E, 0xC1});
+                        falseJumps.push_back(a.jcc(JNE));
+                        falseJumps.push_back(a.jcc(JP)); // NaN
+                        break;
+                    default: { // Ne, true for NaN
+                        a.emit({0x66, 0x0F, 0x2E, 0xC1});
+                        size_t unordered = a.jcc(JP);
+                        falseJumps.push_back(a.jcc(JE));
+                        a.bind(unordered);
+                        break;
+                    }
+                }
+                return -1;
+            }
+        }
+        result r = gen(n, false, guarded);
+        if (r.kind != res_kind::Const) throw reject(); // a double is not a condition
+        return truth(r.value);
+    }
+
+    int truth(const valptr_t &v) {
+        try {
+            return isTrue(v) ? 1 : 0;
+        } catch (const std::exception &) {
+            throw reject();
+        }
+    }
+
+    result genIf(const if_node &n, bool tail, bool guarded) {
+        std::vector<size_t> falseJumps;
+        const int c = genCond(*n.cond, guarded, falseJumps);
+        if (c == 1) return gen(*n.then_branch, tail, guarded);
+        if (c == 0) {
+            if (n.else_branch) return gen(*n.else_branch, tail, guarded);
+            return result{res_kind::Const, none};
+        }
+        if (tail) {
+            // each branch returns on its own, so they may differ in kind
+            finish(gen(*n.then_branch, true, true));
+            for (size_t j : falseJumps) a.bind(j);
+            finish(n.else_branch ? gen(*n.else_branch, true, true) : result{res_kind::Const, none});
+            return result{res_kind::Returned, nullptr};
+        }
+        if (!n.else_branch) throw reject();
+        if (gen(*n.then_branch, false, true).kind != res_kind::Dynamic) throw reject();
+        const size_t done = a.jmp();
+        for (size_t j : falseJumps) a.bind(j);
+        if (gen(*n.else_branch, false, true).kind != res_kind::Dynamic) throw reject();
+        a.bind(done);
+        return result{res_kind::Dynamic, nullptr};
+    }
+
+    static void collectNames(const exprnode &n, std::vector<std::string> &names, node_kind k) {
+        if (n.kind() == k) {
+            if (k == node_kind::Var) names.push_back(static_cast<const var_node &>(n).name);
+            else names.push_back(static_cast<const assign_node &>(n).name);
+        }
+        for (auto* c : children(n)) collectNames(**c, names, k);
+    }
+
+    result genLet(const let_node &n, bool tail, bool guarded) {
+        // temps are computed eagerly, which is only sound if the body
+        // cannot change what they read before their first use
+        std::vector<std::string> reads, writes;
+        for (const auto &t : n.temps) collectNames(*t, reads, node_kind::Var);
+        collectNames(*n.body, writes, node_kind::Assign);
+        for (const auto &w : writes) {
+            for (const auto &r : reads) {
+                if (w == r) throw reject();
+            }
+        }
+        for (size_t i = 0; i < n.temps.size(); ++i) {
+            result r = gen(*n.temps[i], false, guarded);
+            bind(temps[{&n, i}], r);
+        }
+        return gen(*n.body, tail, guarded);
+    }
+
+    result genCall(const call_node &n, bool guarded) {
+        if (n.callee->kind() != node_kind::Var || n.args.size() != 1) throw reject();
+        const function* fn = env.getFunction(static_cast<const var_node &>(*n.callee).name);
+        if (!fn || !fn->isBuiltin || !fn->numericImpl) throw reject();
+        result arg = gen(*n.args[0], false, guarded);
+        if (arg.kind == res_kind::Const) {
+            try {
+                return result{res_kind::Const, fn->builtinImpl({arg.value}, env)};
+            } catch (const std::exception &) {
+                throw reject();
+            }
+        }
+        a.call(reinterpret_cast<uint64_t>(fn->numericImpl));
+        bailOnComplex();
+        return result{res_kind::Dynamic, nullptr};
+    }
+
+    // `guarded`: inside an If branch, where assignments would need merging
+    result gen(const exprnode &n, bool tail, bool guarded) {
+        switch (n.kind()) {
+            case node_kind::Literal: {
+                const valptr_t &v = static_cast<const literal_node &>(n).val;
+                if (!v) throw reject();
+                return result{res_kind::Const, v};
+            }
+            case node_kind::Var: {
+                auto it = vars.find(static_cast<const var_node &>(n).name);
+                if (it == vars.end()) throw reject(); // a global
+                return read(it->second);
+            }
+            case node_kind::Temp: {
+                auto &t = static_cast<const temp_node &>(n);
+                auto it = temps.find({t.owner, t.index});
+                if (it == temps.end()) throw reject();
+                return read(it->second);
+            }
+            case node_kind::Assign: {
+                auto &as = static_cast<const assign_node &>(n);
+                auto it = vars.find(as.name);
+                if (guarded || it == vars.end()) throw reject();
+                result r = gen(*as.rhs, false, guarded);
+                bind(it->second, r);
+                return r;
+            }
+            case node_kind::Local: {
+                if (guarded) throw reject();
+                for (const auto &name : static_cast<const local_node &>(n).names) vars.try_emplace(name);
+                return result{res_kind::Const, none};
+            }
+            case node_kind::Block: {
+                auto &b = static_cast<const block_node &>(n);
+                result r{res_kind::Const, none};
+                for (size_t i = 0; i < b.stmts.size(); ++i) {
+                    r = gen(*b.stmts[i], tail && i + 1 == b.stmts.size(), guarded);
+                }
+                return r;
+            }
+            case node_kind::If:
+                return genIf(static_cast<const if_node &>(n), tail, guarded);
+            case node_kind::Let:
+                return genLet(static_cast<const let_node &>(n), tail, guarded);
+            case node_kind::BinaryOp:
+                return genBinary(static_cast<const binary_op_node &>(n), guarded);
+            case node_kind::Call:
+                return genCall(static_cast<const call_node &>(n), guarded);
+            default:
+                throw reject(); // loops
+        }
+    }
+
+public:
+    explicit compiler(runtime_env &env) : env(env) {}
+
+    std::shared_ptr<jit_code> compile(const function &fn, const exprnode &body) {
+        // int f(const double* args /*rdi*/, double* out /*rsi*/)
+        a.emit({0x55, 0x48, 0x89, 0xE5});      // push rbp; mov rbp, rsp
+        a.emit({0x48, 0x81, 0xEC});            // sub rsp, imm32 (patched below)
+        const size_t frameSize = a.here();
+        a.imm32(0);
+        a.emit({0x48, 0x89, 0xB5});            // mov [rbp-8], rsi
+        a.imm32(-8);
+        for (size_t i = 0; i < fn.params.size(); ++i) {
+            a.loadArg(static_cast<int32_t>(8 * i));
+            binding &b = vars[fn.params[i]];
+            bind(b, result{res_kind::Dynamic, nullptr});
+        }
+
+        finish(gen(body, true, false));
+
+        for (size_t j : bails) a.bind(j);
+        a.returnStatus(1);
+
+        int32_t bytes = (frameBytes + 15) / 16 * 16;
+        std::memcpy(&a.code[frameSize], &bytes, 4);
+        return std::make_shared<jit_code>(a.code, fn.params.size(), std::move(consts));
+    }
+};
+
+} // namespace
+
+bool jitSupported() { return true; }
+
+std::shared_ptr<jit_code> jitCompile(const function &fn, runtime_env &env) {
+    if (fn.isBuiltin) return nullptr;
+    const exprnode* body = dynamic_cast<const exprnode*>(fn.body.get());
+    if (!body) return nullptr;
+    try {
+        return compiler(env).compile(fn, *body);
+    } catch (const reject &) {
+        return nullptr;
+    } catch (const std::runtime_error &) {
+        return nullptr; // no executable memory: interpret
+    }
+}
+
+#else
+
+bool jitSupported() { return false; }
+
+std::shared_ptr<jit_code> jitCompile(const function & /*fn*/, runtime_env & /*env*/) {
+    return nullptr;
+}
+
+#endif // TI_JIT_X86_64
+
+std::shared_ptr<jit_code> jitCodeFor(const function &fn, runtime_env &env) {
+    if (fn.isBuiltin) return nullptr;
+    const size_t version = env.getFunctionVersion();
+    std::shared_ptr<const jit_entry> entry = std::atomic_load(&fn.jitEntry);
+    if (!entry || entry->version != version || entry->mode != env.getMode() ||
+        entry->format != env.getComplexFormat()) {
+        // threads racing here each compile; the last store wins, and any
+        // of the results is right
+        auto fresh = std::make_shared<jit_entry>();
+        fresh->code = jitCompile(fn, env);
+        fresh->version = version;
+        fresh->mode = env.getMode();
+        fresh->format = env.getComplexFormat();
+        entry = fresh;
+        std::atomic_store(&fn.jitEntry, entry);
+    }
+    return entry->code;
+}
+
+} // namespace ti
@@ -0,0 +1,1247 @@
+#include "../include/lists.h"
+#include "../include/runtimeenv.h"
+#include "../include/evaluator.h"
+#include "../include/batch.h"
+#include "../include/memo.h"
+#include "../include/threadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace ti {
+
+using namespace ast;
+
+namespace {
+
+// elements per parallel chunk of a list map
+constexpr size_t MAP_GRAIN = 2048;
+// elements folded left to right before partial results combine pairwise;
+// fixed, so a reduction gives the same bits however many threads run it
+constexpr size_t REDUCE_BLOCK = 1024;
+// elements per parallel chunk of decimal_array arithmetic
+constexpr size_t ARRAY_GRAIN = 16384;
+// elements a range or pipeline yields at a time
+constexpr size_t STREAM_CHUNK = 64 * REDUCE_BLOCK;
+
+// one operand of decimal_array arithmetic: its doubles, or a number that
+// pairs with every element (stride 0)
+struct array_operand {
+    const double* xs = nullptr;
+    size_t stride = 1;
+    size_t n = 0;
+    bool decimal = false; // its elements are decimals, not exact numbers
+    double scalar = 0;
+};
+
+bool readOperand(const value &v, array_operand &o) {
+    if (v.kind() == value_kind::DecimalArray) {
+        const auto &a = static_cast<const decimal_array &>(v);
+        o.xs = a.values().data();
+        o.n = a.size();
+        o.decimal = !a.isIntegral();
+        return true;
+    }
+    if (!isNumeric(v.kind())) return false;
+    o.scalar = toDouble(v);
+    o.xs = &o.scalar;
+    o.stride = 0;
+    o.decimal = v.kind() == value_kind::Decimal;
+    return true;
+}
+
+// out[i] = f(a[i], b[i]) over [begin, end), with the broadcast side hoisted
+// so each loop is a plain SIMD-friendly sweep
+template<typename F>
+void elementwise(const array_operand &a, const array_operand &b, double* out, size_t begin, size_t end, F f) {
+    if (a.stride && b.stride) {
+        for (size_t i = begin; i < end; ++i) out[i] = f(a.xs[i], b.xs[i]);
+    } else if (a.stride) {
+        const double y = b.xs[0];
+        for (size_t i = begin; i < end; ++i) out[i] = f(a.xs[i], y);
+    } else {
+        const double x = a.xs[0];
+        for (size_t i = begin; i < end; ++i) out[i] = f(x, b.xs[i]);
+    }
+}
+
+} // namespace
+
+// === index_range ===
+
+valptr_t index_range::at(size_t i, calc_mode mode) const {
+    valptr_t offset = applyBinary(binary_op::Mul, std::make_shared<integer>(static_cast<long long>(i)), step);
+    return applyMode(applyBinary(binary_op::Add, low, offset), mode);
+}
+
+bool index_range::decimal() const {
+    // a decimal step makes every i*step a double product; a decimal low
+    // with an integer step only matches while i*step is exact in a double
+    if (step->kind() == value_kind::Decimal) return true;
+    return low->kind() == value_kind::Decimal && step->kind() == value_kind::Integer &&
+           std::fabs(stepValue()) * static_cast<double>(count) < 9007199254740992.0;
+}
+
+bool index_range::integral(long long &lo, long long &st) const {
+    if (low->kind() != value_kind::Integer || step->kind() != value_kind::Integer) return false;
+    const BigInt &l = static_cast<const integer &>(*low).getValue();
+    const BigInt &s = static_cast<const integer &>(*step).getValue();
+    const BigInt last = l + s * BigInt(static_cast<long long>(count > 0 ? count - 1 : 0));
+    const BigInt min(std::numeric_limits<long long>::min());
+    const BigInt max(std::numeric_limits<long long>::max());
+    for (const BigInt* v : {&l, &s, &last}) {
+        if (*v < min || *v > max) return false;
+    }
+    lo = l.to_long_long();
+    st = s.to_long_long();
+    return true;
+}
+
+index_range makeRange(const valptr_t &low, const valptr_t &high, const valptr_t &step, calc_mode mode) {
+    for (const valptr_t *v : {&low, &high, &step}) {
+        if (!*v || !isNumeric((*v)->kind())) throw std::runtime_error("range bounds and step must be numbers");
+    }
+    index_range r;
+    r.low = low;
+    r.step = step;
+    const double st = r.stepValue();
+    if (st == 0.0) throw std::runtime_error("step must be nonzero");
+    const double est = std::floor((toDouble(*high) - r.lowValue()) / st);
+    if (std::isnan(est) || est > 1e15) throw std::runtime_error("range is too long");
+
+    // the estimate can be off by one from rounding; settle it with the same
+    // test a For loop uses
+    size_t n = est < 0 ? 0 : static_cast<size_t>(est) + 1;
+    while (n > 0 && !forContinues(r.at(n - 1, mode), high, step)) --n;
+    while (forContinues(r.at(n, mode), high, step)) ++n;
+    r.count = n;
+    return r;
+}
+
+// === index_expr ===
+
+namespace {
+
+bool isComparison(binary_op op) {
+    return op == binary_op::Eq || op == binary_op::Ne || op == binary_op::Lt || op == binary_op::Le ||
+           op == binary_op::Gt || op == binary_op::Ge;
+}
+
+bool fitsLongLong(const BigInt &i) {
+    static const BigInt min(std::numeric_limits<long long>::min());
+    static const BigInt max(std::numeric_limits<long long>::max());
+    return i >= min && i <= max;
+}
+
+// v as a long long, if it is an integer that fits one
+bool smallInt(const value &v, long long &out) {
+    if (v.kind() != value_kind::Integer) return false;
+    const BigInt i = static_cast<const integer &>(v).getValue();
+    if (!fitsLongLong(i)) return false;
+    out = i.to_long_long();
+    return true;
+}
+
+// base^e for 0 <= e < 64; false on overflow
+bool intPower(long long base, long long e, long long &out) {
+    long long r = 1;
+    for (; e > 0; --e) {
+        if (__builtin_mul_overflow(r, base, &r)) return false;
+    }
+    out = r;
+    return true;
+}
+
+} // namespace
+
+index_expr::index_expr(const exprnode &expr, const std::string &var, runtime_env &env) : mode(env.getMode()) {
+    if (compile(expr, var, env, true)) finish();
+}
+
+// supported if every evaluation fits the fixed operand stack
+void index_expr::finish() {
+    size_t height = 0, depth = 0;
+    for (const step &s : steps) {
+        height = s.kind == step_kind::Op ? height - 1 : height + 1;
+        depth = std::max(depth, height);
+    }
+    ok = depth <= MAX_DEPTH;
+}
+
+bool index_expr::pushConstant(const valptr_t &v) {
+    if (!v || !isNumeric(v->kind())) return false;
+    step s(step_kind::Const);
+    s.constant = v;
+    s.realConstant = toDouble(*v);
+    const BigInt i = v->kind() == value_kind::Integer ? static_cast<const integer &>(*v).getValue() : BigInt(0);
+    if (v->kind() == value_kind::Integer && fitsLongLong(i)) {
+        s.intConstant = i.to_long_long();
+    } else {
+        exactInts = false;
+    }
+    steps.push_back(std::move(s));
+    return true;
+}
+
+bool index_expr::pushOp(binary_op op, size_t leftStart, size_t rightStart, bool top) {
+    if (isComparison(op) && !top) return false;
+    const bool constLeft = rightStart == leftStart + 1 && steps[leftStart].kind == step_kind::Const;
+    const bool constRight = steps.size() == rightStart + 1 && steps.back().kind == step_kind::Const;
+    if (op == binary_op::Div) {
+        if (!(constRight && steps.back().realConstant != 0.0)) return false;
+        exactInts = false;
+    }
+    if (op == binary_op::Pow) {
+        if (!constRight || steps.back().constant->kind() != value_kind::Integer) return false;
+        const BigInt e = static_cast<const integer &>(*steps.back().constant).getValue();
+        if (e.sign() < 0) return false;
+        if (e >= BigInt(64)) exactInts = false;
+    }
+    if (constLeft && constRight) {
+        // the same for every element, so computed once
+        valptr_t v = applyMode(applyBinary(op, steps[leftStart].constant, steps.back().constant), mode);
+        steps.erase(steps.begin() + static_cast<std::ptrdiff_t>(leftStart), steps.end());
+        return pushConstant(v);
+    }
+    step s(step_kind::Op);
+    s.op = op;
+    steps.push_back(std::move(s));
+    return true;
+}
+
+bool index_expr::compile(const exprnode &n, const std::string &var, runtime_env &env, bool top) {
+    switch (n.kind()) {
+        case node_kind::Literal:
+            return pushConstant(static_cast<const literal_node &>(n).val);
+        case node_kind::Var: {
+            const std::string &name = static_cast<const var_node &>(n).name;
+            if (name != var) return pushConstant(env.lookupVariable(name));
+            steps.emplace_back(step_kind::Var);
+            return true;
+        }
+        case node_kind::Let:
+            return compile(*static_cast<const let_node &>(n).body, var, env, top);
+        case node_kind::Temp: {
+            // recomputed at each use: a temp only saves work, the value is the same
+            auto &t = static_cast<const temp_node &>(n);
+            return compile(*t.owner->temps[t.index], var, env, false);
+        }
+        case node_kind::BinaryOp: {
+            auto &b = static_cast<const binary_op_node &>(n);
+            const size_t leftStart = steps.size();
+            if (!compile(*b.left, var, env, false)) return false;
+            const size_t rightStart = steps.size();
+            return compile(*b.right, var, env, false) && pushOp(b.op, leftStart, rightStart, top);
+        }
+        default:
+            return false;
+    }
+}
+
+bool index_expr::condition() const {
+    return steps.back().kind == step_kind::Op && isComparison(steps.back().op);
+}
+
+std::shared_ptr<const index_expr> index_expr::combined(binary_op op, const valptr_t &c, bool cLeft) const {
+    if (!ok || condition()) return nullptr;
+    auto out = std::make_shared<index_expr>(*this);
+    const size_t n = steps.size();
+    if (!out->pushConstant(c)) return nullptr;
+    if (cLeft) std::rotate(out->steps.begin(), out->steps.end() - 1, out->steps.end());
+    if (!out->pushOp(op, 0, cLeft ? 1 : n, false)) return nullptr;
+    out->finish();
+    return out->ok ? out : nullptr;
+}
+
+valptr_t index_expr::at(const valptr_t &x) const {
+    valptr_t stack[MAX_DEPTH];
+    size_t h = 0;
+    for (const step &s : steps) {
+        switch (s.kind) {
+            case step_kind::Const: stack[h++] = s.constant; break;
+            case step_kind::Var: stack[h++] = x; break;
+            case step_kind::Op:
+                --h;
+                stack[h - 1] = applyMode(applyBinary(s.op, stack[h - 1], stack[h]), mode);
+                break;
+        }
+    }
+    return stack[0];
+}
+
+namespace {
+
+template<typename T>
+bool compareValues(binary_op op, T a, T b) {
+    switch (op) {
+        case binary_op::Eq: return a == b;
+        case binary_op::Ne: return a != b;
+        case binary_op::Lt: return a < b;
+        case binary_op::Le: return a <= b;
+        case binary_op::Gt: return a > b;
+        default: return a >= b;
+    }
+}
+
+} // namespace
+
+// a comparison yields 1 or 0
+bool index_expr::evalInt(long long x, long long &out) const {
+    if (!exactInts) return false;
+    long long stack[MAX_DEPTH];
+    size_t h = 0;
+    for (const step &s : steps) {
+        switch (s.kind) {
+            case step_kind::Const: stack[h++] = s.intConstant; break;
+            case step_kind::Var: stack[h++] = x; break;
+            case step_kind::Op: {
+                --h;
+                long long &a = stack[h - 1];
+                const long long b = stack[h];
+                bool overflow = false;
+                switch (s.op) {
+                    case binary_op::Add: overflow = __builtin_add_overflow(a, b, &a); break;
+                    case binary_op::Sub: overflow = __builtin_sub_overflow(a, b, &a); break;
+                    case binary_op::Mul: overflow = __builtin_mul_overflow(a, b, &a); break;
+                    case binary_op::Pow: overflow = !intPower(a, b, a); break;
+                    default: a = compareValues(s.op, a, b); break;
+                }
+                if (overflow) return false;
+                break;
+            }
+        }
+    }
+    out = stack[0];
+    return true;
+}
+
+// with constants folded, every operator has x on one side, and a decimal
+// operand makes the result a decimal in plain double arithmetic; a
+// comparison yields 1 or 0
+bool index_expr::evalDecimal(double x, double &out) const {
+    if (steps.back().kind == step_kind::Const) return false;
+    double stack[MAX_DEPTH];
+    size_t h = 0;
+    for (const step &s : steps) {
+        switch (s.kind) {
+            case step_kind::Const: stack[h++] = s.realConstant; break;
+            case step_kind::Var: stack[h++] = x; break;
+            case step_kind::Op: {
+                --h;
+                double &a = stack[h - 1];
+                const double b = stack[h];
+                switch (s.op) {
+                    case binary_op::Add: a = a + b; break;
+                    case binary_op::Sub: a = a - b; break;
+                    case binary_op::Mul: a = a * b; break;
+                    case binary_op::Div: a = a / b; break;
+                    case binary_op::Pow: a = std::pow(a, b); break;
+                    default: a = compareValues(s.op, a, b); break;
+                }
+                break;
+            }
+        }
+    }
+    out = stack[0];
+    return true;
+}
+
+bool index_expr::atInt(long long x, long long &out) const {
+    return !condition() && evalInt(x, out);
+}
+
+bool index_expr::atDecimal(double x, double &out) const {
+    return !condition() && evalDecimal(x, out);
+}
+
+bool index_expr::testInt(long long x, bool &out) const {
+    long long v;
+    if (!condition() || !evalInt(x, v)) return false;
+    out = v != 0;
+    return true;
+}
+
+bool index_expr::testDecimal(double x, bool &out) const {
+    double v;
+    if (!condition() || !evalDecimal(x, v)) return false;
+    out = v != 0;
+    return true;
+}
+
+namespace {
+
+// ix at the elements of r, on any thread: in long long arithmetic while
+// nothing overflows, in doubles over a decimal range, else boxed as the
+// interpreter computes them
+class range_elements {
+private:
+    const index_expr &ix;
+    const index_range &r;
+    long long lo = 0, st = 0;
+    bool ints;
+    bool decimals;
+
+public:
+    range_elements(const index_expr &ix, const index_range &r)
+        : ix(ix), r(r), ints(r.integral(lo, st)), decimals(r.decimal()) {}
+
+    bool integral() const { return ints; }
+
+    // index k of an integral range; lo + k*st may wrap in between, but
+    // index_range::integral() ensured the sum itself fits
+    long long index(size_t k) const {
+        return static_cast<long long>(static_cast<unsigned long long>(lo) +
+                                      static_cast<unsigned long long>(k) * static_cast<unsigned long long>(st));
+    }
+
+    bool intAt(size_t k, long long &out) const { return ints && ix.atInt(index(k), out); }
+
+    valptr_t at(size_t k) const {
+        long long i;
+        if (intAt(k, i)) return std::make_shared<integer>(i);
+        double d;
+        if (decimals && ix.atDecimal(r.lowValue() + static_cast<double>(k) * r.stepValue(), d)) {
+            return std::make_shared<decimal>(d);
+        }
+        return ix.at(ints ? std::make_shared<integer>(index(k)) : r.at(k, ix.getMode()));
+    }
+
+    // elements [begin, begin + n) into out[0, n)
+    void fill(size_t begin, size_t n, valptr_t* out) const {
+        parallelFor(n, MAP_GRAIN, [&](size_t b, size_t e) {
+            checkpoint();
+            for (size_t i = b; i < e; ++i) out[i] = at(begin + i);
+        });
+    }
+};
+
+// the batch evaluator for expr over r, or null if r or expr rule it out
+std::unique_ptr<batch_evaluator> rangeBatch(const exprnode &expr, const std::string &var, const index_range &r,
+                                            runtime_env &env) {
+    if (!r.decimal()) return nullptr;
+    auto batch = std::make_unique<batch_evaluator>(expr, var, env);
+    if (!batch->supported()) return nullptr;
+    return batch;
+}
+
+// === range evaluation ===
+
+// a source of elements a slice at a time (see the fused pipelines below)
+struct stream {
+    // the element count, or UNKNOWN after a filter
+    static constexpr size_t UNKNOWN = std::numeric_limits<size_t>::max();
+    size_t size = 0;
+    virtual ~stream() = default;
+    // replaces out with up to n next elements; empty only at the end
+    virtual void pull(size_t n, std::vector<valptr_t> &out) = 0;
+};
+
+// every element left in s
+std::vector<valptr_t> collect(stream &s) {
+    std::vector<valptr_t> out, xs;
+    if (s.size != stream::UNKNOWN) out.reserve(s.size);
+    for (s.pull(STREAM_CHUNK, xs); !xs.empty(); s.pull(STREAM_CHUNK, xs)) {
+        out.insert(out.end(), std::make_move_iterator(xs.begin()), std::make_move_iterator(xs.end()));
+    }
+    return out;
+}
+
+// seq(expr, var, low, high[, step]), one slice at a time: through the
+// batch evaluator for a decimal range it supports, else the compiled
+// expression in parallel, else the interpreter element by element
+struct range_stream : stream {
+    const exprnode* expr = nullptr;
+    std::string var;
+    index_range r;
+    runtime_env &env;
+    std::unique_ptr<batch_evaluator> batch;
+    std::shared_ptr<const index_expr> ix;
+    bool charged = false; // the budget was charged when the lazy seq was made
+    size_t pos = 0;
+
+    range_stream(const exprnode &e, std::string v, index_range range, runtime_env &env)
+        : expr(&e), var(std::move(v)), r(std::move(range)), env(env) {
+        size = r.count;
+        batch = rangeBatch(e, var, r, env);
+        if (batch) return;
+        auto compiled = std::make_shared<index_expr>(e, var, env);
+        if (compiled->supported()) ix = std::move(compiled);
+    }
+
+    // r under a compiled expression; charged if the budget already was
+    range_stream(index_range range, std::shared_ptr<const index_expr> ix, runtime_env &env, bool charged)
+        : r(std::move(range)), env(env), ix(std::move(ix)), charged(charged) {
+        size = r.count;
+    }
+
+    void pull(size_t n, std::vector<valptr_t> &out) override {
+        n = std::min(n, size - pos);
+        out.clear();
+        if (batch) {
+            std::vector<double> xs(n);
+            const double lo = r.lowValue();
+            const double st = r.stepValue();
+            for (size_t i = 0; i < n; ++i) xs[i] = lo + static_cast<double>(pos + i) * st;
+            out = batch->eval(xs.data(), n);
+        } else if (ix) {
+            // each element is a loop iteration for the budget
+            if (!charged) env.checkBudget(n);
+            out.resize(n);
+            range_elements(*ix, r).fill(pos, n, out.data());
+        } else {
+            const calc_mode mode = env.getMode();
+            scoped_variable bound(env, var);
+            evaluator ev(env);
+            for (size_t i = pos; i < pos + n; ++i) {
+                env.checkBudget();
+                bound.set(r.at(i, mode));
+                out.push_back(ev.run(*expr));
+            }
+        }
+        pos += n;
+    }
+};
+
+} // namespace
+
+// expr at every element of r with var bound to it; a decimal range runs
+// through the batch evaluator when the expression allows it, and an
+// expression index_expr supports runs in parallel
+std::vector<valptr_t> evalOverRange(const exprnode &expr, const std::string &var, const index_range &r,
+                                    runtime_env &env) {
+    range_stream s(expr, var, r, env);
+    return collect(s);
+}
+
+// === lazy_seq ===
+
+lazy_seq::lazy_seq(std::shared_ptr<const index_expr> expr, index_range range)
+    : expr(std::move(expr)), range(std::move(range)) {}
+
+const valptr_t &lazy_seq::materialized() const {
+    std::call_once(built, [this] {
+        std::vector<valptr_t> out(range.count);
+        range_elements(*expr, range).fill(0, range.count, out.data());
+        cached = std::make_shared<valuelist>(std::move(out));
+    });
+    return cached;
+}
+
+void materializeArgs(std::vector<valptr_t> &args) {
+    for (valptr_t &a : args) {
+        if (a && a->kind() == value_kind::LazySeq) a = static_cast<const lazy_seq &>(*a).materialized();
+    }
+}
+
+valptr_t mapList(const valuelist &l, const std::function<valptr_t(const valptr_t &)> &f) {
+    const std::vector<valptr_t> &in = l.elements();
+    std::vector<valptr_t> out(in.size());
+    parallelFor(in.size(), MAP_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) out[i] = f(in[i]);
+    });
+    return std::make_shared<valuelist>(std::move(out));
+}
+
+// === decimal_array ===
+
+decimal_array::decimal_array(double_buffer xs, bool integral) : xs(std::move(xs)), integral(integral) {}
+
+valptr_t decimal_array::at(size_t i) const {
+    if (integral) return std::make_shared<integer>(static_cast<long long>(xs[i]));
+    return std::make_shared<decimal>(xs[i]);
+}
+
+valptr_t decimal_array::boxed() const {
+    std::vector<valptr_t> out(xs.size());
+    parallelFor(xs.size(), MAP_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) out[i] = at(i);
+    });
+    return std::make_shared<valuelist>(std::move(out));
+}
+
+std::string decimal_array::toString() const {
+    std::string s = "{";
+    for (size_t i = 0; i < xs.size(); ++i) {
+        if (i != 0) s += ", ";
+        s += integral ? std::to_string(static_cast<long long>(xs[i])) : decimal(xs[i]).toString();
+    }
+    return s + "}";
+}
+
+size_t decimal_array::hash() const {
+    size_t h = 0x64617272 + integral;
+    for (double x : xs) h ^= std::hash<double>()(x) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+bool decimal_array::equals(const value &other) const {
+    if (other.kind() != value_kind::DecimalArray) return false;
+    const auto &o = static_cast<const decimal_array &>(other);
+    return integral == o.integral && xs == o.xs;
+}
+
+valptr_t asList(const valptr_t &v) {
+    if (v && v->kind() == value_kind::DecimalArray) return static_cast<const decimal_array &>(*v).boxed();
+    if (v && v->kind() == value_kind::LazySeq) return static_cast<const lazy_seq &>(*v).materialized();
+    return v;
+}
+
+valptr_t decimalArrayArith(binary_op op, const value &l, const value &r) {
+    if (op != binary_op::Add && op != binary_op::Sub && op != binary_op::Mul && op != binary_op::Div &&
+        op != binary_op::Pow) {
+        return nullptr;
+    }
+    array_operand a, b;
+    if (!readOperand(l, a) || !readOperand(r, b)) return nullptr;
+    // exact op exact stays exact, element by element
+    if (!a.decimal && !b.decimal) return nullptr;
+    if (a.stride && b.stride && a.n != b.n) throw std::runtime_error("dimension mismatch");
+    const size_t n = a.stride ? a.n : b.n;
+    if (op == binary_op::Div) {
+        for (size_t i = 0; i < (b.stride ? n : 1); ++i) {
+            if (b.xs[i] == 0.0) throw std::domain_error("division by zero");
+        }
+    }
+    std::vector<double> out(n);
+    parallelFor(n, ARRAY_GRAIN, [&](size_t begin, size_t end) {
+        switch (op) {
+            case binary_op::Add: elementwise(a, b, out.data(), begin, end, [](double x, double y) { return x + y; }); break;
+            case binary_op::Sub: elementwise(a, b, out.data(), begin, end, [](double x, double y) { return x - y; }); break;
+            case binary_op::Mul: elementwise(a, b, out.data(), begin, end, [](double x, double y) { return x * y; }); break;
+            case binary_op::Div: elementwise(a, b, out.data(), begin, end, [](double x, double y) { return x / y; }); break;
+            default: elementwise(a, b, out.data(), begin, end, [](double x, double y) { return std::pow(x, y); }); break;
+        }
+    });
+    return std::make_shared<decimal_array>(std::move(out));
+}
+
+namespace {
+
+// seq(expr, var, low, high[, step]); an expression index_expr supports is
+// left as a lazy_seq, charged to the budget as if it had run
+valptr_t seqForm(const call_node &c, runtime_env &env) {
+    if (c.args.size() != 4 && c.args.size() != 5) throw std::runtime_error("seq expects (expr, var, low, high[, step])");
+    const std::string &var = formVariable(c, 1, "seq");
+    evaluator ev(env);
+    valptr_t low = ev.run(*c.args[2]);
+    valptr_t high = ev.run(*c.args[3]);
+    valptr_t step = c.args.size() == 5 ? ev.run(*c.args[4]) : std::make_shared<integer>(1);
+    index_range r = makeRange(low, high, step, env.getMode());
+    auto ix = std::make_shared<index_expr>(*c.args[0], var, env);
+    if (ix->supported()) {
+        for (size_t done = 0; done < r.count; done += STREAM_CHUNK) env.checkBudget(std::min(STREAM_CHUNK, r.count - done));
+        return std::make_shared<lazy_seq>(std::move(ix), std::move(r));
+    }
+    return std::make_shared<valuelist>(evalOverRange(*c.args[0], var, r, env));
+}
+
+// v as a list, a decimal_array or lazy_seq materialized
+valptr_t listArg(const valptr_t &given, const char* name) {
+    valptr_t v = asList(given);
+    if (!v || v->kind() != value_kind::List) throw std::runtime_error(std::string(name) + " expects a list");
+    return v;
+}
+
+// 1-based position argument of sum/prod
+size_t positionArg(const valptr_t &v, const char* name) {
+    if (!v || v->kind() != value_kind::Integer) throw std::runtime_error(std::string(name) + ": positions must be integers");
+    const BigInt &i = static_cast<const integer &>(*v).getValue();
+    if (i < BigInt(1) || i > BigInt(std::numeric_limits<long long>::max())) {
+        throw std::runtime_error(std::string(name) + ": position out of range");
+    }
+    return static_cast<size_t>(i.to_long_long());
+}
+
+// === fused pipelines ===
+//
+// A reducer whose list argument is built from seq, filter, elementwise
+// operators and numeric builtins does not materialize the lists in
+// between: the argument becomes a tree of streams that yield up to
+// STREAM_CHUNK elements at a time, so memory stays constant however long
+// the range. A lazy_seq streams from its range without being built. Any
+// other list argument is evaluated as usual and read through a list_stream.
+
+struct list_stream : stream {
+    valptr_t owner;
+    size_t pos = 0;
+
+    explicit list_stream(valptr_t l) : owner(std::move(l)) { size = elements().size(); }
+    const std::vector<valptr_t> &elements() const { return static_cast<const valuelist &>(*owner).elements(); }
+
+    void pull(size_t n, std::vector<valptr_t> &out) override {
+        n = std::min(n, size - pos);
+        out.assign(elements().begin() + pos, elements().begin() + pos + n);
+        pos += n;
+    }
+};
+
+// a decimal_array, boxed one slice at a time
+struct array_stream : stream {
+    valptr_t owner;
+    size_t pos = 0;
+
+    explicit array_stream(valptr_t a) : owner(std::move(a)) { size = array().size(); }
+    const decimal_array &array() const { return static_cast<const decimal_array &>(*owner); }
+
+    void pull(size_t n, std::vector<valptr_t> &out) override {
+        n = std::min(n, size - pos);
+        out.resize(n);
+        for (size_t i = 0; i < n; ++i) out[i] = array().at(pos + i);
+        pos += n;
+    }
+};
+
+// the stream over a list value; null for anything else
+std::unique_ptr<stream> valueStream(const valptr_t &v, runtime_env &env) {
+    if (!v) return nullptr;
+    switch (v->kind()) {
+        case value_kind::List: return std::make_unique<list_stream>(v);
+        case value_kind::DecimalArray: return std::make_unique<array_stream>(v);
+        case value_kind::LazySeq: {
+            // from the range even if built: computing keeps the fast paths
+            const auto &l = static_cast<const lazy_seq &>(*v);
+            return std::make_unique<range_stream>(l.indices(), l.expression(), env, true);
+        }
+        default: return nullptr;
+    }
+}
+
+// every element left in s, as a list_stream
+std::unique_ptr<stream> drain(stream &s) {
+    return std::make_unique<list_stream>(std::make_shared<valuelist>(collect(s)));
+}
+
+// l op r elementwise; one side may be a scalar instead of a stream. Both
+// sides have a known size, so they yield slices of the same length.
+struct binary_stream : stream {
+    binary_op op;
+    std::unique_ptr<stream> l, r;
+    valptr_t lc, rc;
+    calc_mode mode;
+    std::vector<valptr_t> rbuf;
+
+    void pull(size_t n, std::vector<valptr_t> &out) override {
+        const valptr_t* rv = nullptr;
+        if (r) {
+            r->pull(n, rbuf);
+            rv = rbuf.data();
+            n = rbuf.size();
+        }
+        if (l) l->pull(n, out);
+        else out.assign(n, lc);
+        parallelFor(out.size(), MAP_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) out[i] = applyMode(applyBinary(op, out[i], rv ? rv[i] : rc), mode);
+        });
+    }
+};
+
+// a numeric builtin, which maps over lists element by element
+struct builtin_stream : stream {
+    const function &fn;
+    std::unique_ptr<stream> arg;
+    runtime_env &env;
+
+    builtin_stream(const function &fn, std::unique_ptr<stream> a, runtime_env &env)
+        : fn(fn), arg(std::move(a)), env(env) {
+        size = arg->size;
+    }
+
+    void pull(size_t n, std::vector<valptr_t> &out) override {
+        arg->pull(n, out);
+        parallelFor(out.size(), MAP_GRAIN, [&](size_t begin, size_t end) {
+            std::vector<valptr_t> one(1);
+            for (size_t i = begin; i < end; ++i) {
+                one[0] = out[i];
+                out[i] = fn.builtinImpl(one, env);
+            }
+        });
+    }
+};
+
+// filter(cond, var, list): the elements for which cond is true, with cond
+// compiled to an index_expr when it allows, else run in the interpreter
+struct filter_stream : stream {
+    std::unique_ptr<stream> inner;
+    const exprnode &cond;
+    std::string var;
+    runtime_env &env;
+    std::unique_ptr<index_expr> ix;
+    std::vector<valptr_t> xs;
+
+    filter_stream(std::unique_ptr<stream> s, const exprnode &cond, std::string v, runtime_env &env)
+        : inner(std::move(s)), cond(cond), var(std::move(v)), env(env) {
+        size = UNKNOWN;
+        ix = std::make_unique<index_expr>(cond, var, env);
+        if (!ix->supported()) ix.reset();
+    }
+
+    static bool truth(const valptr_t &v) {
+        if (!v || v->kind() != value_kind::Boolean) throw std::runtime_error("filter: condition is not true or false");
+        return static_cast<const boolean &>(*v).getValue();
+    }
+
+    // cond at number x through ix, unboxed where it can be
+    bool test(const valptr_t &x) const {
+        bool t;
+        if (x->kind() == value_kind::Decimal && ix->testDecimal(static_cast<const decimal &>(*x).getValue(), t)) return t;
+        long long i;
+        if (smallInt(*x, i) && ix->testInt(i, t)) return t;
+        return truth(ix->at(x));
+    }
+
+    void pull(size_t n, std::vector<valptr_t> &out) override {
+        out.clear();
+        while (out.empty()) {
+            inner->pull(n, xs);
+            if (xs.empty()) return;
+            std::vector<char> keep(xs.size());
+            const bool compiled = ix && std::all_of(xs.begin(), xs.end(), [](const valptr_t &x) {
+                return x && isNumeric(x->kind());
+            });
+            if (compiled) {
+                env.checkBudget(xs.size());
+                parallelFor(xs.size(), MAP_GRAIN, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i) keep[i] = test(xs[i]);
+                });
+            } else {
+                scoped_variable bound(env, var);
+                evaluator ev(env);
+                for (size_t i = 0; i < xs.size(); ++i) {
+                    env.checkBudget();
+                    bound.set(xs[i]);
+                    keep[i] = truth(ev.run(cond));
+                }
+            }
+            for (size_t i = 0; i < xs.size(); ++i) {
+                if (keep[i]) out.push_back(std::move(xs[i]));
+            }
+        }
+    }
+};
+
+// elements [begin, end) of another stream
+struct window_stream : stream {
+    std::unique_ptr<stream> inner;
+    size_t skip;
+    size_t left;
+
+    window_stream(std::unique_ptr<stream> s, size_t begin, size_t end)
+        : inner(std::move(s)), skip(begin), left(end > begin ? end - begin : 0) {
+        size = inner->size == UNKNOWN ? UNKNOWN : left;
+    }
+
+    void pull(size_t n, std::vector<valptr_t> &out) override {
+        while (skip > 0) {
+            inner->pull(std::min(skip, STREAM_CHUNK), out);
+            if (out.empty()) left = 0;
+            skip = out.empty() ? 0 : skip - out.size();
+        }
+        out.clear();
+        if (left == 0) return;
+        inner->pull(std::min(n, left), out);
+        left -= out.size();
+    }
+};
+
+// Fusing reorders evaluation (each chunk runs every stage before the next
+// chunk starts), which is only invisible if no part writes anything
+bool effectFree(const exprnode &n, runtime_env &env) {
+    switch (n.kind()) {
+        case node_kind::Assign:
+        case node_kind::Local:
+        case node_kind::For:
+        case node_kind::While:
+            return false;
+        case node_kind::Call: {
+            auto &c = static_cast<const call_node &>(n);
+            if (c.callee->kind() != node_kind::Var) return false;
+            const function* fn = env.getFunction(static_cast<const var_node &>(*c.callee).name);
+            if (!fn || !(fn->isBuiltin ? fn->pure : isPureFunction(*fn, env))) return false;
+            for (const auto &a : c.args) {
+                if (!effectFree(*a, env)) return false;
+            }
+            return true;
+        }
+        default:
+            for (auto* c : children(n)) {
+                if (!effectFree(**c, env)) return false;
+            }
+            return true;
+    }
+}
+
+const function* calledFunction(const exprnode &n, runtime_env &env) {
+    if (n.kind() != node_kind::Call) return nullptr;
+    auto &c = static_cast<const call_node &>(n);
+    if (c.callee->kind() != node_kind::Var) return nullptr;
+    return env.getFunction(static_cast<const var_node &>(*c.callee).name);
+}
+
+// a compiled range under a number, as one compiled range, so the whole
+// stage keeps the fast paths; null if s is not that or the result would
+// not be supported
+std::unique_ptr<stream> combineRange(const binary_stream &s, runtime_env &env) {
+    if (s.l && s.r) return nullptr;
+    auto* rs = dynamic_cast<range_stream*>(s.l ? s.l.get() : s.r.get());
+    if (!rs || !rs->ix || rs->pos != 0 || rs->ix->getMode() != s.mode) return nullptr;
+    std::shared_ptr<const index_expr> ix = rs->ix->combined(s.op, s.l ? s.rc : s.lc, !s.l);
+    if (!ix) return nullptr;
+    return std::make_unique<range_stream>(rs->r, std::move(ix), env, rs->charged);
+}
+
+// true if n calls the form `name` with a variable as its second argument
+bool isFormCall(const exprnode &n, runtime_env &env, const char* name) {
+    const function* fn = calledFunction(n, env);
+    auto &c = static_cast<const call_node &>(n);
+    if (!fn || !fn->formImpl || static_cast<const var_node &>(*c.callee).name != name) return false;
+    return c.args.size() >= 2 && c.args[1]->kind() == node_kind::Var;
+}
+
+bool isSeqCall(const exprnode &n, runtime_env &env) {
+    auto &c = static_cast<const call_node &>(n);
+    return isFormCall(n, env, "seq") && (c.args.size() == 4 || c.args.size() == 5);
+}
+
+bool isFilterCall(const exprnode &n, runtime_env &env) {
+    return isFormCall(n, env, "filter") && static_cast<const call_node &>(n).args.size() == 3;
+}
+
+// true if n is a pipeline: seq, filter, a lazy seq variable, or an
+// operator or numeric builtin over one
+bool fusible(const exprnode &n, runtime_env &env) {
+    switch (n.kind()) {
+        case node_kind::Call: {
+            if (isSeqCall(n, env) || isFilterCall(n, env)) return true;
+            const function* fn = calledFunction(n, env);
+            auto &c = static_cast<const call_node &>(n);
+            return fn && fn->isBuiltin && fn->numericImpl && c.args.size() == 1 && fusible(*c.args[0], env);
+        }
+        case node_kind::BinaryOp: {
+            auto &b = static_cast<const binary_op_node &>(n);
+            return fusible(*b.left, env) || fusible(*b.right, env);
+        }
+        case node_kind::Var: {
+            const valptr_t v = env.lookupVariable(static_cast<const var_node &>(n).name);
+            return v && v->kind() == value_kind::LazySeq;
+        }
+        default:
+            return false;
+    }
+}
+
+// the stream for a pipeline or a list; null (with the value in scalar) for
+// anything else
+std::unique_ptr<stream> buildStream(const exprnode &n, runtime_env &env, valptr_t &scalar) {
+    if (!fusible(n, env) || n.kind() == node_kind::Var) {
+        scalar = evaluator(env).run(n);
+        return valueStream(scalar, env);
+    }
+    if (n.kind() == node_kind::BinaryOp) {
+        auto &b = static_cast<const binary_op_node &>(n);
+        auto s = std::make_unique<binary_stream>();
+        s->op = b.op;
+        s->mode = env.getMode();
+        s->l = buildStream(*b.left, env, s->lc);
+        s->r = buildStream(*b.right, env, s->rc);
+        if (std::unique_ptr<stream> combined = combineRange(*s, env)) return combined;
+        if (s->l && s->r) {
+            // a filtered side has no length to check until it is read
+            if (s->l->size == stream::UNKNOWN) s->l = drain(*s->l);
+            if (s->r->size == stream::UNKNOWN) s->r = drain(*s->r);
+            if (s->l->size != s->r->size) throw std::runtime_error("dimension mismatch");
+        }
+        s->size = s->l ? s->l->size : s->r->size;
+        return s;
+    }
+    auto &c = static_cast<const call_node &>(n);
+    if (isFilterCall(n, env)) {
+        valptr_t v;
+        std::unique_ptr<stream> inner = buildStream(*c.args[2], env, v);
+        if (!inner) throw std::runtime_error("filter expects a list");
+        return std::make_unique<filter_stream>(std::move(inner), *c.args[0],
+                                               static_cast<const var_node &>(*c.args[1]).name, env);
+    }
+    if (!isSeqCall(n, env)) {
+        valptr_t arg;
+        std::unique_ptr<stream> inner = buildStream(*c.args[0], env, arg);
+        return std::make_unique<builtin_stream>(*calledFunction(n, env), std::move(inner), env);
+    }
+    // the bounds exactly as seqForm reads them
+    evaluator ev(env);
+    valptr_t low = ev.run(*c.args[2]);
+    valptr_t high = ev.run(*c.args[3]);
+    valptr_t step = c.args.size() == 5 ? ev.run(*c.args[4]) : std::make_shared<integer>(1);
+    return std::make_unique<range_stream>(*c.args[0], static_cast<const var_node &>(*c.args[1]).name,
+                                          makeRange(low, high, step, env.getMode()), env);
+}
+
+// the list argument of a reducer as a stream: fused when it is an
+// effect-free pipeline, otherwise evaluated and required to be a list
+std::unique_ptr<stream> listStream(const exprnode &n, runtime_env &env, const char* name) {
+    valptr_t v;
+    std::unique_ptr<stream> s;
+    if (fusible(n, env) && effectFree(n, env)) s = buildStream(n, env, v);
+    else s = valueStream(v = evaluator(env).run(n), env);
+    if (!s) s = std::make_unique<list_stream>(listArg(v, name));
+    return s;
+}
+
+// partial results of consecutive blocks, combined in the fixed pairwise
+// tree: entry k of the stack covers a power-of-two run of blocks and
+// merges like a binary counter, so memory is logarithmic in the length
+class tree_reducer {
+private:
+    binary_op op;
+    calc_mode mode;
+    std::vector<std::pair<size_t, valptr_t>> stack;
+
+    valptr_t combine(const valptr_t &a, const valptr_t &b) const { return applyMode(applyBinary(op, a, b), mode); }
+
+public:
+    tree_reducer(binary_op op, calc_mode mode) : op(op), mode(mode) {}
+
+    void push(valptr_t partial) {
+        size_t blocks = 1;
+        while (!stack.empty() && stack.back().first == blocks) {
+            partial = combine(stack.back().second, partial);
+            blocks *= 2;
+            stack.pop_back();
+        }
+        stack.emplace_back(blocks, std::move(partial));
+    }
+
+    // the unpaired runs fold right to left, as the level-by-level tree does
+    valptr_t result(const valptr_t &identity) const {
+        if (stack.empty()) return identity;
+        valptr_t acc = stack.back().second;
+        for (size_t i = stack.size() - 1; i-- > 0;) acc = combine(stack[i].second, acc);
+        return applyMode(acc, mode);
+    }
+};
+
+// reduce over an integral range: a block whose elements and running result
+// all fit in a long long folds in that arithmetic, any other block boxed,
+// element by element, as the general fold does; both give the same value
+valptr_t reduceIntegral(range_stream &s, const range_elements &elems, tree_reducer &tree, binary_op op,
+                        const valptr_t &identity, calc_mode mode) {
+    const bool add = op == binary_op::Add;
+    for (size_t n = 0; s.pos < s.size; s.pos += n) {
+        n = std::min(STREAM_CHUNK, s.size - s.pos);
+        if (!s.charged) s.env.checkBudget(n);
+        const size_t base = s.pos;
+        std::vector<valptr_t> partial((n + REDUCE_BLOCK - 1) / REDUCE_BLOCK);
+        parallelFor(n, REDUCE_BLOCK, [&](size_t b, size_t e) {
+            long long acc, x;
+            bool exact = elems.intAt(base + b, acc);
+            for (size_t i = b + 1; i < e && exact; ++i) {
+                exact = elems.intAt(base + i, x) &&
+                        !(add ? __builtin_add_overflow(acc, x, &acc) : __builtin_mul_overflow(acc, x, &acc));
+            }
+            if (exact) {
+                partial[b / REDUCE_BLOCK] = std::make_shared<integer>(acc);
+                return;
+            }
+            valptr_t boxed = elems.at(base + b);
+            for (size_t i = b + 1; i < e; ++i) boxed = applyMode(applyBinary(op, boxed, elems.at(base + i)), mode);
+            partial[b / REDUCE_BLOCK] = boxed;
+        });
+        for (auto &p : partial) tree.push(std::move(p));
+    }
+    return tree.result(identity);
+}
+
+// every element of s combined with op: each REDUCE_BLOCK is folded left to
+// right, then the block results combine in the fixed tree
+valptr_t reduce(stream &s, binary_op op, const valptr_t &identity, calc_mode mode) {
+    tree_reducer tree(op, mode);
+    if (auto* as = dynamic_cast<array_stream*>(&s); as && as->pos == 0 && !as->array().isIntegral()) {
+        // the all-decimal fold below, straight from the unboxed doubles
+        const double_buffer &xs = as->array().values();
+        std::vector<valptr_t> partial((xs.size() + REDUCE_BLOCK - 1) / REDUCE_BLOCK);
+        parallelFor(xs.size(), REDUCE_BLOCK, [&](size_t b, size_t e) {
+            double acc = xs[b];
+            for (size_t i = b + 1; i < e; ++i) acc = op == binary_op::Add ? acc + xs[i] : acc * xs[i];
+            partial[b / REDUCE_BLOCK] = std::make_shared<decimal>(acc);
+        });
+        for (auto &p : partial) tree.push(std::move(p));
+        return tree.result(identity);
+    }
+    if (auto* rs = dynamic_cast<range_stream*>(&s); rs && rs->ix && (op == binary_op::Add || op == binary_op::Mul)) {
+        const range_elements elems(*rs->ix, rs->r);
+        if (elems.integral()) return reduceIntegral(*rs, elems, tree, op, identity, mode);
+    }
+    std::vector<valptr_t> xs;
+    for (s.pull(STREAM_CHUNK, xs); !xs.empty(); s.pull(STREAM_CHUNK, xs)) {
+        const size_t n = xs.size();
+        std::vector<valptr_t> partial((n + REDUCE_BLOCK - 1) / REDUCE_BLOCK);
+        parallelFor(n, REDUCE_BLOCK, [&](size_t b, size_t e) {
+            bool allDecimal = true;
+            for (size_t i = b; i < e && allDecimal; ++i) allDecimal = xs[i] && xs[i]->kind() == value_kind::Decimal;
+            if (allDecimal) {
+                // the same operations in the same order as the boxed fold
+                const bool add = op == binary_op::Add;
+                double acc = static_cast<const decimal &>(*xs[b]).getValue();
+                for (size_t i = b + 1; i < e; ++i) {
+                    const double x = static_cast<const decimal &>(*xs[i]).getValue();
+                    acc = add ? acc + x : acc * x;
+                }
+                partial[b / REDUCE_BLOCK] = std::make_shared<decimal>(acc);
+                return;
+            }
+            // small integers fold exactly in long long arithmetic while
+            // the running result fits
+            long long iacc, x;
+            bool exact = xs[b] && smallInt(*xs[b], iacc);
+            for (size_t i = b + 1; i < e && exact; ++i) {
+                exact = xs[i] && smallInt(*xs[i], x) &&
+                        !(op == binary_op::Add ? __builtin_add_overflow(iacc, x, &iacc) : __builtin_mul_overflow(iacc, x, &iacc));
+            }
+            if (exact) {
+                partial[b / REDUCE_BLOCK] = std::make_shared<integer>(iacc);
+                return;
+            }
+            valptr_t acc = xs[b];
+            for (size_t i = b + 1; i < e; ++i) acc = applyMode(applyBinary(op, acc, xs[i]), mode);
+            partial[b / REDUCE_BLOCK] = acc;
+        });
+        for (auto &p : partial) tree.push(std::move(p));
+    }
+    return tree.result(identity);
+}
+
+// sum(list[, start[, end]]) and prod(...) with 1-based inclusive positions
+valptr_t reduceForm(const call_node &c, runtime_env &env, const char* name, binary_op op, long long identity) {
+    if (c.args.empty() || c.args.size() > 3) throw std::runtime_error(std::string(name) + " expects (list[, start[, end]])");
+    std::unique_ptr<stream> s = listStream(*c.args[0], env, name);
+    if (c.args.size() >= 2) {
+        evaluator ev(env);
+        const size_t begin = positionArg(ev.run(*c.args[1]), name) - 1;
+        const size_t end = c.args.size() == 3 ? std::min(s->size, positionArg(ev.run(*c.args[2]), name)) : s->size;
+        s = std::make_unique<window_stream>(std::move(s), begin, end);
+    }
+    return reduce(*s, op, std::make_shared<integer>(identity), env.getMode());
+}
+
+// the larger (Gt) or smaller (Lt) of two values
+valptr_t extreme(binary_op op, const valptr_t &a, const valptr_t &b) {
+    return isTrue(applyBinary(op, b, a)) ? b : a;
+}
+
+// max(list), or max(a, b) elementwise when either is a list; min likewise
+valptr_t extremeForm(const call_node &c, runtime_env &env, const char* name, binary_op op) {
+    if (c.args.size() == 1) {
+        std::unique_ptr<stream> s = listStream(*c.args[0], env, name);
+        valptr_t best;
+        std::vector<valptr_t> xs;
+        for (s->pull(STREAM_CHUNK, xs); !xs.empty(); s->pull(STREAM_CHUNK, xs)) {
+            for (const auto &x : xs) best = best ? extreme(op, best, x) : x;
+        }
+        if (!best) throw std::runtime_error(std::string(name) + ": empty list");
+        return best;
+    }
+    if (c.args.size() != 2) throw std::runtime_error(std::string(name) + " expects (list) or (a, b)");
+
+    evaluator ev(env);
+    valptr_t a = asList(ev.run(*c.args[0]));
+    valptr_t b = asList(ev.run(*c.args[1]));
+    const bool la = a && a->kind() == value_kind::List;
+    const bool lb = b && b->kind() == value_kind::List;
+    if (!la && !lb) return extreme(op, a, b);
+    const auto* al = la ? static_cast<const valuelist*>(a.get()) : nullptr;
+    const auto* bl = lb ? static_cast<const valuelist*>(b.get()) : nullptr;
+    const size_t n = la ? al->size() : bl->size();
+    if (la && lb && bl->size() != n) throw std::runtime_error("dimension mismatch");
+    std::vector<valptr_t> out(n);
+    parallelFor(n, MAP_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) out[i] = extreme(op, la ? al->elements()[i] : a, lb ? bl->elements()[i] : b);
+    });
+    return std::make_shared<valuelist>(std::move(out));
+}
+
+// cumSum(list): running sums, left to right
+valptr_t cumSumForm(const call_node &c, runtime_env &env) {
+    if (c.args.size() != 1) throw std::runtime_error("cumSum expects (list)");
+    std::unique_ptr<stream> s = listStream(*c.args[0], env, "cumSum");
+    const calc_mode mode = env.getMode();
+    std::vector<valptr_t> out;
+    if (s->size != stream::UNKNOWN) out.reserve(s->size);
+    std::vector<valptr_t> xs;
+    for (s->pull(STREAM_CHUNK, xs); !xs.empty(); s->pull(STREAM_CHUNK, xs)) {
+        for (const auto &x : xs) out.push_back(out.empty() ? x : applyMode(applyBinary(binary_op::Add, out.back(), x), mode));
+    }
+    return std::make_shared<valuelist>(std::move(out));
+}
+
+// filter(cond, var, list): the elements for which cond is true, in order
+valptr_t filterForm(const call_node &c, runtime_env &env) {
+    if (c.args.size() != 3) throw std::runtime_error("filter expects (cond, var, list)");
+    const std::string &var = formVariable(c, 1, "filter");
+    filter_stream s(listStream(*c.args[2], env, "filter"), *c.args[0], var, env);
+    return std::make_shared<valuelist>(collect(s));
+}
+
+// when(cond, t[, f[, u]]): t where cond is true, f where false, u where it
+// is neither; a list cond picks elementwise, and list branches must match it
+valptr_t whenBuiltin(const std::vector<valptr_t> &given, runtime_env & /*env*/) {
+    if (given.size() < 2 || given.size() > 4) throw std::runtime_error("when expects (cond, t[, f[, u]])");
+    std::vector<valptr_t> args(given.size());
+    std::transform(given.begin(), given.end(), args.begin(), asList);
+    auto pick = [&args](const valptr_t &cond, size_t i, bool elementwise) -> valptr_t {
+        size_t which = 3;
+        if (cond && cond->kind() == value_kind::Boolean) which = static_cast<const boolean &>(*cond).getValue() ? 1 : 2;
+        if (which >= args.size()) {
+            throw std::runtime_error(which == 3 ? "when: condition is not true or false" : "when: no value for a false condition");
+        }
+        const valptr_t &v = args[which];
+        if (!elementwise || !v || v->kind() != value_kind::List) return v;
+        return static_cast<const valuelist &>(*v).elements()[i];
+    };
+    if (!args[0] || args[0]->kind() != value_kind::List) return pick(args[0], 0, false);
+
+    const valuelist &conds = static_cast<const valuelist &>(*args[0]);
+    for (size_t k = 1; k < args.size(); ++k) {
+        if (args[k] && args[k]->kind() == value_kind::List &&
+            static_cast<const valuelist &>(*args[k]).elements().size() != conds.elements().size()) {
+            throw std::runtime_error("dimension mismatch");
+        }
+    }
+    const std::vector<valptr_t> &cs = conds.elements();
+    std::vector<valptr_t> out(cs.size());
+    parallelFor(cs.size(), MAP_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) out[i] = pick(cs[i], i, true);
+    });
+    return std::make_shared<valuelist>(std::move(out));
+}
+
+} // namespace
+
+void register_list_builtins(runtime_env &env) {
+    // {a, b, ...}: the parser's list constructor, named so it can't be
+    // spelled as a call
+    env.registerBuiltin("{}", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        for (const valptr_t &a : args) {
+            if (!a) throw std::runtime_error("list element has no value");
+        }
+        return std::make_shared<valuelist>(args);
+    }, true);
+    env.registerForm("seq", seqForm, true);
+    env.registerForm("filter", filterForm, true);
+    // reducers see their argument unevaluated, so a pipeline can stream
+    env.registerForm("sum", [](const call_node &c, runtime_env &env) {
+        return reduceForm(c, env, "sum", binary_op::Add, 0);
+    }, true);
+    env.registerForm("prod", [](const call_node &c, runtime_env &env) {
+        return reduceForm(c, env, "prod", binary_op::Mul, 1);
+    }, true);
+    env.registerForm("max", [](const call_node &c, runtime_env &env) {
+        return extremeForm(c, env, "max", binary_op::Gt);
+    }, true);
+    env.registerForm("min", [](const call_node &c, runtime_env &env) {
+        return extremeForm(c, env, "min", binary_op::Lt);
+    }, true);
+    env.registerForm("cumSum", cumSumForm, true);
+    env.registerBuiltin("when", whenBuiltin, true);
+}
+
+} // namespace ti
@@ -1,9 +1,116 @@
 #include <iostream>
+#include <string>
 #include "../include/value.h"
 #include "../include/repl.h"
+#include "../include/server.h"
+#include "../include/snapshot.h"
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <limits>
 
-int main() {
+namespace {
+
+ti::server* activeServer = nullptr;
+
+void stopServer(int) {
+    if (activeServer) activeServer->stop();
+}
+
+// a whole number no greater than max; false for anything else
+bool parseCount(const char* text, unsigned long long max, unsigned long long &out) {
+    if (*text < '0' || *text > '9') return false; // strtoull accepts a sign
+    char* end = nullptr;
+    errno = 0;
+    out = std::strtoull(text, &end, 10);
+    return errno == 0 && *end == '\0' && out <= max;
+}
+
+// a finite number of seconds, at least 0
+bool parseSeconds(const char* text, double &out) {
+    char* end = nullptr;
+    out = std::strtod(text, &end);
+    return end != text && *end == '\0' && std::isfinite(out) && out >= 0;
+}
+
+int usageError(const std::string &option, const char* value) {
+    std::cerr << "invalid value for " << option << ": " << value << std::endl;
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
     ti::repl repl;
+    std::string batch;
+    ti::server_options serve;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dump-opt") {
+            // print each statement's tree after optimization
+            repl.environment().setDumpOptimized(true);
+        } else if (arg == "--jit") {
+            // compile numeric functions to native code
+            repl.environment().setJitEnabled(true);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            // cap parallel builtins at N threads (0: all hardware threads)
+            unsigned long long n;
+            if (!parseCount(argv[++i], std::numeric_limits<size_t>::max(), n)) return usageError(arg, argv[i]);
+            repl.environment().setMaxThreads(n);
+        } else if (arg == "--time-budget" && i + 1 < argc) {
+            // seconds per interactive or batch statement
+            double seconds;
+            if (!parseSeconds(argv[++i], seconds)) return usageError(arg, argv[i]);
+            repl.setTimeBudget(seconds);
+        } else if (arg == "--step-budget" && i + 1 < argc) {
+            // calls and loop iterations per interactive or batch statement
+            unsigned long long steps;
+            if (!parseCount(argv[++i], std::numeric_limits<unsigned long long>::max(), steps)) {
+                return usageError(arg, argv[i]);
+            }
+            repl.setStepBudget(steps);
+        } else if (arg == "--load" && i + 1 < argc) {
+            // restore a workspace saved with saveSnapshot
+            try {
+                ti::loadSnapshot(repl.environment(), argv[++i]);
+            } catch (const std::exception &e) {
+                std::cerr << e.what() << std::endl;
+                return 2;
+            }
+        } else if (arg == "--batch" && i + 1 < argc) {
+            // run a script file (- for stdin) non-interactively
+            batch = argv[++i];
+        } else if (arg == "--serve" && i + 1 < argc) {
+            // serve sessions over a Unix domain socket at PATH
+            serve.socketPath = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            unsigned long long n;
+            if (!parseCount(argv[++i], std::numeric_limits<size_t>::max(), n)) return usageError(arg, argv[i]);
+            serve.workers = n;
+        } else if (arg == "--time-limit" && i + 1 < argc) {
+            // seconds per served request
+            if (!parseSeconds(argv[++i], serve.timeLimit)) return usageError(arg, argv[i]);
+        } else if (arg == "--memory-limit" && i + 1 < argc) {
+            // MiB per served request
+            unsigned long long mib;
+            if (!parseCount(argv[++i], std::numeric_limits<size_t>::max() >> 20, mib)) return usageError(arg, argv[i]);
+            serve.memoryLimit = static_cast<size_t>(mib) << 20;
+        } else {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return 2;
+        }
+    }
+    if (!batch.empty()) return repl.runBatch(batch);
+    if (!serve.socketPath.empty()) {
+        ti::server server(serve);
+        activeServer = &server;
+        std::signal(SIGINT, stopServer);
+        std::signal(SIGTERM, stopServer);
+        const int status = server.run();
+        activeServer = nullptr;
+        return status;
+    }
     repl.run();
     return 0;
-}
\ No newline at end of file
+}
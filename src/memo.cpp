@@ -0,0 +1,210 @@
+#include "../include/memo.h"
+#include "../include/evaluator.h"
+#include "../include/lists.h"
+#include "../include/runtimeenv.h"
+#include <set>
+#include <stdexcept>
+#include <string>
+
+namespace ti {
+
+using namespace ast;
+
+// === memo_cache ===
+
+size_t memo_cache::hashArgs(const function* fn, const std::vector<valptr_t> &args) {
+    size_t h = std::hash<const void*>()(fn);
+    for (const auto &a : args) {
+        h ^= (a ? a->hash() : 0) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+    return h;
+}
+
+bool memo_cache::key_equal::operator()(const key* a, const key* b) const {
+    if (a->fn != b->fn || a->hash != b->hash || a->args.size() != b->args.size()) return false;
+    for (size_t i = 0; i < a->args.size(); ++i) {
+        const valptr_t &x = a->args[i];
+        const valptr_t &y = b->args[i];
+        if (x && y ? !x->equals(*y) : x != y) return false;
+    }
+    return true;
+}
+
+valptr_t memo_cache::lookup(const function* fn, const std::vector<valptr_t> &args) {
+    key probe{fn, args, hashArgs(fn, args)};
+    auto it = index.find(&probe);
+    if (it == index.end()) {
+        ++stats.misses;
+        return valptr_t();
+    }
+    ++stats.hits;
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->result;
+}
+
+void memo_cache::store(const function* fn, const std::vector<valptr_t> &args, const valptr_t &result) {
+    if (capacity == 0 || !result) return;
+    key probe{fn, args, hashArgs(fn, args)};
+    auto it = index.find(&probe);
+    if (it != index.end()) {
+        it->second->result = result;
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+    lru.push_front(entry{std::move(probe), result});
+    index.emplace(&lru.front().k, lru.begin());
+    while (lru.size() > capacity) {
+        index.erase(&lru.back().k);
+        lru.pop_back();
+        ++stats.evictions;
+    }
+}
+
+void memo_cache::clear() {
+    index.clear();
+    lru.clear();
+}
+
+void memo_cache::setCapacity(size_t entries) {
+    capacity = entries;
+    while (lru.size() > capacity) {
+        index.erase(&lru.back().k);
+        lru.pop_back();
+        ++stats.evictions;
+    }
+}
+
+memo_stats memo_cache::getStats() const {
+    memo_stats s = stats;
+    s.entries = lru.size();
+    return s;
+}
+
+void memo_cache::resetStats() {
+    stats = memo_stats();
+}
+
+// === purity analysis ===
+
+namespace {
+
+void collectLocals(const exprnode &n, std::set<std::string> &locals) {
+    if (n.kind() == node_kind::Local) {
+        for (const auto &name : static_cast<const local_node &>(n).names) locals.insert(name);
+    }
+    for (auto* c : children(n)) collectLocals(**c, locals);
+}
+
+// checks one body in isolation; user callees are queued for the caller
+bool locallyPure(const exprnode &n, const std::set<std::string> &locals, runtime_env &env,
+                 std::vector<const function*> &callees) {
+    switch (n.kind()) {
+        case node_kind::Var:
+            if (!locals.count(static_cast<const var_node &>(n).name)) return false;
+            break;
+        case node_kind::Assign:
+            if (!locals.count(static_cast<const assign_node &>(n).name)) return false;
+            break;
+        case node_kind::For:
+            if (!locals.count(static_cast<const for_node &>(n).var)) return false;
+            break;
+        case node_kind::Call: {
+            auto &c = static_cast<const call_node &>(n);
+            if (c.callee->kind() != node_kind::Var) return false;
+            const function* fn = env.getFunction(static_cast<const var_node &>(*c.callee).name);
+            if (!fn) return false;
+            if (fn->isBuiltin) {
+                if (!fn->pure) return false;
+            } else {
+                callees.push_back(fn);
+            }
+            // the callee is a name, not a variable read
+            for (const auto &a : c.args) {
+                if (!locallyPure(*a, locals, env, callees)) return false;
+            }
+            return true;
+        }
+        default:
+            break;
+    }
+    for (auto* c : children(n)) {
+        if (!locallyPure(**c, locals, env, callees)) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool isPureFunction(const function &fn, runtime_env &env) {
+    const size_t version = env.getFunctionVersion();
+    if (fn.isBuiltin) return fn.pure;
+    if (fn.purityKnown && fn.purityVersion == version) return fn.purityResult;
+
+    // fn is pure iff every user function reachable from it is locally pure,
+    // so one walk over the reachable set settles it (cycles included)
+    std::vector<const function*> work{&fn};
+    std::set<const function*> seen{&fn};
+    bool pure = true;
+    while (pure && !work.empty()) {
+        const function* f = work.back();
+        work.pop_back();
+        if (f->purityKnown && f->purityVersion == version) {
+            pure = f->purityResult;
+            continue;
+        }
+        const exprnode* body = dynamic_cast<const exprnode*>(f->body.get());
+        if (!body) continue;
+        std::set<std::string> locals(f->params.begin(), f->params.end());
+        collectLocals(*body, locals);
+        std::vector<const function*> callees;
+        pure = locallyPure(*body, locals, env, callees);
+        for (const function* c : callees) {
+            if (seen.insert(c).second) work.push_back(c);
+        }
+    }
+
+    // a pure verdict covers everything reachable; an impure one only fn
+    if (pure) {
+        for (const function* f : seen) {
+            f->purityKnown = true;
+            f->purityResult = true;
+            f->purityVersion = version;
+        }
+    } else {
+        fn.purityKnown = true;
+        fn.purityResult = false;
+        fn.purityVersion = version;
+    }
+    return pure;
+}
+
+void register_memo_builtins(runtime_env &env) {
+    // memoize(f) caches f's results from now on, memoize(f, false) stops;
+    // f is a user function's name, as in odeSolve
+    env.registerForm("memoize", [](const call_node &c, runtime_env &env) -> valptr_t {
+        if (c.args.size() != 1 && c.args.size() != 2) throw std::runtime_error("memoize expects (function[, on])");
+        const std::string &name = formVariable(c, 0, "memoize");
+        function* fn = env.getFunction(name);
+        if (!fn || fn->isBuiltin) throw std::runtime_error("memoize: " + name + " is not a user function");
+        bool on = true;
+        if (c.args.size() == 2) {
+            const valptr_t v = evaluator(env).run(*c.args[1]);
+            if (!v || v->kind() != value_kind::Boolean) throw std::runtime_error("memoize: on must be true or false");
+            on = isTrue(v);
+        }
+        fn->memoize = on;
+        return none;
+    });
+    // memoStats(): {hits, misses, evictions, entries} of the result cache
+    env.registerBuiltin("memoStats", [](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
+        if (!args.empty()) throw std::runtime_error("memoStats expects no arguments");
+        const memo_stats s = env.memoCache().getStats();
+        std::vector<valptr_t> out;
+        for (size_t n : {s.hits, s.misses, s.evictions, s.entries}) {
+            out.push_back(std::make_shared<integer>(static_cast<long long>(n)));
+        }
+        return std::make_shared<valuelist>(std::move(out));
+    });
+}
+
+} // namespace ti
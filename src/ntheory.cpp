@@ -0,0 +1,1202 @@
+#include "../include/ntheory.h"
+#include "../include/arith.h"
+#include "../include/budget.h"
+#include "../include/lists.h"
+#include "../include/runtimeenv.h"
+#include "../include/symbolic.h"
+#include "../include/threadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+
+namespace ti {
+
+namespace {
+
+// partial products stay below this, so each fits BigInt(long long)
+constexpr uint64_t WORD_MAX = static_cast<uint64_t>(std::numeric_limits<long long>::max());
+// words from which the two halves of a product tree run concurrently
+constexpr size_t PARALLEL_WORDS = 2048;
+// below this, n! is a running product of machine words
+constexpr uint64_t SMALL_FACTORIAL = 21;
+// up to this n, binomials go through a sieve;
+// beyond it only products of the k factors are practical
+constexpr uint64_t SIEVE_LIMIT = uint64_t(1) << 28;
+// below this k, the k factors are multiplied directly
+constexpr uint64_t SMALL_K = 64;
+
+BigInt multiplyRange(const std::vector<BigInt> &words, size_t lo, size_t hi) {
+    if (hi - lo == 1) return words[lo];
+    if (hi - lo == 2) return words[lo] * words[lo + 1];
+    const size_t mid = lo + (hi - lo) / 2;
+    BigInt l, r;
+    if (hi - lo >= PARALLEL_WORDS) {
+        thread_pool::shared().run(2, [&](size_t i) {
+            if (i == 0) l = multiplyRange(words, lo, mid);
+            else r = multiplyRange(words, mid, hi);
+        });
+    } else {
+        l = multiplyRange(words, lo, mid);
+        r = multiplyRange(words, mid, hi);
+    }
+    return l * r;
+}
+
+// the factors lo, lo+1, ..., hi
+std::vector<uint64_t> range(uint64_t lo, uint64_t hi) {
+    std::vector<uint64_t> out;
+    if (lo > hi) return out;
+    out.reserve(hi - lo + 1);
+    for (uint64_t i = lo;; ++i) {
+        out.push_back(i);
+        if (i == hi) break;
+    }
+    return out;
+}
+
+// the exponent of p in n!, by Legendre's formula
+uint64_t legendre(uint64_t n, uint64_t p) {
+    uint64_t e = 0;
+    while (n >= p) {
+        n /= p;
+        e += n;
+    }
+    return e;
+}
+
+uint64_t power(uint64_t p, uint64_t e) {
+    uint64_t r = 1;
+    while (e-- > 0) r *= p;
+    return r;
+}
+
+// swing(n) = n! / ((n/2)!)^2: p's exponent is the number of odd digits
+// among floor(n / p^i), i >= 1, so p^e <= n and fits one word
+BigInt swing(uint64_t n, const std::vector<uint32_t> &primes) {
+    std::vector<uint64_t> factors;
+    for (uint32_t p : primes) {
+        if (p > n) break;
+        uint64_t e = 0;
+        for (uint64_t q = n / p; q > 0; q /= p) e += q & 1;
+        if (e > 0) factors.push_back(power(p, e));
+    }
+    return productTree(factors);
+}
+
+BigInt swingFactorial(uint64_t n, const std::vector<uint32_t> &primes) {
+    if (n < SMALL_FACTORIAL) return productTree(range(2, std::max<uint64_t>(n, 1)));
+    BigInt half = swingFactorial(n / 2, primes);
+    return half * half * swing(n, primes);
+}
+
+// the product of p^exponent(p) over the primes up to n; every p^e must be
+// at most n, as in a binomial
+template<typename Exponent>
+BigInt primeProduct(uint64_t n, Exponent exponent) {
+    std::vector<uint64_t> factors;
+    for (uint32_t p : primesUpTo(static_cast<uint32_t>(n))) {
+        if (uint64_t e = exponent(p)) factors.push_back(power(p, e));
+    }
+    return productTree(factors);
+}
+
+long long smallInteger(const value &v, const char* fn) {
+    const BigInt &n = static_cast<const integer &>(v).getValue();
+    if (n > BigInt(std::numeric_limits<long long>::max()) || n < BigInt(-std::numeric_limits<long long>::max())) {
+        throw std::runtime_error(std::string(fn) + ": argument too large");
+    }
+    return n.to_long_long();
+}
+
+bool isNumber(const valptr_t &v) {
+    return v && isNumeric(v->kind());
+}
+
+// n choose k for integers, extended to negative n by
+// C(n, k) = (-1)^k C(k - n - 1, k)
+BigInt exactBinomial(long long n, long long k) {
+    if (k < 0) return BigInt(0);
+    if (n < 0) {
+        BigInt c = binomial(static_cast<uint64_t>(k) - static_cast<uint64_t>(n) - 1, static_cast<uint64_t>(k));
+        return k % 2 ? -c : c;
+    }
+    if (k > n) return BigInt(0);
+    return binomial(static_cast<uint64_t>(n), static_cast<uint64_t>(k));
+}
+
+// n (n-1) ... (n-k+1) for integers; for negative n this is
+// (-1)^k |n| (|n|+1) ... (|n|+k-1)
+BigInt exactFalling(long long n, long long k) {
+    if (k < 0) throw std::runtime_error("nPr: domain error");
+    if (n < 0) {
+        const uint64_t m = static_cast<uint64_t>(-n);
+        BigInt r = fallingFactorial(m + static_cast<uint64_t>(k) - 1, static_cast<uint64_t>(k));
+        return k % 2 ? -r : r;
+    }
+    if (k > n) return BigInt(0);
+    return fallingFactorial(static_cast<uint64_t>(n), static_cast<uint64_t>(k));
+}
+
+valptr_t factorialOf(const valptr_t &v) {
+    if (!isNumber(v)) throw std::runtime_error("factorial expects a number");
+    if (v->kind() == value_kind::Integer) {
+        const long long n = smallInteger(*v, "factorial");
+        if (n < 0) throw std::runtime_error("factorial: domain error");
+        if (static_cast<uint64_t>(n) > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("factorial: argument too large");
+        }
+        return std::make_shared<integer>(factorial(static_cast<uint64_t>(n)));
+    }
+    const double x = toDouble(*v);
+    if (x < 0 && x == std::floor(x)) throw std::runtime_error("factorial: domain error");
+    return std::make_shared<decimal>(std::tgamma(x + 1));
+}
+
+
+// GCC's 128-bit integer holds a full word product
+__extension__ typedef unsigned __int128 u128;
+
+// Montgomery arithmetic modulo an odd n < 2^64 with R = 2^64; residues are
+// kept times R mod n
+struct montgomery64 {
+    uint64_t n, nInv, r2;
+
+    explicit montgomery64(uint64_t n) : n(n), nInv(n) {
+        // n n = 1 mod 8, and each step doubles the correct low bits
+        for (int i = 0; i < 5; ++i) nInv *= 2 - n * nInv;
+        const uint64_t r = (0 - n) % n;
+        r2 = static_cast<uint64_t>(static_cast<u128>(r) * r % n);
+    }
+
+    // t / R mod n for t < n R; the low words of t and m n cancel exactly
+    uint64_t reduce(u128 t) const {
+        const uint64_t m = static_cast<uint64_t>(t) * nInv;
+        const uint64_t hi = static_cast<uint64_t>(t >> 64);
+        const uint64_t mn = static_cast<uint64_t>((static_cast<u128>(m) * n) >> 64);
+        return hi >= mn ? hi - mn : hi - mn + n;
+    }
+    uint64_t mul(uint64_t a, uint64_t b) const { return reduce(static_cast<u128>(a) * b); }
+    uint64_t add(uint64_t a, uint64_t b) const { return a >= n - b ? a - (n - b) : a + b; }
+    uint64_t sub(uint64_t a, uint64_t b) const { return a >= b ? a - b : a - b + n; }
+    uint64_t to(uint64_t a) const { return mul(a % n, r2); }
+    uint64_t from(uint64_t a) const { return reduce(a); }
+    uint64_t pow(uint64_t a, uint64_t e) const {
+        uint64_t r = to(1);
+        for (; e > 0; e >>= 1) {
+            if (e & 1) r = mul(r, a);
+            a = mul(a, a);
+        }
+        return r;
+    }
+};
+
+// Montgomery arithmetic modulo an odd n of L words with R = 2^(64 L).
+// Residues are L-word vectors; the product's scratch space makes one
+// context single-threaded, so parallel work copies it.
+class montgomery {
+public:
+    using residue = std::vector<uint64_t>;
+
+private:
+    BigInt modulus;
+    residue n, r2, unity;
+    uint64_t nInv; // -1/n mod 2^64
+    std::vector<uint64_t> t;
+
+    // x mod n as L words
+    residue words(const BigInt &x) const {
+        BigInt r = x % modulus;
+        if (r.sign() < 0) r += modulus;
+        residue w = r.to_words();
+        w.resize(n.size(), 0);
+        return w;
+    }
+
+public:
+    explicit montgomery(const BigInt &m) : modulus(m), n(m.to_words()), t(n.size() + 2) {
+        uint64_t x = n[0];
+        for (int i = 0; i < 5; ++i) x *= 2 - n[0] * x;
+        nInv = 0 - x;
+        std::vector<uint64_t> r(2 * n.size() + 1, 0);
+        r.back() = 1;
+        r2 = words(BigInt::from_words(r));
+        r.resize(n.size() + 1);
+        r.back() = 1;
+        unity = words(BigInt::from_words(r));
+    }
+
+    const BigInt &mod() const { return modulus; }
+    residue to(const BigInt &x) {
+        residue r = words(x);
+        mul(r, r, r2);
+        return r;
+    }
+    BigInt from(const residue &a) {
+        residue one(n.size(), 0), r;
+        one[0] = 1;
+        mul(r, a, one);
+        return BigInt::from_words(r);
+    }
+    const residue &one() const { return unity; }
+    static bool isZero(const residue &a) {
+        return std::all_of(a.begin(), a.end(), [](uint64_t w) { return w == 0; });
+    }
+
+    // out = a b / R mod n, by coarsely integrated operand scanning; out may
+    // alias either operand
+    void mul(residue &out, const residue &a, const residue &b) {
+        const size_t l = n.size();
+        std::fill(t.begin(), t.end(), 0);
+        for (size_t i = 0; i < l; ++i) {
+            u128 c = 0;
+            for (size_t j = 0; j < l; ++j) {
+                c += t[j] + static_cast<u128>(a[j]) * b[i];
+                t[j] = static_cast<uint64_t>(c);
+                c >>= 64;
+            }
+            c += t[l];
+            t[l] = static_cast<uint64_t>(c);
+            t[l + 1] = static_cast<uint64_t>(c >> 64);
+            const uint64_t m = t[0] * nInv;
+            c = (t[0] + static_cast<u128>(m) * n[0]) >> 64;
+            for (size_t j = 1; j < l; ++j) {
+                c += t[j] + static_cast<u128>(m) * n[j];
+                t[j - 1] = static_cast<uint64_t>(c);
+                c >>= 64;
+            }
+            c += t[l];
+            t[l - 1] = static_cast<uint64_t>(c);
+            t[l] = t[l + 1] + static_cast<uint64_t>(c >> 64);
+        }
+        out.assign(t.begin(), t.begin() + static_cast<std::ptrdiff_t>(l));
+        // t < 2n
+        if (t[l] || !std::lexicographical_compare(out.rbegin(), out.rend(), n.rbegin(), n.rend())) {
+            uint64_t borrow = 0;
+            for (size_t j = 0; j < l; ++j) {
+                const u128 d = static_cast<u128>(out[j]) - n[j] - borrow;
+                out[j] = static_cast<uint64_t>(d);
+                borrow = static_cast<uint64_t>(d >> 64) & 1;
+            }
+        }
+    }
+
+    void add(residue &out, const residue &a, const residue &b) const {
+        const size_t l = n.size();
+        out.resize(l);
+        uint64_t carry = 0;
+        for (size_t j = 0; j < l; ++j) {
+            const u128 s = static_cast<u128>(a[j]) + b[j] + carry;
+            out[j] = static_cast<uint64_t>(s);
+            carry = static_cast<uint64_t>(s >> 64);
+        }
+        if (carry || !std::lexicographical_compare(out.rbegin(), out.rend(), n.rbegin(), n.rend())) {
+            uint64_t borrow = 0;
+            for (size_t j = 0; j < l; ++j) {
+                const u128 d = static_cast<u128>(out[j]) - n[j] - borrow;
+                out[j] = static_cast<uint64_t>(d);
+                borrow = static_cast<uint64_t>(d >> 64) & 1;
+            }
+        }
+    }
+
+    void sub(residue &out, const residue &a, const residue &b) const {
+        const size_t l = n.size();
+        out.resize(l);
+        uint64_t borrow = 0;
+        for (size_t j = 0; j < l; ++j) {
+            const u128 d = static_cast<u128>(a[j]) - b[j] - borrow;
+            out[j] = static_cast<uint64_t>(d);
+            borrow = static_cast<uint64_t>(d >> 64) & 1;
+        }
+        if (borrow) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < l; ++j) {
+                const u128 s = static_cast<u128>(out[j]) + n[j] + carry;
+                out[j] = static_cast<uint64_t>(s);
+                carry = static_cast<uint64_t>(s >> 64);
+            }
+        }
+    }
+
+    // a / 2 mod n
+    void half(residue &a) const {
+        uint64_t carry = 0;
+        if (a[0] & 1) {
+            for (size_t j = 0; j < n.size(); ++j) {
+                const u128 s = static_cast<u128>(a[j]) + n[j] + carry;
+                a[j] = static_cast<uint64_t>(s);
+                carry = static_cast<uint64_t>(s >> 64);
+            }
+        }
+        for (size_t j = 0; j < a.size(); ++j) {
+            const uint64_t next = j + 1 < a.size() ? a[j + 1] : carry;
+            a[j] = (a[j] >> 1) | (next << 63);
+        }
+    }
+
+    residue pow(const residue &a, const BigInt &e) {
+        const std::vector<uint64_t> bits = e.to_words();
+        residue r = unity;
+        for (size_t w = bits.size(); w-- > 0;) {
+            for (int b = 63; b >= 0; --b) {
+                mul(r, r, r);
+                if ((bits[w] >> b) & 1) mul(r, r, a);
+            }
+        }
+        return r;
+    }
+};
+
+bool fitsWord(const BigInt &n) {
+    return n.sign() >= 0 && n.to_words().size() == 1;
+}
+
+uint64_t toWord(const BigInt &n) {
+    return n.to_words()[0];
+}
+
+uint64_t wordsMod(const std::vector<uint64_t> &w, uint64_t p) {
+    u128 r = 0;
+    for (size_t i = w.size(); i-- > 0;) r = ((r << 64) | w[i]) % p;
+    return static_cast<uint64_t>(r);
+}
+
+BigInt gcd(BigInt a, BigInt b) {
+    a = a.abs();
+    b = b.abs();
+    while (!b.is_zero()) {
+        BigInt r = a % b;
+        a = std::move(b);
+        b = std::move(r);
+    }
+    return a;
+}
+
+// (g, x) with g = gcd(a, m) and a x = g mod m, for m > 0
+std::pair<BigInt, BigInt> inverseMod(const BigInt &a, const BigInt &m) {
+    BigInt r0 = a % m, r1 = m, x0(1), x1(0);
+    if (r0.sign() < 0) r0 += m;
+    while (!r1.is_zero()) {
+        const BigInt q = r0 / r1;
+        BigInt r = r0 - q * r1, x = x0 - q * x1;
+        r0 = std::move(r1);
+        r1 = std::move(r);
+        x0 = std::move(x1);
+        x1 = std::move(x);
+    }
+    x0 %= m;
+    if (x0.sign() < 0) x0 += m;
+    return {r0, x0};
+}
+
+// the Jacobi symbol (a / n) for odd n > 0
+int jacobi(BigInt a, BigInt n) {
+    const BigInt two(2), four(4), eight(8);
+    a %= n;
+    if (a.sign() < 0) a += n;
+    int t = 1;
+    while (!a.is_zero()) {
+        while ((a % two).is_zero()) {
+            a /= two;
+            const long long r = (n % eight).to_long_long();
+            if (r == 3 || r == 5) t = -t;
+        }
+        std::swap(a, n);
+        if ((a % four).to_long_long() == 3 && (n % four).to_long_long() == 3) t = -t;
+        a %= n;
+    }
+    return n == BigInt(1) ? t : 0;
+}
+
+constexpr uint32_t SMALL_PRIMES[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+
+// a strong probable prime test of odd n > 2 to base a (a mod n != 0)
+bool strongProbablePrime(const montgomery64 &m, uint64_t a) {
+    uint64_t d = m.n - 1;
+    int s = 0;
+    while (!(d & 1)) {
+        d >>= 1;
+        ++s;
+    }
+    const uint64_t one = m.to(1), minusOne = m.to(m.n - 1);
+    uint64_t x = m.pow(m.to(a), d);
+    if (x == one || x == minusOne) return true;
+    for (int i = 1; i < s; ++i) {
+        x = m.mul(x, x);
+        if (x == minusOne) return true;
+    }
+    return false;
+}
+
+bool isPrimeWord(uint64_t n) {
+    if (n < 2) return false;
+    for (uint32_t p : SMALL_PRIMES) {
+        if (n % p == 0) return n == p;
+    }
+    if (n < 41 * 41) return true;
+    // these bases decide every n < 2^64 (Sinclair)
+    const montgomery64 m(n);
+    for (uint64_t a : {2ull, 325ull, 9375ull, 28178ull, 450775ull, 9780504ull, 1795265022ull}) {
+        if (a % n != 0 && !strongProbablePrime(m, a)) return false;
+    }
+    return true;
+}
+
+// trial division bound before the probable prime tests on big numbers
+constexpr uint32_t PRIME_TRIAL_LIMIT = 1000;
+
+// Baillie-PSW for odd n >= 2^64 without small factors
+bool baillieWagstaff(const BigInt &n) {
+    montgomery ctx(n);
+    const BigInt nm1 = n - BigInt(1);
+    // strong probable prime to base 2
+    BigInt d = nm1;
+    size_t s = 0;
+    const BigInt two(2);
+    while ((d % two).is_zero()) {
+        d /= two;
+        ++s;
+    }
+    const montgomery::residue minusOne = ctx.to(nm1);
+    montgomery::residue x = ctx.pow(ctx.to(two), d);
+    bool probable = x == ctx.one() || x == minusOne;
+    for (size_t i = 1; i < s && !probable; ++i) {
+        ctx.mul(x, x, x);
+        probable = x == minusOne;
+    }
+    if (!probable) return false;
+    // no D below has (D / n) = -1 when n is a square
+    const BigInt root = isqrt(n);
+    if (root * root == n) return false;
+    // Selfridge's parameters: the first of 5, -7, 9, -11, ... with
+    // (D / n) = -1, and P = 1, Q = (1 - D) / 4
+    long long dd = 5;
+    for (;; dd = dd > 0 ? -(dd + 2) : -dd + 2) {
+        const int j = jacobi(BigInt(dd), n);
+        if (j == -1) break;
+        if (j == 0) return false;
+    }
+    // strong Lucas test: with n + 1 = d 2^s, U(d) = 0 or V(d 2^r) = 0 for
+    // some r < s
+    d = n + BigInt(1);
+    s = 0;
+    while ((d % two).is_zero()) {
+        d /= two;
+        ++s;
+    }
+    const montgomery::residue dm = ctx.to(BigInt(dd)), q = ctx.to(BigInt((1 - dd) / 4));
+    montgomery::residue u = ctx.one(), v = ctx.one(), qk = q, t1, t2;
+    const std::vector<uint64_t> bits = d.to_words();
+    int top = 63;
+    while (!((bits.back() >> top) & 1)) --top;
+    for (size_t w = bits.size(); w-- > 0;) {
+        for (int b = w + 1 == bits.size() ? top - 1 : 63; b >= 0; --b) {
+            // U(2k) = U V, V(2k) = V^2 - 2 Q^k
+            ctx.mul(u, u, v);
+            ctx.mul(v, v, v);
+            ctx.add(t1, qk, qk);
+            ctx.sub(v, v, t1);
+            ctx.mul(qk, qk, qk);
+            if ((bits[w] >> b) & 1) {
+                // U(k+1) = (U + V) / 2, V(k+1) = (D U + V) / 2
+                ctx.add(t1, u, v);
+                ctx.mul(t2, dm, u);
+                ctx.add(v, t2, v);
+                u.swap(t1);
+                ctx.half(u);
+                ctx.half(v);
+                ctx.mul(qk, qk, q);
+            }
+        }
+    }
+    if (montgomery::isZero(u) || montgomery::isZero(v)) return true;
+    for (size_t r = 1; r < s; ++r) {
+        ctx.mul(v, v, v);
+        ctx.add(t1, qk, qk);
+        ctx.sub(v, v, t1);
+        if (montgomery::isZero(v)) return true;
+        ctx.mul(qk, qk, qk);
+    }
+    return false;
+}
+
+// a nontrivial factor of a composite n < 2^64 without factors below 41,
+// by Pollard's rho with Brent's cycle detection; the differences are
+// multiplied together so one gcd covers a batch of steps
+uint64_t rhoWord(uint64_t n) {
+    const montgomery64 m(n);
+    constexpr uint64_t BATCH = 128;
+    for (uint64_t c = 1;; ++c) {
+        const uint64_t cm = m.to(c);
+        auto f = [&](uint64_t v) { return m.add(m.mul(v, v), cm); };
+        uint64_t y = m.to(2), x = y, ys = y, q = m.to(1), g = 1;
+        for (uint64_t r = 1; g == 1; r *= 2) {
+            x = y;
+            for (uint64_t i = 0; i < r; ++i) y = f(y);
+            for (uint64_t k = 0; k < r && g == 1; k += BATCH) {
+                ys = y;
+                for (uint64_t i = 0; i < std::min(BATCH, r - k); ++i) {
+                    y = f(y);
+                    q = m.mul(q, m.sub(x, y));
+                }
+                g = std::gcd(q, n);
+            }
+        }
+        if (g == n) {
+            // the batch overshot: step through it one difference at a time
+            do {
+                ys = f(ys);
+                g = std::gcd(m.sub(x, ys), n);
+            } while (g == 1);
+        }
+        if (g != n) return g;
+    }
+}
+
+// rho steps tried on big numbers before ECM; enough to find factors of
+// about ten digits
+constexpr uint64_t RHO_STEPS = uint64_t(1) << 18;
+
+// a nontrivial factor of a composite n >= 2^64 by Brent's rho, or 0 if
+// none turns up within RHO_STEPS
+BigInt rhoBig(const BigInt &n) {
+    montgomery m(n);
+    constexpr uint64_t BATCH = 128;
+    const montgomery::residue c = m.one();
+    montgomery::residue y = m.to(BigInt(2)), x = y, q = m.one(), diff;
+    auto step = [&](montgomery::residue &v) {
+        m.mul(v, v, v);
+        m.add(v, v, c);
+    };
+    uint64_t steps = 0;
+    for (uint64_t r = 1; steps < RHO_STEPS; r *= 2) {
+        x = y;
+        for (uint64_t i = 0; i < r; ++i) step(y);
+        for (uint64_t k = 0; k < r; k += BATCH) {
+            for (uint64_t i = 0; i < std::min(BATCH, r - k); ++i) {
+                step(y);
+                m.sub(diff, x, y);
+                m.mul(q, q, diff);
+            }
+            steps += std::min(BATCH, r - k);
+            checkpoint();
+            const BigInt g = gcd(m.from(q), n);
+            if (g == n) return BigInt(0);
+            if (g != BigInt(1)) return g;
+        }
+    }
+    return BigInt(0);
+}
+
+// One ECM bound: B1 for stage 1 and how many curves to try, tuned for
+// factors of about `digits` digits (after GMP-ECM's table); stage 2 runs
+// to 100 B1.
+struct ecm_bound {
+    int digits;
+    uint64_t b1;
+    size_t curves;
+};
+
+constexpr ecm_bound ECM_BOUNDS[] = {
+    {15, 2000, 25}, {20, 11000, 90}, {25, 50000, 300}, {30, 250000, 700}, {35, 1000000, 1800},
+};
+constexpr uint64_t ECM_STAGE2 = 100;
+// giant step of stage 2; baby steps are the j < D/2 prime to it
+constexpr uint64_t ECM_GIANT = 2310;
+// curves started per parallel batch; a fixed count keeps the curves tried,
+// and so the factor found, independent of the thread count
+constexpr size_t ECM_BATCH = 16;
+
+// An elliptic curve in Montgomery form B y^2 = x^3 + A x^2 + x modulo n,
+// worked on in projective x-only coordinates, so no step inverts. The
+// group order modulo an unknown prime p of n is smooth for some curves;
+// multiplying a point by every small prime power then reaches the point
+// at infinity modulo p, which shows up as gcd(Z, n) = p.
+class ecm_curve {
+private:
+    using residue = montgomery::residue;
+    struct point {
+        residue x, z;
+    };
+
+    montgomery ctx;
+    residue a24; // (A + 2) / 4
+    point start;
+    residue t1, t2, t3, t4;
+
+    void dbl(point &out, const point &p) {
+        ctx.add(t1, p.x, p.z);
+        ctx.mul(t1, t1, t1);
+        ctx.sub(t2, p.x, p.z);
+        ctx.mul(t2, t2, t2);
+        ctx.sub(t3, t1, t2);
+        ctx.mul(out.x, t1, t2);
+        ctx.mul(t4, a24, t3);
+        ctx.add(t4, t4, t2);
+        ctx.mul(out.z, t3, t4);
+    }
+
+    // p + q given d = p - q; out may alias any argument
+    void add(point &out, const point &p, const point &q, const point &d) {
+        ctx.sub(t1, p.x, p.z);
+        ctx.add(t2, q.x, q.z);
+        ctx.mul(t1, t1, t2);
+        ctx.add(t3, p.x, p.z);
+        ctx.sub(t4, q.x, q.z);
+        ctx.mul(t3, t3, t4);
+        ctx.add(t2, t1, t3);
+        ctx.mul(t2, t2, t2);
+        ctx.sub(t4, t1, t3);
+        ctx.mul(t4, t4, t4);
+        ctx.mul(t1, d.z, t2);
+        ctx.mul(out.z, d.x, t4);
+        out.x.swap(t1);
+    }
+
+    // p times k >= 1, by the Montgomery ladder
+    void multiply(point &p, uint64_t k) {
+        if (k == 1) return;
+        point r0 = p, r1;
+        dbl(r1, p);
+        for (int b = 62 - __builtin_clzll(k); b >= 0; --b) {
+            if ((k >> b) & 1) {
+                add(r0, r1, r0, p);
+                dbl(r1, r1);
+            } else {
+                add(r1, r1, r0, p);
+                dbl(r0, r0);
+            }
+        }
+        p = std::move(r0);
+    }
+
+    // a factor from gcd(x, n), or 0 for none
+    BigInt factorFrom(const residue &x) {
+        const BigInt g = gcd(ctx.from(x), ctx.mod());
+        return g == BigInt(1) || g == ctx.mod() ? BigInt(0) : g;
+    }
+
+public:
+    // the curve and point given by Suyama's parametrization, which makes
+    // the group order divisible by 12; `found` is set when setting it up
+    // already exposes a factor
+    ecm_curve(const montgomery &m, uint64_t sigma, BigInt &found) : ctx(m) {
+        const BigInt &n = ctx.mod();
+        const BigInt s(static_cast<long long>(sigma));
+        const BigInt u = (s * s - BigInt(5)) % n, v = BigInt(4) * s % n;
+        const BigInt u3 = u * u % n * u % n, vu = v - u;
+        const BigInt num = vu * vu % n * vu % n * (BigInt(3) * u + v) % n;
+        const auto [g, inv] = inverseMod(BigInt(16) * u3 % n * v % n, n);
+        if (g != BigInt(1)) {
+            found = g == n ? BigInt(0) : g;
+            return;
+        }
+        a24 = ctx.to(num * inv);
+        start.x = ctx.to(u3);
+        start.z = ctx.to(v * v % n * v);
+    }
+
+    bool ready() const { return !a24.empty(); }
+
+    // stage 1 to b1 and stage 2 to b2 over the given prime flags; a factor
+    // of n or 0
+    BigInt run(uint64_t b1, uint64_t b2, const std::vector<uint32_t> &primes, const std::vector<bool> &prime) {
+        point q = start;
+        // prime powers up to b1, packed into word-sized multipliers
+        uint64_t k = 1;
+        for (uint32_t p : primes) {
+            if (p > b1) break;
+            uint64_t pk = p;
+            while (pk <= b1 / p) pk *= p;
+            if (k > std::numeric_limits<uint64_t>::max() / pk) {
+                checkpoint();
+                multiply(q, k);
+                k = 1;
+            }
+            k *= pk;
+        }
+        multiply(q, k);
+        if (BigInt g = factorFrom(q.z); !g.is_zero()) return g;
+
+        // stage 2: a prime b1 < p <= b2 as k D +- j makes
+        // x(kD Q) z(j Q) - x(j Q) z(kD Q) vanish mod the hidden prime
+        std::vector<point> baby(ECM_GIANT / 2);
+        point q2;
+        dbl(q2, q);
+        baby[1] = q;
+        add(baby[3], q2, q, q);
+        for (uint64_t j = 5; j < ECM_GIANT / 2; j += 2) add(baby[j], baby[j - 2], q2, baby[j - 4]);
+        std::vector<uint64_t> js;
+        for (uint64_t j = 1; j < ECM_GIANT / 2; j += 2) {
+            if (std::gcd(j, ECM_GIANT) == 1) js.push_back(j);
+        }
+        // walk kD Q up from k0, each step adding D Q with the previous one
+        // as the difference
+        const uint64_t k0 = std::max<uint64_t>(1, b1 / ECM_GIANT);
+        point giant = q, now = q, ahead = q, next;
+        multiply(giant, ECM_GIANT);
+        multiply(now, k0 * ECM_GIANT);
+        multiply(ahead, (k0 + 1) * ECM_GIANT);
+        residue acc = ctx.one();
+        for (uint64_t kk = k0; kk * ECM_GIANT <= b2 + ECM_GIANT; ++kk) {
+            const uint64_t c = kk * ECM_GIANT;
+            checkpoint();
+            for (uint64_t j : js) {
+                const bool lo = c - j > b1 && c - j <= b2 && prime[c - j];
+                const bool hi = c + j > b1 && c + j <= b2 && prime[c + j];
+                if (!lo && !hi) continue;
+                ctx.mul(t1, now.x, baby[j].z);
+                ctx.mul(t2, baby[j].x, now.z);
+                ctx.sub(t1, t1, t2);
+                ctx.mul(acc, acc, t1);
+            }
+            add(next, ahead, giant, now);
+            now = std::move(ahead);
+            ahead = std::move(next);
+        }
+        return factorFrom(acc);
+    }
+};
+
+// a nontrivial factor of a composite n by ECM, trying the bounds in turn
+BigInt ecm(const BigInt &n) {
+    const montgomery ctx(n);
+    uint64_t curve = 0;
+    for (const ecm_bound &bound : ECM_BOUNDS) {
+        const uint64_t b2 = bound.b1 * ECM_STAGE2;
+        const std::vector<uint32_t> primes = primesUpTo(static_cast<uint32_t>(b2));
+        std::vector<bool> prime(b2 + 1, false);
+        for (uint32_t p : primes) prime[p] = true;
+        for (size_t done = 0; done < bound.curves; done += ECM_BATCH) {
+            std::vector<BigInt> found(ECM_BATCH);
+            thread_pool::shared().run(ECM_BATCH, [&](size_t i) {
+                // sigma from a fixed sequence, so runs are reproducible
+                uint64_t sigma = (curve + i + 1) * 0x9e3779b97f4a7c15ULL;
+                sigma = 6 + (sigma ^ (sigma >> 31)) % (uint64_t(1) << 32);
+                ecm_curve c(ctx, sigma, found[i]);
+                if (c.ready()) found[i] = c.run(bound.b1, b2, primes, prime);
+            });
+            curve += ECM_BATCH;
+            for (const BigInt &f : found) {
+                if (!f.is_zero()) return f;
+            }
+        }
+    }
+    throw std::runtime_error("factor: no factor of " + n.to_string() + " found within the ECM bounds");
+}
+
+// adds the prime factors of n > 1, which has none below the trial bound,
+// to `out`
+void splitInto(const BigInt &n, std::map<BigInt, unsigned> &out) {
+    if (n == BigInt(1)) return;
+    if (isPrime(n)) {
+        ++out[n];
+        return;
+    }
+    if (fitsWord(n)) {
+        const uint64_t d = rhoWord(toWord(n));
+        splitInto(BigInt::from_words({d}), out);
+        splitInto(BigInt::from_words({toWord(n) / d}), out);
+        return;
+    }
+    const BigInt root = isqrt(n);
+    if (root * root == n) {
+        std::map<BigInt, unsigned> half;
+        splitInto(root, half);
+        for (const auto &[p, e] : half) out[p] += 2 * e;
+        return;
+    }
+    BigInt d = rhoBig(n);
+    if (d.is_zero()) d = ecm(n);
+    splitInto(d, out);
+    splitInto(n / d, out);
+}
+
+// trial division bound in factor; the wheel skips multiples of 2, 3 and 5
+constexpr uint64_t FACTOR_TRIAL_LIMIT = 1 << 16;
+constexpr uint64_t WHEEL_STEPS[8] = {4, 2, 4, 2, 4, 6, 2, 6}; // from 7
+
+BigInt power(BigInt b, uint64_t e) {
+    BigInt r(1);
+    for (; e > 0; e >>= 1) {
+        if (e & 1) r *= b;
+        if (e > 1) b *= b;
+    }
+    return r;
+}
+
+uint64_t powModWord(uint64_t b, uint64_t e, uint64_t m) {
+    uint64_t r = 1 % m;
+    for (b %= m; e > 0; e >>= 1) {
+        if (e & 1) r = static_cast<uint64_t>(static_cast<u128>(r) * b % m);
+        b = static_cast<uint64_t>(static_cast<u128>(b) * b % m);
+    }
+    return r;
+}
+
+// bits in n > 0
+uint64_t bitLength(const std::vector<uint64_t> &w) {
+    return 64 * (w.size() - 1) + (64 - static_cast<uint64_t>(__builtin_clzll(w.back())));
+}
+
+// primes p = 1 (mod k) whose residues screen a candidate k-th power; each
+// passes a non-power with probability about 1/k
+constexpr size_t POWER_RESIDUE_PRIMES = 8;
+// trial division bound when taking k-th powers out of a radical
+constexpr uint32_t RADICAL_TRIAL_LIMIT = 10000;
+
+valptr_t integerArg(const valptr_t &v, const char* fn) {
+    if (!v || v->kind() != value_kind::Integer) throw std::runtime_error(std::string(fn) + " expects an integer");
+    return v;
+}
+
+BigInt integerValue(const valptr_t &v, const char* fn) {
+    return static_cast<const integer &>(*integerArg(v, fn)).getValue();
+}
+
+} // namespace
+
+std::vector<uint32_t> primesUpTo(uint32_t n) {
+    std::vector<uint32_t> primes;
+    if (n < 2) return primes;
+    primes.push_back(2);
+    // odd[i] stands for 2i + 1
+    const size_t half = (static_cast<size_t>(n) - 1) / 2 + 1;
+    std::vector<bool> composite(half, false);
+    for (size_t i = 1; i < half; ++i) {
+        if (composite[i]) continue;
+        const uint64_t p = 2 * i + 1;
+        primes.push_back(static_cast<uint32_t>(p));
+        for (uint64_t j = p * p / 2; j < half; j += p) composite[j] = true;
+    }
+    return primes;
+}
+
+BigInt productTree(const std::vector<uint64_t> &factors) {
+    std::vector<BigInt> words;
+    uint64_t word = 1;
+    for (uint64_t f : factors) {
+        if (f == 0) return BigInt(0);
+        if (word > WORD_MAX / f) {
+            words.emplace_back(static_cast<long long>(word));
+            word = f;
+        } else {
+            word *= f;
+        }
+    }
+    words.emplace_back(static_cast<long long>(word));
+    return multiplyRange(words, 0, words.size());
+}
+
+BigInt factorial(uint64_t n) {
+    if (n < SMALL_FACTORIAL) return swingFactorial(n, {});
+    if (n > std::numeric_limits<uint32_t>::max()) throw std::runtime_error("factorial: argument too large");
+    return swingFactorial(n, primesUpTo(static_cast<uint32_t>(n)));
+}
+
+BigInt binomial(uint64_t n, uint64_t k) {
+    if (k > n) return BigInt(0);
+    k = std::min(k, n - k);
+    if (k < SMALL_K || n > SIEVE_LIMIT) return productTree(range(n - k + 1, n)) / factorial(k);
+    return primeProduct(n, [n, k](uint64_t p) { return legendre(n, p) - legendre(k, p) - legendre(n - k, p); });
+}
+
+BigInt fallingFactorial(uint64_t n, uint64_t k) {
+    if (k > n) return BigInt(0);
+    if (k < SMALL_K || n > SIEVE_LIMIT) return productTree(range(n - k + 1, n));
+    // its prime powers can exceed a word, so go through C(n, k) k!
+    return binomial(n, k) * factorial(k);
+}
+
+BigInt isqrt(const BigInt &n) {
+    if (n.sign() <= 0) return BigInt(0);
+    const size_t limbs = n.limb_count();
+    if (limbs < 8) {
+        // Newton's iteration from a power of the base above the root
+        BigInt x = BigInt(1).shift_limbs(static_cast<long long>((limbs + 1) / 2));
+        for (;;) {
+            BigInt y = (x + n / x) / BigInt(2);
+            if (y >= x) return x;
+            x = std::move(y);
+        }
+    }
+    // enough top limbs are kept that their leading limb being small cannot
+    // spoil the estimate
+    const long long h = static_cast<long long>((limbs - 4) / 4);
+    BigInt x = isqrt(n.shift_limbs(-2 * h)).shift_limbs(h);
+    x = (x + n / x) / BigInt(2);
+    BigInt r = n - x * x;
+    while (r.sign() < 0) {
+        x -= BigInt(1);
+        r += BigInt(2) * x + BigInt(1);
+    }
+    while (r > BigInt(2) * x) {
+        r -= BigInt(2) * x + BigInt(1);
+        x += BigInt(1);
+    }
+    return x;
+}
+
+BigInt iroot(const BigInt &n, unsigned k) {
+    if (k == 0) throw std::runtime_error("iroot: index must be positive");
+    if (n.sign() < 0) throw std::runtime_error("iroot: negative radicand");
+    if (k == 1 || n.is_zero()) return n;
+    if (k == 2) return isqrt(n);
+    const std::vector<uint64_t> w = n.to_words();
+    const uint64_t bits = bitLength(w);
+    if (k >= bits) return BigInt(1);
+    // log2 of the root from n's top two words, then the root rounded up to
+    // its leading 52 bits and a power of two
+    const size_t l = w.size();
+    const double logN = std::log2(static_cast<double>(w[l - 1]) + (l > 1 ? std::ldexp(static_cast<double>(w[l - 2]), -64) : 0)) +
+                        64.0 * static_cast<double>(l - 1);
+    const double logRoot = logN / k;
+    BigInt x;
+    if (logRoot < 52) {
+        x = BigInt(static_cast<long long>(std::exp2(logRoot) * (1 + 1e-9)) + 1);
+    } else {
+        const double whole = std::floor(logRoot);
+        x = BigInt(static_cast<long long>(std::exp2(logRoot - whole + 52) * (1 + 1e-9)) + 1) *
+            power(BigInt(2), static_cast<uint64_t>(whole) - 52);
+    }
+    // a Newton step from any x > 0 lands at or above the root, and from
+    // there the steps decrease to it
+    const BigInt kb(static_cast<long long>(k)), km1(static_cast<long long>(k - 1));
+    x = (km1 * x + n / power(x, k - 1)) / kb;
+    for (;;) {
+        BigInt y = (km1 * x + n / power(x, k - 1)) / kb;
+        if (y >= x) return x;
+        x = std::move(y);
+    }
+}
+
+bool isPower(const BigInt &n, unsigned k, BigInt *root) {
+    if (k == 0) throw std::runtime_error("isPower: index must be positive");
+    if (n.sign() < 0) {
+        BigInt r;
+        if (k % 2 == 0 || !isPower(-n, k, &r)) return false;
+        if (root) *root = -r;
+        return true;
+    }
+    if (k == 1 || n <= BigInt(1)) {
+        if (root) *root = n;
+        return true;
+    }
+    const std::vector<uint64_t> w = n.to_words();
+    if (k >= bitLength(w)) return false;
+    // a k-th power is 0 or a k-th power residue mod p, and for p = 1 (mod k)
+    // Euler's criterion tells those apart: a^((p-1)/k) = 1
+    size_t tried = 0;
+    for (uint64_t p = k + 1; tried < POWER_RESIDUE_PRIMES; p += k) {
+        if (!isPrimeWord(p)) continue;
+        ++tried;
+        const uint64_t a = wordsMod(w, p);
+        if (a != 0 && powModWord(a, (p - 1) / k, p) != 1) return false;
+    }
+    BigInt r = iroot(n, k);
+    if (power(r, k) != n) return false;
+    if (root) *root = std::move(r);
+    return true;
+}
+
+std::pair<BigInt, unsigned> perfectPower(const BigInt &n) {
+    const BigInt m = n.abs();
+    if (m < BigInt(2)) return {n, 1};
+    // n = b^e with e maximal has a root for e's smallest prime factor, and
+    // that root's own maximal power completes e
+    for (uint32_t k : primesUpTo(static_cast<uint32_t>(bitLength(m.to_words())))) {
+        BigInt r;
+        if (isPower(n, k, &r)) {
+            auto [b, e] = perfectPower(r);
+            return {b, e * k};
+        }
+    }
+    return {n, 1};
+}
+
+std::pair<BigInt, BigInt> extractRoot(const BigInt &n, unsigned k) {
+    if (n.sign() <= 0) throw std::runtime_error("extractRoot: radicand must be positive");
+    BigInt c(1), m(1);
+    auto take = [&](const BigInt &p, unsigned e) {
+        c *= power(p, e / k);
+        m *= power(p, e % k);
+    };
+    if (fitsWord(n)) {
+        for (const auto &[p, e] : factor(n)) take(p, e);
+        return {c, m};
+    }
+    BigInt rest = n;
+    for (uint32_t p : primesUpTo(RADICAL_TRIAL_LIMIT)) {
+        const BigInt pb(static_cast<long long>(p));
+        unsigned e = 0;
+        while (wordsMod(rest.to_words(), p) == 0) {
+            rest /= pb;
+            ++e;
+        }
+        if (e > 0) take(pb, e);
+    }
+    BigInt r;
+    if (isPower(rest, k, &r)) c *= r;
+    else m *= rest;
+    return {c, m};
+}
+
+valptr_t rootValue(const valptr_t &x, unsigned k, calc_mode mode) {
+    if (!x || (x->kind() != value_kind::Integer && x->kind() != value_kind::Fraction)) return nullptr;
+    BigInt num, den(1);
+    if (x->kind() == value_kind::Integer) num = static_cast<const integer &>(*x).getValue();
+    else std::tie(num, den) = static_cast<const fraction &>(*x).toTuple();
+    if (num.sign() < 0 && k % 2 == 0) return nullptr;
+    BigInt rn, rd;
+    if (isPower(num, k, &rn) && isPower(den, k, &rd)) return makeRational(rn, rd);
+    if (mode == calc_mode::Exact) return symPower(x, makeRational(BigInt(1), BigInt(static_cast<long long>(k))));
+    return nullptr;
+}
+
+BigInt powMod(const BigInt &b, const BigInt &e, const BigInt &m) {
+    if (m.sign() <= 0) throw std::runtime_error("powMod: modulus must be positive");
+    if (e.sign() < 0) throw std::runtime_error("powMod: exponent must be nonnegative");
+    if (m == BigInt(1)) return BigInt(0);
+    const std::vector<uint64_t> mw = m.to_words();
+    if (!(mw[0] & 1)) {
+        // even moduli have no Montgomery form
+        BigInt base = b % m, r(1);
+        const std::vector<uint64_t> bits = e.to_words();
+        for (size_t w = bits.size(); w-- > 0;) {
+            for (int i = 63; i >= 0; --i) {
+                r = r * r % m;
+                if ((bits[w] >> i) & 1) r = r * base % m;
+            }
+        }
+        if (r.sign() < 0) r += m;
+        return r;
+    }
+    if (mw.size() == 1 && e.to_words().size() == 1) {
+        const montgomery64 ctx(mw[0]);
+        BigInt base = b % m;
+        if (base.sign() < 0) base += m;
+        return BigInt::from_words({ctx.from(ctx.pow(ctx.to(toWord(base)), toWord(e)))});
+    }
+    montgomery ctx(m);
+    return ctx.from(ctx.pow(ctx.to(b), e));
+}
+
+bool isPrime(const BigInt &n) {
+    if (n.sign() <= 0) return false;
+    const std::vector<uint64_t> w = n.to_words();
+    if (w.size() == 1) return isPrimeWord(w[0]);
+    for (uint32_t p : primesUpTo(PRIME_TRIAL_LIMIT)) {
+        if (wordsMod(w, p) == 0) return false;
+    }
+    return baillieWagstaff(n);
+}
+
+std::vector<std::pair<BigInt, unsigned>> factor(const BigInt &n) {
+    if (n.is_zero()) throw std::runtime_error("factor: 0 has no factorization");
+    std::map<BigInt, unsigned> found;
+    BigInt rest = n.abs();
+    std::vector<uint64_t> w = rest.to_words();
+    // divides p out of rest while it divides
+    auto divideOut = [&](uint64_t p) {
+        while (wordsMod(w, p) == 0) {
+            ++found[BigInt(static_cast<long long>(p))];
+            rest /= BigInt(static_cast<long long>(p));
+            w = rest.to_words();
+        }
+    };
+    for (uint64_t p : {2, 3, 5}) divideOut(p);
+    for (uint64_t p = 7, i = 0; p < FACTOR_TRIAL_LIMIT; p += WHEEL_STEPS[i++ % 8]) {
+        if (w.size() == 1 && p * p > w[0]) break;
+        divideOut(p);
+    }
+    // what is left is 1, a prime, or has no factor below the bound
+    if (w.size() == 1 && w[0] > 1 && w[0] < FACTOR_TRIAL_LIMIT * FACTOR_TRIAL_LIMIT) {
+        ++found[rest];
+    } else {
+        splitInto(rest, found);
+    }
+    return {found.begin(), found.end()};
+}
+
+void register_ntheory_builtins(runtime_env &env) {
+    env.registerBuiltin("factorial", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        if (args.size() != 1 || !args[0]) throw std::runtime_error("factorial expects one number");
+        const valptr_t arg = asList(args[0]);
+        if (arg->kind() == value_kind::List) return mapList(static_cast<const valuelist &>(*arg), factorialOf);
+        return factorialOf(arg);
+    }, true);
+    // exact for integers; otherwise through the gamma function
+    auto combinatoric = [](const char* name, bool choose) {
+        return [name, choose](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+            if (args.size() != 2 || !isNumber(args[0]) || !isNumber(args[1])) {
+                throw std::runtime_error(std::string(name) + " expects two numbers");
+            }
+            if (args[0]->kind() == value_kind::Integer && args[1]->kind() == value_kind::Integer) {
+                const long long n = smallInteger(*args[0], name), k = smallInteger(*args[1], name);
+                return std::make_shared<integer>(choose ? exactBinomial(n, k) : exactFalling(n, k));
+            }
+            const double n = toDouble(*args[0]), k = toDouble(*args[1]);
+            const double r = std::tgamma(n + 1) / std::tgamma(n - k + 1);
+            return std::make_shared<decimal>(choose ? r / std::tgamma(k + 1) : r);
+        };
+    };
+    env.registerBuiltin("nCr", combinatoric("nCr", true), true);
+    env.registerBuiltin("nPr", combinatoric("nPr", false), true);
+    env.registerBuiltin("isPrime", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        if (args.size() != 1 || !args[0]) throw std::runtime_error("isPrime expects one integer");
+        auto test = [](const valptr_t &v) -> valptr_t {
+            return std::make_shared<boolean>(isPrime(integerValue(v, "isPrime")));
+        };
+        const valptr_t arg = asList(args[0]);
+        if (arg->kind() == value_kind::List) return mapList(static_cast<const valuelist &>(*arg), test);
+        return test(arg);
+    }, true);
+    // factor(n): {{p, e}, ...} with n = the product of the p^e; a negative n
+    // starts with {-1, 1}
+    env.registerBuiltin("factor", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        if (args.size() != 1) throw std::runtime_error("factor expects one integer");
+        const BigInt n = integerValue(args[0], "factor");
+        std::vector<valptr_t> out;
+        auto pair = [](BigInt p, unsigned e) -> valptr_t {
+            return std::make_shared<valuelist>(std::vector<valptr_t>{
+                std::make_shared<integer>(std::move(p)), std::make_shared<integer>(static_cast<long long>(e))});
+        };
+        if (n.sign() < 0) out.push_back(pair(BigInt(-1), 1));
+        for (auto &[p, e] : factor(n)) out.push_back(pair(p, e));
+        return std::make_shared<valuelist>(std::move(out));
+    }, true);
+    // root(x, k): the real k-th root, exact where rootValue allows
+    env.registerBuiltin("root", [](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
+        if (args.size() != 2 || !args[1] || args[1]->kind() != value_kind::Integer) {
+            throw std::runtime_error("root expects (value, index)");
+        }
+        const BigInt kb = static_cast<const integer &>(*args[1]).getValue();
+        if (kb.sign() <= 0 || kb > BigInt(std::numeric_limits<int>::max())) throw std::runtime_error("root: index must be positive");
+        const unsigned k = static_cast<unsigned>(kb.to_long_long());
+        auto apply = [k, &env](const valptr_t &x) -> valptr_t {
+            if (x && x->kind() == value_kind::Symbolic) {
+                return symPower(x, makeRational(BigInt(1), BigInt(static_cast<long long>(k))));
+            }
+            if (!isNumber(x)) throw std::runtime_error("root expects a number");
+            if (valptr_t exact = rootValue(x, k, env.getMode())) return exact;
+            const double v = toDouble(*x);
+            // odd roots of negative numbers are real
+            if (v < 0 && k % 2 == 1) return std::make_shared<decimal>(-std::pow(-v, 1.0 / k));
+            return std::make_shared<decimal>(std::pow(v, 1.0 / k));
+        };
+        const valptr_t arg = asList(args[0]);
+        if (arg && arg->kind() == value_kind::List) return mapList(static_cast<const valuelist &>(*arg), apply);
+        return apply(arg);
+    }, true);
+    env.registerBuiltin("powMod", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        if (args.size() != 3) throw std::runtime_error("powMod expects (base, exponent, modulus)");
+        return std::make_shared<integer>(
+            powMod(integerValue(args[0], "powMod"), integerValue(args[1], "powMod"), integerValue(args[2], "powMod")));
+    }, true);
+}
+
+} // namespace ti
@@ -0,0 +1,613 @@
+#include "../include/numeric.h"
+#include "../include/runtimeenv.h"
+#include "../include/evaluator.h"
+#include "../include/batch.h"
+#include "../include/symbolic.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <numbers>
+#include <stdexcept>
+
+namespace ti {
+
+using namespace ast;
+
+namespace {
+
+constexpr double EPS = std::numeric_limits<double>::epsilon();
+constexpr double REL_TOL = 1e-10;
+constexpr double ABS_TOL = 1e-12;
+// Gauss-Kronrod intervals evaluated before giving up
+constexpr size_t MAX_INTERVALS = 2000;
+// tanh-sinh halvings of the step, starting from h = 1
+constexpr int TANH_SINH_LEVELS = 8;
+// by |t| = 6.5 a node is within 1e-300 of its end, which still matters
+// for singular integrands like 1/sqrt(x); nodes that round onto the end
+// are skipped
+constexpr double TANH_SINH_TMAX = 6.5;
+// nDeriv steps h, h/2, ...
+constexpr size_t RICHARDSON_STEPS = 10;
+constexpr size_t MAX_ITERATIONS = 200;
+
+double tolerance(double value) {
+    return std::max(ABS_TOL, REL_TOL * std::fabs(value));
+}
+
+std::unique_ptr<batch_evaluator> batchFor(const exprnode &e, const std::string &var, runtime_env &env) {
+    auto b = std::make_unique<batch_evaluator>(e, var, env);
+    if (!b->supported()) return nullptr;
+    return b;
+}
+
+} // namespace
+
+// === sampled_function ===
+
+sampled_function::sampled_function(const exprnode &expr, std::string var, runtime_env &env, const char* caller,
+                                   const exprnode* minus)
+    : expr(expr), minus(minus), var(std::move(var)), env(env), caller(caller) {
+    batch = batchFor(expr, this->var, env);
+    if (minus) minusBatch = batchFor(*minus, this->var, env);
+}
+
+sampled_function::~sampled_function() = default;
+
+void sampled_function::evalTerm(const exprnode &e, batch_evaluator* b, const std::vector<double> &xs,
+                                std::vector<double> &ys) {
+    ys.resize(xs.size());
+    if (b && b->evalNumeric(xs.data(), xs.size(), ys.data())) return;
+
+    std::vector<valptr_t> vals;
+    if (b) {
+        vals = b->eval(xs.data(), xs.size());
+    } else {
+        scoped_variable bound(env, var);
+        evaluator ev(env);
+        vals.reserve(xs.size());
+        for (double x : xs) {
+            bound.set(std::make_shared<decimal>(x));
+            vals.push_back(ev.run(e));
+        }
+    }
+    for (size_t i = 0; i < vals.size(); ++i) {
+        if (!vals[i] || !isNumeric(vals[i]->kind())) {
+            throw std::runtime_error(std::string(caller) + ": expression must evaluate to a number");
+        }
+        ys[i] = toDouble(*vals[i]);
+    }
+}
+
+void sampled_function::eval(const std::vector<double> &xs, std::vector<double> &ys) {
+    count += xs.size();
+    evalTerm(expr, batch.get(), xs, ys);
+    if (minus) {
+        std::vector<double> rs;
+        evalTerm(*minus, minusBatch.get(), xs, rs);
+        for (size_t i = 0; i < ys.size(); ++i) ys[i] -= rs[i];
+    }
+}
+
+// === integration ===
+
+namespace {
+
+// 15-point Kronrod abscissae on [0, 1) with weights; the odd-indexed ones
+// are the 7-point Gauss abscissae, whose weights follow
+const double XGK[8] = {0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+                       0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+                       0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+                       0.207784955007898467600689403773245, 0.0};
+const double WGK[8] = {0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+                       0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+                       0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+                       0.204432940075298892414161999234649, 0.209482141084727828012999174891714};
+const double WG[4] = {0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+                      0.381830050505118944950369775488975, 0.417959183673469387755102040816327};
+
+struct interval {
+    double a, b;
+    double value = 0;
+    double error = 0;
+};
+
+// the 15 Kronrod nodes of [a, b] appended to xs
+void kronrodNodes(double a, double b, std::vector<double> &xs) {
+    const double c = 0.5 * (a + b), h = 0.5 * (b - a);
+    for (int j = 0; j < 7; ++j) {
+        xs.push_back(c - h * XGK[j]);
+        xs.push_back(c + h * XGK[j]);
+    }
+    xs.push_back(c);
+}
+
+// QUADPACK's estimate for one interval from its 15 values
+void kronrodRule(interval &iv, const double* fs) {
+    const double h = 0.5 * (iv.b - iv.a);
+    const double fc = fs[14];
+    double resk = WGK[7] * fc, resg = WG[3] * fc, resabs = std::fabs(resk);
+    for (int j = 0; j < 7; ++j) {
+        const double sum = fs[2 * j] + fs[2 * j + 1];
+        resk += WGK[j] * sum;
+        resabs += WGK[j] * (std::fabs(fs[2 * j]) + std::fabs(fs[2 * j + 1]));
+        if (j % 2 == 1) resg += WG[j / 2] * sum;
+    }
+    const double mean = 0.5 * resk;
+    double resasc = WGK[7] * std::fabs(fc - mean);
+    for (int j = 0; j < 7; ++j) resasc += WGK[j] * (std::fabs(fs[2 * j] - mean) + std::fabs(fs[2 * j + 1] - mean));
+
+    iv.value = resk * h;
+    double err = std::fabs((resk - resg) * h);
+    resasc *= std::fabs(h);
+    resabs *= std::fabs(h);
+    if (resasc != 0 && err != 0) err = resasc * std::min(1.0, std::pow(200 * err / resasc, 1.5));
+    if (resabs > std::numeric_limits<double>::min() / (50 * EPS)) err = std::max(50 * EPS * resabs, err);
+    iv.error = err;
+}
+
+double gaussKronrod(const sampler &f, double a, double b, numeric_report &report) {
+    std::vector<interval> pending{{a, b}};
+    double accepted = 0, acceptedError = 0;
+    size_t intervals = 0;
+    std::vector<double> xs, ys;
+    for (;;) {
+        xs.clear();
+        for (const interval &iv : pending) kronrodNodes(iv.a, iv.b, xs);
+        f(xs, ys);
+        intervals += pending.size();
+
+        double value = accepted, error = acceptedError;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            kronrodRule(pending[i], ys.data() + 15 * i);
+            value += pending[i].value;
+            error += pending[i].error;
+        }
+        const double tol = tolerance(value);
+        report.errorEstimate = error;
+        report.converged = error <= tol;
+        if (report.converged || intervals + 2 * pending.size() > MAX_INTERVALS) return value;
+
+        // split every interval over its share of the tolerance, all at once
+        std::vector<interval> next;
+        for (const interval &iv : pending) {
+            const double mid = 0.5 * (iv.a + iv.b);
+            const bool splittable = mid != iv.a && mid != iv.b;
+            if (splittable && iv.error > tol * std::fabs((iv.b - iv.a) / (b - a))) {
+                next.push_back({iv.a, mid});
+                next.push_back({mid, iv.b});
+            } else {
+                accepted += iv.value;
+                acceptedError += iv.error;
+            }
+        }
+        if (next.empty()) return value;
+        pending = std::move(next);
+    }
+}
+
+// Level L uses step h = 2^-L over t in [-TMAX, TMAX] and adds only the odd
+// multiples of h, so each level is one batch of new nodes.
+double tanhSinh(const sampler &f, double a, double b, numeric_report &report) {
+    const double c = 0.5 * (a + b), hw = 0.5 * (b - a);
+    double sum = 0, prev = 0, estimate = 0;
+    std::vector<double> xs, ws, ys;
+    for (int level = 0; level <= TANH_SINH_LEVELS; ++level) {
+        const double h = std::ldexp(1.0, -level);
+        xs.clear();
+        ws.clear();
+        const long long kmax = static_cast<long long>(TANH_SINH_TMAX / h);
+        for (long long k = -kmax; k <= kmax; ++k) {
+            if (level > 0 && k % 2 == 0) continue;
+            const double t = k * h;
+            const double u = std::numbers::pi / 2 * std::sinh(t);
+            const double ch = std::cosh(u);
+            const double w = hw * std::numbers::pi / 2 * std::cosh(t) / (ch * ch);
+            // distance to the nearer end, computed without cancellation
+            const double d = hw * 2 / (std::exp(2 * std::fabs(u)) + 1);
+            const double x = t < 0 ? a + d : t > 0 ? b - d : c;
+            if (w == 0 || !std::isfinite(w) || x == a || x == b) continue;
+            xs.push_back(x);
+            ws.push_back(w);
+        }
+        f(xs, ys);
+        for (size_t i = 0; i < ys.size(); ++i) sum += ws[i] * ys[i];
+        estimate = sum * h;
+        if (level > 0) {
+            report.errorEstimate = std::fabs(estimate - prev);
+            if (report.errorEstimate <= tolerance(estimate)) {
+                report.converged = true;
+                return estimate;
+            }
+        }
+        prev = estimate;
+    }
+    report.converged = false;
+    return estimate;
+}
+
+// integral of f over [a, b] with a < b finite
+double integrateFinite(const sampler &f, double a, double b, numeric_report &report) {
+    report.method = "gauss-kronrod";
+    const double gk = gaussKronrod(f, a, b, report);
+    if (report.converged) return gk;
+
+    numeric_report ts;
+    ts.method = "tanh-sinh";
+    const double alt = tanhSinh(f, a, b, ts);
+    if (!(ts.errorEstimate < report.errorEstimate)) return gk;
+    report.method = ts.method;
+    report.errorEstimate = ts.errorEstimate;
+    report.converged = ts.converged;
+    return alt;
+}
+
+} // namespace
+
+double integrate(const sampler &f, double a, double b, numeric_report &report) {
+    if (std::isnan(a) || std::isnan(b)) throw std::runtime_error("nInt: bounds must be numbers");
+    if (a == b) {
+        report.method = "gauss-kronrod";
+        report.errorEstimate = 0;
+        report.converged = true;
+        return 0;
+    }
+    if (a > b) return -integrate(f, b, a, report);
+    if (std::isfinite(a) && std::isfinite(b)) return integrateFinite(f, a, b, report);
+
+    // map an infinite range onto (-1, 1) or [0, 1); nodes stay inside, so
+    // the Jacobian is finite wherever it is sampled
+    sampler g;
+    double lo = 0, hi = 1;
+    if (std::isinf(a) && std::isinf(b)) {
+        lo = -1;
+        g = [&f](const std::vector<double> &ts, std::vector<double> &ys) {
+            std::vector<double> xs(ts.size());
+            for (size_t i = 0; i < ts.size(); ++i) xs[i] = ts[i] / (1 - ts[i] * ts[i]);
+            f(xs, ys);
+            for (size_t i = 0; i < ts.size(); ++i) {
+                const double s = 1 - ts[i] * ts[i];
+                ys[i] *= (1 + ts[i] * ts[i]) / (s * s);
+            }
+        };
+    } else {
+        // x = a + t/(1-t) on [a, inf), x = b - t/(1-t) on (-inf, b]
+        const double origin = std::isinf(a) ? b : a;
+        const double dir = std::isinf(a) ? -1 : 1;
+        g = [&f, origin, dir](const std::vector<double> &ts, std::vector<double> &ys) {
+            std::vector<double> xs(ts.size());
+            for (size_t i = 0; i < ts.size(); ++i) xs[i] = origin + dir * ts[i] / (1 - ts[i]);
+            f(xs, ys);
+            for (size_t i = 0; i < ts.size(); ++i) ys[i] /= (1 - ts[i]) * (1 - ts[i]);
+        };
+    }
+    return integrateFinite(g, lo, hi, report);
+}
+
+// === differentiation ===
+
+double derivative(const sampler &f, double x, double h, numeric_report &report) {
+    if (!(h > 0) || !std::isfinite(h)) throw std::runtime_error("nDeriv: step must be positive");
+    report.method = "richardson";
+    std::vector<double> xs, ys;
+    for (size_t i = 0; i < RICHARDSON_STEPS; ++i) {
+        const double hi = std::ldexp(h, -static_cast<int>(i));
+        xs.push_back(x + hi);
+        xs.push_back(x - hi);
+    }
+    f(xs, ys);
+
+    // Neville's tableau: row i extrapolates the differences at h/2^0..h/2^i
+    // to step zero; the entry that agrees best with its neighbours wins
+    std::vector<std::vector<double>> t(RICHARDSON_STEPS);
+    double best = 0, bestError = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < RICHARDSON_STEPS; ++i) {
+        const double hi = std::ldexp(h, -static_cast<int>(i));
+        t[i].push_back((ys[2 * i] - ys[2 * i + 1]) / (2 * hi));
+        double factor = 1;
+        for (size_t j = 1; j <= i; ++j) {
+            factor *= 4;
+            t[i].push_back(t[i][j - 1] + (t[i][j - 1] - t[i - 1][j - 1]) / (factor - 1));
+            const double err = std::max(std::fabs(t[i][j] - t[i][j - 1]), std::fabs(t[i][j] - t[i - 1][j - 1]));
+            if (err < bestError) {
+                bestError = err;
+                best = t[i][j];
+            }
+        }
+    }
+    report.errorEstimate = bestError;
+    report.converged = bestError <= tolerance(best) * 1e3; // differences lose about three more digits
+    return best;
+}
+
+// === Brent ===
+
+double findRoot(const sampler &f, double a, double b, double fa, double fb, numeric_report &report) {
+    report.method = "brent";
+    std::vector<double> x(1), y(1);
+    // the absolute floor of the tolerance, on the scale of the bracket, so
+    // a root at zero (where 2 EPS |b| vanishes) still converges
+    const double xtol = 2 * EPS * std::max(std::fabs(a), std::fabs(b));
+    double c = a, fc = fa, d = b - a, e = d;
+    for (size_t it = 0; it < MAX_ITERATIONS; ++it) {
+        if (std::fabs(fc) < std::fabs(fb)) {
+            a = b; b = c; c = a;
+            fa = fb; fb = fc; fc = fa;
+        }
+        const double tol = 2 * EPS * std::fabs(b) + 0.5 * xtol;
+        const double m = 0.5 * (c - b);
+        report.errorEstimate = std::fabs(m);
+        if (std::fabs(m) <= tol || fb == 0) {
+            report.converged = true;
+            return b;
+        }
+        if (std::fabs(e) < tol || std::fabs(fa) <= std::fabs(fb)) {
+            d = e = m;
+        } else {
+            // inverse quadratic interpolation, or secant when only two points differ
+            double s = fb / fa, p, q;
+            if (a == c) {
+                p = 2 * m * s;
+                q = 1 - s;
+            } else {
+                const double qa = fa / fc, r = fb / fc;
+                p = s * (2 * m * qa * (qa - r) - (b - a) * (r - 1));
+                q = (qa - 1) * (r - 1) * (s - 1);
+            }
+            if (p > 0) q = -q;
+            else p = -p;
+            s = e;
+            e = d;
+            if (2 * p < 3 * m * q - std::fabs(tol * q) && p < std::fabs(0.5 * s * q)) {
+                d = p / q;
+            } else {
+                d = e = m;
+            }
+        }
+        a = b;
+        fa = fb;
+        b += std::fabs(d) > tol ? d : (m > 0 ? tol : -tol);
+        x[0] = b;
+        f(x, y);
+        fb = y[0];
+        if ((fb > 0) == (fc > 0)) {
+            c = a;
+            fc = fa;
+            d = e = b - a;
+        }
+    }
+    report.converged = false;
+    return b;
+}
+
+double minimize(const sampler &f, double a, double b, double &fx, numeric_report &report) {
+    report.method = "brent";
+    const double golden = 0.5 * (3 - std::sqrt(5.0));
+    std::vector<double> px(1), py(1);
+    auto at = [&](double x) {
+        px[0] = x;
+        f(px, py);
+        return py[0];
+    };
+    double x = a + golden * (b - a), w = x, v = x;
+    fx = at(x);
+    double fw = fx, fv = fx, d = 0, e = 0;
+    for (size_t it = 0; it < MAX_ITERATIONS; ++it) {
+        const double m = 0.5 * (a + b);
+        const double tol = std::sqrt(EPS) * std::fabs(x) + 1e-12;
+        const double t2 = 2 * tol;
+        report.errorEstimate = 0.5 * (b - a);
+        if (std::fabs(x - m) <= t2 - 0.5 * (b - a)) {
+            report.converged = true;
+            return x;
+        }
+        double p = 0, q = 0, r = 0;
+        if (std::fabs(e) > tol) {
+            // parabola through x, w and v
+            r = (x - w) * (fx - fv);
+            q = (x - v) * (fx - fw);
+            p = (x - v) * q - (x - w) * r;
+            q = 2 * (q - r);
+            if (q > 0) p = -p;
+            else q = -q;
+            r = e;
+            e = d;
+        }
+        if (std::fabs(p) < std::fabs(0.5 * q * r) && p > q * (a - x) && p < q * (b - x)) {
+            d = p / q;
+            const double u = x + d;
+            if (u - a < t2 || b - u < t2) d = x < m ? tol : -tol;
+        } else {
+            e = (x < m ? b : a) - x;
+            d = golden * e;
+        }
+        const double u = x + (std::fabs(d) >= tol ? d : (d > 0 ? tol : -tol));
+        const double fu = at(u);
+        if (fu <= fx) {
+            if (u < x) b = x;
+            else a = x;
+            v = w; fv = fw;
+            w = x; fw = fx;
+            x = u; fx = fu;
+        } else {
+            if (u < x) a = u;
+            else b = u;
+            if (fu <= fw || w == x) {
+                v = w; fv = fw;
+                w = u; fw = fu;
+            } else if (fu <= fv || v == x || v == w) {
+                v = u; fv = fu;
+            }
+        }
+    }
+    report.converged = false;
+    return x;
+}
+
+// === builtins ===
+
+namespace {
+
+// grid points for bracketing: GRID + 1 evenly spaced over a bounded range,
+// or 0 and +-2^k (k = -8..40) when there are no bounds
+constexpr size_t GRID = 64;
+
+double numberArg(const exprnode &n, runtime_env &env, const char* name) {
+    valptr_t v = evaluator(env).run(n);
+    if (v && v->kind() == value_kind::Symbolic) v = symConstantValue(static_cast<const symbolic &>(*v)); // π
+    if (!v || !isNumeric(v->kind())) throw std::runtime_error(std::string(name) + ": bounds must be numbers");
+    return toDouble(*v);
+}
+
+std::vector<double> searchGrid(double lo, double hi, bool bounded, double around) {
+    std::vector<double> xs;
+    if (bounded) {
+        for (size_t i = 0; i <= GRID; ++i) xs.push_back(lo + (hi - lo) * static_cast<double>(i) / GRID);
+        xs.back() = hi;
+        return xs;
+    }
+    const double scale = std::max(1.0, std::fabs(around));
+    for (int k = 40; k >= -8; --k) xs.push_back(around - scale * std::ldexp(1.0, k));
+    xs.push_back(around);
+    for (int k = -8; k <= 40; ++k) xs.push_back(around + scale * std::ldexp(1.0, k));
+    return xs;
+}
+
+valptr_t reported(runtime_env &env, double result, numeric_report report, const sampled_function &f) {
+    report.evaluations = f.evaluations();
+    env.setNumericReport(report);
+    return std::make_shared<decimal>(result);
+}
+
+// nInt(expr, var, low, high)
+valptr_t nIntForm(const call_node &c, runtime_env &env) {
+    if (c.args.size() != 4) throw std::runtime_error("nInt expects (expr, var, low, high)");
+    const std::string &var = formVariable(c, 1, "nInt");
+    const double a = numberArg(*c.args[2], env, "nInt");
+    const double b = numberArg(*c.args[3], env, "nInt");
+    sampled_function f(*c.args[0], var, env, "nInt");
+    numeric_report report;
+    const double r = integrate([&f](const std::vector<double> &xs, std::vector<double> &ys) { f.eval(xs, ys); }, a, b,
+                               report);
+    return reported(env, r, report, f);
+}
+
+// nDeriv(expr, var, x[, h]): with h, the central difference at h as on the
+// handheld, its error estimated against h/2
+valptr_t nDerivForm(const call_node &c, runtime_env &env) {
+    if (c.args.size() != 3 && c.args.size() != 4) throw std::runtime_error("nDeriv expects (expr, var, x[, h])");
+    const std::string &var = formVariable(c, 1, "nDeriv");
+    const double x = numberArg(*c.args[2], env, "nDeriv");
+    sampled_function f(*c.args[0], var, env, "nDeriv");
+    numeric_report report;
+    if (c.args.size() == 3) {
+        const double r = derivative([&f](const std::vector<double> &xs, std::vector<double> &ys) { f.eval(xs, ys); },
+                                    x, 0.1 * std::max(1.0, std::fabs(x)), report);
+        return reported(env, r, report, f);
+    }
+    const double h = numberArg(*c.args[3], env, "nDeriv");
+    if (!(h > 0)) throw std::runtime_error("nDeriv: step must be positive");
+    std::vector<double> ys;
+    f.eval({x + h, x - h, x + h / 2, x - h / 2}, ys);
+    const double d = (ys[0] - ys[1]) / (2 * h);
+    report.method = "central difference";
+    report.errorEstimate = std::fabs(d - (ys[2] - ys[3]) / h);
+    report.converged = true;
+    return reported(env, d, report, f);
+}
+
+// nSolve(expr, var[, guess]) or nSolve(expr, var, low, high); an equation
+// l = r is solved as l - r = 0
+valptr_t nSolveForm(const call_node &c, runtime_env &env) {
+    if (c.args.size() < 2 || c.args.size() > 4) throw std::runtime_error("nSolve expects (expr, var[, guess]) or (expr, var, low, high)");
+    const std::string &var = formVariable(c, 1, "nSolve");
+    const exprnode* lhs = c.args[0].get();
+    const exprnode* rhs = nullptr;
+    if (lhs->kind() == node_kind::BinaryOp && static_cast<const binary_op_node *>(lhs)->op == binary_op::Eq) {
+        rhs = static_cast<const binary_op_node *>(lhs)->right.get();
+        lhs = static_cast<const binary_op_node *>(lhs)->left.get();
+    }
+    const bool bounded = c.args.size() == 4;
+    const double lo = c.args.size() >= 3 ? numberArg(*c.args[2], env, "nSolve") : 0;
+    const double hi = bounded ? numberArg(*c.args[3], env, "nSolve") : lo;
+    if (bounded && !(lo < hi)) throw std::runtime_error("nSolve: low must be below high");
+
+    sampled_function f(*lhs, var, env, "nSolve", rhs);
+    auto sample = [&f](const std::vector<double> &xs, std::vector<double> &ys) { f.eval(xs, ys); };
+    numeric_report report;
+    report.method = "brent";
+
+    // one batch over the grid; take the sign change nearest the guess
+    std::vector<double> xs = searchGrid(lo, hi, bounded, lo), ys;
+    sample(xs, ys);
+    size_t bestPair = xs.size();
+    double bestDistance = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < xs.size(); ++i) {
+        if (ys[i] == 0) return reported(env, xs[i], report, f);
+        if (i + 1 < xs.size() && std::isfinite(ys[i]) && std::isfinite(ys[i + 1]) && (ys[i] < 0) != (ys[i + 1] < 0)) {
+            const double distance = bounded ? static_cast<double>(i) : std::min(std::fabs(xs[i] - lo), std::fabs(xs[i + 1] - lo));
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                bestPair = i;
+            }
+        }
+    }
+    if (bestPair == xs.size()) throw std::runtime_error("nSolve: no sign change found");
+    const size_t i = bestPair;
+    const double r = findRoot(sample, xs[i], xs[i + 1], ys[i], ys[i + 1], report);
+    return reported(env, r, report, f);
+}
+
+// fMin/fMax(expr, var[, low, high]): the x of the smallest (largest) value
+valptr_t extremumForm(const call_node &c, runtime_env &env, const char* name, double sign) {
+    if (c.args.size() != 2 && c.args.size() != 4) throw std::runtime_error(std::string(name) + " expects (expr, var[, low, high])");
+    const std::string &var = formVariable(c, 1, name);
+    const bool bounded = c.args.size() == 4;
+    const double lo = bounded ? numberArg(*c.args[2], env, name) : 0;
+    const double hi = bounded ? numberArg(*c.args[3], env, name) : 0;
+    if (bounded && !(lo < hi)) throw std::runtime_error(std::string(name) + ": low must be below high");
+
+    sampled_function f(*c.args[0], var, env, name);
+    auto sample = [&f, sign](const std::vector<double> &xs, std::vector<double> &ys) {
+        f.eval(xs, ys);
+        for (double &y : ys) y *= sign;
+    };
+
+    std::vector<double> xs = searchGrid(lo, hi, bounded, 0), ys;
+    sample(xs, ys);
+    size_t best = 0;
+    for (size_t i = 1; i < xs.size(); ++i) {
+        if (ys[i] < ys[best] || std::isnan(ys[best])) best = i;
+    }
+    if (!bounded && (best == 0 || best + 1 == xs.size())) {
+        throw std::runtime_error(std::string(name) + ": no extremum found");
+    }
+    numeric_report report;
+    double fx;
+    const double x = minimize(sample, xs[best == 0 ? 0 : best - 1], xs[std::min(best + 1, xs.size() - 1)], fx, report);
+    // an endpoint of a bounded range can beat every interior point
+    return reported(env, fx <= ys[best] ? x : xs[best], report, f);
+}
+
+} // namespace
+
+void register_numeric_builtins(runtime_env &env) {
+    env.registerForm("nInt", nIntForm, true);
+    env.registerForm("nDeriv", nDerivForm, true);
+    env.registerForm("nSolve", nSolveForm, true);
+    env.registerForm("fMin", [](const call_node &c, runtime_env &env) { return extremumForm(c, env, "fMin", 1); }, true);
+    env.registerForm("fMax", [](const call_node &c, runtime_env &env) { return extremumForm(c, env, "fMax", -1); }, true);
+    // numericReport(): how the last of those got its answer, e.g.
+    // "tanh-sinh, 127 evaluations, error 3.1e-15"
+    env.registerBuiltin("numericReport", [](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
+        if (!args.empty()) throw std::runtime_error("numericReport expects no arguments");
+        const numeric_report &r = env.getNumericReport();
+        if (r.method.empty()) return std::make_shared<string>("no numeric calculation yet");
+        char error[32];
+        std::snprintf(error, sizeof error, "%.2g", r.errorEstimate);
+        return std::make_shared<string>(r.method + ", " + std::to_string(r.evaluations) + " evaluations, error " + error +
+                                        (r.converged ? "" : ", not converged"));
+    });
+}
+
+} // namespace ti
@@ -0,0 +1,574 @@
+#include "../include/ode.h"
+#include "../include/runtimeenv.h"
+#include "../include/evaluator.h"
+#include "../include/batch.h"
+#include "../include/arith.h"
+#include "../include/lists.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+
+namespace ti {
+
+using namespace ast;
+
+namespace {
+
+constexpr double EPS = std::numeric_limits<double>::epsilon();
+
+// Dormand-Prince 5(4): nodes, stage coefficients (row 6 is the solution
+// weights, so the last stage is f at the new point), error weights, and
+// the quartic dense-output polynomials
+const double DP_C[7] = {0, 1.0 / 5, 3.0 / 10, 4.0 / 5, 8.0 / 9, 1, 1};
+const double DP_A[7][6] = {
+    {},
+    {1.0 / 5},
+    {3.0 / 40, 9.0 / 40},
+    {44.0 / 45, -56.0 / 15, 32.0 / 9},
+    {19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729},
+    {9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656},
+    {35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84},
+};
+const double DP_E[7] = {71.0 / 57600, 0, -71.0 / 16695, 71.0 / 1920, -17253.0 / 339200, 22.0 / 525, -1.0 / 40};
+const double DP_BI[7][4] = {
+    {1, -183.0 / 64, 37.0 / 12, -145.0 / 128},
+    {0, 0, 0, 0},
+    {0, 1500.0 / 371, -1000.0 / 159, 1000.0 / 371},
+    {0, -125.0 / 32, 125.0 / 12, -375.0 / 64},
+    {0, 9477.0 / 3392, -729.0 / 106, 25515.0 / 6784},
+    {0, -11.0 / 7, 11.0 / 3, -55.0 / 28},
+    {0, 3.0 / 2, -4, 5.0 / 2},
+};
+
+// Shampine and Reichelt's Rosenbrock pair
+const double RB_D = 1 / (2 + std::sqrt(2.0));
+const double RB_E32 = 6 + std::sqrt(2.0);
+
+// in-place LU with partial pivoting of the n x n row-major matrix a
+void luFactor(std::vector<double> &a, std::vector<size_t> &piv, size_t n) {
+    piv.resize(n);
+    for (size_t k = 0; k < n; ++k) {
+        size_t p = k;
+        for (size_t i = k + 1; i < n; ++i) {
+            if (std::fabs(a[i * n + k]) > std::fabs(a[p * n + k])) p = i;
+        }
+        piv[k] = p;
+        if (p != k) {
+            for (size_t j = 0; j < n; ++j) std::swap(a[k * n + j], a[p * n + j]);
+        }
+        if (a[k * n + k] == 0) throw std::runtime_error("ode: singular iteration matrix");
+        for (size_t i = k + 1; i < n; ++i) {
+            const double m = a[i * n + k] /= a[k * n + k];
+            for (size_t j = k + 1; j < n; ++j) a[i * n + j] -= m * a[k * n + j];
+        }
+    }
+}
+
+void luSolve(const std::vector<double> &a, const std::vector<size_t> &piv, size_t n, double* b) {
+    for (size_t k = 0; k < n; ++k) {
+        std::swap(b[k], b[piv[k]]);
+        for (size_t i = k + 1; i < n; ++i) b[i] -= a[i * n + k] * b[k];
+    }
+    for (size_t k = n; k-- > 0;) {
+        for (size_t j = k + 1; j < n; ++j) b[k] -= a[k * n + j] * b[j];
+        b[k] /= a[k * n + k];
+    }
+}
+
+} // namespace
+
+// === ode_solution ===
+
+void ode_solution::at(double t, double* out) const {
+    const size_t m = steps.size();
+    if (m == 0) {
+        std::copy(states.begin(), states.begin() + n, out);
+        return;
+    }
+    // the last step starting at or before t (in the direction of travel)
+    const bool forward = steps[0] > 0;
+    size_t lo = 0, hi = m;
+    while (hi - lo > 1) {
+        const size_t mid = (lo + hi) / 2;
+        if (forward ? starts[mid] <= t : starts[mid] >= t) lo = mid;
+        else hi = mid;
+    }
+    const double h = steps[lo];
+    const double s = (t - starts[lo]) / h;
+    const double* y = states.data() + n * lo;
+    if (method == ode_method::DormandPrince) {
+        const double* k = slopes.data() + 7 * n * lo;
+        double w[7];
+        for (size_t j = 0; j < 7; ++j) {
+            w[j] = s * (DP_BI[j][0] + s * (DP_BI[j][1] + s * (DP_BI[j][2] + s * DP_BI[j][3])));
+        }
+        for (size_t i = 0; i < n; ++i) {
+            double sum = 0;
+            for (size_t j = 0; j < 7; ++j) sum += w[j] * k[j * n + i];
+            out[i] = y[i] + h * sum;
+        }
+    } else {
+        const double* k = slopes.data() + 2 * n * lo;
+        const double w1 = s * (1 - s) / (1 - 2 * RB_D);
+        const double w2 = s * (s - 2 * RB_D) / (1 - 2 * RB_D);
+        for (size_t i = 0; i < n; ++i) out[i] = y[i] + h * (w1 * k[i] + w2 * k[n + i]);
+    }
+}
+
+// === integrator ===
+
+class ode_integrator {
+private:
+    struct trajectory {
+        double t = 0;
+        double h = 0; // signed
+        std::vector<double> y;
+        std::vector<double> f; // f(t, y), reused as the first stage
+        size_t steps = 0;
+        bool done = false;
+    };
+
+    ode_rhs &rhs;
+    const size_t n;
+    const double t0, t1, dir;
+    const ode_options &opts;
+    ode_stats &stats;
+    std::vector<trajectory> trajs;
+    std::vector<ode_solution> sols;
+    std::vector<size_t> active;
+
+    // buffers for one batched evaluation
+    std::vector<double> ts, ys, dys;
+
+    void evalBatch() {
+        dys.resize(ys.size());
+        stats.evaluations += ts.size();
+        rhs.eval(ts.size(), ts.data(), ys.data(), dys.data());
+    }
+
+    double errorNorm(const double* err, const double* y, const double* ynew) const {
+        double norm = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const double scale = opts.atol + opts.rtol * std::max(std::fabs(y[i]), std::fabs(ynew[i]));
+            norm = std::max(norm, std::fabs(err[i]) / scale);
+        }
+        return norm;
+    }
+
+    void initialSteps() {
+        ts.clear();
+        ys.clear();
+        for (auto &tr : trajs) {
+            ts.push_back(tr.t);
+            ys.insert(ys.end(), tr.y.begin(), tr.y.end());
+        }
+        evalBatch();
+        for (size_t i = 0; i < trajs.size(); ++i) {
+            trajectory &tr = trajs[i];
+            tr.f.assign(dys.begin() + i * n, dys.begin() + (i + 1) * n);
+            // Hairer's first guess: a step that moves y by about 1% of itself
+            double d0 = 0, d1 = 0;
+            for (size_t j = 0; j < n; ++j) {
+                const double sc = opts.atol + opts.rtol * std::fabs(tr.y[j]);
+                d0 = std::max(d0, std::fabs(tr.y[j]) / sc);
+                d1 = std::max(d1, std::fabs(tr.f[j]) / sc);
+            }
+            const double h = d0 < 1e-5 || d1 < 1e-5 ? 1e-6 : 0.01 * d0 / d1;
+            tr.h = dir * std::min(h, std::fabs(t1 - t0));
+        }
+    }
+
+    // clips each active step to t1; true for trajectories on their last step
+    std::vector<bool> clipSteps() {
+        std::vector<bool> last(active.size());
+        for (size_t a = 0; a < active.size(); ++a) {
+            trajectory &tr = trajs[active[a]];
+            const double left = std::fabs(t1 - tr.t);
+            if (std::fabs(tr.h) < 16 * EPS * std::max(1.0, std::fabs(tr.t))) {
+                throw std::runtime_error("ode: step size too small at t = " + std::to_string(tr.t));
+            }
+            if (++tr.steps > opts.maxSteps) throw std::runtime_error("ode: too many steps");
+            if (std::fabs(tr.h) >= left) {
+                tr.h = dir * left;
+                last[a] = true;
+            }
+        }
+        return last;
+    }
+
+    void accept(size_t i, bool last, const double* ynew, const double* fnew, const double* slopes, size_t slopeCount) {
+        trajectory &tr = trajs[i];
+        ode_solution &sol = sols[i];
+        sol.starts.push_back(tr.t);
+        sol.steps.push_back(tr.h);
+        sol.states.insert(sol.states.end(), tr.y.begin(), tr.y.end());
+        sol.slopes.insert(sol.slopes.end(), slopes, slopes + slopeCount);
+        tr.t = last ? t1 : tr.t + tr.h;
+        tr.y.assign(ynew, ynew + n);
+        tr.f.assign(fnew, fnew + n);
+        ++stats.accepted;
+        if (last) {
+            tr.done = true;
+            sol.starts.push_back(tr.t);
+            sol.states.insert(sol.states.end(), tr.y.begin(), tr.y.end());
+        }
+    }
+
+    void dormandPrinceRound() {
+        const size_t m = active.size();
+        std::vector<bool> last = clipSteps();
+        // k[s] holds stage s of every active trajectory
+        std::vector<std::vector<double>> k(7, std::vector<double>(m * n));
+        for (size_t a = 0; a < m; ++a) std::copy(trajs[active[a]].f.begin(), trajs[active[a]].f.end(), k[0].begin() + a * n);
+        std::vector<double> ynew(m * n);
+        for (size_t s = 1; s < 7; ++s) {
+            ts.assign(m, 0);
+            ys.assign(m * n, 0);
+            for (size_t a = 0; a < m; ++a) {
+                const trajectory &tr = trajs[active[a]];
+                ts[a] = s == 6 && last[a] ? t1 : tr.t + DP_C[s] * tr.h;
+                for (size_t i = 0; i < n; ++i) {
+                    double sum = 0;
+                    for (size_t r = 0; r < s; ++r) sum += DP_A[s][r] * k[r][a * n + i];
+                    ys[a * n + i] = tr.y[i] + tr.h * sum;
+                }
+            }
+            evalBatch();
+            k[s] = dys;
+            if (s == 6) ynew = ys;
+        }
+
+        std::vector<double> err(n), slopes(7 * n);
+        for (size_t a = 0; a < m; ++a) {
+            trajectory &tr = trajs[active[a]];
+            for (size_t i = 0; i < n; ++i) {
+                double sum = 0;
+                for (size_t r = 0; r < 7; ++r) sum += DP_E[r] * k[r][a * n + i];
+                err[i] = tr.h * sum;
+            }
+            const double norm = errorNorm(err.data(), tr.y.data(), ynew.data() + a * n);
+            const double grow = norm == 0 ? 5 : std::clamp(0.9 * std::pow(norm, -0.2), 0.2, 5.0);
+            if (norm <= 1) {
+                for (size_t r = 0; r < 7; ++r) std::copy(k[r].begin() + a * n, k[r].begin() + (a + 1) * n, slopes.begin() + r * n);
+                accept(active[a], last[a], ynew.data() + a * n, k[6].data() + a * n, slopes.data(), 7 * n);
+                tr.h *= grow;
+            } else {
+                ++stats.rejected;
+                tr.h *= std::min(1.0, grow);
+            }
+        }
+    }
+
+    void rosenbrockRound() {
+        const size_t m = active.size();
+        std::vector<bool> last = clipSteps();
+
+        // Jacobian columns and df/dt by forward differences, one batch
+        ts.clear();
+        ys.clear();
+        for (size_t a = 0; a < m; ++a) {
+            const trajectory &tr = trajs[active[a]];
+            // points 0..n-1 perturb one component of y, point n perturbs t
+            for (size_t j = 0; j <= n; ++j) {
+                ts.push_back(j == n ? tr.t + std::sqrt(EPS) * std::max(1.0, std::fabs(tr.t)) : tr.t);
+                ys.insert(ys.end(), tr.y.begin(), tr.y.end());
+                if (j < n) ys[ys.size() - n + j] += std::sqrt(EPS) * std::max(1.0, std::fabs(tr.y[j]));
+            }
+        }
+        evalBatch();
+
+        std::vector<std::vector<double>> lu(m);
+        std::vector<std::vector<size_t>> piv(m);
+        std::vector<double> T(m * n), k1(m * n), k2(m * n), f1, ynew(m * n);
+        for (size_t a = 0; a < m; ++a) {
+            const trajectory &tr = trajs[active[a]];
+            const double* base = dys.data() + a * (n + 1) * n;
+            const double dt = ts[a * (n + 1) + n] - tr.t;
+            lu[a].assign(n * n, 0);
+            for (size_t j = 0; j < n; ++j) {
+                const double dy = ys[(a * (n + 1) + j) * n + j] - tr.y[j];
+                for (size_t i = 0; i < n; ++i) {
+                    const double jac = (base[j * n + i] - tr.f[i]) / dy;
+                    lu[a][i * n + j] = (i == j ? 1 : 0) - tr.h * RB_D * jac;
+                }
+            }
+            for (size_t i = 0; i < n; ++i) T[a * n + i] = (base[n * n + i] - tr.f[i]) / dt;
+            luFactor(lu[a], piv[a], n);
+            for (size_t i = 0; i < n; ++i) k1[a * n + i] = tr.f[i] + tr.h * RB_D * T[a * n + i];
+            luSolve(lu[a], piv[a], n, k1.data() + a * n);
+        }
+
+        ts.assign(m, 0);
+        ys.assign(m * n, 0);
+        for (size_t a = 0; a < m; ++a) {
+            const trajectory &tr = trajs[active[a]];
+            ts[a] = tr.t + 0.5 * tr.h;
+            for (size_t i = 0; i < n; ++i) ys[a * n + i] = tr.y[i] + 0.5 * tr.h * k1[a * n + i];
+        }
+        evalBatch();
+        f1 = dys;
+        for (size_t a = 0; a < m; ++a) {
+            const trajectory &tr = trajs[active[a]];
+            for (size_t i = 0; i < n; ++i) k2[a * n + i] = f1[a * n + i] - k1[a * n + i];
+            luSolve(lu[a], piv[a], n, k2.data() + a * n);
+            for (size_t i = 0; i < n; ++i) {
+                k2[a * n + i] += k1[a * n + i];
+                ynew[a * n + i] = tr.y[i] + tr.h * k2[a * n + i];
+            }
+        }
+
+        ts.assign(m, 0);
+        ys = ynew;
+        for (size_t a = 0; a < m; ++a) ts[a] = last[a] ? t1 : trajs[active[a]].t + trajs[active[a]].h;
+        evalBatch();
+
+        std::vector<double> k3(n), err(n), slopes(2 * n);
+        for (size_t a = 0; a < m; ++a) {
+            trajectory &tr = trajs[active[a]];
+            const double* f2 = dys.data() + a * n;
+            for (size_t i = 0; i < n; ++i) {
+                k3[i] = f2[i] - RB_E32 * (k2[a * n + i] - f1[a * n + i]) - 2 * (k1[a * n + i] - tr.f[i]) +
+                        tr.h * RB_D * T[a * n + i];
+            }
+            luSolve(lu[a], piv[a], n, k3.data());
+            for (size_t i = 0; i < n; ++i) err[i] = tr.h / 6 * (k1[a * n + i] - 2 * k2[a * n + i] + k3[i]);
+            const double norm = errorNorm(err.data(), tr.y.data(), ynew.data() + a * n);
+            const double grow = norm == 0 ? 5 : std::clamp(0.8 * std::pow(norm, -1.0 / 3), 0.2, 5.0);
+            if (norm <= 1) {
+                std::copy(k1.begin() + a * n, k1.begin() + (a + 1) * n, slopes.begin());
+                std::copy(k2.begin() + a * n, k2.begin() + (a + 1) * n, slopes.begin() + n);
+                accept(active[a], last[a], ynew.data() + a * n, f2, slopes.data(), 2 * n);
+                tr.h *= grow;
+            } else {
+                ++stats.rejected;
+                tr.h *= std::min(1.0, grow);
+            }
+        }
+    }
+
+public:
+    ode_integrator(ode_rhs &rhs, double t0, double t1, const ode_options &opts, ode_stats &stats)
+        : rhs(rhs), n(rhs.dim()), t0(t0), t1(t1), dir(t1 < t0 ? -1 : 1), opts(opts), stats(stats) {}
+
+    std::vector<ode_solution> run(const std::vector<double> &y0s) {
+        const size_t count = n ? y0s.size() / n : 0;
+        trajs.resize(count);
+        sols.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            trajs[i].t = t0;
+            trajs[i].y.assign(y0s.begin() + i * n, y0s.begin() + (i + 1) * n);
+            sols[i].n = n;
+            sols[i].method = opts.method;
+            sols[i].starts.push_back(t0);
+            sols[i].states = trajs[i].y;
+            if (t0 == t1) trajs[i].done = true;
+        }
+        if (count == 0 || t0 == t1) return std::move(sols);
+        // a solution only lists its final state once, after the last step
+        for (auto &sol : sols) {
+            sol.starts.clear();
+            sol.states.clear();
+        }
+
+        initialSteps();
+        for (;;) {
+            active.clear();
+            for (size_t i = 0; i < count; ++i) {
+                if (!trajs[i].done) active.push_back(i);
+            }
+            if (active.empty()) break;
+            if (opts.method == ode_method::DormandPrince) dormandPrinceRound();
+            else rosenbrockRound();
+        }
+        return std::move(sols);
+    }
+};
+
+std::vector<ode_solution> solveOde(ode_rhs &f, double t0, double t1, const std::vector<double> &y0s,
+                                   const ode_options &opts, ode_stats &stats) {
+    if (!std::isfinite(t0) || !std::isfinite(t1)) throw std::runtime_error("ode: t0 and t1 must be finite");
+    return ode_integrator(f, t0, t1, opts, stats).run(y0s);
+}
+
+// === builtins ===
+
+namespace {
+
+// a user function f(t, y) whose body is an expression of its parameters:
+// each stage is one batch over every trajectory
+class batched_rhs : public ode_rhs {
+private:
+    batch_evaluator batch;
+
+public:
+    batched_rhs(const function &fn, runtime_env &env)
+        : batch(static_cast<const exprnode &>(*fn.body), fn.params, env) {}
+    bool supported() const { return batch.supported(); }
+    size_t dim() const override { return 1; }
+
+    void eval(size_t count, const double* t, const double* y, double* dy) override {
+        const std::vector<const double*> cols{t, y};
+        if (batch.evalNumeric(cols, count, dy)) return;
+        std::vector<valptr_t> vals = batch.eval(cols, count);
+        for (size_t i = 0; i < count; ++i) {
+            if (!vals[i] || !isNumeric(vals[i]->kind())) throw std::runtime_error("ode: f must return a number");
+            dy[i] = toDouble(*vals[i]);
+        }
+    }
+};
+
+// anything else: one call per point, with y a number or a list
+class interpreted_rhs : public ode_rhs {
+private:
+    const function &fn;
+    runtime_env &env;
+    size_t n;
+    bool listState;
+
+public:
+    interpreted_rhs(const function &fn, runtime_env &env, size_t n, bool listState)
+        : fn(fn), env(env), n(n), listState(listState) {}
+    size_t dim() const override { return n; }
+
+    void eval(size_t count, const double* t, const double* y, double* dy) override {
+        for (size_t p = 0; p < count; ++p) {
+            valptr_t state;
+            if (listState) {
+                std::vector<valptr_t> xs(n);
+                for (size_t i = 0; i < n; ++i) xs[i] = std::make_shared<decimal>(y[p * n + i]);
+                state = std::make_shared<valuelist>(std::move(xs));
+            } else {
+                state = std::make_shared<decimal>(y[p]);
+            }
+            valptr_t r = asList(env.callFunction(fn, {std::make_shared<decimal>(t[p]), state}));
+            if (!listState) {
+                if (!r || !isNumeric(r->kind())) throw std::runtime_error("ode: f must return a number");
+                dy[p] = toDouble(*r);
+                continue;
+            }
+            if (!r || r->kind() != value_kind::List || static_cast<const valuelist &>(*r).elements().size() != n) {
+                throw std::runtime_error("ode: f must return a list of " + std::to_string(n) + " numbers");
+            }
+            const auto &es = static_cast<const valuelist &>(*r).elements();
+            for (size_t i = 0; i < n; ++i) {
+                if (!es[i] || !isNumeric(es[i]->kind())) throw std::runtime_error("ode: f must return numbers");
+                dy[p * n + i] = toDouble(*es[i]);
+            }
+        }
+    }
+};
+
+double numberValue(const valptr_t &v, const char* name, const char* what) {
+    if (!v || !isNumeric(v->kind())) throw std::runtime_error(std::string(name) + ": " + what + " must be a number");
+    return toDouble(*v);
+}
+
+// appends a state (a number, or a list of numbers for a system) to out;
+// returns its dimension and whether it was a list
+std::pair<size_t, bool> readState(const valptr_t &given, const char* name, std::vector<double> &out) {
+    const valptr_t v = asList(given);
+    if (v && v->kind() == value_kind::List) {
+        const auto &es = static_cast<const valuelist &>(*v).elements();
+        for (const auto &e : es) out.push_back(numberValue(e, name, "initial values"));
+        return {es.size(), true};
+    }
+    out.push_back(numberValue(v, name, "the initial value"));
+    return {1, false};
+}
+
+valptr_t makeState(const double* y, size_t n, bool list) {
+    if (!list) return std::make_shared<decimal>(y[0]);
+    std::vector<valptr_t> xs(n);
+    for (size_t i = 0; i < n; ++i) xs[i] = std::make_shared<decimal>(y[i]);
+    return std::make_shared<valuelist>(std::move(xs));
+}
+
+// the final state, or the states at t0, t0 + step, ... and t1 when step > 0
+valptr_t sampleSolution(const ode_solution &sol, double step, bool list) {
+    const size_t n = sol.dim();
+    if (step <= 0) return makeState(sol.finalState(), n, list);
+    const double t0 = sol.t0(), t1 = sol.t1(), dir = t1 < t0 ? -1 : 1;
+    std::vector<valptr_t> out;
+    std::vector<double> y(n);
+    for (size_t i = 0;; ++i) {
+        const double t = t0 + dir * step * static_cast<double>(i);
+        if ((t - t1) * dir >= 0) break;
+        sol.at(t, y.data());
+        out.push_back(makeState(y.data(), n, list));
+    }
+    out.push_back(makeState(sol.finalState(), n, list));
+    return std::make_shared<valuelist>(std::move(out));
+}
+
+// odeSolve(f, t0, t1, y0[, step[, method]]) and odeField(f, t0, t1, {y0, ...}[, step[, method]]):
+// f(t, y) is a function name; y is a number, or a list for a system; method
+// is "rk45" (default) or "stiff"
+valptr_t odeForm(const call_node &c, runtime_env &env, const char* name, bool field) {
+    if (c.args.size() < 4 || c.args.size() > 6) {
+        throw std::runtime_error(std::string(name) + " expects (f, t0, t1, " + (field ? "{y0, ...}" : "y0") + "[, step[, method]])");
+    }
+    const std::string &fname = formVariable(c, 0, name);
+    const function* fn = env.getFunction(fname);
+    if (!fn) throw std::runtime_error(std::string(name) + ": undefined function " + fname);
+
+    evaluator ev(env);
+    const double t0 = numberValue(ev.run(*c.args[1]), name, "t0");
+    const double t1 = numberValue(ev.run(*c.args[2]), name, "t1");
+    valptr_t init = asList(ev.run(*c.args[3]));
+    const double step = c.args.size() >= 5 ? numberValue(ev.run(*c.args[4]), name, "step") : 0;
+    ode_options opts;
+    if (c.args.size() == 6) {
+        valptr_t m = ev.run(*c.args[5]);
+        const std::string method = m && m->kind() == value_kind::String ? static_cast<const string &>(*m).getValue() : "";
+        if (method == "stiff") opts.method = ode_method::Rosenbrock;
+        else if (method != "rk45") throw std::runtime_error(std::string(name) + ": method must be \"rk45\" or \"stiff\"");
+    }
+
+    std::vector<double> y0s;
+    size_t n = 0;
+    bool list = false;
+    if (field) {
+        if (!init || init->kind() != value_kind::List) throw std::runtime_error(std::string(name) + " expects a list of initial values");
+        const auto &es = static_cast<const valuelist &>(*init).elements();
+        for (size_t i = 0; i < es.size(); ++i) {
+            auto [dim, isList] = readState(es[i], name, y0s);
+            if (i > 0 && (dim != n || isList != list)) throw std::runtime_error("dimension mismatch");
+            n = dim;
+            list = isList;
+        }
+    } else {
+        std::tie(n, list) = readState(init, name, y0s);
+    }
+    if (n == 0) throw std::runtime_error(std::string(name) + ": empty state");
+
+    std::unique_ptr<ode_rhs> rhs;
+    if (!list && !fn->isBuiltin && fn->params.size() == 2 && dynamic_cast<const exprnode*>(fn->body.get())) {
+        auto batched = std::make_unique<batched_rhs>(*fn, env);
+        if (batched->supported()) rhs = std::move(batched);
+    }
+    if (!rhs) rhs = std::make_unique<interpreted_rhs>(*fn, env, n, list);
+
+    ode_stats stats;
+    std::vector<ode_solution> sols = solveOde(*rhs, t0, t1, y0s, opts, stats);
+    numeric_report report;
+    report.method = opts.method == ode_method::DormandPrince ? "dormand-prince" : "rosenbrock";
+    report.evaluations = stats.evaluations;
+    env.setNumericReport(report);
+
+    if (!field) return sampleSolution(sols[0], step, list);
+    std::vector<valptr_t> out(sols.size());
+    for (size_t i = 0; i < sols.size(); ++i) out[i] = sampleSolution(sols[i], step, list);
+    return std::make_shared<valuelist>(std::move(out));
+}
+
+} // namespace
+
+void register_ode_builtins(runtime_env &env) {
+    env.registerForm("odeSolve", [](const call_node &c, runtime_env &env) { return odeForm(c, env, "odeSolve", false); });
+    env.registerForm("odeField", [](const call_node &c, runtime_env &env) { return odeForm(c, env, "odeField", true); });
+}
+
+} // namespace ti
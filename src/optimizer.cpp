@@ -0,0 +1,469 @@
+#include "../include/optimizer.h"
+#include "../include/runtimeenv.h"
+#include "../include/arith.h"
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ti {
+
+using namespace ast;
+
+namespace {
+
+using exprptr = std::unique_ptr<exprnode>;
+
+bool sameLiteral(const valptr_t &a, const valptr_t &b) {
+    if (!a || !b) return a == b;
+    if (a->kind() != b->kind()) return false;
+    if (a->kind() == value_kind::Decimal) return toDouble(*a) == toDouble(*b);
+    return a->toString() == b->toString();
+}
+
+const valptr_t &literalValue(const exprnode &n) {
+    return static_cast<const literal_node &>(n).val;
+}
+
+bool isLiteral(const exprnode &n) {
+    return n.kind() == node_kind::Literal && literalValue(n);
+}
+
+bool isIntLiteral(const exprnode &n, long long k) {
+    return isLiteral(n) && literalValue(n)->kind() == value_kind::Integer &&
+           static_cast<const integer &>(*literalValue(n)).getValue() == BigInt(k);
+}
+
+bool isExactLiteral(const exprnode &n) {
+    if (!isLiteral(n)) return false;
+    value_kind k = literalValue(n)->kind();
+    return k == value_kind::Integer || k == value_kind::Fraction;
+}
+
+// true if n certainly evaluates to an integer or fraction (or fails), so
+// x+0 -> x and exact reassociation keep its value and type: a variable
+// may hold a decimal, which rounds differently, or a string or list
+bool isExactNumeric(const exprnode &n) {
+    if (isExactLiteral(n)) return true;
+    if (n.kind() != node_kind::BinaryOp) return false;
+    auto &b = static_cast<const binary_op_node &>(n);
+    switch (b.op) {
+        case binary_op::Add:
+        case binary_op::Sub:
+        case binary_op::Mul:
+        case binary_op::Div:
+            return isExactNumeric(*b.left) && isExactNumeric(*b.right);
+        case binary_op::Pow:
+            // a fractional exponent may leave the rationals
+            return isExactNumeric(*b.left) && isLiteral(*b.right) &&
+                   literalValue(*b.right)->kind() == value_kind::Integer;
+        default:
+            return false;
+    }
+}
+
+exprptr makeLiteral(const valptr_t &v) {
+    return std::make_unique<literal_node>(v);
+}
+
+class optimizer {
+private:
+    runtime_env &env;
+    const opt_options &opts;
+    calc_mode mode;
+
+    void foldBinary(exprptr &n);
+    void collectWrites(exprnode &n, std::set<std::string> &writes, bool &opaque);
+    bool isInvariant(const exprnode &n, const std::set<std::string> &writes);
+    void replaceInvariants(exprptr &n, const std::set<std::string> &writes, let_node &let);
+    bool isPureStatement(const exprnode &n, bool root);
+    void cseStatement(exprptr &n);
+    void replaceCommon(exprptr &n, const std::unordered_set<const exprnode*> &dups, let_node &let);
+    size_t addTemp(let_node &let, exprptr e);
+
+public:
+    optimizer(runtime_env &env, const opt_options &opts) : env(env), opts(opts), mode(env.getMode()) {}
+
+    void fold(exprptr &n);
+    void hoist(exprptr &n);
+    void cse(exprptr &n);
+    void resolve(exprnode &n, std::vector<const let_node*> &lets);
+};
+
+// --- constant folding and algebraic simplification ---
+
+void optimizer::fold(exprptr &n) {
+    if (n->kind() == node_kind::Call) {
+        // the callee is a function name, not a variable reference
+        for (auto &a : static_cast<call_node &>(*n).args) fold(a);
+        return;
+    }
+    for (exprptr* c : children(*n)) fold(*c);
+
+    switch (n->kind()) {
+        case node_kind::Var:
+            if (opts.foldConstants && mode == calc_mode::Approximate &&
+                static_cast<var_node &>(*n).name == "π") {
+                n = makeLiteral(std::make_shared<decimal>(M_PI));
+            }
+            break;
+        case node_kind::If: {
+            auto &i = static_cast<if_node &>(*n);
+            if (!opts.foldConstants || !isLiteral(*i.cond) || literalValue(*i.cond)->kind() != value_kind::Boolean) break;
+            exprptr taken;
+            if (isTrue(literalValue(*i.cond))) taken = std::move(i.then_branch);
+            else if (i.else_branch) taken = std::move(i.else_branch);
+            else taken = makeLiteral(none);
+            n = std::move(taken);
+            break;
+        }
+        case node_kind::BinaryOp:
+            foldBinary(n);
+            break;
+        default:
+            break;
+    }
+}
+
+void optimizer::foldBinary(exprptr &n) {
+    auto &b = static_cast<binary_op_node &>(*n);
+    if (opts.foldConstants && isLiteral(*b.left) && isLiteral(*b.right)) {
+        try {
+            n = makeLiteral(applyMode(applyBinary(b.op, literalValue(*b.left), literalValue(*b.right)), mode));
+            return;
+        } catch (const std::exception &) {
+            // leave it for the runtime to report when (and if) it executes
+        }
+    }
+    // in approximate mode an exact operand would still be converted by the
+    // operator, so dropping the operator could change the result's type
+    if (!opts.simplify || mode == calc_mode::Approximate) return;
+
+    // identities hold for exact operands only: 0.0+0 is a decimal either
+    // way, but "a"+0 fails and -0.0+0 is 0.0
+    exprptr keep;
+    const bool exactLeft = isExactNumeric(*b.left);
+    const bool exactRight = isExactNumeric(*b.right);
+    switch (b.op) {
+        case binary_op::Add:
+            if (exactLeft && isIntLiteral(*b.right, 0)) keep = std::move(b.left);
+            else if (exactRight && isIntLiteral(*b.left, 0)) keep = std::move(b.right);
+            break;
+        case binary_op::Sub:
+            if (exactLeft && isIntLiteral(*b.right, 0)) keep = std::move(b.left);
+            break;
+        case binary_op::Mul:
+            if (exactLeft && isIntLiteral(*b.right, 1)) keep = std::move(b.left);
+            else if (exactRight && isIntLiteral(*b.left, 1)) keep = std::move(b.right);
+            break;
+        case binary_op::Div:
+        case binary_op::Pow:
+            if (exactLeft && isIntLiteral(*b.right, 1)) keep = std::move(b.left);
+            break;
+        default:
+            break;
+    }
+    if (keep) {
+        n = std::move(keep);
+        return;
+    }
+
+    // exact constants commute and associate: (x op c1) op c2 -> x op (c1 op c2)
+    // when x is exact too (for a decimal x the rounding would change)
+    if (!opts.foldConstants || (b.op != binary_op::Add && b.op != binary_op::Mul)) return;
+    exprptr* outerConst = isExactLiteral(*b.right) ? &b.right : isExactLiteral(*b.left) ? &b.left : nullptr;
+    exprptr* inner = outerConst == &b.right ? &b.left : &b.right;
+    if (!outerConst || (*inner)->kind() != node_kind::BinaryOp) return;
+    auto &in = static_cast<binary_op_node &>(**inner);
+    if (in.op != b.op) return;
+    exprptr* innerConst = isExactLiteral(*in.right) ? &in.right : isExactLiteral(*in.left) ? &in.left : nullptr;
+    if (!innerConst) return;
+    exprptr &innerOther = innerConst == &in.right ? in.left : in.right;
+    if (!isExactNumeric(*innerOther)) return;
+    *innerConst = makeLiteral(applyBinary(b.op, literalValue(**innerConst), literalValue(**outerConst)));
+    exprptr merged = std::move(*inner);
+    n = std::move(merged);
+    foldBinary(n);
+}
+
+// --- loop-invariant hoisting ---
+
+void optimizer::collectWrites(exprnode &n, std::set<std::string> &writes, bool &opaque) {
+    switch (n.kind()) {
+        case node_kind::Assign:
+            writes.insert(static_cast<assign_node &>(n).name);
+            break;
+        case node_kind::For:
+            writes.insert(static_cast<for_node &>(n).var);
+            break;
+        case node_kind::Local:
+            for (auto &name : static_cast<local_node &>(n).names) writes.insert(name);
+            break;
+        case node_kind::Call: {
+            // user functions may assign globals, and so may builtins not
+            // marked pure (loadSnapshot replaces them all). Forms bind
+            // variables inside their arguments, which must not be hoisted
+            // out from under them.
+            auto &c = static_cast<call_node &>(n);
+            function* fn = c.callee->kind() == node_kind::Var
+                ? env.getFunction(static_cast<var_node &>(*c.callee).name) : nullptr;
+            if (!fn || !fn->isBuiltin || !fn->pure || fn->formImpl) opaque = true;
+            break;
+        }
+        default:
+            break;
+    }
+    for (exprptr* c : children(n)) collectWrites(**c, writes, opaque);
+}
+
+bool optimizer::isInvariant(const exprnode &n, const std::set<std::string> &writes) {
+    switch (n.kind()) {
+        case node_kind::Literal:
+            return true;
+        case node_kind::Var:
+            return writes.count(static_cast<const var_node &>(n).name) == 0;
+        case node_kind::BinaryOp: {
+            auto &b = static_cast<const binary_op_node &>(n);
+            return isInvariant(*b.left, writes) && isInvariant(*b.right, writes);
+        }
+        default:
+            return false;
+    }
+}
+
+size_t optimizer::addTemp(let_node &let, exprptr e) {
+    for (size_t i = 0; i < let.temps.size(); ++i) {
+        if (structurallyEqual(*let.temps[i], *e)) return i;
+    }
+    let.temps.push_back(std::move(e));
+    return let.temps.size() - 1;
+}
+
+void optimizer::replaceInvariants(exprptr &n, const std::set<std::string> &writes, let_node &let) {
+    if (n->kind() == node_kind::BinaryOp && isInvariant(*n, writes)) {
+        size_t index = addTemp(let, std::move(n));
+        n = std::make_unique<temp_node>(&let, index);
+        return;
+    }
+    for (exprptr* c : children(*n)) replaceInvariants(*c, writes, let);
+}
+
+void optimizer::hoist(exprptr &n) {
+    for (exprptr* c : children(*n)) hoist(*c);
+    if (n->kind() != node_kind::For && n->kind() != node_kind::While) return;
+
+    std::set<std::string> writes;
+    bool opaque = false;
+    collectWrites(*n, writes, opaque);
+    if (opaque) return;
+
+    // temps are computed lazily on first use, so hoisting never evaluates
+    // something the loop would not have (zero iterations, untaken If)
+    auto let = std::make_unique<let_node>(std::vector<exprptr>(), nullptr);
+    if (n->kind() == node_kind::For) {
+        replaceInvariants(static_cast<for_node &>(*n).body, writes, *let);
+    } else {
+        auto &w = static_cast<while_node &>(*n);
+        replaceInvariants(w.cond, writes, *let);
+        replaceInvariants(w.body, writes, *let);
+    }
+    if (let->temps.empty()) return;
+    let->body = std::move(n);
+    n = std::move(let);
+}
+
+// --- common subexpression elimination ---
+
+// Statements eligible for CSE contain no calls (which could reassign the
+// variables an expression reads between two occurrences), no loops and no
+// nested lets.
+bool optimizer::isPureStatement(const exprnode &n, bool root) {
+    switch (n.kind()) {
+        case node_kind::Literal:
+        case node_kind::Var:
+        case node_kind::Temp:
+            return true;
+        case node_kind::Assign:
+            return root && isPureStatement(*static_cast<const assign_node &>(n).rhs, false);
+        case node_kind::BinaryOp:
+        case node_kind::If:
+            for (exprptr* c : children(n)) {
+                if (!isPureStatement(**c, false)) return false;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+void optimizer::replaceCommon(exprptr &n, const std::unordered_set<const exprnode*> &dups, let_node &let) {
+    if (n->kind() == node_kind::BinaryOp && dups.count(n.get())) {
+        size_t index = addTemp(let, std::move(n));
+        n = std::make_unique<temp_node>(&let, index);
+        return;
+    }
+    for (exprptr* c : children(*n)) replaceCommon(*c, dups, let);
+}
+
+void optimizer::cseStatement(exprptr &n) {
+    std::vector<const exprnode*> ops;
+    std::function<void(const exprnode &)> collect = [&](const exprnode &e) {
+        if (e.kind() == node_kind::BinaryOp) ops.push_back(&e);
+        for (exprptr* c : children(e)) collect(**c);
+    };
+    collect(*n);
+
+    std::unordered_multimap<size_t, const exprnode*> byHash;
+    std::unordered_set<const exprnode*> dups;
+    for (const exprnode* e : ops) {
+        size_t h = structuralHash(*e);
+        auto range = byHash.equal_range(h);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (structurallyEqual(*it->second, *e)) {
+                dups.insert(it->second);
+                dups.insert(e);
+            }
+        }
+        byHash.emplace(h, e);
+    }
+    if (dups.empty()) return;
+
+    // replacement is top-down, so only the largest repeated trees become temps
+    auto let = std::make_unique<let_node>(std::vector<exprptr>(), nullptr);
+    replaceCommon(n, dups, *let);
+    let->body = std::move(n);
+    n = std::move(let);
+}
+
+void optimizer::cse(exprptr &n) {
+    if (isPureStatement(*n, true)) {
+        cseStatement(n);
+        return;
+    }
+    switch (n->kind()) {
+        case node_kind::Block:
+            for (auto &s : static_cast<block_node &>(*n).stmts) cse(s);
+            break;
+        case node_kind::If: {
+            auto &i = static_cast<if_node &>(*n);
+            cse(i.then_branch);
+            if (i.else_branch) cse(i.else_branch);
+            break;
+        }
+        case node_kind::For:
+            cse(static_cast<for_node &>(*n).body);
+            break;
+        case node_kind::While:
+            cse(static_cast<while_node &>(*n).body);
+            break;
+        case node_kind::Let:
+            cse(static_cast<let_node &>(*n).body);
+            break;
+        default:
+            break;
+    }
+}
+
+// --- temp addressing ---
+
+void optimizer::resolve(exprnode &n, std::vector<const let_node*> &lets) {
+    if (n.kind() == node_kind::Let) lets.push_back(&static_cast<let_node &>(n));
+    if (n.kind() == node_kind::Temp) {
+        auto &t = static_cast<temp_node &>(n);
+        size_t depth = 0;
+        while (depth < lets.size() && lets[depth] != t.owner) ++depth;
+        if (depth == lets.size()) throw std::logic_error("optimizer: temp used outside its let");
+        t.depth = depth;
+    }
+    for (exprptr* c : children(n)) resolve(**c, lets);
+    if (n.kind() == node_kind::Let) lets.pop_back();
+}
+
+} // namespace
+
+size_t structuralHash(const exprnode &n) {
+    size_t h = std::hash<int>()(static_cast<int>(n.kind()));
+    auto mix = [&h](size_t v) { h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2); };
+    switch (n.kind()) {
+        case node_kind::Literal: {
+            const valptr_t &v = literalValue(n);
+            if (v && v->kind() == value_kind::Decimal) mix(std::hash<double>()(toDouble(*v)));
+            else if (v) mix(std::hash<std::string>()(v->toString()));
+            break;
+        }
+        case node_kind::Var: mix(std::hash<std::string>()(static_cast<const var_node &>(n).name)); break;
+        case node_kind::Assign: mix(std::hash<std::string>()(static_cast<const assign_node &>(n).name)); break;
+        case node_kind::For: mix(std::hash<std::string>()(static_cast<const for_node &>(n).var)); break;
+        case node_kind::BinaryOp: mix(static_cast<size_t>(static_cast<const binary_op_node &>(n).op)); break;
+        case node_kind::Temp: {
+            auto &t = static_cast<const temp_node &>(n);
+            mix(std::hash<const void*>()(t.owner));
+            mix(t.index);
+            break;
+        }
+        case node_kind::Local:
+            for (auto &name : static_cast<const local_node &>(n).names) mix(std::hash<std::string>()(name));
+            break;
+        default:
+            break;
+    }
+    for (exprptr* c : children(n)) mix(structuralHash(**c));
+    return h;
+}
+
+bool structurallyEqual(const exprnode &a, const exprnode &b) {
+    if (&a == &b) return true;
+    if (a.kind() != b.kind()) return false;
+    switch (a.kind()) {
+        case node_kind::Literal:
+            if (!sameLiteral(literalValue(a), literalValue(b))) return false;
+            break;
+        case node_kind::Var:
+            if (static_cast<const var_node &>(a).name != static_cast<const var_node &>(b).name) return false;
+            break;
+        case node_kind::Assign:
+            if (static_cast<const assign_node &>(a).name != static_cast<const assign_node &>(b).name) return false;
+            break;
+        case node_kind::For:
+            if (static_cast<const for_node &>(a).var != static_cast<const for_node &>(b).var) return false;
+            break;
+        case node_kind::Local:
+            if (static_cast<const local_node &>(a).names != static_cast<const local_node &>(b).names) return false;
+            break;
+        case node_kind::BinaryOp:
+            if (static_cast<const binary_op_node &>(a).op != static_cast<const binary_op_node &>(b).op) return false;
+            break;
+        case node_kind::Temp: {
+            auto &x = static_cast<const temp_node &>(a);
+            auto &y = static_cast<const temp_node &>(b);
+            if (x.owner != y.owner || x.index != y.index) return false;
+            break;
+        }
+        default:
+            break;
+    }
+    auto ca = children(a);
+    auto cb = children(b);
+    if (ca.size() != cb.size()) return false;
+    for (size_t i = 0; i < ca.size(); ++i) {
+        if (!structurallyEqual(**ca[i], **cb[i])) return false;
+    }
+    return true;
+}
+
+std::unique_ptr<exprnode> optimize(std::unique_ptr<exprnode> root, runtime_env &env, const opt_options &opts) {
+    if (!root) return root;
+    optimizer opt(env, opts);
+    opt.fold(root);
+    if (opts.hoistInvariants) opt.hoist(root);
+    if (opts.eliminateCommon) opt.cse(root);
+    std::vector<const let_node*> lets;
+    opt.resolve(*root, lets);
+    if (env.getDumpOptimized()) dump(*root, std::cerr);
+    return root;
+}
+
+} // namespace ti
@@ -0,0 +1,645 @@
+#include "../include/parser.h"
+#include "../include/complexnum.h"
+#include "../include/runtimeenv.h"
+#include <cctype>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ti {
+
+using namespace ast;
+
+namespace {
+
+using exprptr = std::unique_ptr<exprnode>;
+
+enum class tok_type {
+    Number,
+    Name,      // lowercased identifier, or π / 𝑖
+    String,
+    Symbol,    // operators and punctuation; unicode forms are normalized
+    Separator, // newline or ':'
+    End,
+};
+
+struct token {
+    tok_type type;
+    std::string text;
+    size_t line;
+};
+
+const std::set<std::string> KEYWORDS = {
+    "define", "func", "endfunc", "prgm", "endprgm", "if", "then", "else", "elseif", "endif", "for", "endfor",
+    "while", "endwhile", "local", "return", "and", "or", "xor", "not", "true", "false",
+};
+
+// builtins that may be written as commands, without parentheses
+const std::set<std::string> COMMANDS = {"disp", "randseed"};
+
+// the UTF-8 spellings the lexer accepts, and what they stand for
+const std::pair<const char*, const char*> UNICODE_SYMBOLS[] = {
+    {"→", "->"},
+    {"≠", "/="},
+    {"≤", "<="},
+    {"≥", ">="},
+};
+const char* PI_NAME = "π";
+const char* IMAGINARY_NAME = "𝑖";
+const char* INFINITY_NAME = "∞"; // a Number token
+const char* COMMENT = "©";
+
+bool startsWith(const std::string &s, size_t i, const char* prefix) {
+    return s.compare(i, std::char_traits<char>::length(prefix), prefix) == 0;
+}
+
+std::vector<token> lex(const std::string &code) {
+    std::vector<token> toks;
+    size_t line = 1;
+    size_t i = 0;
+    const size_t n = code.size();
+    auto digit = [&](size_t k) { return k < n && std::isdigit(static_cast<unsigned char>(code[k])); };
+    while (i < n) {
+        const char ch = code[i];
+        if (ch == ' ' || ch == '\t' || ch == '\r') {
+            ++i;
+        } else if (ch == '\n' || (ch == ':' && (i + 1 >= n || code[i + 1] != '='))) {
+            toks.push_back(token{tok_type::Separator, std::string(1, ch), line});
+            if (ch == '\n') ++line;
+            ++i;
+        } else if (startsWith(code, i, COMMENT)) {
+            while (i < n && code[i] != '\n') ++i;
+        } else if (std::isalpha(static_cast<unsigned char>(ch)) || ch == '_') {
+            std::string name;
+            for (; i < n && (std::isalnum(static_cast<unsigned char>(code[i])) || code[i] == '_'); ++i) {
+                name.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(code[i]))));
+            }
+            toks.push_back(token{tok_type::Name, name, line});
+        } else if (digit(i) || (ch == '.' && digit(i + 1))) {
+            const size_t start = i;
+            while (digit(i)) ++i;
+            if (i < n && code[i] == '.') {
+                ++i;
+                while (digit(i)) ++i;
+            }
+            // an exponent only when digits follow, so 2e is 2 times e
+            if (i < n && (code[i] == 'e' || code[i] == 'E')) {
+                size_t k = i + 1;
+                if (k < n && (code[k] == '+' || code[k] == '-')) ++k;
+                if (digit(k)) {
+                    i = k;
+                    while (digit(i)) ++i;
+                }
+            }
+            toks.push_back(token{tok_type::Number, code.substr(start, i - start), line});
+        } else if (ch == '"') {
+            const size_t close = code.find('"', i + 1);
+            if (close == std::string::npos) {
+                throw std::runtime_error("syntax error: unterminated string on line " + std::to_string(line));
+            }
+            toks.push_back(token{tok_type::String, code.substr(i + 1, close - i - 1), line});
+            for (size_t k = i; k < close; ++k) line += code[k] == '\n';
+            i = close + 1;
+        } else if (startsWith(code, i, INFINITY_NAME)) {
+            toks.push_back(token{tok_type::Number, INFINITY_NAME, line});
+            i += std::char_traits<char>::length(INFINITY_NAME);
+        } else if (startsWith(code, i, PI_NAME) || startsWith(code, i, IMAGINARY_NAME)) {
+            const char* name = startsWith(code, i, PI_NAME) ? PI_NAME : IMAGINARY_NAME;
+            toks.push_back(token{tok_type::Name, name, line});
+            i += std::char_traits<char>::length(name);
+        } else {
+            std::string sym;
+            for (const auto &[spelling, meaning] : UNICODE_SYMBOLS) {
+                if (startsWith(code, i, spelling)) {
+                    sym = meaning;
+                    i += std::char_traits<char>::length(spelling);
+                    break;
+                }
+            }
+            if (sym.empty()) {
+                static const char* PAIRS[] = {":=", "->", "<=", ">=", "/="};
+                for (const char* p : PAIRS) {
+                    if (startsWith(code, i, p)) sym = p;
+                }
+                if (sym.empty()) {
+                    if (std::string("+-*/^(){},=<>!").find(ch) == std::string::npos) {
+                        throw std::runtime_error("syntax error: unexpected character '" + std::string(1, ch) +
+                                                 "' on line " + std::to_string(line));
+                    }
+                    sym = std::string(1, ch);
+                }
+                i += sym.size();
+            }
+            toks.push_back(token{tok_type::Symbol, sym, line});
+        }
+    }
+    toks.push_back(token{tok_type::End, "", line});
+    return toks;
+}
+
+exprptr makeBinary(binary_op op, exprptr l, exprptr r) {
+    return std::make_unique<binary_op_node>(op, std::move(l), std::move(r));
+}
+
+class parser {
+private:
+    std::vector<token> toks;
+    size_t pos = 0;
+    // lowercased function name -> the name it is registered under
+    std::unordered_map<std::string, std::string> functionNames;
+    // Return statements not yet found in a function's tail position
+    std::unordered_set<const exprnode*> returns;
+    bool inFunction = false;
+
+    const token &peek(size_t ahead = 0) const { return toks[std::min(pos + ahead, toks.size() - 1)]; }
+    const token &next() { return toks[pos < toks.size() - 1 ? pos++ : pos]; }
+
+    bool atSymbol(const char* s, size_t ahead = 0) const {
+        return peek(ahead).type == tok_type::Symbol && peek(ahead).text == s;
+    }
+    bool atKeyword(const char* k) const { return peek().type == tok_type::Name && peek().text == k; }
+    bool atSeparator() const { return peek().type == tok_type::Separator; }
+    bool atEnd() const { return peek().type == tok_type::End; }
+
+    [[noreturn]] void fail(const std::string &what) const {
+        const token &t = peek();
+        std::string found = t.type == tok_type::End ? "end of input"
+                            : t.type == tok_type::Separator ? (t.text == "\n" ? "end of line" : "':'")
+                                                            : "'" + t.text + "'";
+        throw std::runtime_error("syntax error: " + what + ", found " + found + " on line " + std::to_string(t.line));
+    }
+    void expectSymbol(const char* s) {
+        if (!atSymbol(s)) fail(std::string("expected '") + s + "'");
+        next();
+    }
+    void expectKeyword(const char* k) {
+        if (!atKeyword(k)) fail(std::string("expected ") + k);
+        next();
+    }
+    std::string expectName() {
+        if (peek().type != tok_type::Name || KEYWORDS.count(peek().text)) fail("expected a name");
+        return next().text;
+    }
+    void skipSeparators() {
+        while (atSeparator()) next();
+    }
+    // after a statement: a separator, or the end of the input
+    void endStatement() {
+        if (!atSeparator() && !atEnd()) fail("expected end of statement");
+    }
+
+    std::string functionName(const std::string &name) const {
+        auto it = functionNames.find(name);
+        return it == functionNames.end() ? name : it->second;
+    }
+
+    exprptr makeCall(const std::string &name, std::vector<exprptr> args) const {
+        return std::make_unique<call_node>(std::make_unique<var_node>(functionName(name)), std::move(args));
+    }
+
+    bool atDefinitionHead() const;
+    statement definition(std::string name);
+    exprptr functionBody(const char* end, bool program);
+    void acceptTailReturns(exprnode &n);
+
+    exprptr block(std::initializer_list<const char*> terminators);
+    exprptr stmt();
+    exprptr ifStatement();
+    exprptr forStatement();
+    exprptr whileStatement();
+
+    exprptr expression();
+    exprptr orExpr();
+    exprptr andExpr();
+    exprptr notExpr();
+    exprptr comparison();
+    exprptr additive();
+    exprptr term();
+    exprptr unary();
+    exprptr power();
+    exprptr postfix();
+    exprptr primary();
+    std::vector<exprptr> arguments(const char* close);
+
+public:
+    parser(const std::string &code, const runtime_env &env) : toks(lex(code)) {
+        for (const auto &[name, fn] : env.functionTable()) {
+            std::string lower;
+            for (char c : name) lower.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+            functionNames.emplace(lower, name);
+        }
+    }
+
+    std::vector<statement> program();
+};
+
+std::vector<statement> parser::program() {
+    std::vector<statement> out;
+    skipSeparators();
+    while (!atEnd()) {
+        if (atKeyword("define")) {
+            next();
+            const std::string name = expectName();
+            if (atSymbol("(")) {
+                out.push_back(definition(name));
+            } else {
+                // Define x=expr is an assignment
+                expectSymbol("=");
+                statement s;
+                s.body = std::make_unique<assign_node>(name, expression());
+                out.push_back(std::move(s));
+            }
+        } else if (atDefinitionHead()) {
+            out.push_back(definition(next().text));
+        } else {
+            statement s;
+            s.body = stmt();
+            out.push_back(std::move(s));
+        }
+        endStatement();
+        skipSeparators();
+    }
+    return out;
+}
+
+// f(x, y) := ..., told apart from a call only by what follows the ')'
+bool parser::atDefinitionHead() const {
+    if (peek().type != tok_type::Name || KEYWORDS.count(peek().text) || !atSymbol("(", 1)) return false;
+    size_t k = 2;
+    if (!atSymbol(")", k)) {
+        for (;;) {
+            if (peek(k).type != tok_type::Name) return false;
+            if (!atSymbol(",", ++k)) break;
+            ++k;
+        }
+    }
+    return atSymbol(")", k) && atSymbol(":=", k + 1);
+}
+
+statement parser::definition(std::string name) {
+    statement s;
+    s.definition = true;
+    s.name = functionName(name);
+    expectSymbol("(");
+    if (!atSymbol(")")) {
+        s.params.push_back(expectName());
+        while (atSymbol(",")) {
+            next();
+            s.params.push_back(expectName());
+        }
+    }
+    expectSymbol(")");
+    if (atSymbol(":=")) next();
+    else expectSymbol("=");
+
+    if (atKeyword("func")) {
+        next();
+        s.body = functionBody("endfunc", false);
+    } else if (atKeyword("prgm")) {
+        next();
+        s.body = functionBody("endprgm", true);
+    } else {
+        s.body = expression();
+    }
+    return s;
+}
+
+exprptr parser::functionBody(const char* end, bool program) {
+    inFunction = true;
+    returns.clear();
+    exprptr body = block({end});
+    expectKeyword(end);
+    inFunction = false;
+    acceptTailReturns(*body);
+    if (!returns.empty()) {
+        throw std::runtime_error("syntax error: Return is only supported as the last statement of a function");
+    }
+    if (program) {
+        // a program's value is Done, not its last statement's
+        auto &b = static_cast<block_node &>(*body);
+        b.stmts.push_back(std::make_unique<literal_node>(none));
+    }
+    return body;
+}
+
+// a Return in tail position is just its value: the evaluator yields the
+// last value of a block and the taken branch of an If
+void parser::acceptTailReturns(exprnode &n) {
+    returns.erase(&n);
+    if (n.kind() == node_kind::Block) {
+        auto &b = static_cast<block_node &>(n);
+        if (!b.stmts.empty()) acceptTailReturns(*b.stmts.back());
+    } else if (n.kind() == node_kind::If) {
+        auto &i = static_cast<if_node &>(n);
+        acceptTailReturns(*i.then_branch);
+        if (i.else_branch) acceptTailReturns(*i.else_branch);
+    }
+}
+
+// statements up to (not including) one of the terminator keywords
+exprptr parser::block(std::initializer_list<const char*> terminators) {
+    auto done = [&] {
+        for (const char* t : terminators) {
+            if (atKeyword(t)) return true;
+        }
+        return false;
+    };
+    std::vector<exprptr> stmts;
+    skipSeparators();
+    while (!done()) {
+        if (atEnd()) fail(std::string("expected ") + *terminators.begin());
+        stmts.push_back(stmt());
+        if (!done()) endStatement();
+        skipSeparators();
+    }
+    return std::make_unique<block_node>(std::move(stmts));
+}
+
+exprptr parser::stmt() {
+    if (atKeyword("if")) return ifStatement();
+    if (atKeyword("for")) return forStatement();
+    if (atKeyword("while")) return whileStatement();
+    if (atKeyword("local")) {
+        next();
+        std::vector<std::string> names{expectName()};
+        while (atSymbol(",")) {
+            next();
+            names.push_back(expectName());
+        }
+        return std::make_unique<local_node>(std::move(names));
+    }
+    if (atKeyword("return")) {
+        if (!inFunction) fail("Return outside a function");
+        next();
+        exprptr value = atSeparator() || atEnd() || atKeyword("endif") || atKeyword("else") || atKeyword("elseif")
+            ? std::make_unique<literal_node>(none) : expression();
+        returns.insert(value.get());
+        return value;
+    }
+    if (peek().type == tok_type::Name && COMMANDS.count(peek().text) && !atSymbol("(", 1) && !atSymbol(":=", 1)) {
+        // Disp "x=", x: a command's arguments need no parentheses
+        std::string name = next().text;
+        std::vector<exprptr> args;
+        if (!atSeparator() && !atEnd()) {
+            args.push_back(expression());
+            while (atSymbol(",")) {
+                next();
+                args.push_back(expression());
+            }
+        }
+        return makeCall(name, std::move(args));
+    }
+    if (peek().type == tok_type::Name && !KEYWORDS.count(peek().text) && atSymbol(":=", 1)) {
+        std::string name = next().text;
+        next();
+        return std::make_unique<assign_node>(std::move(name), expression());
+    }
+    exprptr e = expression();
+    if (atSymbol("->")) {
+        next();
+        e = std::make_unique<assign_node>(expectName(), std::move(e));
+    }
+    return e;
+}
+
+exprptr parser::ifStatement() {
+    const bool elseIf = next().text == "elseif";
+    exprptr cond = expression();
+    if (elseIf && !atKeyword("then")) fail("expected then");
+    if (!atKeyword("then")) {
+        // If cond, then one statement on the next line or after ':'
+        skipSeparators();
+        return std::make_unique<if_node>(std::move(cond), stmt());
+    }
+    next();
+    exprptr then = block({"elseif", "else", "endif"});
+    exprptr otherwise;
+    if (atKeyword("elseif")) {
+        // ElseIf ... EndIf closes the whole chain
+        return std::make_unique<if_node>(std::move(cond), std::move(then), ifStatement());
+    }
+    if (atKeyword("else")) {
+        next();
+        otherwise = block({"endif"});
+    }
+    expectKeyword("endif");
+    return std::make_unique<if_node>(std::move(cond), std::move(then), std::move(otherwise));
+}
+
+exprptr parser::forStatement() {
+    next();
+    std::string var = expectName();
+    expectSymbol(",");
+    exprptr start = expression();
+    expectSymbol(",");
+    exprptr end = expression();
+    exprptr step;
+    if (atSymbol(",")) {
+        next();
+        step = expression();
+    }
+    exprptr body = block({"endfor"});
+    next();
+    return std::make_unique<for_node>(std::move(var), std::move(start), std::move(end), std::move(step),
+                                      std::move(body));
+}
+
+exprptr parser::whileStatement() {
+    next();
+    exprptr cond = expression();
+    exprptr body = block({"endwhile"});
+    next();
+    return std::make_unique<while_node>(std::move(cond), std::move(body));
+}
+
+// --- expressions, loosest binding first ---
+
+exprptr parser::expression() {
+    return orExpr();
+}
+
+exprptr parser::orExpr() {
+    exprptr e = andExpr();
+    while (atKeyword("or") || atKeyword("xor")) {
+        std::string op = next().text;
+        std::vector<exprptr> args;
+        args.push_back(std::move(e));
+        args.push_back(andExpr());
+        e = makeCall(op, std::move(args));
+    }
+    return e;
+}
+
+exprptr parser::andExpr() {
+    exprptr e = notExpr();
+    while (atKeyword("and")) {
+        next();
+        std::vector<exprptr> args;
+        args.push_back(std::move(e));
+        args.push_back(notExpr());
+        e = makeCall("and", std::move(args));
+    }
+    return e;
+}
+
+exprptr parser::notExpr() {
+    if (!atKeyword("not")) return comparison();
+    next();
+    std::vector<exprptr> args;
+    args.push_back(notExpr());
+    return makeCall("not", std::move(args));
+}
+
+exprptr parser::comparison() {
+    static const std::unordered_map<std::string, binary_op> OPS = {
+        {"=", binary_op::Eq}, {"/=", binary_op::Ne}, {"<", binary_op::Lt},
+        {"<=", binary_op::Le}, {">", binary_op::Gt}, {">=", binary_op::Ge},
+    };
+    exprptr e = additive();
+    while (peek().type == tok_type::Symbol && OPS.count(peek().text)) {
+        binary_op op = OPS.at(next().text);
+        e = makeBinary(op, std::move(e), additive());
+    }
+    return e;
+}
+
+exprptr parser::additive() {
+    exprptr e = term();
+    while (atSymbol("+") || atSymbol("-")) {
+        binary_op op = next().text == "+" ? binary_op::Add : binary_op::Sub;
+        e = makeBinary(op, std::move(e), term());
+    }
+    return e;
+}
+
+exprptr parser::term() {
+    exprptr e = unary();
+    for (;;) {
+        if (atSymbol("*") || atSymbol("/")) {
+            binary_op op = next().text == "*" ? binary_op::Mul : binary_op::Div;
+            e = makeBinary(op, std::move(e), unary());
+        } else if ((peek().type == tok_type::Name && !KEYWORDS.count(peek().text)) || atSymbol("(")) {
+            // implicit product: 2x, 3(x+1), (a+b)(a-b)
+            e = makeBinary(binary_op::Mul, std::move(e), power());
+        } else {
+            return e;
+        }
+    }
+}
+
+// -2^2 is -(2^2), as on the calculator
+exprptr parser::unary() {
+    if (atSymbol("+")) {
+        next();
+        return unary();
+    }
+    if (!atSymbol("-")) return power();
+    next();
+    exprptr operand = unary();
+    if (operand->kind() == node_kind::Literal) {
+        const valptr_t &v = static_cast<literal_node &>(*operand).val;
+        if (v->kind() == value_kind::Integer) {
+            return std::make_unique<literal_node>(
+                std::make_shared<integer>(BigInt(0) - static_cast<const integer &>(*v).getValue()));
+        }
+        if (v->kind() == value_kind::Decimal) {
+            return std::make_unique<literal_node>(std::make_shared<decimal>(-toDouble(*v)));
+        }
+    }
+    return makeBinary(binary_op::Mul, std::make_unique<literal_node>(std::make_shared<integer>(-1)),
+                      std::move(operand));
+}
+
+// right-associative; the exponent may carry a sign (2^-1)
+exprptr parser::power() {
+    exprptr base = postfix();
+    if (!atSymbol("^")) return base;
+    next();
+    return makeBinary(binary_op::Pow, std::move(base), unary());
+}
+
+exprptr parser::postfix() {
+    exprptr e = primary();
+    while (atSymbol("!")) {
+        next();
+        std::vector<exprptr> args;
+        args.push_back(std::move(e));
+        e = makeCall("factorial", std::move(args));
+    }
+    return e;
+}
+
+std::vector<exprptr> parser::arguments(const char* close) {
+    std::vector<exprptr> args;
+    if (!atSymbol(close)) {
+        args.push_back(expression());
+        while (atSymbol(",")) {
+            next();
+            args.push_back(expression());
+        }
+    }
+    expectSymbol(close);
+    return args;
+}
+
+exprptr parser::primary() {
+    const token &t = peek();
+    switch (t.type) {
+        case tok_type::Number: {
+            next();
+            if (t.text == INFINITY_NAME) {
+                return std::make_unique<literal_node>(std::make_shared<decimal>(std::numeric_limits<double>::infinity()));
+            }
+            if (t.text.find_first_of(".eE") == std::string::npos) {
+                return std::make_unique<literal_node>(std::make_shared<integer>(BigInt(t.text)));
+            }
+            return std::make_unique<literal_node>(std::make_shared<decimal>(std::stod(t.text)));
+        }
+        case tok_type::String:
+            next();
+            return std::make_unique<literal_node>(std::make_shared<string>(t.text));
+        case tok_type::Name: {
+            if (t.text == "true" || t.text == "false") {
+                next();
+                return std::make_unique<literal_node>(std::make_shared<boolean>(t.text == "true"));
+            }
+            if (t.text == IMAGINARY_NAME) {
+                next();
+                return std::make_unique<literal_node>(imaginaryUnit());
+            }
+            if (KEYWORDS.count(t.text)) fail("expected an expression");
+            std::string name = next().text;
+            if (atSymbol("(")) {
+                next();
+                return makeCall(name, arguments(")"));
+            }
+            return std::make_unique<var_node>(std::move(name));
+        }
+        case tok_type::Symbol:
+            if (t.text == "(") {
+                next();
+                exprptr e = expression();
+                expectSymbol(")");
+                return e;
+            }
+            if (t.text == "{") {
+                next();
+                // see register_list_builtins: "{}" can't be spelled as a call
+                return makeCall("{}", arguments("}"));
+            }
+            break;
+        default:
+            break;
+    }
+    fail("expected an expression");
+}
+
+} // namespace
+
+std::vector<statement> parse(const std::string &code, const runtime_env &env) {
+    return parser(code, env).program();
+}
+
+} // namespace ti
@@ -0,0 +1,1220 @@
+#include "../include/poly.h"
+#include "../include/arith.h"
+#include "../include/complexnum.h"
+#include "../include/runtimeenv.h"
+#include "../include/evaluator.h"
+#include "../include/lists.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <stdexcept>
+#include <type_traits>
+
+namespace ti {
+
+using namespace ast;
+
+namespace {
+
+using ipoly = std::vector<BigInt>; // dense integer coefficients, lowest first, no leading zeros
+using dpoly = std::vector<double>;
+using cplx = std::complex<double>;
+
+// polynomials of at least this degree are stored sparse when under a
+// quarter of their coefficients are nonzero
+constexpr size_t SPARSE_MIN_DEGREE = 64;
+// dense algorithms (division, gcd, square-free parts) refuse larger degrees
+constexpr size_t MAX_DENSE_DEGREE = size_t(1) << 20;
+// Aberth iteration costs O(n^2) per sweep
+constexpr size_t MAX_ROOT_DEGREE = 20000;
+constexpr size_t MAX_ABERTH_SWEEPS = 1000;
+// below 2^30, so coefficients reduce through BigInt's one-limb division
+constexpr uint64_t PRIME = 998244353;
+constexpr double EPS = std::numeric_limits<double>::epsilon();
+
+bool isZeroCoeff(const BigInt &c) { return c.is_zero(); }
+bool isZeroCoeff(double c) { return c == 0; }
+
+template<typename C>
+void trim(std::vector<C> &p) {
+    while (!p.empty() && isZeroCoeff(p.back())) p.pop_back();
+}
+
+BigInt intPow(BigInt base, size_t exp) {
+    BigInt result(1);
+    while (exp) {
+        if (exp & 1) result *= base;
+        exp >>= 1;
+        if (exp) base *= base;
+    }
+    return result;
+}
+
+BigInt content(const ipoly &p) {
+    BigInt g(0);
+    const BigInt one(1);
+    for (const auto &c : p) {
+        g = gcd(g, c);
+        if (g == one) break;
+    }
+    return g;
+}
+
+// p over its content, with a positive leading coefficient
+ipoly primitive(ipoly p) {
+    trim(p);
+    if (p.empty()) return p;
+    BigInt g = content(p);
+    if (p.back().sign() < 0) g = -g;
+    if (g != BigInt(1)) {
+        for (auto &c : p) c /= g;
+    }
+    return p;
+}
+
+ipoly derivative(const ipoly &p) {
+    ipoly d(p.size() > 1 ? p.size() - 1 : 0);
+    for (size_t i = 1; i < p.size(); ++i) d[i - 1] = p[i] * BigInt(static_cast<long long>(i));
+    trim(d);
+    return d;
+}
+
+// r = lc(b)^(deg a - deg b + 1) * a mod b, and the quotient when q is
+// non-null; b is nonzero
+void pseudoDivide(const ipoly &a, const ipoly &b, ipoly* q, ipoly &r) {
+    r = a;
+    if (q) q->clear();
+    if (r.size() < b.size()) return;
+    const BigInt &l = b.back();
+    const bool unit = l == BigInt(1);
+    size_t e = r.size() - b.size() + 1;
+    if (q) q->assign(e, BigInt(0));
+    while (!r.empty() && r.size() >= b.size()) {
+        const size_t shift = r.size() - b.size();
+        const BigInt s = r.back();
+        if (!unit) {
+            for (auto &c : r) c *= l;
+            if (q) {
+                for (auto &c : *q) c *= l;
+            }
+        }
+        if (q) (*q)[shift] += s;
+        for (size_t i = 0; i + 1 < b.size(); ++i) r[shift + i] -= s * b[i];
+        r.pop_back(); // l*top - s*l
+        trim(r);
+        --e;
+    }
+    if (!unit && e > 0) {
+        const BigInt f = intPow(l, e);
+        for (auto &c : r) c *= f;
+        if (q) {
+            for (auto &c : *q) c *= f;
+        }
+    }
+}
+
+// a / b when b divides a over the integers
+ipoly exactQuotient(ipoly a, const ipoly &b) {
+    if (b.size() == 1 && b[0] == BigInt(1)) return a;
+    if (a.size() < b.size()) {
+        if (!a.empty()) throw std::logic_error("inexact polynomial division");
+        return a;
+    }
+    ipoly q(a.size() - b.size() + 1);
+    for (size_t k = q.size(); k-- > 0;) {
+        const BigInt &top = a[k + b.size() - 1];
+        if (top.is_zero()) continue;
+        if (!(top % b.back()).is_zero()) throw std::logic_error("inexact polynomial division");
+        q[k] = top / b.back();
+        for (size_t i = 0; i < b.size(); ++i) a[k + i] -= q[k] * b[i];
+    }
+    trim(a);
+    if (!a.empty()) throw std::logic_error("inexact polynomial division");
+    trim(q);
+    return q;
+}
+
+// --- arithmetic mod PRIME, for the coprimality test ---
+
+using mpoly = std::vector<uint64_t>;
+
+uint64_t powMod(uint64_t b, uint64_t e) {
+    uint64_t r = 1;
+    for (b %= PRIME; e; e >>= 1, b = b * b % PRIME) {
+        if (e & 1) r = r * b % PRIME;
+    }
+    return r;
+}
+
+mpoly reduceMod(const ipoly &p) {
+    const BigInt prime(static_cast<long long>(PRIME));
+    mpoly r(p.size());
+    for (size_t i = 0; i < p.size(); ++i) {
+        long long c = (p[i] % prime).to_long_long();
+        r[i] = static_cast<uint64_t>(c < 0 ? c + static_cast<long long>(PRIME) : c);
+    }
+    return r;
+}
+
+void remMod(mpoly &a, const mpoly &b) {
+    const uint64_t inv = powMod(b.back(), PRIME - 2);
+    while (a.size() >= b.size()) {
+        const uint64_t c = a.back() * inv % PRIME;
+        const size_t shift = a.size() - b.size();
+        for (size_t i = 0; i < b.size(); ++i) a[shift + i] = (a[shift + i] + PRIME - c * b[i] % PRIME) % PRIME;
+        while (!a.empty() && a.back() == 0) a.pop_back();
+    }
+}
+
+// true if a and b are certainly coprime: their images mod a prime not
+// dividing either leading coefficient are, and reduction can only raise
+// the degree of the gcd
+bool coprimeMod(const ipoly &a, const ipoly &b) {
+    mpoly x = reduceMod(a), y = reduceMod(b);
+    if (x.back() == 0 || y.back() == 0) return false;
+    while (!y.empty()) {
+        remMod(x, y);
+        std::swap(x, y);
+    }
+    return x.size() == 1;
+}
+
+// primitive gcd of integer polynomials by the subresultant PRS
+ipoly gcdZ(ipoly a, ipoly b) {
+    if (a.empty()) return primitive(b);
+    if (b.empty()) return primitive(a);
+    if (a.size() == 1 || b.size() == 1 || coprimeMod(a, b)) return {BigInt(1)};
+    if (a.size() < b.size()) std::swap(a, b);
+    a = primitive(a);
+    b = primitive(b);
+    BigInt g(1), h(1);
+    for (;;) {
+        const size_t delta = a.size() - b.size();
+        ipoly r;
+        pseudoDivide(a, b, nullptr, r);
+        if (r.empty()) return primitive(b);
+        if (r.size() == 1) return {BigInt(1)};
+        a = std::move(b);
+        const BigInt div = g * intPow(h, delta);
+        for (auto &c : r) c /= div;
+        b = std::move(r);
+        g = a.back();
+        if (delta > 0) h = intPow(g, delta) / intPow(h, delta - 1);
+    }
+}
+
+ipoly subtract(ipoly a, const ipoly &b) {
+    if (a.size() < b.size()) a.resize(b.size());
+    for (size_t i = 0; i < b.size(); ++i) a[i] -= b[i];
+    trim(a);
+    return a;
+}
+
+// Yun's algorithm on a primitive polynomial. Its loop runs once per
+// multiplicity but only on divisors of the square-free part, so a factor
+// of high multiplicity stays cheap. Every gcd is primitive and every
+// quotient exact over the integers (Gauss's lemma).
+std::vector<std::pair<ipoly, size_t>> squareFreeParts(const ipoly &f) {
+    std::vector<std::pair<ipoly, size_t>> out;
+    if (f.size() < 2) return out;
+    const ipoly df = derivative(f);
+    const ipoly a = gcdZ(f, df);
+    ipoly b = exactQuotient(f, a);
+    ipoly d = subtract(exactQuotient(df, a), derivative(b));
+    for (size_t i = 1; b.size() > 1; ++i) {
+        ipoly g = gcdZ(b, d);
+        if (g.size() > 1) {
+            b = exactQuotient(std::move(b), g);
+            d = exactQuotient(std::move(d), g);
+            out.push_back({std::move(g), i});
+        }
+        d = subtract(std::move(d), derivative(b));
+    }
+    return out;
+}
+
+// the sign of g(x), exactly: with x = M / 2^k, the sign of
+// sum g_i M^i 2^(k(n-i))
+// a nonzero double exactly as m / 2^k, with k > 0 only for a fraction
+struct dyadic {
+    long long m;
+    int k;
+};
+
+dyadic toDyadic(double x) {
+    int e;
+    const double f = std::frexp(x, &e);
+    long long m = static_cast<long long>(std::ldexp(f, 53));
+    int k = 53 - e;
+    while (k > 0 && m % 2 == 0) {
+        m /= 2;
+        --k;
+    }
+    return {m, k};
+}
+
+// g(x) 2^(k deg g) for x = m / 2^k with k > 0, else g(x): an integer
+BigInt scaledValue(const ipoly &g, const dyadic &x) {
+    BigInt acc = g.back();
+    if (x.k <= 0) {
+        const BigInt xb = BigInt(x.m) * intPow(BigInt(2), static_cast<size_t>(-x.k));
+        for (size_t i = g.size() - 1; i-- > 0;) acc = acc * xb + g[i];
+        return acc;
+    }
+    const BigInt mb(x.m), d = intPow(BigInt(2), static_cast<size_t>(x.k));
+    BigInt dp(1);
+    for (size_t i = g.size() - 1; i-- > 0;) {
+        dp *= d;
+        acc = acc * mb + g[i] * dp;
+    }
+    return acc;
+}
+
+int exactSign(const ipoly &g, double x) {
+    if (x == 0) return g[0].sign();
+    return scaledValue(g, toDyadic(x)).sign();
+}
+
+// num / den as a double when both may be far outside double range
+double quotientToDouble(const BigInt &num, const BigInt &den) {
+    // scaled so the integer quotient keeps about 27 digits
+    const long long shift = 9 * (static_cast<long long>(den.limb_count()) - static_cast<long long>(num.limb_count()) + 3);
+    const BigInt q = shift >= 0 ? num * intPow(BigInt(10), static_cast<size_t>(shift)) / den
+                                : num / (den * intPow(BigInt(10), static_cast<size_t>(-shift)));
+    return q.to_double() * std::pow(10.0, -static_cast<double>(shift));
+}
+
+// x after one Newton step on g, with g(x) and g'(x) evaluated exactly
+double polishRoot(const ipoly &g, double x) {
+    if (g.size() < 2) return x;
+    if (x == 0) return g[1].is_zero() ? x : -quotientToDouble(g[0], g[1]);
+    ipoly dg(g.size() - 1);
+    for (size_t i = 1; i < g.size(); ++i) dg[i - 1] = g[i] * BigInt(static_cast<long long>(i));
+    const dyadic d = toDyadic(x);
+    BigInt slope = scaledValue(dg, d);
+    if (slope.is_zero()) return x;
+    // g(x) / g'(x) = value 2^-(k deg g) / (slope 2^-(k (deg g - 1)))
+    if (d.k > 0) slope *= intPow(BigInt(2), static_cast<size_t>(d.k));
+    return x - quotientToDouble(scaledValue(g, d), slope);
+}
+
+// the same for double coefficients, in long double; x unless the step
+// makes |p| smaller
+double polishRoot(const dpoly &p, double x) {
+    auto at = [&p](long double t, long double &slope) {
+        long double v = p.back();
+        slope = 0;
+        for (size_t i = p.size() - 1; i-- > 0;) {
+            slope = slope * t + v;
+            v = v * t + p[i];
+        }
+        return v;
+    };
+    long double slope, ignored;
+    const long double v = at(x, slope);
+    if (slope == 0 || !std::isfinite(static_cast<double>(v / slope))) return x;
+    const double y = static_cast<double>(x - v / slope);
+    return std::fabs(at(y, ignored)) <= std::fabs(v) ? y : x;
+}
+
+// --- Aberth-Ehrlich ---
+
+// the Newton correction p(x)/p'(x); true if |p(x)| is already at the
+// level of its rounding error. Points outside the unit circle use the
+// reversed polynomial so Horner's rule cannot overflow.
+bool newtonRatio(const dpoly &a, cplx x, cplx &ratio) {
+    const size_t n = a.size() - 1;
+    if (std::abs(x) <= 1) {
+        cplx p = a[n], dp = 0;
+        double bound = std::fabs(a[n]);
+        const double ax = std::abs(x);
+        for (size_t i = n; i-- > 0;) {
+            dp = dp * x + p;
+            p = p * x + a[i];
+            bound = bound * ax + std::fabs(a[i]);
+        }
+        ratio = p / dp;
+        return std::abs(p) <= 4 * EPS * bound;
+    }
+    // p(x) = x^n q(1/x) and p'(x) = x^(n-1) (n q(u) - u q'(u)), u = 1/x
+    const cplx u = 1.0 / x;
+    cplx q = a[0], dq = 0;
+    double bound = std::fabs(a[0]);
+    const double au = std::abs(u);
+    for (size_t i = 1; i <= n; ++i) {
+        dq = dq * u + q;
+        q = q * u + a[i];
+        bound = bound * au + std::fabs(a[i]);
+    }
+    if (q == 0.0) {
+        ratio = 0;
+        return true;
+    }
+    ratio = 1.0 / (u * (static_cast<double>(n) - u * dq / q));
+    return std::abs(q) <= 4 * EPS * bound;
+}
+
+// starting points on circles whose radii come from the upper convex hull
+// of (i, log|a_i|) (Bini's choice), so roots of very different moduli
+// each start near their own circle
+std::vector<cplx> initialRoots(const dpoly &a) {
+    const size_t n = a.size() - 1;
+    std::vector<size_t> hull;
+    auto logAbs = [&](size_t i) { return std::log(std::fabs(a[i])); };
+    for (size_t i = 0; i <= n; ++i) {
+        if (a[i] == 0) continue;
+        while (hull.size() >= 2) {
+            const size_t p = hull[hull.size() - 2], q = hull.back();
+            const double cross = (double(q) - double(p)) * (logAbs(i) - logAbs(p)) -
+                                 (logAbs(q) - logAbs(p)) * (double(i) - double(p));
+            if (cross < 0) break;
+            hull.pop_back();
+        }
+        hull.push_back(i);
+    }
+    std::vector<cplx> z;
+    z.reserve(n);
+    const double tau = 2 * std::numbers::pi;
+    for (size_t j = 0; j + 1 < hull.size(); ++j) {
+        const size_t k0 = hull[j], k1 = hull[j + 1], m = k1 - k0;
+        const double r = std::exp((logAbs(k0) - logAbs(k1)) / double(m));
+        for (size_t t = 0; t < m; ++t) {
+            z.push_back(std::polar(r, tau * (double(t) / double(m) + double(k0) / double(n)) + 0.4));
+        }
+    }
+    return z;
+}
+
+// roots of a (lowest coefficient first, nonzero leading coefficient)
+std::vector<cplx> aberth(dpoly a) {
+    std::vector<cplx> roots;
+    size_t zeros = 0;
+    while (zeros < a.size() && a[zeros] == 0) ++zeros;
+    roots.assign(zeros, cplx(0));
+    a.erase(a.begin(), a.begin() + zeros);
+    const size_t n = a.size() - 1;
+    if (n == 0) return roots;
+    if (n == 1) {
+        roots.push_back(-a[0] / a[1]);
+        return roots;
+    }
+
+    std::vector<cplx> z = initialRoots(a);
+    std::vector<bool> done(n, false);
+    size_t remaining = n;
+    for (size_t sweep = 0; sweep < MAX_ABERTH_SWEEPS && remaining > 0; ++sweep) {
+        // Gauss-Seidel: each update sees the ones before it
+        for (size_t k = 0; k < n; ++k) {
+            if (done[k]) continue;
+            cplx ratio;
+            if (newtonRatio(a, z[k], ratio)) {
+                done[k] = true;
+                --remaining;
+                continue;
+            }
+            cplx s = 0;
+            for (size_t j = 0; j < n; ++j) {
+                if (j != k) s += 1.0 / (z[k] - z[j]);
+            }
+            const cplx w = ratio / (1.0 - ratio * s);
+            if (!std::isfinite(w.real()) || !std::isfinite(w.imag())) continue;
+            z[k] -= w;
+            if (std::abs(w) <= 4 * EPS * std::abs(z[k])) {
+                done[k] = true;
+                --remaining;
+            }
+        }
+    }
+    roots.insert(roots.end(), z.begin(), z.end());
+    return roots;
+}
+
+double ratioToDouble(const BigInt &num, const BigInt &den) {
+    const double r = num.to_double() / den.to_double();
+    if (!std::isfinite(r)) throw std::overflow_error("polynomial coefficient out of double range");
+    return r;
+}
+
+// nonzero terms of a stored layout as (exponent, coefficient) pairs
+template<typename C>
+std::vector<std::pair<size_t, C>> termsOf(const std::vector<size_t> &exps, const std::vector<C> &cs) {
+    std::vector<std::pair<size_t, C>> out;
+    for (size_t i = 0; i < cs.size(); ++i) {
+        if (!isZeroCoeff(cs[i])) out.push_back({exps.empty() ? i : exps[i], cs[i]});
+    }
+    return out;
+}
+
+// dense products: Kronecker substitution into one BigInt multiply for
+// exact coefficients, schoolbook for doubles
+ipoly mulDense(const ipoly &a, const ipoly &b) {
+    if (a.size() == 1 || b.size() == 1) {
+        const BigInt &s = a.size() == 1 ? a[0] : b[0];
+        ipoly out = a.size() == 1 ? b : a;
+        for (auto &c : out) c *= s;
+        return out;
+    }
+    size_t la = 0, lb = 0;
+    for (const auto &c : a) la = std::max(la, c.limb_count());
+    for (const auto &c : b) lb = std::max(lb, c.limb_count());
+    // |product coefficient| < min(n, m) * 10^(9(la+lb)), far below half a slot
+    const size_t slot = la + lb + 1;
+    const BigInt product = BigInt::kronecker_pack(a, slot) * BigInt::kronecker_pack(b, slot);
+    return BigInt::kronecker_unpack(product, slot, a.size() + b.size() - 1);
+}
+
+dpoly mulDense(const dpoly &a, const dpoly &b) {
+    dpoly out(a.size() + b.size() - 1, 0.0);
+    for (size_t i = 0; i < a.size(); ++i) {
+        for (size_t j = 0; j < b.size(); ++j) out[i + j] += a[i] * b[j];
+    }
+    return out;
+}
+
+// roots this far from the real axis (relative) are taken as real
+constexpr double REAL_TOLERANCE = 1e-7;
+// exact polynomials up to this degree get their real roots bisected to
+// full precision with exact signs
+constexpr size_t MAX_BISECT_DEGREE = 300;
+
+// the real roots of a square-free integer polynomial from its Aberth
+// approximations. Rounding can leave a real root's approximation slightly
+// off the axis; such a candidate is accepted when g changes sign across
+// an interval around it narrower than the gap to any other approximation.
+// Past MAX_BISECT_DEGREE a root is its approximation after one exact
+// Newton step instead of bisected.
+void realRootsOf(const ipoly &g, const std::vector<cplx> &zs, size_t mult, std::vector<double> &out) {
+    std::vector<double> found;
+    for (size_t k = 0; k < zs.size(); ++k) {
+        const cplx z = zs[k];
+        const double scale = std::max(1.0, std::abs(z));
+        if (std::fabs(z.imag()) > 0.1 * scale) continue;
+        double gap = std::numeric_limits<double>::infinity();
+        for (size_t j = 0; j < zs.size(); ++j) {
+            if (j != k) gap = std::min(gap, std::abs(z - zs[j]));
+        }
+        const double r = std::isfinite(gap) ? gap / 2 : scale;
+        // every real point is then as near another approximation, e.g. a
+        // pair of close complex roots straddling a real one
+        if (std::fabs(z.imag()) >= r) continue;
+        if (std::fabs(z.imag()) <= REAL_TOLERANCE * scale && g.size() - 1 > MAX_BISECT_DEGREE) {
+            found.push_back(polishRoot(g, z.real()));
+            continue;
+        }
+        double lo = z.real() - r, hi = z.real() + r;
+        int slo = exactSign(g, lo);
+        const int shi = exactSign(g, hi);
+        if (slo == shi) continue;
+        if (g.size() - 1 > MAX_BISECT_DEGREE) {
+            found.push_back(polishRoot(g, z.real()));
+            continue;
+        }
+        for (;;) {
+            const double mid = lo + (hi - lo) / 2;
+            if (mid <= lo || mid >= hi) break;
+            const int s = exactSign(g, mid);
+            if (s == 0) {
+                lo = hi = mid;
+                break;
+            }
+            if (s == slo) lo = mid;
+            else hi = mid;
+        }
+        found.push_back(lo + (hi - lo) / 2);
+    }
+    // overlapping intervals can certify one root twice
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    for (double x : found) out.insert(out.end(), mult, x);
+}
+
+// the common variable of two operands; a constant adopts the other's
+std::string commonVar(const polynomial &a, const polynomial &b) {
+    if (a.getVar() == b.getVar() || b.degree() == 0) return a.getVar();
+    if (a.degree() == 0) return b.getVar();
+    throw std::runtime_error("polynomials in different variables: " + a.getVar() + ", " + b.getVar());
+}
+
+void checkDense(size_t degree) {
+    if (degree > MAX_DENSE_DEGREE) throw std::runtime_error("polynomial degree too large");
+}
+
+} // namespace
+
+// === polynomial ===
+
+template<> std::vector<BigInt> &polynomial::coeffs<BigInt>() { return nums; }
+template<> std::vector<double> &polynomial::coeffs<double>() { return dcoeffs; }
+template<> const std::vector<BigInt> &polynomial::coeffs<BigInt>() const { return nums; }
+template<> const std::vector<double> &polynomial::coeffs<double>() const { return dcoeffs; }
+
+template<typename C>
+std::vector<C> polynomial::dense() const {
+    const std::vector<C> &cs = coeffs<C>();
+    if (exps.empty()) return cs;
+    checkDense(exps.back());
+    std::vector<C> out(exps.back() + 1, C(0));
+    for (size_t i = 0; i < cs.size(); ++i) out[exps[i]] = cs[i];
+    return out;
+}
+
+polynomial::polynomial(std::string var) : var(std::move(var)) {}
+
+polynomial::polynomial(std::string var, std::vector<BigInt> nums, BigInt den)
+    : var(std::move(var)), nums(std::move(nums)), den(std::move(den)) {
+    if (this->den.is_zero()) throw std::domain_error("division by zero");
+    if (this->den.sign() < 0) {
+        this->den = -this->den;
+        for (auto &c : this->nums) c = -c;
+    }
+    normalize();
+}
+
+polynomial::polynomial(std::string var, std::vector<double> coeffs)
+    : var(std::move(var)), approx(true), dcoeffs(std::move(coeffs)) {
+    normalize();
+}
+
+polynomial polynomial::monomial(std::string var, const value &c, size_t exp) {
+    polynomial p(std::move(var));
+    p.exps = {exp};
+    switch (c.kind()) {
+        case value_kind::Integer:
+            p.nums = {static_cast<const integer &>(c).getValue()};
+            break;
+        case value_kind::Fraction: {
+            auto [n, d] = static_cast<const fraction &>(c).toTuple();
+            p.nums = {n};
+            p.den = d;
+            if (p.den.sign() < 0) {
+                p.den = -p.den;
+                p.nums[0] = -p.nums[0];
+            }
+            break;
+        }
+        case value_kind::Decimal:
+            p.approx = true;
+            p.dcoeffs = {static_cast<const decimal &>(c).getValue()};
+            break;
+        default:
+            throw std::runtime_error("polynomial coefficient must be a number, got " + c.toString());
+    }
+    p.normalize();
+    return p;
+}
+
+void polynomial::normalize() {
+    auto layout = [this](auto &cs) {
+        if (exps.empty()) {
+            trim(cs);
+        } else {
+            size_t k = 0;
+            for (size_t i = 0; i < cs.size(); ++i) {
+                if (isZeroCoeff(cs[i])) continue;
+                exps[k] = exps[i];
+                cs[k++] = std::move(cs[i]);
+            }
+            exps.resize(k);
+            cs.resize(k);
+        }
+        const size_t nonzero = exps.empty() ? termCount() : cs.size();
+        const size_t deg = degree();
+        const bool sparse = deg >= SPARSE_MIN_DEGREE && nonzero * 4 < deg + 1;
+        if (sparse && exps.empty()) {
+            std::remove_reference_t<decltype(cs)> packed;
+            for (size_t i = 0; i < cs.size(); ++i) {
+                if (isZeroCoeff(cs[i])) continue;
+                exps.push_back(i);
+                packed.push_back(std::move(cs[i]));
+            }
+            cs = std::move(packed);
+        } else if (!sparse && !exps.empty()) {
+            std::remove_reference_t<decltype(cs)> full(deg + 1);
+            for (size_t i = 0; i < cs.size(); ++i) full[exps[i]] = std::move(cs[i]);
+            cs = std::move(full);
+            exps.clear();
+        }
+    };
+    if (approx) {
+        layout(dcoeffs);
+        return;
+    }
+    layout(nums);
+    if (nums.empty()) {
+        den = BigInt(1);
+        return;
+    }
+    BigInt g = den;
+    const BigInt one(1);
+    for (const auto &c : nums) {
+        if (g == one) break;
+        g = ti::gcd(g, c);
+    }
+    if (g != one) {
+        den /= g;
+        for (auto &c : nums) c /= g;
+    }
+}
+
+poly_ring polynomial::ring() const {
+    if (approx) return poly_ring::Decimal;
+    return den == BigInt(1) ? poly_ring::Integer : poly_ring::Rational;
+}
+
+size_t polynomial::degree() const {
+    if (!exps.empty()) return exps.back();
+    const size_t n = approx ? dcoeffs.size() : nums.size();
+    return n ? n - 1 : 0;
+}
+
+size_t polynomial::termCount() const {
+    if (!exps.empty()) return exps.size();
+    if (approx) return dcoeffs.size() - std::count(dcoeffs.begin(), dcoeffs.end(), 0.0);
+    return std::count_if(nums.begin(), nums.end(), [](const BigInt &c) { return !c.is_zero(); });
+}
+
+valptr_t polynomial::coefficient(size_t exp) const {
+    size_t i = exp;
+    if (!exps.empty()) {
+        auto it = std::lower_bound(exps.begin(), exps.end(), exp);
+        i = it != exps.end() && *it == exp ? static_cast<size_t>(it - exps.begin()) : SIZE_MAX;
+    }
+    if (approx) return std::make_shared<decimal>(i < dcoeffs.size() ? dcoeffs[i] : 0.0);
+    return i < nums.size() ? makeRational(nums[i], den) : std::make_shared<integer>(0);
+}
+
+polynomial polynomial::toDecimal() const {
+    if (approx) return *this;
+    polynomial p(var);
+    p.approx = true;
+    p.exps = exps;
+    p.dcoeffs.resize(nums.size());
+    for (size_t i = 0; i < nums.size(); ++i) p.dcoeffs[i] = ratioToDouble(nums[i], den);
+    p.normalize();
+    return p;
+}
+
+template<typename C>
+polynomial polynomial::combine(const polynomial &a, const polynomial &b, int sign) {
+    polynomial out(commonVar(a, b));
+    out.approx = std::is_same_v<C, double>;
+    // exact operands are brought to the least common denominator
+    C fa(1), fb(sign);
+    if constexpr (std::is_same_v<C, BigInt>) {
+        out.den = a.den;
+        if (a.den != b.den) {
+            const BigInt g = ti::gcd(a.den, b.den);
+            fa = b.den / g;
+            fb *= a.den / g;
+            out.den = a.den * fa;
+        }
+    }
+    const std::vector<C> &ac = a.coeffs<C>(), &bc = b.coeffs<C>();
+    std::vector<C> &oc = out.coeffs<C>();
+    const C one(1);
+    if (a.exps.empty() && b.exps.empty()) {
+        oc.assign(std::max(ac.size(), bc.size()), C(0));
+        for (size_t i = 0; i < ac.size(); ++i) oc[i] = fa == one ? ac[i] : ac[i] * fa;
+        for (size_t i = 0; i < bc.size(); ++i) oc[i] += bc[i] * fb;
+    } else {
+        auto at = termsOf(a.exps, ac), bt = termsOf(b.exps, bc);
+        size_t i = 0, j = 0;
+        while (i < at.size() || j < bt.size()) {
+            if (j == bt.size() || (i < at.size() && at[i].first < bt[j].first)) {
+                out.exps.push_back(at[i].first);
+                oc.push_back(at[i++].second * fa);
+            } else if (i == at.size() || bt[j].first < at[i].first) {
+                out.exps.push_back(bt[j].first);
+                oc.push_back(bt[j++].second * fb);
+            } else {
+                out.exps.push_back(at[i].first);
+                oc.push_back(at[i++].second * fa + bt[j++].second * fb);
+            }
+        }
+    }
+    out.normalize();
+    return out;
+}
+
+template<typename C>
+polynomial polynomial::multiply(const polynomial &a, const polynomial &b) {
+    polynomial out(commonVar(a, b));
+    out.approx = std::is_same_v<C, double>;
+    if (a.isZero() || b.isZero()) return out;
+    if constexpr (std::is_same_v<C, BigInt>) out.den = a.den * b.den;
+    const std::vector<C> &ac = a.coeffs<C>(), &bc = b.coeffs<C>();
+    std::vector<C> &oc = out.coeffs<C>();
+    if (a.exps.empty() && b.exps.empty()) {
+        oc = mulDense(ac, bc);
+    } else {
+        // sparse: all pairwise products, merged by exponent
+        auto at = termsOf(a.exps, ac), bt = termsOf(b.exps, bc);
+        std::vector<std::pair<size_t, C>> prods;
+        prods.reserve(at.size() * bt.size());
+        for (const auto &x : at) {
+            for (const auto &y : bt) prods.push_back({x.first + y.first, x.second * y.second});
+        }
+        std::sort(prods.begin(), prods.end(), [](const auto &x, const auto &y) { return x.first < y.first; });
+        for (auto &p : prods) {
+            if (!out.exps.empty() && out.exps.back() == p.first) {
+                oc.back() += p.second;
+            } else {
+                out.exps.push_back(p.first);
+                oc.push_back(std::move(p.second));
+            }
+        }
+    }
+    out.normalize();
+    return out;
+}
+
+polynomial polynomial::operator+(const polynomial &other) const {
+    if (approx || other.approx) return combine<double>(toDecimal(), other.toDecimal(), 1);
+    return combine<BigInt>(*this, other, 1);
+}
+
+polynomial polynomial::operator-(const polynomial &other) const {
+    if (approx || other.approx) return combine<double>(toDecimal(), other.toDecimal(), -1);
+    return combine<BigInt>(*this, other, -1);
+}
+
+polynomial polynomial::operator*(const polynomial &other) const {
+    if (approx || other.approx) return multiply<double>(toDecimal(), other.toDecimal());
+    return multiply<BigInt>(*this, other);
+}
+
+polynomial polynomial::operator-() const {
+    polynomial p(*this);
+    for (auto &c : p.nums) c = -c;
+    for (auto &c : p.dcoeffs) c = -c;
+    return p;
+}
+
+polynomial polynomial::pow(size_t exp) const {
+    if (degree() > 0 && exp > MAX_DENSE_DEGREE * 64 / degree()) throw std::runtime_error("polynomial degree too large");
+    polynomial result(var, std::vector<BigInt>{BigInt(1)});
+    polynomial base = *this;
+    while (exp) {
+        if (exp & 1) result = result * base;
+        exp >>= 1;
+        if (exp) base = base * base;
+    }
+    return result;
+}
+
+polynomial polynomial::scaled(const value &c, bool divide) const {
+    if (approx || c.kind() == value_kind::Decimal) {
+        polynomial p = toDecimal();
+        const double s = toDouble(c);
+        if (divide && s == 0) throw std::domain_error("division by zero");
+        for (auto &x : p.dcoeffs) x = divide ? x / s : x * s;
+        p.normalize();
+        return p;
+    }
+    BigInt n, d(1);
+    if (c.kind() == value_kind::Integer) n = static_cast<const integer &>(c).getValue();
+    else if (c.kind() == value_kind::Fraction) std::tie(n, d) = static_cast<const fraction &>(c).toTuple();
+    else throw std::runtime_error("polynomial coefficient must be a number, got " + c.toString());
+    if (divide) std::swap(n, d);
+    if (d.is_zero()) throw std::domain_error("division by zero");
+    polynomial p(*this);
+    for (auto &x : p.nums) x *= n;
+    p.den *= d;
+    if (p.den.sign() < 0) {
+        p.den = -p.den;
+        for (auto &x : p.nums) x = -x;
+    }
+    p.normalize();
+    return p;
+}
+
+polynomial polynomial::derivative() const {
+    polynomial p(var);
+    p.approx = approx;
+    p.den = den;
+    auto build = [&](const auto &cs, auto &out) {
+        for (size_t i = 0; i < cs.size(); ++i) {
+            const size_t e = exps.empty() ? i : exps[i];
+            if (e == 0 || isZeroCoeff(cs[i])) continue;
+            p.exps.push_back(e - 1);
+            if constexpr (std::is_same_v<std::decay_t<decltype(cs[i])>, double>) out.push_back(cs[i] * double(e));
+            else out.push_back(cs[i] * BigInt(static_cast<long long>(e)));
+        }
+    };
+    if (approx) build(dcoeffs, p.dcoeffs);
+    else build(nums, p.nums);
+    p.normalize();
+    return p;
+}
+
+valptr_t polynomial::evaluate(const valptr_t &x) const {
+    // Horner over the nonzero terms, highest first, raising x over gaps
+    auto power = [&](size_t k) -> valptr_t {
+        return k == 1 ? x : applyBinary(binary_op::Pow, x, std::make_shared<integer>(static_cast<long long>(k)));
+    };
+    valptr_t acc;
+    size_t prev = 0;
+    const size_t n = approx ? dcoeffs.size() : nums.size();
+    for (size_t i = n; i-- > 0;) {
+        const size_t e = exps.empty() ? i : exps[i];
+        const bool zero = approx ? dcoeffs[i] == 0 : nums[i].is_zero();
+        if (zero) continue;
+        valptr_t c = approx ? valptr_t(std::make_shared<decimal>(dcoeffs[i])) : makeRational(nums[i], den);
+        acc = acc ? applyBinary(binary_op::Add, applyBinary(binary_op::Mul, acc, power(prev - e)), c) : c;
+        prev = e;
+    }
+    if (!acc) return std::make_shared<integer>(0);
+    return prev ? applyBinary(binary_op::Mul, acc, power(prev)) : acc;
+}
+
+void polynomial::divide(const polynomial &a, const polynomial &b, polynomial &q, polynomial &r) {
+    if (b.isZero()) throw std::domain_error("division by zero");
+    const std::string v = commonVar(a, b);
+    checkDense(a.degree());
+    checkDense(b.degree());
+    if (a.approx || b.approx) {
+        dpoly x = a.toDecimal().dense<double>(), y = b.toDecimal().dense<double>();
+        dpoly quot(x.size() >= y.size() ? x.size() - y.size() + 1 : 0, 0.0);
+        for (size_t k = quot.size(); k-- > 0;) {
+            quot[k] = x[k + y.size() - 1] / y.back();
+            for (size_t i = 0; i < y.size(); ++i) x[k + i] -= quot[k] * y[i];
+            x[k + y.size() - 1] = 0;
+        }
+        q = polynomial(v, std::move(quot));
+        r = polynomial(v, std::move(x));
+        return;
+    }
+    ipoly x = a.dense<BigInt>(), y = b.dense<BigInt>();
+    if (x.size() < y.size()) {
+        q = polynomial(v);
+        r = a;
+        r.var = v;
+        return;
+    }
+    // lc^e * x = Q*y + R, so a = x/da = (Q db / (lc^e da)) * b + R / (lc^e da)
+    ipoly quot, rem;
+    pseudoDivide(x, y, &quot, rem);
+    const BigInt scale = intPow(y.back(), x.size() - y.size() + 1) * a.den;
+    for (auto &c : quot) c *= b.den;
+    q = polynomial(v, std::move(quot), scale);
+    r = polynomial(v, std::move(rem), scale);
+}
+
+polynomial polynomial::gcd(const polynomial &a, const polynomial &b) {
+    if (a.approx || b.approx) throw std::runtime_error("polynomial gcd needs exact coefficients");
+    const std::string v = commonVar(a, b);
+    return polynomial(v, gcdZ(a.dense<BigInt>(), b.dense<BigInt>()));
+}
+
+std::vector<std::pair<polynomial, size_t>> polynomial::squareFree(valptr_t &unit) const {
+    if (approx) throw std::runtime_error("square-free factorization needs exact coefficients");
+    if (isZero()) throw std::runtime_error("square-free factorization of the zero polynomial");
+    ipoly f = dense<BigInt>();
+    BigInt c = content(f);
+    if (f.back().sign() < 0) c = -c;
+    unit = makeRational(c, den);
+    std::vector<std::pair<polynomial, size_t>> out;
+    for (auto &[g, m] : squareFreeParts(primitive(std::move(f)))) out.push_back({polynomial(var, std::move(g)), m});
+    return out;
+}
+
+std::vector<std::complex<double>> polynomial::roots() const {
+    if (isZero()) throw std::runtime_error("roots of the zero polynomial");
+    if (degree() > MAX_ROOT_DEGREE) throw std::runtime_error("polynomial degree too large for root finding");
+    if (approx) return aberth(dense<double>());
+    // multiple roots are ill-conditioned: find each square-free part's
+    // simple roots and repeat them
+    valptr_t unit;
+    std::vector<cplx> out;
+    for (const auto &[g, m] : squareFree(unit)) {
+        const ipoly gi = g.dense<BigInt>();
+        dpoly d(gi.size());
+        for (size_t i = 0; i < d.size(); ++i) d[i] = ratioToDouble(gi[i], BigInt(1));
+        for (const cplx &z : aberth(std::move(d))) out.insert(out.end(), m, z);
+    }
+    return out;
+}
+
+std::vector<double> polynomial::realRoots() const {
+    std::vector<double> out;
+    if (approx) {
+        const dpoly p = dense<double>();
+        for (const cplx &z : roots()) {
+            if (std::fabs(z.imag()) <= REAL_TOLERANCE * std::max(1.0, std::abs(z))) out.push_back(polishRoot(p, z.real()));
+        }
+    } else {
+        if (isZero()) throw std::runtime_error("roots of the zero polynomial");
+        if (degree() > MAX_ROOT_DEGREE) throw std::runtime_error("polynomial degree too large for root finding");
+        valptr_t unit;
+        for (const auto &[g, m] : squareFree(unit)) {
+            const ipoly gi = g.dense<BigInt>();
+            dpoly d(gi.size());
+            for (size_t i = 0; i < d.size(); ++i) d[i] = ratioToDouble(gi[i], BigInt(1));
+            realRootsOf(gi, aberth(std::move(d)), m, out);
+        }
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+std::string polynomial::toString() const {
+    std::string out;
+    const size_t n = approx ? dcoeffs.size() : nums.size();
+    for (size_t i = n; i-- > 0;) {
+        const size_t e = exps.empty() ? i : exps[i];
+        bool negative, unitCoeff;
+        std::string cs;
+        if (approx) {
+            const double c = dcoeffs[i];
+            if (c == 0) continue;
+            negative = c < 0;
+            unitCoeff = false;
+            cs = decimal(std::fabs(c)).toString();
+        } else {
+            if (nums[i].is_zero()) continue;
+            negative = nums[i].sign() < 0;
+            unitCoeff = nums[i].abs() == den;
+            const BigInt g = ti::gcd(nums[i], den);
+            cs = (nums[i].abs() / g).to_string();
+            if (den != g) cs += "/" + (den / g).to_string();
+        }
+        out += negative ? "-" : out.empty() ? "" : "+";
+        if (!unitCoeff || e == 0) {
+            out += cs;
+            if (e > 0) out += "*";
+        }
+        if (e > 0) out += var;
+        if (e > 1) out += "^" + std::to_string(e);
+    }
+    return out.empty() ? "0" : out;
+}
+
+size_t polynomial::hash() const {
+    size_t h = std::hash<std::string>()(var) ^ (approx ? 0x706f6c79ULL : 0);
+    auto mix = [&h](size_t x) { h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2); };
+    mix(den.hash());
+    for (size_t e : exps) mix(e);
+    for (const auto &c : nums) mix(c.hash());
+    for (double c : dcoeffs) mix(std::hash<double>()(c));
+    return h;
+}
+
+bool polynomial::equals(const value &other) const {
+    auto o = dynamic_cast<const polynomial*>(&other);
+    // layouts are canonical, so equal polynomials store the same vectors
+    return o && var == o->var && approx == o->approx && den == o->den && exps == o->exps && nums == o->nums &&
+           dcoeffs == o->dcoeffs;
+}
+
+// === expressions ===
+
+namespace {
+
+bool mentions(const exprnode &e, const std::string &var) {
+    switch (e.kind()) {
+        case node_kind::Literal:
+            return false;
+        case node_kind::Var:
+            return static_cast<const var_node &>(e).name == var;
+        case node_kind::BinaryOp: {
+            auto &b = static_cast<const binary_op_node &>(e);
+            return mentions(*b.left, var) || mentions(*b.right, var);
+        }
+        case node_kind::Call: {
+            auto &c = static_cast<const call_node &>(e);
+            if (c.callee->kind() != node_kind::Var && mentions(*c.callee, var)) return true;
+            return std::any_of(c.args.begin(), c.args.end(), [&](const auto &a) { return mentions(*a, var); });
+        }
+        default:
+            return true;
+    }
+}
+
+polynomial toPoly(const valptr_t &v, const std::string &var) {
+    if (v && v->kind() == value_kind::Polynomial) {
+        const auto &p = static_cast<const polynomial &>(*v);
+        if (p.getVar() != var && p.degree() > 0) throw std::runtime_error("expected a polynomial in " + var + ", got " + p.toString());
+        return p;
+    }
+    if (!v || !isNumeric(v->kind())) throw std::runtime_error("expected a polynomial in " + var);
+    return polynomial::monomial(var, *v, 0);
+}
+
+} // namespace
+
+polynomial polyFromExpr(const exprnode &expr, const std::string &var, runtime_env &env) {
+    if (!mentions(expr, var)) return toPoly(evaluator(env).run(expr), var);
+    if (expr.kind() == node_kind::Var) return polynomial::monomial(var, integer(1), 1);
+    if (expr.kind() != node_kind::BinaryOp) throw std::runtime_error("not a polynomial in " + var);
+    auto &b = static_cast<const binary_op_node &>(expr);
+    switch (b.op) {
+        case binary_op::Add: return polyFromExpr(*b.left, var, env) + polyFromExpr(*b.right, var, env);
+        case binary_op::Sub: return polyFromExpr(*b.left, var, env) - polyFromExpr(*b.right, var, env);
+        case binary_op::Mul: return polyFromExpr(*b.left, var, env) * polyFromExpr(*b.right, var, env);
+        case binary_op::Div:
+        case binary_op::Pow: {
+            if (mentions(*b.right, var)) throw std::runtime_error("not a polynomial in " + var);
+            const polynomial l = polyFromExpr(*b.left, var, env);
+            return static_cast<const polynomial &>(*polyArith(b.op, l, *evaluator(env).run(*b.right)));
+        }
+        default:
+            throw std::runtime_error("not a polynomial in " + var);
+    }
+}
+
+valptr_t polyArith(binary_op op, const value &l, const value &r) {
+    const bool lp = l.kind() == value_kind::Polynomial, rp = r.kind() == value_kind::Polynomial;
+    if ((!lp && !isNumeric(l.kind())) || (!rp && !isNumeric(r.kind()))) {
+        throw std::runtime_error("invalid operand types: " + l.toString() + ", " + r.toString());
+    }
+    const std::string &var = lp ? static_cast<const polynomial &>(l).getVar() : static_cast<const polynomial &>(r).getVar();
+    auto operand = [&var](const value &v, bool isPoly) {
+        return isPoly ? static_cast<const polynomial &>(v) : polynomial::monomial(var, v, 0);
+    };
+    switch (op) {
+        case binary_op::Add: return std::make_shared<polynomial>(operand(l, lp) + operand(r, rp));
+        case binary_op::Sub: return std::make_shared<polynomial>(operand(l, lp) - operand(r, rp));
+        case binary_op::Mul: return std::make_shared<polynomial>(operand(l, lp) * operand(r, rp));
+        case binary_op::Div: {
+            if (!rp) return std::make_shared<polynomial>(operand(l, lp).scaled(r, true));
+            polynomial q(var), rem(var);
+            polynomial::divide(operand(l, lp), static_cast<const polynomial &>(r), q, rem);
+            if (!rem.isZero()) throw std::runtime_error("polynomial division leaves a remainder; use polyQuotient and polyRemainder");
+            return std::make_shared<polynomial>(std::move(q));
+        }
+        case binary_op::Pow: {
+            if (!lp || r.kind() != value_kind::Integer || static_cast<const integer &>(r).getValue().sign() < 0) {
+                throw std::runtime_error("polynomials can only be raised to non-negative integer powers");
+            }
+            const BigInt e = static_cast<const integer &>(r).getValue();
+            if (e > BigInt(static_cast<long long>(MAX_DENSE_DEGREE) * 64)) throw std::runtime_error("polynomial degree too large");
+            return std::make_shared<polynomial>(static_cast<const polynomial &>(l).pow(static_cast<size_t>(e.to_long_long())));
+        }
+        case binary_op::Eq:
+        case binary_op::Ne: {
+            const bool eq = operand(l, lp).equals(operand(r, rp));
+            return std::make_shared<boolean>(op == binary_op::Eq ? eq : !eq);
+        }
+        default:
+            throw std::runtime_error("polynomials cannot be ordered");
+    }
+}
+
+// === builtins ===
+
+namespace {
+
+// argument i as a polynomial: an expression in var when one is named,
+// else a polynomial value, a coefficient list (highest degree first, in
+// x) or a number
+polynomial polyOperand(const call_node &c, size_t i, const std::string* var, runtime_env &env) {
+    if (var) return polyFromExpr(*c.args[i], *var, env);
+    valptr_t v = asList(evaluator(env).run(*c.args[i]));
+    if (v && v->kind() == value_kind::List) {
+        const auto &es = static_cast<const valuelist &>(*v).elements();
+        polynomial p("x");
+        for (size_t k = 0; k < es.size(); ++k) {
+            if (!es[k] || !isNumeric(es[k]->kind())) throw std::runtime_error("polynomial coefficients must be numbers");
+            p = p + polynomial::monomial("x", *es[k], es.size() - 1 - k);
+        }
+        return p;
+    }
+    return toPoly(v, v && v->kind() == value_kind::Polynomial ? static_cast<const polynomial &>(*v).getVar() : "x");
+}
+
+// (p) or (expr, var)
+polynomial unaryArg(const call_node &c, runtime_env &env, const char* name) {
+    if (c.args.empty() || c.args.size() > 2) throw std::runtime_error(std::string(name) + " expects (poly) or (expr, var)");
+    if (c.args.size() == 1) return polyOperand(c, 0, nullptr, env);
+    const std::string &var = formVariable(c, 1, name);
+    return polyOperand(c, 0, &var, env);
+}
+
+// (a, b) or (exprA, exprB, var)
+std::pair<polynomial, polynomial> binaryArgs(const call_node &c, runtime_env &env, const char* name) {
+    if (c.args.size() < 2 || c.args.size() > 3) throw std::runtime_error(std::string(name) + " expects (a, b) or (a, b, var)");
+    const std::string* var = c.args.size() == 3 ? &formVariable(c, 2, name) : nullptr;
+    return {polyOperand(c, 0, var, env), polyOperand(c, 1, var, env)};
+}
+
+valptr_t makeList(std::vector<valptr_t> xs) {
+    return std::make_shared<valuelist>(std::move(xs));
+}
+
+} // namespace
+
+void register_poly_builtins(runtime_env &env) {
+    env.registerForm("expand", [](const call_node &c, runtime_env &env) -> valptr_t {
+        if (c.args.size() != 2) throw std::runtime_error("expand expects (expr, var)");
+        return std::make_shared<polynomial>(polyFromExpr(*c.args[0], formVariable(c, 1, "expand"), env));
+    });
+    env.registerForm("polyCoeffs", [](const call_node &c, runtime_env &env) -> valptr_t {
+        const polynomial p = unaryArg(c, env, "polyCoeffs");
+        std::vector<valptr_t> out;
+        for (size_t e = p.degree() + 1; e-- > 0;) out.push_back(p.coefficient(e));
+        return makeList(std::move(out));
+    });
+    env.registerForm("polyDegree", [](const call_node &c, runtime_env &env) -> valptr_t {
+        return std::make_shared<integer>(static_cast<long long>(unaryArg(c, env, "polyDegree").degree()));
+    });
+    env.registerForm("polyEval", [](const call_node &c, runtime_env &env) -> valptr_t {
+        if (c.args.size() != 2) throw std::runtime_error("polyEval expects (poly, x)");
+        return polyOperand(c, 0, nullptr, env).evaluate(evaluator(env).run(*c.args[1]));
+    });
+    env.registerForm("polyGcd", [](const call_node &c, runtime_env &env) -> valptr_t {
+        auto [a, b] = binaryArgs(c, env, "polyGcd");
+        return std::make_shared<polynomial>(polynomial::gcd(a, b));
+    });
+    env.registerForm("polyQuotient", [](const call_node &c, runtime_env &env) -> valptr_t {
+        auto [a, b] = binaryArgs(c, env, "polyQuotient");
+        polynomial q(a.getVar()), r(a.getVar());
+        polynomial::divide(a, b, q, r);
+        return std::make_shared<polynomial>(std::move(q));
+    });
+    env.registerForm("polyRemainder", [](const call_node &c, runtime_env &env) -> valptr_t {
+        auto [a, b] = binaryArgs(c, env, "polyRemainder");
+        polynomial q(a.getVar()), r(a.getVar());
+        polynomial::divide(a, b, q, r);
+        return std::make_shared<polynomial>(std::move(r));
+    });
+    // the real roots in ascending order, repeated by multiplicity
+    env.registerForm("polyRoots", [](const call_node &c, runtime_env &env) -> valptr_t {
+        std::vector<valptr_t> out;
+        for (double x : unaryArg(c, env, "polyRoots").realRoots()) out.push_back(std::make_shared<decimal>(x));
+        return makeList(std::move(out));
+    });
+    // every root, repeated by multiplicity: the real ones as polyRoots finds
+    // them, then the others ordered by real and imaginary part
+    env.registerForm("cZeros", [](const call_node &c, runtime_env &env) -> valptr_t {
+        const polynomial p = unaryArg(c, env, "cZeros");
+        std::vector<valptr_t> out;
+        for (double x : p.realRoots()) out.push_back(std::make_shared<decimal>(x));
+        std::vector<cplx> others;
+        for (const cplx &z : p.roots()) {
+            const double scale = REAL_TOLERANCE * std::max(1.0, std::abs(z));
+            // roots on the imaginary axis come back with a tiny real part
+            if (std::fabs(z.imag()) > scale) others.push_back(cplx(std::fabs(z.real()) <= scale ? 0.0 : z.real(), z.imag()));
+        }
+        std::sort(others.begin(), others.end(), [](const cplx &a, const cplx &b) {
+            return a.real() != b.real() ? a.real() < b.real() : a.imag() < b.imag();
+        });
+        for (const cplx &z : others) out.push_back(makeComplex(z));
+        return makeList(std::move(out));
+    });
+    // {{unit, 1}, {factor, multiplicity}, ...}, the unit left out when it is 1
+    env.registerForm("polySqrFree", [](const call_node &c, runtime_env &env) -> valptr_t {
+        valptr_t unit;
+        auto factors = unaryArg(c, env, "polySqrFree").squareFree(unit);
+        std::vector<valptr_t> out;
+        const auto one = std::make_shared<integer>(1);
+        if (!unit->equals(*one)) out.push_back(makeList({unit, one}));
+        for (auto &[f, m] : factors) {
+            out.push_back(makeList({std::make_shared<polynomial>(std::move(f)), std::make_shared<integer>(static_cast<long long>(m))}));
+        }
+        return makeList(std::move(out));
+    });
+}
+
+} // namespace ti
@@ -0,0 +1,363 @@
+#include "../include/random.h"
+#include "../include/lists.h"
+#include "../include/runtimeenv.h"
+#include "../include/threadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TI_RANDOM_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace ti {
+
+namespace {
+
+// variates per parallel chunk
+constexpr size_t RANDOM_GRAIN = 16384;
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+constexpr int PHILOX_ROUNDS = 10;
+constexpr uint32_t PHILOX_M0 = 0xD2511F53;
+constexpr uint32_t PHILOX_M1 = 0xCD9E8D57;
+constexpr uint32_t PHILOX_W0 = 0x9E3779B9;
+constexpr uint32_t PHILOX_W1 = 0xBB67AE85;
+
+// the fourth counter word: separate streams for each kind of variate
+enum class domain : uint32_t { Uniform, Normal, Integer };
+
+// the round keys of a seed
+struct philox_key {
+    uint32_t k0[PHILOX_ROUNDS], k1[PHILOX_ROUNDS];
+
+    explicit philox_key(uint64_t seed) {
+        uint32_t a = static_cast<uint32_t>(seed), b = static_cast<uint32_t>(seed >> 32);
+        for (int r = 0; r < PHILOX_ROUNDS; ++r, a += PHILOX_W0, b += PHILOX_W1) {
+            k0[r] = a;
+            k1[r] = b;
+        }
+    }
+};
+
+void philox(const philox_key &k, uint32_t c[4]) {
+    for (int r = 0; r < PHILOX_ROUNDS; ++r) {
+        const uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * c[0];
+        const uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * c[2];
+        const uint32_t c0 = static_cast<uint32_t>(p1 >> 32) ^ c[1] ^ k.k0[r];
+        const uint32_t c2 = static_cast<uint32_t>(p0 >> 32) ^ c[3] ^ k.k1[r];
+        c[1] = static_cast<uint32_t>(p1);
+        c[3] = static_cast<uint32_t>(p0);
+        c[0] = c0;
+        c[2] = c2;
+    }
+}
+
+// the block for counter (index, attempt, d)
+void block(const philox_key &k, uint64_t index, uint32_t attempt, domain d, uint32_t w[4]) {
+    w[0] = static_cast<uint32_t>(index);
+    w[1] = static_cast<uint32_t>(index >> 32);
+    w[2] = attempt;
+    w[3] = static_cast<uint32_t>(d);
+    philox(k, w);
+}
+
+// (2m + 1) / 2^53 for the top 52 bits m of lo | hi << 32: strictly inside
+// (0, 1), and exactly what the SIMD path computes as 1.m - (1 - 2^-53)
+double unit(uint32_t lo, uint32_t hi) {
+    const uint64_t x = static_cast<uint64_t>(hi) << 32 | lo;
+    return static_cast<double>((x >> 12) * 2 + 1) * 0x1p-53;
+}
+
+// Uniform variates come two per block: the 8 positions 8g..8g+7 are the
+// halves of counters 4g..4g+3, position 8g + j being half j / 4 of counter
+// 4g + j % 4, so four counters fill two SIMD registers with no shuffling.
+double uniformAt(const philox_key &k, uint64_t p) {
+    const uint64_t g = p / 8, j = p % 8;
+    uint32_t w[4];
+    block(k, 4 * g + j % 4, 0, domain::Uniform, w);
+    return j < 4 ? unit(w[0], w[1]) : unit(w[2], w[3]);
+}
+
+#ifdef TI_RANDOM_AVX2
+
+// positions [8 first, 8 (first + groups)), four counters per pass
+__attribute__((target("avx2")))
+void uniformAvx2(const philox_key &k, uint64_t first, size_t groups, double* out) {
+    const __m256i m0 = _mm256_set1_epi64x(PHILOX_M0), m1 = _mm256_set1_epi64x(PHILOX_M1);
+    const __m256i low = _mm256_set1_epi64x(0xFFFFFFFF);
+    const __m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+    const __m256i one = _mm256_set1_epi64x(0x3FF0000000000000);
+    const __m256d bias = _mm256_set1_pd(1.0 - 0x1p-53);
+    for (size_t g = 0; g < groups; ++g) {
+        // each 64-bit lane holds one 32-bit word, so _mm256_mul_epu32 gives full products
+        const __m256i counter = _mm256_add_epi64(_mm256_set1_epi64x(static_cast<long long>(4 * (first + g))), lanes);
+        __m256i c0 = _mm256_and_si256(counter, low), c1 = _mm256_srli_epi64(counter, 32);
+        __m256i c2 = _mm256_setzero_si256(), c3 = _mm256_set1_epi64x(static_cast<uint32_t>(domain::Uniform));
+        for (int r = 0; r < PHILOX_ROUNDS; ++r) {
+            const __m256i p0 = _mm256_mul_epu32(c0, m0), p1 = _mm256_mul_epu32(c2, m1);
+            const __m256i n0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p1, 32), c1), _mm256_set1_epi64x(k.k0[r]));
+            const __m256i n2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p0, 32), c3), _mm256_set1_epi64x(k.k1[r]));
+            c1 = _mm256_and_si256(p1, low);
+            c3 = _mm256_and_si256(p0, low);
+            c0 = n0;
+            c2 = n2;
+        }
+        const __m256i x0 = _mm256_or_si256(c0, _mm256_slli_epi64(c1, 32));
+        const __m256i x1 = _mm256_or_si256(c2, _mm256_slli_epi64(c3, 32));
+        const __m256d u0 = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(x0, 12), one)), bias);
+        const __m256d u1 = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(x1, 12), one)), bias);
+        _mm256_storeu_pd(out + 8 * g, u0);
+        _mm256_storeu_pd(out + 8 * g + 4, u1);
+    }
+}
+
+bool haveAvx2() {
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+
+#endif // TI_RANDOM_AVX2
+
+// uniform variates for positions [p, p + n)
+void fillUniform(const philox_key &k, uint64_t p, double* out, size_t n) {
+    size_t i = 0;
+#ifdef TI_RANDOM_AVX2
+    if (haveAvx2()) {
+        for (; i < n && (p + i) % 8 != 0; ++i) out[i] = uniformAt(k, p + i);
+        const size_t groups = (n - i) / 8;
+        uniformAvx2(k, (p + i) / 8, groups, out + i);
+        i += 8 * groups;
+    }
+#endif
+    for (; i < n; ++i) out[i] = uniformAt(k, p + i);
+}
+
+// Marsaglia and Tsang's ziggurat with 128 layers, as laid out by Doornik
+// ("An improved ziggurat method to generate normal random samples"):
+// x[i] is the right edge of layer i, r[i] = x[i+1] / x[i] the part of it
+// wholly under the curve
+constexpr int ZIG_LAYERS = 128;
+constexpr double ZIG_R = 3.442619855899;
+constexpr double ZIG_V = 9.91256303526217e-3;
+
+struct ziggurat {
+    double x[ZIG_LAYERS + 1];
+    double r[ZIG_LAYERS];
+
+    ziggurat() {
+        double f = std::exp(-0.5 * ZIG_R * ZIG_R);
+        x[0] = ZIG_V / f; // the base layer's rectangle plus the tail
+        x[1] = ZIG_R;
+        x[ZIG_LAYERS] = 0;
+        for (int i = 2; i < ZIG_LAYERS; ++i) {
+            x[i] = std::sqrt(-2 * std::log(ZIG_V / x[i - 1] + f));
+            f = std::exp(-0.5 * x[i] * x[i]);
+        }
+        for (int i = 0; i < ZIG_LAYERS; ++i) r[i] = x[i + 1] / x[i];
+    }
+};
+
+const ziggurat &zigguratTables() {
+    static const ziggurat z;
+    return z;
+}
+
+// a standard normal variate; nearly always from the first block
+double normalAt(const philox_key &k, uint64_t p) {
+    const ziggurat &z = zigguratTables();
+    uint32_t w[4];
+    for (uint32_t attempt = 0;;) {
+        block(k, p, attempt++, domain::Normal, w);
+        const double u = 2 * unit(w[0], w[1]) - 1;
+        const unsigned i = w[2] & (ZIG_LAYERS - 1); // unit(w[2], w[3]) ignores these bits
+        if (std::fabs(u) < z.r[i]) return u * z.x[i];
+        if (i == 0) {
+            // beyond R, by Marsaglia's exponential rejection
+            double x, y;
+            do {
+                block(k, p, attempt++, domain::Normal, w);
+                x = std::log(unit(w[0], w[1])) / ZIG_R;
+                y = std::log(unit(w[2], w[3]));
+            } while (-2 * y < x * x);
+            return u < 0 ? x - ZIG_R : ZIG_R - x;
+        }
+        // the wedge between the layer's inner rectangle and the curve
+        const double x = u * z.x[i];
+        const double f0 = std::exp(-0.5 * (z.x[i] * z.x[i] - x * x));
+        const double f1 = std::exp(-0.5 * (z.x[i + 1] * z.x[i + 1] - x * x));
+        if (f1 + unit(w[2], w[3]) * (f0 - f1) < 1.0) return x;
+    }
+}
+
+// lo + a uniform integer below width (0 meaning 2^64), by Lemire's
+// multiply-and-reject, so every value is equally likely
+int64_t integerAt(const philox_key &k, uint64_t p, int64_t lo, uint64_t width) {
+    __extension__ typedef unsigned __int128 uint128;
+    uint32_t w[4];
+    for (uint32_t attempt = 0;; ++attempt) {
+        block(k, p, attempt, domain::Integer, w);
+        const uint64_t x = static_cast<uint64_t>(w[1]) << 32 | w[0];
+        if (width == 0) return static_cast<int64_t>(x);
+        const uint128 m = static_cast<uint128>(x) * width;
+        if (static_cast<uint64_t>(m) < width && static_cast<uint64_t>(m) < (0 - width) % width) continue;
+        return static_cast<int64_t>(static_cast<uint64_t>(lo) + static_cast<uint64_t>(m >> 64));
+    }
+}
+
+// takes n positions from s
+uint64_t advance(random_state &s, size_t n) {
+    const uint64_t p = s.position;
+    s.position += n;
+    return p;
+}
+
+// --- builtins ---
+
+// largest magnitude of a randInt bound: integers up to 2^53 are exact doubles
+constexpr long long MAX_RANDOM_INT = 1LL << 53;
+
+// an integer argument within [lo, hi]
+long long integerArg(const valptr_t &v, long long lo, long long hi, const char* name, const char* what) {
+    if (!v || v->kind() != value_kind::Integer) throw std::runtime_error(std::string(name) + ": " + what + " must be an integer");
+    const BigInt &i = static_cast<const integer &>(*v).getValue();
+    if (i < BigInt(lo) || i > BigInt(hi)) throw std::runtime_error(std::string(name) + ": " + what + " out of range");
+    return i.to_long_long();
+}
+
+// the number of values asked for
+size_t countArg(const valptr_t &v, const char* name) {
+    return static_cast<size_t>(integerArg(v, 1, std::numeric_limits<long long>::max(), name, "count"));
+}
+
+valptr_t randSeedBuiltin(const std::vector<valptr_t> &args, runtime_env &env) {
+    if (args.size() != 1) throw std::runtime_error("RandSeed expects (n)");
+    const long long seed = integerArg(args[0], std::numeric_limits<long long>::min(), std::numeric_limits<long long>::max(),
+                                      "RandSeed", "seed");
+    env.randomState() = random_state{static_cast<uint64_t>(seed), 0};
+    return none;
+}
+
+// rand() or rand(n)
+valptr_t randBuiltin(const std::vector<valptr_t> &args, runtime_env &env) {
+    if (args.size() > 1) throw std::runtime_error("rand expects ([n])");
+    const size_t n = args.empty() ? 1 : countArg(args[0], "rand");
+    std::vector<double> xs(n);
+    randomUniform(env.randomState(), xs.data(), n);
+    if (args.empty()) return std::make_shared<decimal>(xs[0]);
+    return std::make_shared<decimal_array>(std::move(xs));
+}
+
+// randInt(lo, hi[, n])
+valptr_t randIntBuiltin(const std::vector<valptr_t> &args, runtime_env &env) {
+    if (args.size() != 2 && args.size() != 3) throw std::runtime_error("randInt expects (lo, hi[, n])");
+    long long lo = integerArg(args[0], -MAX_RANDOM_INT, MAX_RANDOM_INT, "randInt", "bound");
+    long long hi = integerArg(args[1], -MAX_RANDOM_INT, MAX_RANDOM_INT, "randInt", "bound");
+    if (lo > hi) std::swap(lo, hi);
+    const size_t n = args.size() == 3 ? countArg(args[2], "randInt") : 1;
+    std::vector<int64_t> ks(n);
+    randomIntegers(env.randomState(), lo, hi, ks.data(), n);
+    if (args.size() == 2) return std::make_shared<integer>(static_cast<long long>(ks[0]));
+    return std::make_shared<decimal_array>(std::vector<double>(ks.begin(), ks.end()), true);
+}
+
+// randNorm(mean, sd[, n])
+valptr_t randNormBuiltin(const std::vector<valptr_t> &args, runtime_env &env) {
+    if (args.size() != 2 && args.size() != 3) throw std::runtime_error("randNorm expects (mean, sd[, n])");
+    if (!args[0] || !isNumeric(args[0]->kind()) || !args[1] || !isNumeric(args[1]->kind())) {
+        throw std::runtime_error("randNorm: mean and sd must be numbers");
+    }
+    const double mean = toDouble(*args[0]), sd = toDouble(*args[1]);
+    const size_t n = args.size() == 3 ? countArg(args[2], "randNorm") : 1;
+    std::vector<double> xs(n);
+    randomNormal(env.randomState(), xs.data(), n);
+    for (double &x : xs) x = mean + sd * x;
+    if (args.size() == 2) return std::make_shared<decimal>(xs[0]);
+    return std::make_shared<decimal_array>(std::move(xs));
+}
+
+// randSamp(list, n[, noRepl]): n elements picked at random, each time from
+// the whole list, or without replacement when noRepl is nonzero
+valptr_t randSampBuiltin(const std::vector<valptr_t> &args, runtime_env &env) {
+    if (args.size() != 2 && args.size() != 3) throw std::runtime_error("randSamp expects (list, n[, noRepl])");
+    const valptr_t &source = args[0];
+    const bool packed = source && source->kind() == value_kind::DecimalArray;
+    if (!packed && (!source || source->kind() != value_kind::List)) throw std::runtime_error("randSamp expects a list");
+    const size_t size = packed ? static_cast<const decimal_array &>(*source).size()
+                               : static_cast<const valuelist &>(*source).size();
+    if (size == 0) throw std::runtime_error("randSamp: empty list");
+    const size_t n = countArg(args[1], "randSamp");
+    const bool noRepl = args.size() == 3 && integerArg(args[2], 0, 1, "randSamp", "noRepl") != 0;
+
+    std::vector<size_t> picks(n);
+    random_state &s = env.randomState();
+    if (!noRepl) {
+        std::vector<int64_t> ks(n);
+        randomIntegers(s, 0, static_cast<int64_t>(size - 1), ks.data(), n);
+        std::copy(ks.begin(), ks.end(), picks.begin());
+    } else {
+        // the first n steps of a Fisher-Yates shuffle of the positions
+        if (n > size) throw std::runtime_error("randSamp: more picks than elements");
+        std::vector<size_t> order(size);
+        std::iota(order.begin(), order.end(), 0);
+        const philox_key k(s.seed);
+        const uint64_t p = advance(s, n);
+        for (size_t i = 0; i < n; ++i) {
+            const size_t j = i + static_cast<size_t>(integerAt(k, p + i, 0, size - i));
+            std::swap(order[i], order[j]);
+            picks[i] = order[i];
+        }
+    }
+
+    if (packed) {
+        const auto &a = static_cast<const decimal_array &>(*source);
+        std::vector<double> out(n);
+        for (size_t i = 0; i < n; ++i) out[i] = a.values()[picks[i]];
+        return std::make_shared<decimal_array>(std::move(out), a.isIntegral());
+    }
+    const auto &elems = static_cast<const valuelist &>(*source).elements();
+    std::vector<valptr_t> out(n);
+    for (size_t i = 0; i < n; ++i) out[i] = elems[picks[i]];
+    return std::make_shared<valuelist>(std::move(out));
+}
+
+} // namespace
+
+void randomUniform(random_state &s, double* out, size_t n) {
+    const philox_key k(s.seed);
+    const uint64_t p = advance(s, n);
+    parallelFor(n, RANDOM_GRAIN, [&](size_t begin, size_t end) { fillUniform(k, p + begin, out + begin, end - begin); });
+}
+
+void randomNormal(random_state &s, double* out, size_t n) {
+    const philox_key k(s.seed);
+    const uint64_t p = advance(s, n);
+    parallelFor(n, RANDOM_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) out[i] = normalAt(k, p + i);
+    });
+}
+
+void randomIntegers(random_state &s, int64_t lo, int64_t hi, int64_t* out, size_t n) {
+    if (lo > hi) throw std::logic_error("randomIntegers: empty range");
+    const philox_key k(s.seed);
+    const uint64_t p = advance(s, n);
+    const uint64_t width = static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo) + 1;
+    parallelFor(n, RANDOM_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) out[i] = integerAt(k, p + i, lo, width);
+    });
+}
+
+void register_random_builtins(runtime_env &env) {
+    // impure: each call moves the stream on
+    env.registerBuiltin("RandSeed", randSeedBuiltin);
+    env.registerBuiltin("rand", randBuiltin);
+    env.registerBuiltin("randInt", randIntBuiltin);
+    env.registerBuiltin("randNorm", randNormBuiltin);
+    env.registerBuiltin("randSamp", randSampBuiltin);
+}
+
+} // namespace ti
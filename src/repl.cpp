@@ -1,11 +1,131 @@
 // repl.cpp
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <future>
 #include <sstream>
+#include <stdexcept>
+#include <string_view>
 #include "../include/repl.h"
+#include "../include/complexnum.h"
+#include "../include/evaluator.h"
+#include "../include/optimizer.h"
 #include "../include/token.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define TI_REPL_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TI_REPL_TTY 1
+#endif
+
+namespace {
+
+// stdout buffer in batch mode, so results are written in large blocks
+constexpr size_t BATCH_BUFFER = 1 << 20;
+
+// how often the prompt thread looks at a running statement, and how long
+// one runs before its progress is shown
+constexpr auto PROGRESS_TICK = std::chrono::milliseconds(100);
+constexpr auto PROGRESS_DELAY = std::chrono::milliseconds(500);
+
+// the statement Ctrl-C cancels; null at the prompt, where Ctrl-C keeps
+// its default meaning and ends the program
+std::atomic<ti::eval_control*> interruptTarget{nullptr};
+
+void interrupt(int sig) {
+    if (ti::eval_control* c = interruptTarget.load()) {
+        c->cancel();
+    } else {
+        std::signal(sig, SIG_DFL);
+        std::raise(sig);
+    }
+}
+
+bool progressVisible() {
+#ifdef TI_REPL_TTY
+    return ::isatty(STDERR_FILENO);
+#else
+    return false;
+#endif
+}
+
+// A whole script, mapped into memory when it is a regular file, read in
+// large blocks otherwise (stdin, pipes); "-" is stdin.
+class script_text {
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    void* mapped = nullptr;
+    std::string owned;
+
+    void readAll(std::FILE* f) {
+        char block[1 << 16];
+        size_t n;
+        while ((n = std::fread(block, 1, sizeof block, f)) > 0) owned.append(block, n);
+        if (std::ferror(f)) throw std::runtime_error("read error");
+        data = owned.data();
+        size = owned.size();
+    }
+
+public:
+    explicit script_text(const std::string& path) {
+        if (path == "-") {
+            readAll(stdin);
+            return;
+        }
+#ifdef TI_REPL_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                ::madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+                mapped = p;
+                data = static_cast<const char*>(p);
+                size = static_cast<size_t>(st.st_size);
+                ::close(fd);
+                return;
+            }
+        }
+        ::close(fd);
+#endif
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) throw std::runtime_error("cannot open " + path);
+        try {
+            readAll(f);
+        } catch (...) {
+            std::fclose(f);
+            throw;
+        }
+        std::fclose(f);
+    }
+
+    ~script_text() {
+#ifdef TI_REPL_MMAP
+        if (mapped) ::munmap(mapped, size);
+#endif
+    }
+
+    script_text(const script_text&) = delete;
+    script_text& operator=(const script_text&) = delete;
+
+    std::string_view text() const { return std::string_view(data, size); }
+};
+
+} // namespace
+
+ti::repl::repl() {
+    register_default_builtins(env);
+}
+
 std::string ti::repl::input(const std::string& prompt) {
     
 
@@ -16,11 +136,9 @@ std::string ti::repl::input(const std::string& prompt) {
     if (!std::getline(std::cin, str)) return std::string();
     fullInput = str;
 
-    std::string trimmed = tk::trim(str);
-    std::vector<std::string> stack;
-    int consecutiveEmpty = trimmed.empty() ? 1 : 0;
-    stack = tk::recompute_stack(fullInput);
-    bool multiline = !stack.empty() || tk::is_continue_only(trimmed);
+    // block state is carried line to line, so the buffer is never re-scanned
+    tk::statement_splitter statement;
+    bool multiline = !statement.feed(str);
 
     while (multiline) {
         std::string cont = "... ";
@@ -34,34 +152,7 @@ std::string ti::repl::input(const std::string& prompt) {
         if (!std::getline(std::cin, str)) break;
         fullInput += "\n";
         fullInput += str;
-        trimmed = tk::trim(str);
-
-        if (trimmed.empty()) {
-            consecutiveEmpty++;
-            if (consecutiveEmpty >= 2) {
-                break;
-            }
-        } else {
-            consecutiveEmpty = 0;
-        }
-
-        // recompute stack from full input and decide
-        stack = tk::recompute_stack(fullInput);
-        std::string lastNonEmpty;
-        size_t p = fullInput.find_last_not_of('\n');
-        if (p == std::string::npos) lastNonEmpty = std::string();
-        else {
-            size_t lineStart = fullInput.find_last_of('\n', p);
-            if (lineStart == std::string::npos) lastNonEmpty = tk::trim(fullInput);
-            else lastNonEmpty = tk::trim(fullInput.substr(lineStart + 1));
-        }
-        // if stack empty and last non-empty line does not request continuation, break immediately
-        if (stack.empty() && !tk::is_continue_only(lastNonEmpty)) {
-            break;
-        }
-        multiline = true;
-
-        // if no stack and last line not continue-only, we'll exit loop naturally
+        multiline = !statement.feed(str);
     }
 
     tk::trim_trailing_empty(fullInput);
@@ -71,21 +162,78 @@ std::string ti::repl::input(const std::string& prompt) {
 
 // TI Nspire uses 'expr' for eval/exec
 ti::cmdres ti::repl::expr(const std::string& code) {
-    std::vector<std::string> tokens = tk::tokenize(code);
-    // TODO: implement
-    
-    int exitcode;
-    std::stringstream out;
-
-    // test tokenization => good
-    // std::stringstream out;
-    // for (const auto& str : tokens) {
-    //     out << str << ", ";
-    // }
-    return ti::cmdres(0, out.str());
+    // the value of the last statement is the result
+    std::string out;
+    try {
+        for (ti::statement& s : ti::parse(code, env)) out = execute(s);
+    } catch (const limit_exceeded&) {
+        throw;
+    } catch (const std::exception& e) {
+        return ti::cmdres(1, std::string("Error: ") + e.what());
+    }
+    return ti::cmdres(0, out);
+}
+
+std::string ti::repl::execute(ti::statement& s) {
+    refreshFunctions();
+    if (s.definition) {
+        const function* existing = env.getFunction(s.name);
+        if (existing && existing->isBuiltin) throw std::runtime_error("cannot redefine builtin " + s.name);
+        std::shared_ptr<const ast::exprnode> source(ast::clone(*s.body));
+        function fn(s.params, ti::optimize(std::move(s.body), env));
+        fn.source = std::move(source);
+        env.defineFunction(s.name, fn);
+        return none->toString();
+    }
+    const std::unique_ptr<ast::exprnode> tree = ti::optimize(std::move(s.body), env);
+    const valptr_t v = evaluator(env).run(*tree);
+    if (!v) return std::string(); // a function with no body
+    if (env.getComplexFormat() == complex_format::Polar &&
+        (v->kind() == value_kind::Complex || v->kind() == value_kind::ComplexArray)) {
+        return polarString(*v);
+    }
+    return v->toString();
+}
+
+ti::cmdres ti::repl::evaluate(const std::string& code, const std::shared_ptr<eval_control>& control) {
+    eval_budget budget = eval_budget::starting(timeBudget, 0, stepBudget);
+    budget.control = control;
+    env.setBudget(budget);
+    // kernels outside the evaluator (BigInt, parallel builtins) check it too
+    budget_scope scope(&env.getBudget());
+    try {
+        ti::cmdres res = this->expr(code);
+        env.setBudget(eval_budget());
+        return res;
+    } catch (const limit_exceeded& e) {
+        env.setBudget(eval_budget());
+        return ti::cmdres(1, std::string("Error: ") + e.what());
+    } catch (...) {
+        env.setBudget(eval_budget());
+        throw;
+    }
+}
+
+void ti::repl::refreshFunctions() {
+    // between statements no function body is running, so replacing them
+    // is safe here
+    if (env.getMode() == functionMode) return;
+    functionMode = env.getMode();
+    std::vector<std::pair<std::string, function>> refreshed;
+    for (const auto &[name, fn] : env.functionTable()) {
+        if (!fn.source) continue;
+        function copy = fn;
+        copy.body = ti::optimize(ast::clone(*fn.source), env);
+        refreshed.emplace_back(name, std::move(copy));
+    }
+    for (const auto &[name, fn] : refreshed) env.defineFunction(name, fn);
 }
 
 void ti::repl::run() {
+    using clock = std::chrono::steady_clock;
+    auto previous = std::signal(SIGINT, interrupt);
+    const bool progress = progressVisible();
+    static const char SPINNER[] = "|/-\\";
     while (true) {
         std::string input = this->input("ti> ");
         if (input == "exit") {
@@ -95,10 +243,88 @@ void ti::repl::run() {
             std::cout << col::CLEAR << col::RESET << std::endl;
             continue;
         }
-        ti::cmdres res = this->expr(input);
-        if (res.exitcode != 0) {
-            std::cout << col::red;
+
+        // the statement runs on its own thread; this one waits in short
+        // slices so it can draw progress while Ctrl-C cancels the statement
+        auto control = std::make_shared<eval_control>();
+        const auto start = clock::now();
+        std::future<ti::cmdres> pending =
+            std::async(std::launch::async, [this, &input, &control] { return this->evaluate(input, control); });
+        interruptTarget = control.get();
+        bool shown = false;
+        for (size_t tick = 0; pending.wait_for(PROGRESS_TICK) != std::future_status::ready; ++tick) {
+            const auto elapsed = clock::now() - start;
+            if (!progress || elapsed < PROGRESS_DELAY) continue;
+            std::fprintf(stderr, "\r%c %.1fs, %llu steps%s\033[K", SPINNER[tick % 4],
+                         std::chrono::duration<double>(elapsed).count(), control->steps.load(std::memory_order_relaxed),
+                         control->cancelled ? ", interrupting" : " (Ctrl-C to interrupt)");
+            std::fflush(stderr);
+            shown = true;
+        }
+        interruptTarget = nullptr;
+        if (shown) std::fputs("\r\033[K", stderr);
+
+        try {
+            ti::cmdres res = pending.get();
+            if (res.exitcode != 0) {
+                std::cout << col::red;
+            }
+            std::cout << res.output << col::RESET << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << col::red << "Error: " << e.what() << col::RESET << std::endl;
+        }
+    }
+    std::signal(SIGINT, previous);
+}
+
+int ti::repl::runBatch(const std::string& path) {
+    // before any output: stdout is then written in large blocks, and
+    // anything printed through std::cout (synced with stdio) stays in order
+    std::setvbuf(stdout, nullptr, _IOFBF, BATCH_BUFFER);
+    try {
+        script_text script(path);
+        const std::string_view text = script.text();
+
+        int status = 0;
+        std::string statement;
+        std::string line;
+        tk::statement_splitter splitter;
+        // one pass: each line is split off, fed to the block tracker and
+        // appended to its statement exactly once
+        for (size_t pos = 0; pos < text.size();) {
+            size_t next = text.find('\n', pos);
+            if (next == std::string_view::npos) next = text.size();
+            line.assign(text.data() + pos, next - pos);
+            pos = next + 1;
+
+            if (splitter.lines != 0) statement += '\n';
+            statement += line;
+            if (!splitter.feed(line) && pos < text.size()) continue;
+
+            tk::trim_trailing_empty(statement);
+            splitter = tk::statement_splitter();
+            if (statement.empty()) continue;
+            if (statement == "exit") break;
+            if (statement != "clear") {
+                try {
+                    ti::cmdres res = this->evaluate(statement, nullptr);
+                    if (res.exitcode != 0) status = 1;
+                    if (!res.output.empty()) {
+                        std::fwrite(res.output.data(), 1, res.output.size(), stdout);
+                        std::fputc('\n', stdout);
+                    }
+                } catch (const std::exception& e) {
+                    status = 1;
+                    std::fprintf(stdout, "Error: %s\n", e.what());
+                }
+            }
+            statement.clear();
         }
-        std::cout << res.output << col::RESET << std::endl;
+        if (std::fflush(stdout) != 0) return 2;
+        return status;
+    } catch (const std::exception& e) {
+        std::fflush(stdout);
+        std::fprintf(stderr, "%s\n", e.what());
+        return 2;
     }
-}
\ No newline at end of file
+}
@@ -1,24 +1,112 @@
 #include "../include/runtimeenv.h"
+#include "../include/arith.h"
+#include "../include/complexnum.h"
+#include "../include/constants.h"
+#include "../include/evaluator.h"
+#include "../include/lists.h"
+#include "../include/ntheory.h"
+#include "../include/ode.h"
+#include "../include/poly.h"
+#include "../include/sequence.h"
+#include "../include/snapshot.h"
+#include "../include/symbolic.h"
+#include "../include/threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <stdexcept>
 #include <iostream>
 #include <string>
 
 namespace ti {
 
+namespace {
+
+// elements per parallel chunk of a numeric builtin over a decimal_array
+constexpr size_t ARRAY_GRAIN = 16384;
+
+} // namespace
+
+size_t runtime_env::freshVersion() {
+    static std::atomic<size_t> counter{0};
+    return ++counter;
+}
+
+slot* runtime_env::findLocal(const std::string &name) {
+    if (frames.empty()) return nullptr;
+    // scan only the innermost frame; frames are small, so this beats hashing
+    for (size_t i = slots.size(); i > frames.back().base; --i) {
+        if (slots[i - 1].name == name) return &slots[i - 1];
+    }
+    return nullptr;
+}
+
+const slot* runtime_env::findLocal(const std::string &name) const {
+    return const_cast<runtime_env*>(this)->findLocal(name);
+}
+
 valptr_t runtime_env::getVariable(const std::string &name) const {
+    if (const slot* s = findLocal(name)) return s->value ? s->value : makeSymbol(name);
     auto it = variables.find(name);
-    if (it == variables.end()) {
-        throw std::runtime_error("undefined variable: " + name);
-    }
+    if (it == variables.end()) return makeSymbol(name);
     return it->second;
 }
 
+valptr_t runtime_env::lookupVariable(const std::string &name) const {
+    if (const slot* s = findLocal(name)) return s->value;
+    auto it = variables.find(name);
+    return it == variables.end() ? valptr_t() : it->second;
+}
+
+void runtime_env::unsetVariable(const std::string &name) {
+    if (slot* s = findLocal(name)) {
+        s->value.reset();
+        return;
+    }
+    variables.erase(name);
+}
+
 void runtime_env::setVariable(const std::string &name, const valptr_t &value) {
+    if (slot* s = findLocal(name)) {
+        s->value = value;
+        return;
+    }
     variables[name] = value;
 }
 
+void runtime_env::declareLocal(const std::string &name) {
+    if (frames.empty()) throw std::runtime_error("Local is only valid inside a function or program");
+    if (findLocal(name)) return;
+    slots.push_back(slot{name, valptr_t()});
+}
+
+void runtime_env::pushFrame(const function &fn, const std::vector<valptr_t> &args) {
+    if (frames.size() >= maxCallDepth) {
+        throw std::runtime_error("call stack overflow: recursion deeper than " + std::to_string(maxCallDepth));
+    }
+    frames.push_back(callframe{&fn, slots.size(), tempBases.size()});
+    for (size_t i = 0; i < fn.params.size() && i < args.size(); ++i) {
+        slots.push_back(slot{fn.params[i], args[i]});
+    }
+}
+
+void runtime_env::popFrame() {
+    if (frames.empty()) return;
+    slots.resize(frames.back().base);
+    frames.pop_back();
+}
+
 void runtime_env::defineFunction(const std::string &name, const function &fn) {
     functions[name] = fn;
+    functionVersion = freshVersion();
+    // cached results may depend on the old definition
+    memo.clear();
+}
+
+void runtime_env::undefineFunction(const std::string &name) {
+    if (functions.erase(name) == 0) return;
+    functionVersion = freshVersion();
+    memo.clear();
 }
 
 bool runtime_env::hasFunction(const std::string &name) const {
@@ -31,46 +119,355 @@ function* runtime_env::getFunction(const std::string &name) {
     return &it->second;
 }
 
+void runtime_env::pushTemps(size_t count) {
+    tempBases.push_back(temps.size());
+    temps.resize(temps.size() + count);
+}
+
+void runtime_env::popTemps() {
+    if (tempBases.empty()) return;
+    temps.resize(tempBases.back());
+    tempBases.pop_back();
+}
+
+valptr_t &runtime_env::temp(size_t depth, size_t index) {
+    size_t group = (frames.empty() ? 0 : frames.back().tempBase) + depth;
+    return temps[tempBases[group] + index];
+}
+
 valptr_t runtime_env::callFunction(const std::string &name, const std::vector<valptr_t> &args) {
     auto it = functions.find(name);
     if (it == functions.end()) {
         throw std::runtime_error("undefined function: " + name);
     }
-    function &fn = it->second;
+    return callFunction(it->second, args);
+}
+
+valptr_t runtime_env::callFunction(const function &fn, const std::vector<valptr_t> &args) {
     if (fn.isBuiltin) {
-        return fn.builtinImpl(args, *this);
+        if (std::none_of(args.begin(), args.end(), [](const valptr_t &a) { return a && a->kind() == value_kind::LazySeq; })) {
+            return fn.builtinImpl(args, *this);
+        }
+        std::vector<valptr_t> given(args);
+        materializeArgs(given);
+        return fn.builtinImpl(given, *this);
     } else {
-        // very simple user function handling:
-        // - bind positional params to local variables (no local stack implemented here)
-        // - evaluate body (the body must be an ast::exprnode)
-        // NOTE: for a robust interpreter you should create scoped callframes, but keep it simple here.
-        if (fn.body == nullptr) return valptr_t(); // null
-        // create a temporary env copy for function call (simple lexical isolation)
-        runtime_env local = *this; // shallow copy of variables and functions
-        for (size_t i = 0; i < fn.params.size() && i < args.size(); ++i) {
-            local.setVariable(fn.params[i], args[i]);
+        // run the body on the evaluator's heap stack so deep recursion
+        // does not grow the native stack
+        return evaluator(*this).call(fn, args);
+    }
+}
+
+void runtime_env::registerBuiltin(const std::string &name, std::function<valptr_t(const std::vector<valptr_t>&, runtime_env&)> impl,
+                                  bool pure) {
+    function fn(std::move(impl));
+    fn.pure = pure;
+    defineFunction(name, fn);
+}
+
+size_t runtime_env::getMaxThreads() const {
+    return thread_pool::shared().getMaxThreads();
+}
+
+void runtime_env::setMaxThreads(size_t n) {
+    thread_pool::shared().setMaxThreads(n);
+}
+
+void runtime_env::setBudget(const eval_budget &b) {
+    budget = b;
+    budgeted = b.limited();
+    budgetSteps = 0;
+}
+
+void runtime_env::spendSteps(unsigned long long n) {
+    const unsigned long long before = budgetSteps;
+    budgetSteps += n;
+    if (eval_control* c = budget.control.get()) {
+        // a relaxed load and store: cheap enough for every step, so an
+        // interrupt lands within one loop iteration
+        c->steps.store(budgetSteps, std::memory_order_relaxed);
+        if (c->cancelled.load(std::memory_order_relaxed)) throw limit_exceeded(budget_kind::Cancelled, "interrupted");
+    }
+    if (budget.stepLimit > 0 && budgetSteps > budget.stepLimit) {
+        throw limit_exceeded(budget_kind::Steps, "step limit exceeded");
+    }
+    if (budgetSteps / BUDGET_INTERVAL != before / BUDGET_INTERVAL) budget.check();
+}
+
+void runtime_env::registerNumericBuiltin(const std::string &name, double (*impl)(double)) {
+    function fn([impl, name](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
+        if (args.size() != 1 || !args[0]) throw std::runtime_error(name + " expects one number");
+        const bool complexResults = env.getComplexFormat() != complex_format::Real;
+        const bool exact = env.getMode() == calc_mode::Exact;
+        auto apply = [impl, &name, complexResults, exact](const valptr_t &arg) -> valptr_t {
+            valptr_t x = arg;
+            if (x && x->kind() == value_kind::Symbolic) {
+                // sin(π) is a number unless the mode keeps it exact
+                valptr_t c = exact ? nullptr : symConstantValue(static_cast<const symbolic &>(*x));
+                if (!c) return symCall(name, x);
+                x = std::move(c);
+            }
+            if (x && x->kind() == value_kind::Complex) {
+                if (valptr_t z = complexCall(name, *x)) return z;
+                throw std::runtime_error(name + " expects a real number");
+            }
+            if (!x || !isNumeric(x->kind())) throw std::runtime_error(name + " expects one number");
+            const double y = impl(toDouble(*x));
+            // ln(-1) has no real value, but a complex one
+            if (std::isnan(y) && complexResults) {
+                if (valptr_t z = complexCall(name, *x)) return z;
+            }
+            return std::make_shared<decimal>(y);
+        };
+        if (args[0]->kind() == value_kind::ComplexArray) {
+            if (valptr_t z = complexCall(name, *args[0])) return z;
+            throw std::runtime_error(name + " expects a real number");
+        }
+        if (args[0]->kind() == value_kind::DecimalArray) {
+            // straight over the doubles; boxed only if a complex result may be due
+            const auto &a = static_cast<const decimal_array &>(*args[0]);
+            std::vector<double> ys(a.size());
+            parallelFor(ys.size(), ARRAY_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) ys[i] = impl(a.values()[i]);
+            });
+            if (!complexResults || std::none_of(ys.begin(), ys.end(), [](double y) { return std::isnan(y); })) {
+                return std::make_shared<decimal_array>(std::move(ys));
+            }
+            return mapList(static_cast<const valuelist &>(*a.boxed()), apply);
+        }
+        if (args[0]->kind() == value_kind::List) return mapList(static_cast<const valuelist &>(*args[0]), apply);
+        return apply(args[0]);
+    });
+    fn.pure = true;
+    fn.numericImpl = impl;
+    defineFunction(name, fn);
+}
+
+void runtime_env::registerForm(const std::string &name, std::function<valptr_t(const ast::call_node&, runtime_env&)> impl,
+                               bool pure) {
+    function fn([name](const std::vector<valptr_t> & /*args*/, runtime_env & /*env*/) -> valptr_t {
+        throw std::runtime_error(name + " cannot be called with evaluated arguments");
+    });
+    fn.formImpl = std::move(impl);
+    fn.pure = pure;
+    defineFunction(name, fn);
+}
+
+const std::string &formVariable(const ast::call_node &c, size_t index, const char* form) {
+    if (c.args[index]->kind() != ast::node_kind::Var) {
+        throw std::runtime_error(std::string(form) + ": argument " + std::to_string(index + 1) + " must be a variable name");
+    }
+    return static_cast<const ast::var_node &>(*c.args[index]).name;
+}
+
+scoped_variable::scoped_variable(runtime_env &env, std::string name)
+    : env(env), name(std::move(name)), saved(env.lookupVariable(this->name)) {}
+
+scoped_variable::~scoped_variable() {
+    if (saved) env.setVariable(name, saved);
+    else env.unsetVariable(name);
+}
+
+bool runtime_env::shouldMemoize(const function &fn) {
+    if (fn.isBuiltin || memoPolicy == memo_policy::Off) return false;
+    if (fn.memoize) return true;
+    return memoPolicy == memo_policy::Auto && isPureFunction(fn, *this);
+}
+
+namespace {
+
+valptr_t absValue(const valptr_t &x, calc_mode mode) {
+    switch (x ? x->kind() : value_kind::Other) {
+        case value_kind::Complex:
+        case value_kind::ComplexArray:
+            return complexAbs(*x, mode);
+        case value_kind::Integer:
+            return std::make_shared<integer>(static_cast<const integer &>(*x).getValue().abs());
+        case value_kind::Fraction: {
+            auto [num, den] = static_cast<const fraction &>(*x).toTuple();
+            return makeRational(num.abs(), den.abs());
         }
-        // evaluate
-        ast::exprnode* expr = dynamic_cast<ast::exprnode*>(fn.body.get());
-        if (!expr) return valptr_t();
-        return expr->eval(local);
+        case value_kind::Decimal:
+            return std::make_shared<decimal>(std::fabs(static_cast<const decimal &>(*x).getValue()));
+        default:
+            throw std::runtime_error("abs expects one number");
     }
 }
 
-void runtime_env::registerBuiltin(const std::string &name, std::function<valptr_t(const std::vector<valptr_t>&, runtime_env&)> impl) {
-    functions[name] = function(std::move(impl));
+// a mode setMode and getMode know, by TI's name for it; setting k (from 1,
+// as TI numbers them) is settings[k - 1]
+struct mode_entry {
+    const char* name;
+    std::vector<const char*> settings;
+    size_t (*get)(const runtime_env &env);
+    void (*set)(runtime_env &env, size_t index);
+};
+
+const mode_entry MODES[] = {
+    {"Auto or Approx", {"Auto", "Approximate", "Exact"},
+     [](const runtime_env &env) -> size_t {
+         switch (env.getMode()) {
+             case calc_mode::Auto: return 0;
+             case calc_mode::Approximate: return 1;
+             default: return 2;
+         }
+     },
+     [](runtime_env &env, size_t index) {
+         env.setMode(index == 0 ? calc_mode::Auto : index == 1 ? calc_mode::Approximate : calc_mode::Exact);
+     }},
+    {"Real or Complex Format", {"Real", "Rectangular", "Polar"},
+     [](const runtime_env &env) { return static_cast<size_t>(env.getComplexFormat()); },
+     [](runtime_env &env, size_t index) { env.setComplexFormat(static_cast<complex_format>(index)); }},
+    // not a TI mode: which user functions have their results cached
+    {"Memoize", {"Off", "Opt-in", "Auto"},
+     [](const runtime_env &env) { return static_cast<size_t>(env.getMemoPolicy()); },
+     [](runtime_env &env, size_t index) { env.setMemoPolicy(static_cast<memo_policy>(index)); }},
+    // not a TI mode: whether numeric user functions run as native code (--jit)
+    {"Compile", {"Off", "On"},
+     [](const runtime_env &env) -> size_t { return env.getJitEnabled(); },
+     [](runtime_env &env, size_t index) { env.setJitEnabled(index == 1); }},
+};
+
+// "a", "b", "c" for error messages
+std::string quotedList(const std::vector<const char*> &names) {
+    std::string out;
+    for (const char* name : names) out += std::string(out.empty() ? "\"" : ", \"") + name + "\"";
+    return out;
 }
 
-// register a simple 'disp' builtin example
+const mode_entry &findMode(const valptr_t &name, const char* fn) {
+    std::vector<const char*> names;
+    for (const mode_entry &m : MODES) {
+        if (name && name->kind() == value_kind::String && static_cast<const string &>(*name).getValue() == m.name) return m;
+        names.push_back(m.name);
+    }
+    throw std::runtime_error(std::string(fn) + ": the mode must be one of " + quotedList(names));
+}
+
+} // namespace
+
 void register_default_builtins(runtime_env &env) {
-    env.registerBuiltin("disp", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+    env.registerBuiltin("disp", [](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
         for (auto &a : args) {
-            if (a) std::cout << a->toString() << " ";
+            if (a && env.getComplexFormat() == complex_format::Polar &&
+                (a->kind() == value_kind::Complex || a->kind() == value_kind::ComplexArray)) {
+                std::cout << polarString(*a) << " ";
+            } else if (a) std::cout << a->toString() << " ";
             else std::cout << "<null> ";
         }
         std::cout << std::endl;
-        return valptr_t(); // or return none if you have one
+        return none;
     });
+
+    // and, or, xor and not, which the parser turns into calls; both
+    // operands are always evaluated
+    env.registerBuiltin("and", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        return std::make_shared<boolean>(isTrue(args.at(0)) && isTrue(args.at(1)));
+    }, true);
+    env.registerBuiltin("or", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        return std::make_shared<boolean>(isTrue(args.at(0)) || isTrue(args.at(1)));
+    }, true);
+    env.registerBuiltin("xor", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        return std::make_shared<boolean>(isTrue(args.at(0)) != isTrue(args.at(1)));
+    }, true);
+    env.registerBuiltin("not", [](const std::vector<valptr_t> &args, runtime_env & /*env*/) -> valptr_t {
+        return std::make_shared<boolean>(!isTrue(args.at(0)));
+    }, true);
+
+    // setMode(name, setting) changes a mode and returns its previous
+    // setting; getMode(name) returns the current one
+    env.registerBuiltin("setMode", [](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
+        if (args.size() != 2) throw std::runtime_error("setMode expects (mode, setting)");
+        const mode_entry &m = findMode(args[0], "setMode");
+        const std::string setting = args[1] && args[1]->kind() == value_kind::String
+            ? static_cast<const string &>(*args[1]).getValue() : "";
+        for (size_t i = 0; i < m.settings.size(); ++i) {
+            if (setting != m.settings[i]) continue;
+            const size_t previous = m.get(env);
+            m.set(env, i);
+            return std::make_shared<string>(m.settings[previous]);
+        }
+        throw std::runtime_error(std::string("setMode: ") + m.name + " must be one of " + quotedList(m.settings));
+    });
+    env.registerBuiltin("getMode", [](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
+        if (args.size() != 1) throw std::runtime_error("getMode expects (mode)");
+        const mode_entry &m = findMode(args[0], "getMode");
+        return std::make_shared<string>(m.settings[m.get(env)]);
+    });
+
+    register_list_builtins(env);
+    register_memo_builtins(env);
+    register_numeric_builtins(env);
+    register_ode_builtins(env);
+    register_poly_builtins(env);
+    register_symbolic_builtins(env);
+    register_constant_builtins(env);
+    register_ntheory_builtins(env);
+    register_sequence_builtins(env);
+    register_complex_builtins(env);
+    register_random_builtins(env);
+    register_snapshot_builtins(env);
+
+    // the <cmath> overloads are ambiguous as pointers; pick the double ones
+    using unary = double (*)(double);
+    env.registerNumericBuiltin("sin", static_cast<unary>(std::sin));
+    env.registerNumericBuiltin("cos", static_cast<unary>(std::cos));
+    env.registerNumericBuiltin("tan", static_cast<unary>(std::tan));
+    env.registerNumericBuiltin("arcsin", static_cast<unary>(std::asin));
+    env.registerNumericBuiltin("arccos", static_cast<unary>(std::acos));
+    env.registerNumericBuiltin("arctan", static_cast<unary>(std::atan));
+    env.registerNumericBuiltin("sinh", static_cast<unary>(std::sinh));
+    env.registerNumericBuiltin("cosh", static_cast<unary>(std::cosh));
+    env.registerNumericBuiltin("tanh", static_cast<unary>(std::tanh));
+    env.registerNumericBuiltin("exp", static_cast<unary>(std::exp));
+    env.registerNumericBuiltin("ln", static_cast<unary>(std::log));
+    env.registerNumericBuiltin("log", static_cast<unary>(std::log10));
+    env.registerNumericBuiltin("sqrt", static_cast<unary>(std::sqrt));
+
+    // abs keeps exact values exact; compiled code only sees decimals
+    env.registerNumericBuiltin("abs", static_cast<unary>(std::fabs));
+    function* abs = env.getFunction("abs");
+    abs->builtinImpl = [](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
+        if (args.size() != 1 || !args[0]) throw std::runtime_error("abs expects one number");
+        const calc_mode mode = env.getMode();
+        auto apply = [mode](const valptr_t &x) { return absValue(x, mode); };
+        if (args[0]->kind() == value_kind::DecimalArray) {
+            const auto &a = static_cast<const decimal_array &>(*args[0]);
+            std::vector<double> ys(a.size());
+            std::transform(a.values().begin(), a.values().end(), ys.begin(), [](double x) { return std::fabs(x); });
+            return std::make_shared<decimal_array>(std::move(ys), a.isIntegral());
+        }
+        if (args[0]->kind() == value_kind::List) return mapList(static_cast<const valuelist &>(*args[0]), apply);
+        return apply(args[0]);
+    };
+
+    // sqrt keeps perfect squares exact, and in Exact mode other exact
+    // numbers as radicals; outside Real format sqrt(-4) is 2i
+    function* sqrt = env.getFunction("sqrt");
+    sqrt->builtinImpl = [](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
+        if (args.size() != 1 || !args[0]) throw std::runtime_error("sqrt expects one number");
+        auto apply = [&env](valptr_t x) -> valptr_t {
+            if (x && x->kind() == value_kind::Symbolic) {
+                valptr_t c = env.getMode() == calc_mode::Exact ? nullptr : symConstantValue(static_cast<const symbolic &>(*x));
+                if (!c) return symCall("sqrt", x);
+                x = std::move(c);
+            }
+            if (x && x->kind() == value_kind::Complex) return complexCall("sqrt", *x);
+            if (!x || !isNumeric(x->kind())) throw std::runtime_error("sqrt expects one number");
+            if (valptr_t exact = rootValue(x, 2, env.getMode())) return exact;
+            if (env.getComplexFormat() != complex_format::Real && toDouble(*x) < 0) {
+                const valptr_t negated = applyBinary(ast::binary_op::Sub, std::make_shared<integer>(0), x);
+                valptr_t root = rootValue(negated, 2, calc_mode::Auto);
+                if (root) return makeComplex(std::make_shared<integer>(0), root);
+                return complexCall("sqrt", *x);
+            }
+            return std::make_shared<decimal>(std::sqrt(toDouble(*x)));
+        };
+        if (args[0]->kind() == value_kind::ComplexArray) return complexCall("sqrt", *args[0]);
+        const valptr_t arg = asList(args[0]);
+        if (arg->kind() == value_kind::List) return mapList(static_cast<const valuelist &>(*arg), apply);
+        return apply(args[0]);
+    };
 }
 
 } // namespace ti
@@ -0,0 +1,404 @@
+#include "../include/sequence.h"
+#include "../include/arith.h"
+#include "../include/evaluator.h"
+#include "../include/lists.h"
+#include "../include/memo.h"
+#include "../include/poly.h"
+#include "../include/symbolic.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace ti {
+
+using namespace ast;
+
+namespace {
+
+// terms past the table from which a linear recurrence jumps instead of
+// filling the gap one term at a time
+constexpr size_t JUMP_DISTANCE = 64;
+// integer recurrences up to this order jump with schoolbook products
+constexpr size_t SCHOOLBOOK_ORDER = 8;
+
+bool isExact(const valptr_t &v) {
+    return v && (v->kind() == value_kind::Integer || v->kind() == value_kind::Fraction);
+}
+
+long long indexArg(const valptr_t &v, const std::string &name) {
+    if (!v || v->kind() != value_kind::Integer) throw std::runtime_error(name + ": index must be an integer");
+    const BigInt &i = static_cast<const integer &>(*v).getValue();
+    if (i < BigInt(std::numeric_limits<long long>::min() / 2) || i > BigInt(std::numeric_limits<long long>::max() / 2)) {
+        throw std::runtime_error(name + ": index out of range");
+    }
+    return i.to_long_long();
+}
+
+// the elements of a list (or decimal_array) argument
+std::vector<valptr_t> listArg(const valptr_t &given, const char* form, const char* what) {
+    const valptr_t v = asList(given);
+    if (!v || v->kind() != value_kind::List) throw std::runtime_error(std::string(form) + ": " + what + " must be a list");
+    return static_cast<const valuelist &>(*v).elements();
+}
+
+// k for `var - k` with a literal integer k >= 1, else 0
+size_t lagOf(const exprnode &n, const std::string &var) {
+    if (n.kind() != node_kind::BinaryOp) return 0;
+    auto &b = static_cast<const binary_op_node &>(n);
+    if (b.op != binary_op::Sub || b.left->kind() != node_kind::Var || b.right->kind() != node_kind::Literal) return 0;
+    if (static_cast<const var_node &>(*b.left).name != var) return 0;
+    const valptr_t &k = static_cast<const literal_node &>(*b.right).val;
+    if (!k || k->kind() != value_kind::Integer) return 0;
+    const BigInt &lag = static_cast<const integer &>(*k).getValue();
+    if (lag < BigInt(1) || lag > BigInt(1 << 16)) return 0;
+    return static_cast<size_t>(lag.to_long_long());
+}
+
+struct rule_shape {
+    bool selfRef = false;
+    bool lagsOnly = true; // var appears only as the index of name(var - k)
+    size_t order = 0;
+};
+
+void inspectRule(const exprnode &n, const std::string &name, const std::string &var, rule_shape &s) {
+    if (n.kind() == node_kind::Call) {
+        auto &c = static_cast<const call_node &>(n);
+        if (c.callee->kind() == node_kind::Var && static_cast<const var_node &>(*c.callee).name == name) {
+            s.selfRef = true;
+            const size_t lag = c.args.size() == 1 ? lagOf(*c.args[0], var) : 0;
+            if (lag == 0) s.lagsOnly = false;
+            s.order = std::max(s.order, lag);
+            return;
+        }
+    }
+    if (n.kind() == node_kind::Var && static_cast<const var_node &>(n).name == var) s.lagsOnly = false;
+    for (auto* child : children(n)) inspectRule(**child, name, var, s);
+}
+
+// The coefficients, lowest first, of x^n mod x^D - a_1 x^(D-1) - ... - a_D,
+// by repeated squaring.
+//
+// For small integer recurrences the products are schoolbook on BigInts;
+// the polynomial class would pack each into one larger integer product
+// (Kronecker) and divide, several times the work at this size.
+std::vector<BigInt> powerModSmall(const std::vector<BigInt> &a, size_t n) {
+    const size_t d = a.size();
+    // p * q (or p * x) with every x^k, k >= d, replaced by sum a_j x^(k-j)
+    auto reduce = [&](std::vector<BigInt> &p) {
+        for (size_t k = p.size(); k-- > d;) {
+            if (p[k].sign() == 0) continue;
+            for (size_t j = 1; j <= d; ++j) p[k - j] = p[k - j] + a[j - 1] * p[k];
+        }
+        p.resize(d);
+    };
+    std::vector<BigInt> r(d, BigInt(0));
+    r[0] = BigInt(1);
+    for (int bit = std::numeric_limits<size_t>::digits - 1 - __builtin_clzll(n); bit >= 0; --bit) {
+        std::vector<BigInt> sq(2 * d - 1, BigInt(0));
+        for (size_t i = 0; i < d; ++i) {
+            if (r[i].sign() == 0) continue;
+            sq[2 * i] = sq[2 * i] + r[i] * r[i];
+            for (size_t j = i + 1; j < d; ++j) {
+                if (r[j].sign() != 0) sq[i + j] = sq[i + j] + BigInt(2) * (r[i] * r[j]);
+            }
+        }
+        if ((n >> bit) & 1) sq.insert(sq.begin(), BigInt(0));
+        reduce(sq);
+        r = std::move(sq);
+    }
+    return r;
+}
+
+// the same for any exact coefficients, with the polynomial class
+std::vector<valptr_t> powerModPoly(const std::vector<valptr_t> &a, size_t n) {
+    const size_t d = a.size();
+    const std::string x = "x";
+    polynomial modulus = polynomial::monomial(x, integer(1), d);
+    for (size_t k = 0; k < d; ++k) modulus = modulus - polynomial::monomial(x, *a[k], d - 1 - k);
+    const polynomial shift = polynomial::monomial(x, integer(1), 1);
+    polynomial r = polynomial::monomial(x, integer(1), 0);
+    polynomial q(x), rem(x);
+    for (int bit = std::numeric_limits<size_t>::digits - 1 - __builtin_clzll(n); bit >= 0; --bit) {
+        r = r * r;
+        if ((n >> bit) & 1) r = r * shift;
+        if (r.degree() >= d) {
+            polynomial::divide(r, modulus, q, rem);
+            r = std::move(rem);
+            rem = polynomial(x);
+        }
+    }
+    std::vector<valptr_t> out;
+    for (size_t k = 0; k < d; ++k) out.push_back(r.coefficient(k));
+    return out;
+}
+
+// Keeps a function definition for the lifetime of the object: the
+// previous one (or its absence) is restored on destruction.
+class scoped_function {
+private:
+    runtime_env &env;
+    std::string name;
+    std::unique_ptr<function> saved;
+
+public:
+    scoped_function(runtime_env &env, std::string name) : env(env), name(std::move(name)) {
+        if (function* fn = env.getFunction(this->name)) saved = std::make_unique<function>(*fn);
+    }
+    ~scoped_function() {
+        if (saved) env.defineFunction(name, *saved);
+        else env.undefineFunction(name);
+    }
+    scoped_function(const scoped_function&) = delete;
+    scoped_function& operator=(const scoped_function&) = delete;
+};
+
+} // namespace
+
+sequence::sequence(std::string name, std::string var, std::shared_ptr<exprnode> rule, std::vector<valptr_t> initial,
+                   long long n0)
+    : name(std::move(name)), var(std::move(var)), rule(std::move(rule)), n0(n0), given(initial.size()),
+      table(std::move(initial)), ruleFn({this->var}, this->rule) {}
+
+bool sequence::isPure(runtime_env &env) const {
+    return isPureFunction(ruleFn, env);
+}
+
+std::vector<valptr_t> sequence::initialTerms() const {
+    return std::vector<valptr_t>(table.begin(), table.begin() + static_cast<std::ptrdiff_t>(given));
+}
+
+void sequence::validate(runtime_env &env) {
+    if (version == env.getFunctionVersion() && mode == env.getMode() && pure) return;
+    if (version != env.getFunctionVersion()) {
+        version = env.getFunctionVersion();
+        pure = isPureFunction(ruleFn, env);
+    }
+    mode = env.getMode();
+    table.resize(given);
+    analyzed = false;
+}
+
+valptr_t sequence::evalRule(long long index, runtime_env &env) {
+    scoped_variable bind(env, var);
+    bind.set(std::make_shared<integer>(index));
+    return evaluator(env).run(*rule);
+}
+
+valptr_t sequence::probeRule(const std::vector<valptr_t> &terms, runtime_env &env) {
+    probe = &terms;
+    try {
+        valptr_t v = evalRule(probeAt, env);
+        probe = nullptr;
+        return v;
+    } catch (...) {
+        probe = nullptr;
+        throw;
+    }
+}
+
+void sequence::fill(size_t count, runtime_env &env) {
+    scoped_variable bind(env, var);
+    evaluator ev(env);
+    busy = true;
+    try {
+        while (table.size() < count) {
+            filling = n0 + static_cast<long long>(table.size());
+            bind.set(std::make_shared<integer>(filling));
+            table.push_back(ev.run(*rule));
+        }
+    } catch (...) {
+        busy = false;
+        throw;
+    }
+    busy = false;
+}
+
+void sequence::analyze(runtime_env &env) {
+    analyzed = true;
+    recurrence.clear();
+    rule_shape shape;
+    inspectRule(*rule, name, var, shape);
+    selfRef = shape.selfRef;
+    order = shape.order;
+    if (!selfRef || !shape.lagsOnly || !pure || given < order) return;
+
+    // The rule is c0 + sum c_k u(n-k) if it is affine in the earlier terms:
+    // read c0 and the c_k off probes at zero and the unit vectors, then
+    // check two other points.
+    const valptr_t zero = std::make_shared<integer>(0);
+    const valptr_t one = std::make_shared<integer>(1);
+    std::vector<valptr_t> c(order);
+    probeAt = n0 + static_cast<long long>(given);
+    try {
+        std::vector<valptr_t> x(order, zero);
+        const valptr_t c0 = probeRule(x, env);
+        if (!isExact(c0)) return;
+        for (size_t k = 0; k < order; ++k) {
+            x.assign(order, zero);
+            x[k] = one;
+            c[k] = applyBinary(binary_op::Sub, probeRule(x, env), c0);
+            if (!isExact(c[k])) return;
+        }
+        for (long long check = 1; check <= 2; ++check) {
+            valptr_t expected = c0;
+            for (size_t k = 0; k < order; ++k) {
+                x[k] = std::make_shared<integer>(check * 7 + static_cast<long long>(k * k) * (check + 2) - 3);
+                expected = applyBinary(binary_op::Add, expected, applyBinary(binary_op::Mul, c[k], x[k]));
+            }
+            const valptr_t actual = probeRule(x, env);
+            if (!actual || !actual->equals(*expected)) return;
+        }
+        // u(n) - u(n-1) removes c0, leaving a homogeneous recurrence of
+        // order d+1
+        if (c0->equals(*zero)) {
+            recurrence = std::move(c);
+        } else {
+            recurrence.resize(order + 1);
+            recurrence[0] = applyBinary(binary_op::Add, one, c[0]);
+            for (size_t k = 1; k < order; ++k) recurrence[k] = applyBinary(binary_op::Sub, c[k], c[k - 1]);
+            recurrence[order] = applyBinary(binary_op::Sub, zero, c[order - 1]);
+        }
+    } catch (const std::exception &) {
+        recurrence.clear();
+    }
+}
+
+valptr_t sequence::jump(size_t i, runtime_env &env) {
+    // the homogeneous recurrence holds from relative index `given` on, so
+    // its window of D terms starts at given - d
+    const size_t terms = recurrence.size();
+    const size_t base = given - order;
+    fill(base + terms, env);
+    if (i < base + terms) return table[i];
+
+    const size_t n = i - base;
+    std::vector<valptr_t> r;
+    if (terms <= SCHOOLBOOK_ORDER &&
+        std::all_of(recurrence.begin(), recurrence.end(), [](const valptr_t &a) { return a->kind() == value_kind::Integer; })) {
+        std::vector<BigInt> a;
+        for (auto &c : recurrence) a.push_back(static_cast<const integer &>(*c).getValue());
+        for (auto &c : powerModSmall(a, n)) r.push_back(std::make_shared<integer>(std::move(c)));
+    } else {
+        r = powerModPoly(recurrence, n);
+    }
+
+    valptr_t sum = std::make_shared<integer>(0);
+    for (size_t j = 0; j < terms; ++j) {
+        sum = applyBinary(binary_op::Add, sum, applyBinary(binary_op::Mul, r[j], table[base + j]));
+    }
+    return applyMode(sum, env.getMode());
+}
+
+valptr_t sequence::term(long long n, runtime_env &env) {
+    if (probe) {
+        const long long k = probeAt - n;
+        if (k < 1 || k > static_cast<long long>(probe->size())) throw std::runtime_error(name + ": not a recurrence");
+        return (*probe)[static_cast<size_t>(k - 1)];
+    }
+    if (n < n0) throw std::runtime_error(name + ": no term before " + name + "(" + std::to_string(n0) + ")");
+    if (depth == 0) validate(env);
+    const size_t i = static_cast<size_t>(n - n0);
+    if (i < table.size()) return table[i];
+    if (busy) {
+        throw std::runtime_error(name + "(" + std::to_string(filling) + ") refers to " + name + "(" + std::to_string(n) +
+                                 "), which is not defined yet");
+    }
+
+    ++depth;
+    try {
+        if (!analyzed) analyze(env);
+        valptr_t v;
+        if (!selfRef && i >= given) {
+            v = evalRule(n, env);
+        } else if (!recurrence.empty() && i >= table.size() + JUMP_DISTANCE) {
+            v = jump(i, env);
+        } else {
+            fill(i + 1, env);
+            v = table[i];
+        }
+        --depth;
+        return v;
+    } catch (...) {
+        --depth;
+        throw;
+    }
+}
+
+void defineSequence(runtime_env &env, std::shared_ptr<sequence> seq) {
+    const std::string name = seq->getName();
+    // terms are computed one at a time in order, so lists are not mapped
+    // in parallel
+    function fn([seq, name](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
+        if (args.size() != 1 || !args[0]) throw std::runtime_error(name + " expects one index");
+        auto at = [&](const valptr_t &x) -> valptr_t {
+            if (x && x->kind() == value_kind::Symbolic) return symCall(name, x);
+            return seq->term(indexArg(x, name), env);
+        };
+        const valptr_t indices = asList(args[0]);
+        if (indices->kind() != value_kind::List) return at(indices);
+        std::vector<valptr_t> out;
+        for (auto &x : static_cast<const valuelist &>(*indices).elements()) out.push_back(at(x));
+        return std::make_shared<valuelist>(std::move(out));
+    });
+    fn.sequenceDef = seq;
+    // the rule's calls of the sequence itself count as pure while the
+    // rule is checked
+    fn.pure = true;
+    env.defineFunction(name, fn);
+    fn.pure = seq->isPure(env);
+    env.defineFunction(name, fn);
+}
+
+namespace {
+
+// seqDefine(u, n, rule, {u(n0), u(n0+1), ...}[, n0])
+valptr_t seqDefineForm(const call_node &c, runtime_env &env) {
+    if (c.args.size() != 4 && c.args.size() != 5) {
+        throw std::runtime_error("seqDefine expects (name, var, rule, {initial terms}[, n0])");
+    }
+    const std::string &name = formVariable(c, 0, "seqDefine");
+    const std::string &var = formVariable(c, 1, "seqDefine");
+    evaluator ev(env);
+    std::vector<valptr_t> initial = listArg(ev.run(*c.args[3]), "seqDefine", "initial terms");
+    const long long n0 = c.args.size() == 5 ? indexArg(ev.run(*c.args[4]), "seqDefine") : 1;
+    std::shared_ptr<exprnode> rule = clone(*c.args[2]);
+    defineSequence(env, std::make_shared<sequence>(name, var, std::move(rule), std::move(initial), n0));
+    return none;
+}
+
+// seqGen(rule, n, u, {n0, nmax}[, {initial terms}[, step]]): the terms
+// u(n0), u(n0 + step), ... up to nmax, with u defined only meanwhile
+valptr_t seqGenForm(const call_node &c, runtime_env &env) {
+    if (c.args.size() < 4 || c.args.size() > 6) {
+        throw std::runtime_error("seqGen expects (rule, var, name, {n0, nmax}[, {initial terms}[, step]])");
+    }
+    const std::string &var = formVariable(c, 1, "seqGen");
+    const std::string &name = formVariable(c, 2, "seqGen");
+    evaluator ev(env);
+    const std::vector<valptr_t> range = listArg(ev.run(*c.args[3]), "seqGen", "{n0, nmax}");
+    if (range.size() != 2) throw std::runtime_error("seqGen: range must be {n0, nmax}");
+    const long long n0 = indexArg(range[0], "seqGen");
+    const long long nmax = indexArg(range[1], "seqGen");
+    std::vector<valptr_t> initial;
+    if (c.args.size() >= 5) initial = listArg(ev.run(*c.args[4]), "seqGen", "initial terms");
+    const long long step = c.args.size() == 6 ? indexArg(ev.run(*c.args[5]), "seqGen") : 1;
+    if (step < 1) throw std::runtime_error("seqGen: step must be positive");
+
+    // the rule tree outlives the sequence, so it is borrowed, not copied
+    std::shared_ptr<exprnode> rule(std::shared_ptr<void>(), c.args[0].get());
+    auto seq = std::make_shared<sequence>(name, var, rule, std::move(initial), n0);
+    scoped_function scope(env, name);
+    defineSequence(env, seq);
+    std::vector<valptr_t> out;
+    for (long long n = n0; n <= nmax; n += step) out.push_back(seq->term(n, env));
+    return std::make_shared<valuelist>(std::move(out));
+}
+
+} // namespace
+
+void register_sequence_builtins(runtime_env &env) {
+    env.registerForm("seqDefine", seqDefineForm);
+    env.registerForm("seqGen", seqGenForm);
+}
+
+} // namespace ti
@@ -0,0 +1,285 @@
+#include "../include/server.h"
+#include "../include/budget.h"
+#include "../include/repl.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace ti {
+
+namespace {
+
+constexpr size_t FRAME_HEADER = 5;
+// larger frames are taken as a protocol error and end the session
+constexpr size_t MAX_FRAME = 64 << 20;
+constexpr size_t READ_BLOCK = 1 << 16;
+// unsent responses beyond this mean the client stopped reading; its
+// session is closed rather than buffering without bound
+constexpr size_t MAX_OUTBOX = 256 << 20;
+
+uint32_t readLength(const char* p) {
+    const auto* b = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(b[0]) | static_cast<uint32_t>(b[1]) << 8 | static_cast<uint32_t>(b[2]) << 16 |
+           static_cast<uint32_t>(b[3]) << 24;
+}
+
+// the frame for one response
+std::string makeFrame(char type, const std::string &payload) {
+    std::string frame(FRAME_HEADER, '\0');
+    const uint32_t n = static_cast<uint32_t>(payload.size());
+    for (int i = 0; i < 4; ++i) frame[i] = static_cast<char>(n >> (8 * i));
+    frame[4] = type;
+    frame += payload;
+    return frame;
+}
+
+// Writes as much of out as the socket takes without blocking and removes
+// it from out; false if the peer is gone.
+bool flush(int fd, std::string &out) {
+    size_t sent = 0;
+    while (sent < out.size()) {
+        const ssize_t n = ::send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    out.erase(0, sent);
+    return true;
+}
+
+} // namespace
+
+struct server::session {
+    int fd;            // non-blocking
+    repl r;            // the session's own runtime_env
+    std::string inbox; // bytes not yet forming a whole frame (socket thread only)
+    bool eof = false;  // the client sent all its requests (socket thread only)
+
+    // guarded by server::lock
+    std::deque<std::string> requests;
+    std::string outbox; // response bytes the socket has not taken yet
+    bool queued = false;
+    bool running = false;
+    std::atomic<bool> closed{false};
+
+    explicit session(int fd) : fd(fd) {}
+    ~session() { ::close(fd); }
+    session(const session&) = delete;
+    session& operator=(const session&) = delete;
+};
+
+server::server(server_options options) : options(std::move(options)) {}
+
+server::~server() {
+    stop();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        wake.notify_all();
+    }
+    for (auto &w : workers) {
+        if (w.joinable()) w.join();
+    }
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        ::unlink(options.socketPath.c_str());
+    }
+    for (int fd : wakeFds) {
+        if (fd >= 0) ::close(fd);
+    }
+}
+
+void server::stop() {
+    stopping = true;
+    if (wakeFds[1] >= 0) wakeSocketThread();
+}
+
+void server::schedule(const std::shared_ptr<session> &s) {
+    if (s->closed || s->queued || s->running || s->requests.empty()) return;
+    s->queued = true;
+    ready.push_back(s);
+    wake.notify_one();
+}
+
+void server::serve(session &s, const std::string &request) {
+    runtime_env &env = s.r.environment();
+    char type = 'R';
+    std::string text;
+    env.setBudget(eval_budget::starting(options.timeLimit, options.memoryLimit));
+    budget_scope scope(&env.getBudget());
+    try {
+        cmdres res = s.r.expr(request);
+        type = res.exitcode != 0 ? 'X' : 'R';
+        text = std::move(res.output);
+    } catch (const limit_exceeded &e) {
+        type = e.kind() == budget_kind::Memory ? 'M' : 'T';
+        text = e.what();
+    } catch (const std::exception &e) {
+        type = 'X';
+        text = e.what();
+    }
+    env.setBudget(eval_budget());
+
+    // a client that reads slowly must not hold up the worker: whatever the
+    // socket doesn't take now is left for the socket thread
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (s.closed) return;
+        s.outbox += makeFrame(type, text);
+        if (!flush(s.fd, s.outbox) || s.outbox.size() > MAX_OUTBOX) {
+            s.closed = true;
+            s.outbox.clear();
+        }
+    }
+    wakeSocketThread();
+}
+
+void server::wakeSocketThread() {
+    // the pipe is non-blocking: if it is full, a wakeup is already pending
+    const char byte = 0;
+    [[maybe_unused]] ssize_t n = ::write(wakeFds[1], &byte, 1);
+}
+
+void server::workerLoop() {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        wake.wait(guard, [this] { return stopping || !ready.empty(); });
+        if (stopping) return;
+        std::shared_ptr<session> s = std::move(ready.front());
+        ready.pop_front();
+        s->queued = false;
+        if (s->closed || s->requests.empty()) continue;
+        std::string request = std::move(s->requests.front());
+        s->requests.pop_front();
+        s->running = true;
+        guard.unlock();
+        serve(*s, request);
+        guard.lock();
+        s->running = false;
+        // back of the queue, so busy sessions take turns
+        schedule(s);
+    }
+}
+
+int server::run() {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (options.socketPath.empty() || options.socketPath.size() >= sizeof addr.sun_path) {
+        std::cerr << "invalid socket path: " << options.socketPath << std::endl;
+        return 2;
+    }
+    std::memcpy(addr.sun_path, options.socketPath.c_str(), options.socketPath.size() + 1);
+    if (::pipe2(wakeFds, O_CLOEXEC | O_NONBLOCK) != 0) {
+        std::cerr << "pipe: " << std::strerror(errno) << std::endl;
+        return 2;
+    }
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ::unlink(options.socketPath.c_str()); // a stale socket from an earlier run
+    if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0 ||
+        ::listen(listenFd, SOMAXCONN) != 0) {
+        std::cerr << options.socketPath << ": " << std::strerror(errno) << std::endl;
+        return 2;
+    }
+
+    size_t threads = options.workers ? options.workers : std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    for (size_t i = 0; i < threads; ++i) workers.emplace_back(&server::workerLoop, this);
+
+    std::vector<std::shared_ptr<session>> sessions;
+    std::vector<pollfd> fds;
+    char block[READ_BLOCK];
+    while (!stopping) {
+        fds.assign({pollfd{wakeFds[0], POLLIN, 0}, pollfd{listenFd, POLLIN, 0}});
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (const auto &s : sessions) {
+                const short events = static_cast<short>((s->eof ? 0 : POLLIN) | (s->outbox.empty() ? 0 : POLLOUT));
+                fds.push_back(pollfd{s->fd, events, 0});
+            }
+        }
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "poll: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (fds[0].revents) {
+            // stop(), or a worker left a response to send or finished a
+            // session's last request
+            char drain[256];
+            while (::read(wakeFds[0], drain, sizeof drain) > 0) {}
+            if (stopping) break;
+        }
+
+        // fds[i + 2] belongs to sessions[i]; new sessions go after them
+        const size_t polled = sessions.size();
+        if (fds[1].revents & POLLIN) {
+            const int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd >= 0) sessions.push_back(std::make_shared<session>(fd));
+        }
+        std::vector<std::shared_ptr<session>> open;
+        open.reserve(sessions.size());
+        for (size_t i = 0; i < sessions.size(); ++i) {
+            const std::shared_ptr<session> &s = sessions[i];
+            const short revents = i < polled ? fds[i + 2].revents : 0;
+            bool broken = s->closed;
+            if (!broken && (revents & POLLIN)) {
+                const ssize_t n = ::read(s->fd, block, sizeof block);
+                if (n > 0) s->inbox.append(block, static_cast<size_t>(n));
+                // at end of input the requests already read are still
+                // answered; the session closes once they are sent
+                if (n == 0) s->eof = true;
+                if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) broken = true;
+            } else if (revents & (POLLHUP | POLLERR)) {
+                // gone in both directions: nothing more can be delivered
+                broken = true;
+            }
+            // split off every whole frame
+            size_t used = 0;
+            std::vector<std::string> incoming;
+            while (!broken && s->inbox.size() - used >= FRAME_HEADER) {
+                const uint32_t length = readLength(s->inbox.data() + used);
+                if (length > MAX_FRAME || s->inbox[used + 4] != 'E') {
+                    broken = true;
+                    break;
+                }
+                if (s->inbox.size() - used < FRAME_HEADER + length) break;
+                incoming.emplace_back(s->inbox, used + FRAME_HEADER, length);
+                used += FRAME_HEADER + length;
+            }
+            s->inbox.erase(0, used);
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (!broken && (revents & POLLOUT)) broken = !flush(s->fd, s->outbox);
+            if (broken) {
+                s->closed = true;
+                s->requests.clear();
+                s->outbox.clear();
+                continue;
+            }
+            for (auto &request : incoming) s->requests.push_back(std::move(request));
+            schedule(s);
+            const bool done = s->eof && s->requests.empty() && !s->queued && !s->running && s->outbox.empty();
+            if (!done) open.push_back(s);
+        }
+        sessions.swap(open);
+    }
+
+    stopping = true;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        wake.notify_all();
+        for (const auto &s : sessions) s->closed = true;
+    }
+    for (auto &w : workers) w.join();
+    workers.clear();
+    return 0;
+}
+
+} // namespace ti
@@ -0,0 +1,979 @@
+#include "../include/snapshot.h"
+#include "../include/complexnum.h"
+#include "../include/lists.h"
+#include "../include/poly.h"
+#include "../include/runtimeenv.h"
+#include "../include/sequence.h"
+#include "../include/symbolic.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TI_SNAPSHOT_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ti {
+
+// the raw parts of a polynomial, which is otherwise only built through
+// arithmetic (a friend of the class)
+struct snapshot_codec {
+    static const std::string &var(const polynomial &p) { return p.var; }
+    static bool approx(const polynomial &p) { return p.approx; }
+    static const std::vector<size_t> &exps(const polynomial &p) { return p.exps; }
+    static const std::vector<BigInt> &nums(const polynomial &p) { return p.nums; }
+    static const BigInt &den(const polynomial &p) { return p.den; }
+    static const std::vector<double> &dcoeffs(const polynomial &p) { return p.dcoeffs; }
+
+    // exps empty for a dense layout; normalize() picks the layout again
+    static polynomial build(std::string var, std::vector<size_t> exps, std::vector<BigInt> nums, BigInt den) {
+        polynomial p(std::move(var));
+        p.exps = std::move(exps);
+        p.nums = std::move(nums);
+        p.den = std::move(den);
+        p.normalize();
+        return p;
+    }
+    static polynomial build(std::string var, std::vector<size_t> exps, std::vector<double> coeffs) {
+        polynomial p(std::move(var));
+        p.approx = true;
+        p.exps = std::move(exps);
+        p.dcoeffs = std::move(coeffs);
+        p.normalize();
+        return p;
+    }
+};
+
+namespace {
+
+constexpr char MAGIC[8] = {'T', 'I', 'S', 'N', 'A', 'P', '\r', '\n'};
+constexpr uint32_t VERSION = 2;
+constexpr uint32_t ENDIAN_MARK = 0x01020304;
+constexpr size_t HEADER_SIZE = 64;
+// doubles of arrays start at multiples of this in the file
+constexpr size_t ARRAY_ALIGN = 64;
+// arrays of at least this many bytes are borrowed from the mapping on
+// load; smaller ones are copied, so they do not keep it alive
+constexpr size_t BORROW_MIN = 1 << 16;
+constexpr size_t WRITE_BUFFER = 1 << 20;
+// values and trees nested deeper than this are refused on save and taken
+// as damage on load, which bounds the recursion of both
+constexpr size_t MAX_NESTING = 1000;
+
+// header fields after the magic
+struct header {
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t stringsOffset;
+    uint64_t stringCount;
+    uint64_t fileSize;
+};
+
+// Value tags. The enums written as bytes (ast::node_kind, binary_op,
+// sym_kind, calc_mode, complex_format) are stored by their declared
+// order, so reordering any of them needs a new VERSION.
+enum class value_tag : uint8_t {
+    Null,
+    Void,
+    False,
+    True,
+    Integer,
+    Decimal,
+    Fraction,
+    String,
+    List,
+    Polynomial,
+    Symbolic,
+    Complex,      // approximate: two doubles
+    ExactComplex, // two exact parts
+    ComplexArray,
+    DecimalArray,
+    IntegralArray, // decimal_array holding integers
+    DecimalList,   // since version 2: a list of decimals, its doubles contiguous
+};
+
+[[noreturn]] void damaged() {
+    throw std::runtime_error("snapshot: damaged file");
+}
+
+// counts the value() or node() calls in progress
+class nesting_guard {
+private:
+    size_t &depth;
+
+public:
+    explicit nesting_guard(size_t &d) : depth(d) { ++depth; }
+    ~nesting_guard() { --depth; }
+    bool tooDeep() const { return depth > MAX_NESTING; }
+};
+
+bool allDecimal(const valuelist &l) {
+    for (const auto &x : l.elements()) {
+        if (!x || x->kind() != value_kind::Decimal) return false;
+    }
+    return !l.elements().empty();
+}
+
+class snapshot_writer {
+private:
+    std::FILE* f;
+    std::string buffer;
+    uint64_t offset = 0;
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<const std::string*> strings; // by id
+    std::unordered_map<const ast::let_node*, uint32_t> lets;
+    size_t nesting = 0;
+
+    void flush() {
+        if (!buffer.empty() && std::fwrite(buffer.data(), 1, buffer.size(), f) != buffer.size()) {
+            throw std::runtime_error("snapshot: write error");
+        }
+        buffer.clear();
+    }
+
+public:
+    explicit snapshot_writer(std::FILE* f) : f(f) {}
+
+    void bytes(const void* p, size_t n) {
+        if (buffer.size() + n > WRITE_BUFFER) flush();
+        if (n >= WRITE_BUFFER) {
+            if (std::fwrite(p, 1, n, f) != n) throw std::runtime_error("snapshot: write error");
+        } else {
+            buffer.append(static_cast<const char*>(p), n);
+        }
+        offset += n;
+    }
+
+    template<typename T> void put(T v) { bytes(&v, sizeof v); }
+    void u8(uint8_t v) { put(v); }
+    void u32(uint32_t v) { put(v); }
+    void u64(uint64_t v) { put(v); }
+
+    // a string table index
+    void str(const std::string &s) {
+        auto [it, fresh] = ids.try_emplace(s, static_cast<uint32_t>(strings.size()));
+        if (fresh) strings.push_back(&it->first);
+        u32(it->second);
+    }
+
+    void align() {
+        static const char zeros[ARRAY_ALIGN] = {};
+        bytes(zeros, (ARRAY_ALIGN - offset % ARRAY_ALIGN) % ARRAY_ALIGN);
+    }
+
+    void doubles(const double* xs, size_t n) {
+        align();
+        bytes(xs, n * sizeof(double));
+    }
+
+    void bigint(const BigInt &b) {
+        u8(b.sign() < 0);
+        const std::vector<int> &limbs = b.limbs();
+        u64(limbs.size());
+        bytes(limbs.data(), limbs.size() * sizeof(int));
+    }
+
+    void value(const valptr_t &v);
+    void symbolicDag(const symptr &root);
+    void node(const ast::exprnode &n);
+    void optionalNode(const std::unique_ptr<ast::exprnode> &n) {
+        u8(n != nullptr);
+        if (n) node(*n);
+    }
+
+    // the string table, then the header over the placeholder at the start
+    void finish() {
+        const uint64_t stringsOffset = offset;
+        for (const std::string* s : strings) {
+            u32(static_cast<uint32_t>(s->size()));
+            bytes(s->data(), s->size());
+        }
+        flush();
+        const header h{VERSION, ENDIAN_MARK, stringsOffset, strings.size(), offset};
+        char head[HEADER_SIZE] = {};
+        std::memcpy(head, MAGIC, sizeof MAGIC);
+        std::memcpy(head + sizeof MAGIC, &h, sizeof h);
+        if (std::fseek(f, 0, SEEK_SET) != 0 || std::fwrite(head, 1, HEADER_SIZE, f) != HEADER_SIZE) {
+            throw std::runtime_error("snapshot: write error");
+        }
+    }
+};
+
+void snapshot_writer::value(const valptr_t &v) {
+    const nesting_guard guard(nesting);
+    if (guard.tooDeep()) throw std::runtime_error("snapshot: value nested too deeply to save");
+    if (!v) {
+        u8(static_cast<uint8_t>(value_tag::Null));
+        return;
+    }
+    switch (v->kind()) {
+        case value_kind::Void:
+            u8(static_cast<uint8_t>(value_tag::Void));
+            return;
+        case value_kind::Boolean:
+            u8(static_cast<uint8_t>(static_cast<const boolean &>(*v).getValue() ? value_tag::True : value_tag::False));
+            return;
+        case value_kind::Integer:
+            u8(static_cast<uint8_t>(value_tag::Integer));
+            bigint(static_cast<const integer &>(*v).getValue());
+            return;
+        case value_kind::Decimal:
+            u8(static_cast<uint8_t>(value_tag::Decimal));
+            put(static_cast<const decimal &>(*v).getValue());
+            return;
+        case value_kind::Fraction: {
+            const auto &q = static_cast<const fraction &>(*v);
+            u8(static_cast<uint8_t>(value_tag::Fraction));
+            bigint(q.getNumerator().getValue());
+            bigint(q.getDenominator().getValue());
+            return;
+        }
+        case value_kind::String:
+            u8(static_cast<uint8_t>(value_tag::String));
+            str(static_cast<const string &>(*v).getValue());
+            return;
+        case value_kind::List: {
+            const auto &l = static_cast<const valuelist &>(*v);
+            if (allDecimal(l)) {
+                std::vector<double> xs;
+                xs.reserve(l.size());
+                for (const auto &x : l.elements()) xs.push_back(static_cast<const decimal &>(*x).getValue());
+                u8(static_cast<uint8_t>(value_tag::DecimalList));
+                u64(xs.size());
+                doubles(xs.data(), xs.size());
+                return;
+            }
+            u8(static_cast<uint8_t>(value_tag::List));
+            u64(l.size());
+            for (const auto &x : l.elements()) value(x);
+            return;
+        }
+        case value_kind::Polynomial: {
+            const auto &p = static_cast<const polynomial &>(*v);
+            u8(static_cast<uint8_t>(value_tag::Polynomial));
+            str(snapshot_codec::var(p));
+            u8(snapshot_codec::approx(p));
+            const std::vector<size_t> &exps = snapshot_codec::exps(p);
+            u64(exps.size());
+            for (size_t e : exps) u64(e);
+            if (snapshot_codec::approx(p)) {
+                const std::vector<double> &cs = snapshot_codec::dcoeffs(p);
+                u64(cs.size());
+                doubles(cs.data(), cs.size());
+            } else {
+                bigint(snapshot_codec::den(p));
+                u64(snapshot_codec::nums(p).size());
+                for (const BigInt &c : snapshot_codec::nums(p)) bigint(c);
+            }
+            return;
+        }
+        case value_kind::Symbolic:
+            u8(static_cast<uint8_t>(value_tag::Symbolic));
+            symbolicDag(static_cast<const symbolic &>(*v).getNode());
+            return;
+        case value_kind::Complex: {
+            const auto &z = static_cast<const complex_number &>(*v);
+            if (z.isExact()) {
+                u8(static_cast<uint8_t>(value_tag::ExactComplex));
+                value(z.real());
+                value(z.imag());
+            } else {
+                u8(static_cast<uint8_t>(value_tag::Complex));
+                put(z.toComplex().real());
+                put(z.toComplex().imag());
+            }
+            return;
+        }
+        case value_kind::ComplexArray: {
+            const auto &a = static_cast<const complex_array &>(*v);
+            u8(static_cast<uint8_t>(value_tag::ComplexArray));
+            u64(a.colCount());
+            u64(a.size());
+            doubles(a.reals().data(), a.size());
+            doubles(a.imags().data(), a.size());
+            return;
+        }
+        case value_kind::DecimalArray: {
+            const auto &a = static_cast<const decimal_array &>(*v);
+            u8(static_cast<uint8_t>(a.isIntegral() ? value_tag::IntegralArray : value_tag::DecimalArray));
+            u64(a.size());
+            doubles(a.values().data(), a.size());
+            return;
+        }
+        case value_kind::LazySeq:
+            value(static_cast<const lazy_seq &>(*v).materialized());
+            return;
+        case value_kind::Other:
+            break;
+    }
+    throw std::runtime_error("snapshot: cannot save " + v->toString());
+}
+
+// the DAG in post-order, each node once, children by index
+void snapshot_writer::symbolicDag(const symptr &root) {
+    std::unordered_map<const sym_node*, uint32_t> index;
+    std::vector<const sym_node*> order;
+    std::vector<std::pair<const sym_node*, bool>> stack{{root.get(), false}};
+    while (!stack.empty()) {
+        auto [n, expanded] = stack.back();
+        stack.pop_back();
+        if (index.count(n)) continue;
+        if (expanded) {
+            index.emplace(n, static_cast<uint32_t>(order.size()));
+            order.push_back(n);
+            continue;
+        }
+        stack.push_back({n, true});
+        for (auto it = n->args().rbegin(); it != n->args().rend(); ++it) {
+            if (!index.count(it->get())) stack.push_back({it->get(), false});
+        }
+    }
+    u32(static_cast<uint32_t>(order.size()));
+    for (const sym_node* n : order) {
+        u8(static_cast<uint8_t>(n->kind()));
+        switch (n->kind()) {
+            case sym_kind::Number:
+                value(n->number());
+                break;
+            case sym_kind::Symbol:
+                str(n->name());
+                break;
+            case sym_kind::Call:
+                str(n->name());
+                [[fallthrough]];
+            default:
+                u32(static_cast<uint32_t>(n->args().size()));
+                for (const symptr &a : n->args()) u32(index.at(a.get()));
+        }
+    }
+}
+
+void snapshot_writer::node(const ast::exprnode &n) {
+    using namespace ast;
+    const nesting_guard guard(nesting);
+    if (guard.tooDeep()) throw std::runtime_error("snapshot: function nested too deeply to save");
+    u8(static_cast<uint8_t>(n.kind()));
+    switch (n.kind()) {
+        case node_kind::Literal:
+            value(static_cast<const literal_node &>(n).val);
+            return;
+        case node_kind::Var:
+            str(static_cast<const var_node &>(n).name);
+            return;
+        case node_kind::Assign: {
+            auto &a = static_cast<const assign_node &>(n);
+            str(a.name);
+            node(*a.rhs);
+            return;
+        }
+        case node_kind::Call: {
+            auto &c = static_cast<const call_node &>(n);
+            node(*c.callee);
+            u32(static_cast<uint32_t>(c.args.size()));
+            for (const auto &a : c.args) node(*a);
+            return;
+        }
+        case node_kind::Local: {
+            auto &l = static_cast<const local_node &>(n);
+            u32(static_cast<uint32_t>(l.names.size()));
+            for (const auto &name : l.names) str(name);
+            return;
+        }
+        case node_kind::Block: {
+            auto &b = static_cast<const block_node &>(n);
+            u32(static_cast<uint32_t>(b.stmts.size()));
+            for (const auto &s : b.stmts) node(*s);
+            return;
+        }
+        case node_kind::If: {
+            auto &i = static_cast<const if_node &>(n);
+            node(*i.cond);
+            node(*i.then_branch);
+            optionalNode(i.else_branch);
+            return;
+        }
+        case node_kind::For: {
+            auto &f = static_cast<const for_node &>(n);
+            str(f.var);
+            node(*f.start);
+            node(*f.end);
+            optionalNode(f.step);
+            node(*f.body);
+            return;
+        }
+        case node_kind::While: {
+            auto &w = static_cast<const while_node &>(n);
+            node(*w.cond);
+            node(*w.body);
+            return;
+        }
+        case node_kind::Let: {
+            // numbered before its children, whose temps refer to it
+            auto &l = static_cast<const let_node &>(n);
+            lets.emplace(&l, static_cast<uint32_t>(lets.size()));
+            u32(static_cast<uint32_t>(l.temps.size()));
+            for (const auto &t : l.temps) node(*t);
+            node(*l.body);
+            return;
+        }
+        case node_kind::Temp: {
+            auto &t = static_cast<const temp_node &>(n);
+            auto it = lets.find(t.owner);
+            if (it == lets.end()) throw std::runtime_error("snapshot: temp outside its let");
+            u32(it->second);
+            u64(t.index);
+            u64(t.depth);
+            return;
+        }
+        case node_kind::BinaryOp: {
+            auto &b = static_cast<const binary_op_node &>(n);
+            u8(static_cast<uint8_t>(b.op));
+            node(*b.left);
+            node(*b.right);
+            return;
+        }
+    }
+    throw std::runtime_error("snapshot: unknown node kind");
+}
+
+// A whole snapshot file in memory: mapped where possible, read otherwise.
+// Borrowed arrays hold a reference to it.
+class snapshot_file {
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    void* mapped = nullptr;
+    std::vector<char> owned;
+
+public:
+    explicit snapshot_file(const std::string &path) {
+#ifdef TI_SNAPSHOT_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                mapped = p;
+                bytes = static_cast<const char*>(p);
+                length = static_cast<size_t>(st.st_size);
+                ::close(fd);
+                return;
+            }
+        }
+        ::close(fd);
+#endif
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) throw std::runtime_error("cannot open " + path);
+        char block[1 << 16];
+        size_t n;
+        while ((n = std::fread(block, 1, sizeof block, f)) > 0) owned.insert(owned.end(), block, block + n);
+        const bool failed = std::ferror(f);
+        std::fclose(f);
+        if (failed) throw std::runtime_error("read error: " + path);
+        bytes = owned.data();
+        length = owned.size();
+    }
+
+    ~snapshot_file() {
+#ifdef TI_SNAPSHOT_MMAP
+        if (mapped) ::munmap(mapped, length);
+#endif
+    }
+
+    snapshot_file(const snapshot_file&) = delete;
+    snapshot_file& operator=(const snapshot_file&) = delete;
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+class snapshot_reader {
+private:
+    std::shared_ptr<const snapshot_file> file;
+    const char* base;
+    size_t end;
+    size_t pos = HEADER_SIZE;
+    std::vector<std::string> strings;
+    std::vector<ast::let_node*> lets;
+    std::vector<uint32_t> openLets; // the lets enclosing the node being read
+    std::vector<const ast::temp_node*> temps;
+    size_t nesting = 0;
+
+    void need(size_t n) const {
+        if (n > end - pos) damaged();
+    }
+
+public:
+    size_t borrowedBytes = 0;
+    uint32_t version = 0;
+
+    explicit snapshot_reader(std::shared_ptr<const snapshot_file> f)
+        : file(std::move(f)), base(file->data()), end(file->size()) {
+        if (end < HEADER_SIZE || std::memcmp(base, MAGIC, sizeof MAGIC) != 0) {
+            throw std::runtime_error("snapshot: not a snapshot file");
+        }
+        header h;
+        std::memcpy(&h, base + sizeof MAGIC, sizeof h);
+        if (h.byteOrder != ENDIAN_MARK) throw std::runtime_error("snapshot: written with another byte order");
+        if (h.version > VERSION) {
+            throw std::runtime_error("snapshot: version " + std::to_string(h.version) + " is newer than this build reads");
+        }
+        version = h.version;
+        if (h.fileSize != end || h.stringsOffset < HEADER_SIZE || h.stringsOffset > end) damaged();
+        pos = h.stringsOffset;
+        if (h.stringCount > (end - pos) / sizeof(uint32_t)) damaged();
+        strings.reserve(h.stringCount);
+        for (uint64_t i = 0; i < h.stringCount; ++i) {
+            const uint32_t n = get<uint32_t>();
+            need(n);
+            strings.emplace_back(base + pos, n);
+            pos += n;
+        }
+        // the records lie between the header and the string table
+        end = h.stringsOffset;
+        pos = HEADER_SIZE;
+    }
+
+    bool atEnd() const { return pos == end; }
+
+    template<typename T> T get() {
+        need(sizeof(T));
+        T v;
+        std::memcpy(&v, base + pos, sizeof v);
+        pos += sizeof v;
+        return v;
+    }
+    uint8_t u8() { return get<uint8_t>(); }
+    uint32_t u32() { return get<uint32_t>(); }
+    uint64_t u64() { return get<uint64_t>(); }
+
+    // an element count (64 or 32 bits), checked against the bytes left so
+    // a damaged count cannot ask for a huge allocation
+    size_t count(size_t minBytes) {
+        const uint64_t n = u64();
+        if (n > (end - pos) / std::max<size_t>(1, minBytes)) damaged();
+        return static_cast<size_t>(n);
+    }
+    size_t shortCount(size_t minBytes) {
+        const uint32_t n = u32();
+        if (n > (end - pos) / std::max<size_t>(1, minBytes)) damaged();
+        return n;
+    }
+
+    // every temp read so far refers to a temp its let has
+    void checkTemps() const {
+        for (const ast::temp_node* t : temps) {
+            if (t->index >= t->owner->temps.size()) damaged();
+        }
+    }
+
+    const std::string &str() {
+        const uint32_t i = u32();
+        if (i >= strings.size()) damaged();
+        return strings[i];
+    }
+
+    // large arrays borrowed from the mapping unless the caller only copies them out
+    double_buffer doubles(size_t n, bool mayBorrow = true) {
+        pos += std::min(end - pos, (ARRAY_ALIGN - pos % ARRAY_ALIGN) % ARRAY_ALIGN);
+        if (n > (end - pos) / sizeof(double)) damaged();
+        const char* p = base + pos;
+        pos += n * sizeof(double);
+        if (mayBorrow && n * sizeof(double) >= BORROW_MIN) {
+            // the mapping is page aligned and the offset a multiple of
+            // ARRAY_ALIGN, so the doubles are aligned in place
+            borrowedBytes += n * sizeof(double);
+            return double_buffer(reinterpret_cast<const double*>(p), n, file);
+        }
+        std::vector<double> xs(n);
+        if (n) std::memcpy(xs.data(), p, n * sizeof(double));
+        return xs;
+    }
+
+    BigInt bigint() {
+        const bool negative = u8() != 0;
+        std::vector<int> limbs(count(sizeof(int)));
+        if (limbs.empty()) damaged();
+        std::memcpy(limbs.data(), base + pos, limbs.size() * sizeof(int));
+        pos += limbs.size() * sizeof(int);
+        for (int d : limbs) {
+            if (d < 0 || d >= 1000000000) damaged();
+        }
+        return BigInt::from_limbs(std::move(limbs), negative);
+    }
+
+    valptr_t value();
+    symptr symbolicDag();
+    std::unique_ptr<ast::exprnode> node();
+    std::unique_ptr<ast::exprnode> optionalNode() { return u8() ? node() : nullptr; }
+};
+
+valptr_t snapshot_reader::value() {
+    const nesting_guard guard(nesting);
+    if (guard.tooDeep()) damaged();
+    const auto tag = static_cast<value_tag>(u8());
+    switch (tag) {
+        case value_tag::Null:
+            return valptr_t();
+        case value_tag::Void:
+            return none;
+        case value_tag::False:
+            return std::make_shared<boolean>(false);
+        case value_tag::True:
+            return std::make_shared<boolean>(true);
+        case value_tag::Integer:
+            return std::make_shared<integer>(bigint());
+        case value_tag::Decimal:
+            return std::make_shared<decimal>(get<double>());
+        case value_tag::Fraction: {
+            BigInt num = bigint();
+            BigInt den = bigint();
+            if (den.is_zero()) damaged();
+            return std::make_shared<fraction>(integer(std::move(num)), integer(std::move(den)));
+        }
+        case value_tag::String:
+            return std::make_shared<string>(str());
+        case value_tag::List: {
+            std::vector<valptr_t> xs(count(1));
+            for (auto &x : xs) x = value();
+            return std::make_shared<valuelist>(std::move(xs));
+        }
+        case value_tag::DecimalList: {
+            const double_buffer ds = doubles(count(sizeof(double)), false);
+            std::vector<valptr_t> xs;
+            xs.reserve(ds.size());
+            for (double d : ds) xs.push_back(std::make_shared<decimal>(d));
+            return std::make_shared<valuelist>(std::move(xs));
+        }
+        case value_tag::Polynomial: {
+            std::string var = str();
+            const bool approx = u8() != 0;
+            std::vector<size_t> exps(count(sizeof(uint64_t)));
+            for (size_t i = 0; i < exps.size(); ++i) {
+                exps[i] = static_cast<size_t>(u64());
+                if (i > 0 && exps[i] <= exps[i - 1]) damaged();
+            }
+            if (approx) {
+                const double_buffer cs = doubles(count(sizeof(double)));
+                if (!exps.empty() && exps.size() != cs.size()) damaged();
+                return std::make_shared<polynomial>(
+                    snapshot_codec::build(std::move(var), std::move(exps), std::vector<double>(cs.begin(), cs.end())));
+            }
+            BigInt den = bigint();
+            if (den.sign() <= 0) damaged();
+            std::vector<BigInt> nums(count(1 + sizeof(uint64_t) + sizeof(int)));
+            for (auto &c : nums) c = bigint();
+            if (!exps.empty() && exps.size() != nums.size()) damaged();
+            return std::make_shared<polynomial>(
+                snapshot_codec::build(std::move(var), std::move(exps), std::move(nums), std::move(den)));
+        }
+        case value_tag::Symbolic:
+            return std::make_shared<symbolic>(symbolicDag());
+        case value_tag::Complex: {
+            const double re = get<double>();
+            const double im = get<double>();
+            return std::make_shared<complex_number>(std::complex<double>(re, im));
+        }
+        case value_tag::ExactComplex: {
+            valptr_t re = value();
+            valptr_t im = value();
+            if (!re || !im) damaged();
+            return std::make_shared<complex_number>(std::move(re), std::move(im));
+        }
+        case value_tag::ComplexArray: {
+            const size_t cols = static_cast<size_t>(u64());
+            const size_t n = count(2 * sizeof(double));
+            if (cols != 0 && n % cols != 0) damaged();
+            double_buffer re = doubles(n);
+            double_buffer im = doubles(n);
+            return std::make_shared<complex_array>(std::move(re), std::move(im), cols);
+        }
+        case value_tag::DecimalArray:
+        case value_tag::IntegralArray:
+            return std::make_shared<decimal_array>(doubles(count(sizeof(double))), tag == value_tag::IntegralArray);
+    }
+    damaged();
+}
+
+symptr snapshot_reader::symbolicDag() {
+    const uint32_t n = u32();
+    if (n == 0 || n > end - pos) damaged();
+    std::vector<symptr> nodes;
+    nodes.reserve(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        const auto kind = static_cast<sym_kind>(u8());
+        if (kind == sym_kind::Number) {
+            valptr_t v = value();
+            if (!v) damaged();
+            nodes.push_back(sym_node::number(std::move(v)));
+            continue;
+        }
+        if (kind == sym_kind::Symbol) {
+            nodes.push_back(sym_node::symbol(str()));
+            continue;
+        }
+        std::string label = kind == sym_kind::Call ? str() : std::string();
+        std::vector<symptr> args(shortCount(sizeof(uint32_t)));
+        for (auto &a : args) {
+            const uint32_t j = u32();
+            // children come before their parents
+            if (j >= nodes.size()) damaged();
+            a = nodes[j];
+        }
+        switch (kind) {
+            case sym_kind::Add:
+                nodes.push_back(sym_node::add(std::move(args)));
+                break;
+            case sym_kind::Mul:
+                nodes.push_back(sym_node::mul(std::move(args)));
+                break;
+            case sym_kind::Pow:
+                if (args.size() != 2) damaged();
+                nodes.push_back(sym_node::pow(args[0], args[1]));
+                break;
+            case sym_kind::Call:
+                nodes.push_back(sym_node::call(label, std::move(args)));
+                break;
+            default:
+                damaged();
+        }
+    }
+    return nodes.back();
+}
+
+std::unique_ptr<ast::exprnode> snapshot_reader::node() {
+    using namespace ast;
+    const nesting_guard guard(nesting);
+    if (guard.tooDeep()) damaged();
+    auto nodes = [this] {
+        std::vector<std::unique_ptr<exprnode>> out(shortCount(1));
+        for (auto &n : out) n = node();
+        return out;
+    };
+    switch (static_cast<node_kind>(u8())) {
+        case node_kind::Literal:
+            return std::make_unique<literal_node>(value());
+        case node_kind::Var:
+            return std::make_unique<var_node>(str());
+        case node_kind::Assign: {
+            std::string name = str();
+            return std::make_unique<assign_node>(std::move(name), node());
+        }
+        case node_kind::Call: {
+            auto callee = node();
+            return std::make_unique<call_node>(std::move(callee), nodes());
+        }
+        case node_kind::Local: {
+            std::vector<std::string> names(shortCount(sizeof(uint32_t)));
+            for (auto &name : names) name = str();
+            return std::make_unique<local_node>(std::move(names));
+        }
+        case node_kind::Block:
+            return std::make_unique<block_node>(nodes());
+        case node_kind::If: {
+            auto cond = node();
+            auto then = node();
+            return std::make_unique<if_node>(std::move(cond), std::move(then), optionalNode());
+        }
+        case node_kind::For: {
+            std::string var = str();
+            auto start = node();
+            auto stop = node();
+            auto step = optionalNode();
+            return std::make_unique<for_node>(std::move(var), std::move(start), std::move(stop), std::move(step), node());
+        }
+        case node_kind::While: {
+            auto cond = node();
+            return std::make_unique<while_node>(std::move(cond), node());
+        }
+        case node_kind::Let: {
+            auto let = std::make_unique<let_node>(std::vector<std::unique_ptr<exprnode>>(), nullptr);
+            openLets.push_back(static_cast<uint32_t>(lets.size()));
+            lets.push_back(let.get());
+            let->temps = nodes();
+            let->body = node();
+            openLets.pop_back();
+            return let;
+        }
+        case node_kind::Temp: {
+            // the owner encloses the temp, and depth is its place among
+            // the enclosing lets, as the optimizer resolves it
+            const uint32_t owner = u32();
+            const size_t index = static_cast<size_t>(u64());
+            const uint64_t depth = u64();
+            if (depth >= openLets.size() || openLets[depth] != owner) damaged();
+            auto t = std::make_unique<temp_node>(lets[owner], index);
+            t->depth = static_cast<size_t>(depth);
+            temps.push_back(t.get());
+            return t;
+        }
+        case node_kind::BinaryOp: {
+            const uint8_t op = u8();
+            if (op > static_cast<uint8_t>(binary_op::Ge)) damaged();
+            auto left = node();
+            return std::make_unique<binary_op_node>(static_cast<binary_op>(op), std::move(left), node());
+        }
+    }
+    damaged();
+}
+
+std::string stringArg(const std::vector<valptr_t> &args, const char* name) {
+    if (args.size() != 1 || !args[0] || args[0]->kind() != value_kind::String) {
+        throw std::runtime_error(std::string(name) + " expects (path)");
+    }
+    return static_cast<const string &>(*args[0]).getValue();
+}
+
+} // namespace
+
+snapshot_stats saveSnapshot(const runtime_env &env, const std::string &path) {
+    // written beside the target and renamed over it, so a failed save
+    // leaves the old file and a mapping of it stays valid
+    const std::string temp = path + ".tmp";
+    std::FILE* f = std::fopen(temp.c_str(), "wb");
+    if (!f) throw std::runtime_error("cannot create " + temp);
+    snapshot_stats stats;
+    try {
+        snapshot_writer w(f);
+        const char zeros[HEADER_SIZE] = {};
+        w.bytes(zeros, HEADER_SIZE);
+
+        w.u8(static_cast<uint8_t>(env.getMode()));
+        w.u8(static_cast<uint8_t>(env.getComplexFormat()));
+        w.u64(env.randomState().seed);
+        w.u64(env.randomState().position);
+
+        w.u64(env.globals().size());
+        for (const auto &[name, v] : env.globals()) {
+            w.str(name);
+            w.value(v);
+        }
+        stats.variables = env.globals().size();
+
+        std::vector<std::pair<const std::string*, const function*>> user;
+        std::vector<const sequence*> sequences;
+        for (const auto &[name, fn] : env.functionTable()) {
+            if (!fn.isBuiltin) user.emplace_back(&name, &fn);
+            else if (fn.sequenceDef) sequences.push_back(fn.sequenceDef.get());
+        }
+        w.u64(user.size());
+        for (const auto &[name, fn] : user) {
+            w.str(*name);
+            w.u32(static_cast<uint32_t>(fn->params.size()));
+            for (const auto &p : fn->params) w.str(p);
+            w.u8(fn->memoize);
+            const auto* body = dynamic_cast<const ast::exprnode*>(fn->body.get());
+            w.u8(body != nullptr);
+            if (body) w.node(*body);
+        }
+        stats.functions = user.size();
+
+        // sequences by their definition; the terms are computed again
+        w.u64(sequences.size());
+        for (const sequence* seq : sequences) {
+            w.str(seq->getName());
+            w.str(seq->getVar());
+            w.node(seq->getRule());
+            w.u64(static_cast<uint64_t>(seq->getFirstIndex()));
+            const std::vector<valptr_t> initial = seq->initialTerms();
+            w.u64(initial.size());
+            for (const auto &v : initial) w.value(v);
+        }
+        stats.sequences = sequences.size();
+        w.finish();
+    } catch (...) {
+        std::fclose(f);
+        std::remove(temp.c_str());
+        throw;
+    }
+    if (std::fclose(f) != 0 || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        throw std::runtime_error("cannot write " + path);
+    }
+    return stats;
+}
+
+snapshot_stats loadSnapshot(runtime_env &env, const std::string &path) {
+    snapshot_reader r(std::make_shared<const snapshot_file>(path));
+
+    // everything is read before env changes, so a damaged file leaves it as it was
+    const uint8_t mode = r.u8();
+    const uint8_t format = r.u8();
+    if (mode > static_cast<uint8_t>(calc_mode::Approximate) || format > static_cast<uint8_t>(complex_format::Polar)) {
+        damaged();
+    }
+    random_state rng;
+    rng.seed = r.u64();
+    rng.position = r.u64();
+
+    std::vector<std::pair<std::string, valptr_t>> variables(r.count(sizeof(uint32_t) + 1));
+    for (auto &[name, v] : variables) {
+        name = r.str();
+        v = r.value();
+    }
+    std::vector<std::pair<std::string, function>> functions(r.count(sizeof(uint32_t) * 2 + 2));
+    for (auto &[name, fn] : functions) {
+        name = r.str();
+        std::vector<std::string> params(r.shortCount(sizeof(uint32_t)));
+        for (auto &p : params) p = r.str();
+        const bool memoize = r.u8() != 0;
+        std::shared_ptr<ast::node> body;
+        if (r.u8()) body = r.node();
+        fn = function(params, std::move(body));
+        fn.memoize = memoize;
+    }
+    std::vector<std::shared_ptr<sequence>> sequences;
+    if (r.version >= 2) {
+        sequences.resize(r.count(sizeof(uint32_t) * 2 + 1 + sizeof(uint64_t) * 2));
+        for (auto &seq : sequences) {
+            std::string name = r.str();
+            std::string var = r.str();
+            std::shared_ptr<ast::exprnode> rule = r.node();
+            const auto n0 = static_cast<long long>(r.u64());
+            std::vector<valptr_t> initial(r.count(1));
+            for (auto &v : initial) {
+                v = r.value();
+                if (!v) damaged();
+            }
+            seq = std::make_shared<sequence>(std::move(name), std::move(var), std::move(rule), std::move(initial), n0);
+        }
+    }
+    r.checkTemps();
+    if (!r.atEnd()) damaged();
+
+    env.setMode(static_cast<calc_mode>(mode));
+    env.setComplexFormat(static_cast<complex_format>(format));
+    env.randomState() = rng;
+    for (auto &[name, v] : variables) env.setGlobal(name, v);
+    for (auto &[name, fn] : functions) env.defineFunction(name, fn);
+    for (auto &seq : sequences) defineSequence(env, seq);
+
+    snapshot_stats stats;
+    stats.variables = variables.size();
+    stats.functions = functions.size();
+    stats.sequences = sequences.size();
+    stats.borrowedBytes = r.borrowedBytes;
+    return stats;
+}
+
+void register_snapshot_builtins(runtime_env &env) {
+    // saveSnapshot(path), loadSnapshot(path): the number of variables,
+    // functions and sequences written or restored
+    env.registerBuiltin("saveSnapshot", [](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
+        const snapshot_stats s = saveSnapshot(env, stringArg(args, "saveSnapshot"));
+        return std::make_shared<integer>(static_cast<long long>(s.variables + s.functions + s.sequences));
+    });
+    env.registerBuiltin("loadSnapshot", [](const std::vector<valptr_t> &args, runtime_env &env) -> valptr_t {
+        const snapshot_stats s = loadSnapshot(env, stringArg(args, "loadSnapshot"));
+        return std::make_shared<integer>(static_cast<long long>(s.variables + s.functions + s.sequences));
+    });
+}
+
+} // namespace ti
@@ -0,0 +1,791 @@
+#include "../include/symbolic.h"
+#include "../include/arith.h"
+#include "../include/evaluator.h"
+#include "../include/lists.h"
+#include "../include/ntheory.h"
+#include "../include/runtimeenv.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <numbers>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
+namespace ti {
+
+using ast::binary_op;
+using ast::call_node;
+
+namespace {
+
+// Buckets are keyed by structural hash and hold the nodes weakly; expired
+// entries are dropped when their bucket is probed and in a full sweep each
+// time the table doubles, so it stays proportional to the live nodes.
+struct intern_table {
+    std::mutex lock;
+    std::unordered_map<size_t, std::vector<std::weak_ptr<const sym_node>>> buckets;
+    size_t entries = 0;
+    size_t sweepAt = 4096;
+};
+
+intern_table &table() {
+    static intern_table t;
+    return t;
+}
+
+// guards the memo fields of every node
+std::mutex memoLock;
+
+void mix(size_t &h, size_t x) {
+    h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+}
+
+valptr_t copyNumber(const value &v) {
+    switch (v.kind()) {
+        case value_kind::Integer: return std::make_shared<integer>(static_cast<const integer &>(v));
+        case value_kind::Fraction: return std::make_shared<fraction>(static_cast<const fraction &>(v));
+        case value_kind::Decimal: return std::make_shared<decimal>(static_cast<const decimal &>(v));
+        default: throw std::runtime_error("expected a number, got " + v.toString());
+    }
+}
+
+symptr lit(long long n) {
+    return sym_node::number(std::make_shared<integer>(n));
+}
+
+symptr ratio(long long n, long long d) {
+    return sym_node::number(makeRational(BigInt(n), BigInt(d)));
+}
+
+bool isNumber(const symptr &n) {
+    return n->kind() == sym_kind::Number;
+}
+
+bool isZero(const symptr &n) {
+    return isNumber(n) && toDouble(*n->number()) == 0;
+}
+
+bool isInt(const valptr_t &v, long long k) {
+    return v->kind() == value_kind::Integer && static_cast<const integer &>(*v).getValue() == BigInt(k);
+}
+
+bool isNegative(const valptr_t &v) {
+    return toDouble(*v) < 0;
+}
+
+valptr_t wrap(const symptr &n) {
+    if (isNumber(n)) return n->number();
+    return std::make_shared<symbolic>(n);
+}
+
+// total order used to sort the operands of sums and products: numbers,
+// then by base and exponent, so x, x^2 and y^3 group by variable
+int compare(const symptr &a, const symptr &b) {
+    if (a == b) return 0;
+    if (isNumber(a) || isNumber(b)) {
+        if (!isNumber(a)) return 1;
+        if (!isNumber(b)) return -1;
+        const double x = toDouble(*a->number()), y = toDouble(*b->number());
+        if (x != y) return x < y ? -1 : 1;
+        return static_cast<int>(a->number()->kind()) - static_cast<int>(b->number()->kind());
+    }
+    if (a->kind() == sym_kind::Pow || b->kind() == sym_kind::Pow) {
+        static const symptr one = lit(1);
+        const symptr &ba = a->kind() == sym_kind::Pow ? a->args()[0] : a;
+        const symptr &bb = b->kind() == sym_kind::Pow ? b->args()[0] : b;
+        if (int c = compare(ba, bb)) return c;
+        return compare(a->kind() == sym_kind::Pow ? a->args()[1] : one, b->kind() == sym_kind::Pow ? b->args()[1] : one);
+    }
+    auto rank = [](sym_kind k) {
+        switch (k) {
+            case sym_kind::Symbol: return 0;
+            case sym_kind::Call: return 1;
+            case sym_kind::Mul: return 2;
+            default: return 3;
+        }
+    };
+    if (a->kind() != b->kind()) return rank(a->kind()) - rank(b->kind());
+    if (int c = a->name().compare(b->name())) return c;
+    const auto &x = a->args(), &y = b->args();
+    for (size_t i = 0; i < x.size() && i < y.size(); ++i) {
+        if (int c = compare(x[i], y[i])) return c;
+    }
+    return static_cast<int>(x.size()) - static_cast<int>(y.size());
+}
+
+// numeric coefficient and the rest of a canonical term
+std::pair<valptr_t, symptr> splitTerm(const symptr &t) {
+    if (t->kind() == sym_kind::Mul && isNumber(t->args()[0])) {
+        const auto &f = t->args();
+        if (f.size() == 2) return {f[0]->number(), f[1]};
+        return {f[0]->number(), sym_node::mul(std::vector<symptr>(f.begin() + 1, f.end()))};
+    }
+    return {std::make_shared<integer>(1), t};
+}
+
+// polynomial degree of a term, for ordering sums highest degree first
+double termDegree(const symptr &t) {
+    switch (t->kind()) {
+        case sym_kind::Symbol: return 1;
+        case sym_kind::Pow:
+            return isNumber(t->args()[1]) ? toDouble(*t->args()[1]->number()) * termDegree(t->args()[0]) : 0;
+        case sym_kind::Mul: {
+            double d = 0;
+            for (const auto &f : t->args()) d += termDegree(f);
+            return d;
+        }
+        default: return 0;
+    }
+}
+
+symptr productOf(const std::vector<symptr> &factors);
+symptr powerOf(const symptr &base, const symptr &exp);
+
+// The canonical constructors below take canonical operands and return
+// canonical results.
+
+symptr sumOf(const std::vector<symptr> &terms) {
+    valptr_t constant = std::make_shared<integer>(0);
+    std::vector<std::pair<symptr, valptr_t>> like; // rest, summed coefficient
+    std::unordered_map<const sym_node*, size_t> index;
+    std::vector<symptr> pending(terms.rbegin(), terms.rend());
+    while (!pending.empty()) {
+        symptr t = std::move(pending.back());
+        pending.pop_back();
+        if (t->kind() == sym_kind::Add) {
+            pending.insert(pending.end(), t->args().rbegin(), t->args().rend());
+        } else if (isNumber(t)) {
+            constant = applyBinary(binary_op::Add, constant, t->number());
+        } else {
+            auto [c, rest] = splitTerm(t);
+            auto [it, fresh] = index.emplace(rest.get(), like.size());
+            if (fresh) like.emplace_back(rest, c);
+            else like[it->second].second = applyBinary(binary_op::Add, like[it->second].second, c);
+        }
+    }
+    std::vector<std::pair<symptr, symptr>> out; // term, rest
+    for (auto &[rest, c] : like) {
+        if (toDouble(*c) == 0) continue;
+        out.emplace_back(isInt(c, 1) ? rest : productOf({sym_node::number(c), rest}), rest);
+    }
+    std::sort(out.begin(), out.end(), [](const auto &a, const auto &b) {
+        const double da = termDegree(a.second), db = termDegree(b.second);
+        if (da != db) return da > db;
+        return compare(a.second, b.second) < 0;
+    });
+    std::vector<symptr> result;
+    for (auto &t : out) result.push_back(std::move(t.first));
+    if (result.empty() || toDouble(*constant) != 0) result.push_back(sym_node::number(constant));
+    return result.size() == 1 ? result[0] : sym_node::add(std::move(result));
+}
+
+symptr productOf(const std::vector<symptr> &factors) {
+    valptr_t coeff = std::make_shared<integer>(1);
+    std::vector<std::pair<symptr, std::vector<symptr>>> powers; // base, exponents
+    std::unordered_map<const sym_node*, size_t> index;
+    std::vector<symptr> pending(factors.rbegin(), factors.rend());
+    while (!pending.empty()) {
+        symptr f = std::move(pending.back());
+        pending.pop_back();
+        if (f->kind() == sym_kind::Mul) {
+            pending.insert(pending.end(), f->args().rbegin(), f->args().rend());
+        } else if (isNumber(f)) {
+            coeff = applyBinary(binary_op::Mul, coeff, f->number());
+        } else {
+            const bool p = f->kind() == sym_kind::Pow;
+            const symptr &base = p ? f->args()[0] : f;
+            symptr exp = p ? f->args()[1] : lit(1);
+            auto [it, fresh] = index.emplace(base.get(), powers.size());
+            if (fresh) powers.push_back({base, {std::move(exp)}});
+            else powers[it->second].second.push_back(std::move(exp));
+        }
+    }
+    if (toDouble(*coeff) == 0) return sym_node::number(coeff);
+    std::vector<symptr> out;
+    bool regroup = false;
+    for (auto &[base, exps] : powers) {
+        symptr p = powerOf(base, exps.size() == 1 ? exps[0] : sumOf(exps));
+        if (isNumber(p)) {
+            coeff = applyBinary(binary_op::Mul, coeff, p->number());
+        } else if (p->kind() == sym_kind::Mul) {
+            // (a*b)^n came apart; its factors may share bases with others
+            out.insert(out.end(), p->args().begin(), p->args().end());
+            regroup = true;
+        } else {
+            out.push_back(std::move(p));
+        }
+    }
+    if (regroup) {
+        out.push_back(sym_node::number(coeff));
+        return productOf(out);
+    }
+    std::sort(out.begin(), out.end(), [](const symptr &a, const symptr &b) { return compare(a, b) < 0; });
+    if (!isInt(coeff, 1) || out.empty()) out.insert(out.begin(), sym_node::number(coeff));
+    return out.size() == 1 ? out[0] : sym_node::mul(std::move(out));
+}
+
+// largest root index for which radicals of exact numbers are simplified
+constexpr long long RADICAL_MAX_INDEX = 64;
+
+valptr_t intValue(const BigInt &n) {
+    return std::make_shared<integer>(n);
+}
+
+// An exact base to a power p/q (q > 1): the whole part of p/q and the
+// perfect q-th powers under the radical come out, and the radicand is made
+// an integer, so 12^(1/2) = 2*3^(1/2), (1/2)^(1/2) = 1/2*2^(1/2) and
+// 4^(1/4) = 2^(1/2).
+symptr radicalOf(const symptr &base, const symptr &exp) {
+    BigInt a, b(1), p, q;
+    const valptr_t &bv = base->number();
+    if (bv->kind() == value_kind::Integer) a = static_cast<const integer &>(*bv).getValue();
+    else std::tie(a, b) = static_cast<const fraction &>(*bv).toTuple();
+    std::tie(p, q) = static_cast<const fraction &>(*exp->number()).toTuple();
+    const bool odd = !(q % BigInt(2)).is_zero();
+    if (a.is_zero() && p.sign() > 0) return lit(0);
+    if (q > BigInt(RADICAL_MAX_INDEX) || (a.sign() < 0 && !odd) || a.is_zero()) return sym_node::pow(base, exp);
+    const unsigned k = static_cast<unsigned>(q.to_long_long());
+    // p = s q + r with 0 < r < q
+    BigInt s = p / q, r = p - s * q;
+    if (r.sign() < 0) {
+        r += q;
+        s -= BigInt(1);
+    }
+    valptr_t coeff = applyBinary(binary_op::Pow, bv, intValue(s));
+    // an odd root of -1 is -1
+    if (a.sign() < 0 && !(r % BigInt(2)).is_zero()) coeff = applyBinary(binary_op::Mul, coeff, intValue(BigInt(-1)));
+    // (a/b)^(r/q) = (a b^(q-1))^(r/q) / b^r
+    const valptr_t bq = applyBinary(binary_op::Pow, intValue(b), intValue(q - BigInt(1)));
+    const BigInt m = a.abs() * static_cast<const integer &>(*bq).getValue();
+    auto [c, rest] = extractRoot(m, k);
+    coeff = applyBinary(binary_op::Mul, coeff, applyBinary(binary_op::Pow, makeRational(c, b), intValue(r)));
+    if (rest == BigInt(1)) return sym_node::number(coeff);
+    // a radicand that is itself a power shares its exponent with the index
+    auto [root, t] = perfectPower(rest);
+    const symptr inner = t == 1 ? sym_node::pow(sym_node::number(intValue(rest)), sym_node::number(makeRational(r, q)))
+                                : powerOf(sym_node::number(intValue(root)),
+                                          sym_node::number(makeRational(r * BigInt(static_cast<long long>(t)), q)));
+    // built directly: productOf would simplify the power again
+    if (isNumber(inner)) return sym_node::number(applyBinary(binary_op::Mul, coeff, inner->number()));
+    std::vector<symptr> factors = inner->kind() == sym_kind::Mul ? inner->args() : std::vector<symptr>{inner};
+    if (isNumber(factors[0])) {
+        coeff = applyBinary(binary_op::Mul, coeff, factors[0]->number());
+        factors.erase(factors.begin());
+    }
+    if (!isInt(coeff, 1)) factors.insert(factors.begin(), sym_node::number(coeff));
+    return factors.size() == 1 ? factors[0] : sym_node::mul(std::move(factors));
+}
+
+symptr powerOf(const symptr &base, const symptr &exp) {
+    if (isNumber(exp)) {
+        const valptr_t &e = exp->number();
+        if (isInt(e, 0)) return lit(1);
+        if (isInt(e, 1)) return base;
+        // roots of exact numbers stay symbolic: 2^(1/2) is not 1.414...
+        if (isNumber(base) && (e->kind() != value_kind::Fraction || base->number()->kind() == value_kind::Decimal)) {
+            return sym_node::number(applyBinary(binary_op::Pow, base->number(), e));
+        }
+        if (isNumber(base) && e->kind() == value_kind::Fraction) return radicalOf(base, exp);
+        if (e->kind() == value_kind::Integer) {
+            if (base->kind() == sym_kind::Pow) {
+                return powerOf(base->args()[0], productOf({base->args()[1], exp}));
+            }
+            if (base->kind() == sym_kind::Mul) {
+                std::vector<symptr> fs;
+                for (const auto &f : base->args()) fs.push_back(powerOf(f, exp));
+                return productOf(fs);
+            }
+        }
+    }
+    if (isNumber(base) && isInt(base->number(), 1)) return base;
+    return sym_node::pow(base, exp);
+}
+
+symptr callOf(const std::string &fn, const std::vector<symptr> &args) {
+    // as a power, so sqrt(x)^2 = x and the power rule differentiates it
+    if (fn == "sqrt" && args.size() == 1) return powerOf(args[0], ratio(1, 2));
+    return sym_node::call(fn, args);
+}
+
+// n's value when its only symbols are the constants π and e; nothing when
+// another symbol or a function without a real counterpart is in it
+std::optional<double> constantValue(const symptr &n) {
+    using unary = double (*)(double);
+    static const std::unordered_map<std::string, unary> functions = {
+        {"sin", static_cast<unary>(std::sin)},     {"cos", static_cast<unary>(std::cos)},
+        {"tan", static_cast<unary>(std::tan)},     {"arcsin", static_cast<unary>(std::asin)},
+        {"arccos", static_cast<unary>(std::acos)}, {"arctan", static_cast<unary>(std::atan)},
+        {"sinh", static_cast<unary>(std::sinh)},   {"cosh", static_cast<unary>(std::cosh)},
+        {"tanh", static_cast<unary>(std::tanh)},   {"exp", static_cast<unary>(std::exp)},
+        {"ln", static_cast<unary>(std::log)},      {"log", static_cast<unary>(std::log10)},
+        {"abs", static_cast<unary>(std::fabs)},
+    };
+    std::vector<double> xs;
+    for (const auto &a : n->args()) {
+        const std::optional<double> x = constantValue(a);
+        if (!x) return std::nullopt;
+        xs.push_back(*x);
+    }
+    switch (n->kind()) {
+        case sym_kind::Number: return toDouble(*n->number());
+        case sym_kind::Symbol:
+            if (n->name() == "π") return std::numbers::pi;
+            if (n->name() == "e") return std::numbers::e;
+            return std::nullopt;
+        case sym_kind::Add: {
+            double sum = 0;
+            for (double x : xs) sum += x;
+            return sum;
+        }
+        case sym_kind::Mul: {
+            double product = 1;
+            for (double x : xs) product *= x;
+            return product;
+        }
+        case sym_kind::Pow: return std::pow(xs[0], xs[1]);
+        case sym_kind::Call: {
+            auto it = functions.find(n->name());
+            if (it == functions.end() || xs.size() != 1) return std::nullopt;
+            return it->second(xs[0]);
+        }
+    }
+    return std::nullopt;
+}
+
+// f'(u) for a builtin f; s is f(u) itself
+symptr outerDerivative(const std::string &fn, const symptr &u, const symptr &s) {
+    auto one = [](const std::string &f, const symptr &x) { return callOf(f, {x}); };
+    if (fn == "sin") return one("cos", u);
+    if (fn == "cos") return productOf({lit(-1), one("sin", u)});
+    if (fn == "tan") return powerOf(one("cos", u), lit(-2));
+    if (fn == "arcsin" || fn == "arccos") {
+        symptr d = powerOf(sumOf({lit(1), productOf({lit(-1), powerOf(u, lit(2))})}), ratio(-1, 2));
+        return fn == "arcsin" ? d : productOf({lit(-1), d});
+    }
+    if (fn == "arctan") return powerOf(sumOf({lit(1), powerOf(u, lit(2))}), lit(-1));
+    if (fn == "sinh") return one("cosh", u);
+    if (fn == "cosh") return one("sinh", u);
+    if (fn == "tanh") return powerOf(one("cosh", u), lit(-2));
+    if (fn == "exp") return s;
+    if (fn == "ln") return powerOf(u, lit(-1));
+    if (fn == "log") return powerOf(productOf({u, one("ln", lit(10))}), lit(-1));
+    if (fn == "abs") return productOf({u, powerOf(s, lit(-1))});
+    throw std::runtime_error("cannot differentiate " + fn);
+}
+
+// Printing. Levels: 1 sum, 2 product or quotient, 3 power, 4 atom; an
+// operand below the level its context needs is parenthesized.
+
+std::string str(const symptr &n);
+
+std::string numberString(const value &v) {
+    if (v.kind() == value_kind::Fraction) {
+        auto [num, den] = static_cast<const fraction &>(v).toTuple();
+        return num.to_string() + "/" + den.to_string();
+    }
+    return v.toString();
+}
+
+bool isReciprocal(const symptr &n) {
+    return n->kind() == sym_kind::Pow && isNumber(n->args()[1]) && isNegative(n->args()[1]->number());
+}
+
+int level(const symptr &n) {
+    switch (n->kind()) {
+        case sym_kind::Number: {
+            const valptr_t &v = n->number();
+            if (isNegative(v)) return 1;
+            return v->kind() == value_kind::Fraction ? 2 : 4;
+        }
+        case sym_kind::Add: return 1;
+        case sym_kind::Mul: return 2;
+        case sym_kind::Pow: {
+            if (isReciprocal(n)) return 2;
+            const symptr &e = n->args()[1];
+            return isNumber(e) && e->number()->equals(fraction(1, 2)) ? 4 : 3; // sqrt(...)
+        }
+        default: return 4;
+    }
+}
+
+std::string wrapped(const symptr &n, int need) {
+    std::string s = str(n);
+    return level(n) < need ? "(" + s + ")" : s;
+}
+
+std::string powerString(const symptr &base, const symptr &exp) {
+    if (isNumber(exp) && exp->number()->equals(fraction(1, 2))) return "sqrt(" + str(base) + ")";
+    return wrapped(base, 4) + "^" + wrapped(exp, 4);
+}
+
+// |product| with the sign reported separately, reciprocals as a quotient
+std::string productString(const std::vector<symptr> &factors, bool &negative) {
+    negative = false;
+    std::vector<std::string> top, bottom;
+    for (const auto &f : factors) {
+        if (isNumber(f)) {
+            valptr_t c = f->number();
+            if (isNegative(c)) {
+                negative = true;
+                c = applyBinary(binary_op::Mul, c, std::make_shared<integer>(-1));
+            }
+            if (c->kind() == value_kind::Fraction) {
+                auto [num, den] = static_cast<const fraction &>(*c).toTuple();
+                if (num != BigInt(1)) top.push_back(num.to_string());
+                bottom.push_back(den.to_string());
+            } else if (!isInt(c, 1)) {
+                top.push_back(c->toString());
+            }
+        } else if (isReciprocal(f)) {
+            symptr e = sym_node::number(applyBinary(binary_op::Mul, f->args()[1]->number(), std::make_shared<integer>(-1)));
+            bottom.push_back(isInt(e->number(), 1) ? wrapped(f->args()[0], 3) : powerString(f->args()[0], e));
+        } else {
+            top.push_back(wrapped(f, 2));
+        }
+    }
+    auto join = [](const std::vector<std::string> &parts) {
+        std::string s;
+        for (const auto &p : parts) s += (s.empty() ? "" : "*") + p;
+        return s;
+    };
+    std::string out = top.empty() ? "1" : join(top);
+    if (!bottom.empty()) out += "/" + (bottom.size() > 1 ? "(" + join(bottom) + ")" : bottom[0]);
+    return out;
+}
+
+std::string str(const symptr &n) {
+    switch (n->kind()) {
+        case sym_kind::Number: return numberString(*n->number());
+        case sym_kind::Symbol: return n->name();
+        case sym_kind::Call: {
+            std::string s = n->name() + "(";
+            for (size_t i = 0; i < n->args().size(); ++i) s += (i ? "," : "") + str(n->args()[i]);
+            return s + ")";
+        }
+        case sym_kind::Pow:
+            if (isReciprocal(n)) break;
+            return powerString(n->args()[0], n->args()[1]);
+        case sym_kind::Add: {
+            std::string s;
+            for (const auto &t : n->args()) {
+                bool negative = false;
+                std::string ts;
+                if (isNumber(t)) {
+                    negative = isNegative(t->number());
+                    ts = numberString(*applyBinary(binary_op::Mul, t->number(), std::make_shared<integer>(negative ? -1 : 1)));
+                } else if (t->kind() == sym_kind::Mul || isReciprocal(t)) {
+                    ts = productString(t->kind() == sym_kind::Mul ? t->args() : std::vector<symptr>{t}, negative);
+                } else {
+                    ts = str(t);
+                }
+                s += negative ? "-" : s.empty() ? "" : "+";
+                s += ts;
+            }
+            return s;
+        }
+        case sym_kind::Mul: break;
+    }
+    bool negative;
+    std::string s = productString(n->kind() == sym_kind::Mul ? n->args() : std::vector<symptr>{n}, negative);
+    return negative ? "-" + s : s;
+}
+
+} // namespace
+
+sym_node::sym_node(sym_kind k, valptr_t num, std::string label, std::vector<symptr> operands)
+    : k(k), num(std::move(num)), label(std::move(label)), operands(std::move(operands)) {
+    hashValue = static_cast<size_t>(k);
+    if (this->num) mix(hashValue, this->num->hash());
+    mix(hashValue, std::hash<std::string>()(this->label));
+    // children are interned, so their addresses identify them
+    for (const auto &o : this->operands) mix(hashValue, std::hash<const void*>()(o.get()));
+}
+
+symptr sym_node::intern(sym_node &&candidate) {
+    intern_table &t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+    auto &bucket = t.buckets[candidate.hashValue];
+    for (size_t i = 0; i < bucket.size();) {
+        symptr p = bucket[i].lock();
+        if (!p) {
+            bucket[i] = std::move(bucket.back());
+            bucket.pop_back();
+            --t.entries;
+            continue;
+        }
+        if (p->k == candidate.k && p->label == candidate.label && p->operands == candidate.operands &&
+            (p->num ? candidate.num && p->num->equals(*candidate.num) : !candidate.num)) {
+            return p;
+        }
+        ++i;
+    }
+    symptr p(new sym_node(std::move(candidate)));
+    bucket.push_back(p);
+    if (++t.entries > t.sweepAt) {
+        for (auto it = t.buckets.begin(); it != t.buckets.end();) {
+            auto &b = it->second;
+            b.erase(std::remove_if(b.begin(), b.end(), [](const auto &w) { return w.expired(); }), b.end());
+            it = b.empty() ? t.buckets.erase(it) : std::next(it);
+        }
+        t.entries = 0;
+        for (const auto &[h, b] : t.buckets) t.entries += b.size();
+        t.sweepAt = std::max<size_t>(4096, 2 * t.entries);
+    }
+    return p;
+}
+
+size_t sym_node::liveCount() {
+    intern_table &t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+    size_t n = 0;
+    for (const auto &[h, b] : t.buckets) {
+        for (const auto &w : b) n += !w.expired();
+    }
+    return n;
+}
+
+symptr sym_node::number(valptr_t v) {
+    if (!v || !isNumeric(v->kind())) throw std::runtime_error("expected a number");
+    return intern(sym_node(sym_kind::Number, std::move(v), "", {}));
+}
+
+symptr sym_node::symbol(const std::string &name) {
+    return intern(sym_node(sym_kind::Symbol, nullptr, name, {}));
+}
+
+symptr sym_node::add(std::vector<symptr> terms) {
+    return intern(sym_node(sym_kind::Add, nullptr, "", std::move(terms)));
+}
+
+symptr sym_node::mul(std::vector<symptr> factors) {
+    return intern(sym_node(sym_kind::Mul, nullptr, "", std::move(factors)));
+}
+
+symptr sym_node::pow(symptr base, symptr exp) {
+    return intern(sym_node(sym_kind::Pow, nullptr, "", {std::move(base), std::move(exp)}));
+}
+
+symptr sym_node::call(const std::string &fn, std::vector<symptr> args) {
+    return intern(sym_node(sym_kind::Call, nullptr, fn, std::move(args)));
+}
+
+symptr simplify(const symptr &n) {
+    {
+        std::lock_guard<std::mutex> guard(memoLock);
+        if (n->canonical) return n;
+        if (n->simplifiedMemo) return n->simplifiedMemo;
+    }
+    std::vector<symptr> args;
+    args.reserve(n->args().size());
+    for (const auto &a : n->args()) args.push_back(simplify(a));
+    symptr r;
+    switch (n->kind()) {
+        case sym_kind::Number:
+        case sym_kind::Symbol: r = n; break;
+        case sym_kind::Add: r = sumOf(args); break;
+        case sym_kind::Mul: r = productOf(args); break;
+        case sym_kind::Pow: r = powerOf(args[0], args[1]); break;
+        case sym_kind::Call: r = callOf(n->name(), args); break;
+    }
+    std::lock_guard<std::mutex> guard(memoLock);
+    r->canonical = true;
+    if (r != n) n->simplifiedMemo = r;
+    return r;
+}
+
+symptr derivative(const symptr &n, const symptr &var) {
+    if (var->kind() != sym_kind::Symbol) throw std::runtime_error("can only differentiate with respect to a variable");
+    const symptr s = simplify(n);
+    {
+        std::lock_guard<std::mutex> guard(memoLock);
+        for (const auto &[v, d] : s->derivativeMemo) {
+            if (v.lock() != var) continue;
+            if (symptr r = d.lock()) return r;
+        }
+    }
+    const auto &a = s->args();
+    symptr r;
+    switch (s->kind()) {
+        case sym_kind::Number: r = lit(0); break;
+        case sym_kind::Symbol: r = lit(s == var ? 1 : 0); break;
+        case sym_kind::Add: {
+            std::vector<symptr> terms;
+            for (const auto &t : a) terms.push_back(derivative(t, var));
+            r = sumOf(terms);
+            break;
+        }
+        case sym_kind::Mul: {
+            std::vector<symptr> terms;
+            for (size_t i = 0; i < a.size(); ++i) {
+                symptr d = derivative(a[i], var);
+                if (isZero(d)) continue;
+                std::vector<symptr> fs(a);
+                fs[i] = std::move(d);
+                terms.push_back(productOf(fs));
+            }
+            r = sumOf(terms);
+            break;
+        }
+        case sym_kind::Pow: {
+            const symptr &b = a[0], &e = a[1];
+            symptr db = derivative(b, var), de = derivative(e, var);
+            if (isZero(de)) {
+                r = productOf({e, powerOf(b, sumOf({e, lit(-1)})), db});
+            } else if (isZero(db)) {
+                r = productOf({s, callOf("ln", {b}), de});
+            } else {
+                r = productOf({s, sumOf({productOf({de, callOf("ln", {b})}), productOf({e, db, powerOf(b, lit(-1))})})});
+            }
+            break;
+        }
+        case sym_kind::Call: {
+            if (a.size() != 1) throw std::runtime_error("cannot differentiate " + s->name());
+            symptr du = derivative(a[0], var);
+            r = isZero(du) ? lit(0) : productOf({outerDerivative(s->name(), a[0], s), du});
+            break;
+        }
+    }
+    std::lock_guard<std::mutex> guard(memoLock);
+    r->canonical = true;
+    auto &memo = s->derivativeMemo;
+    memo.erase(std::remove_if(memo.begin(), memo.end(), [](const auto &e) { return e.first.expired() || e.second.expired(); }),
+               memo.end());
+    memo.emplace_back(var, r);
+    return r;
+}
+
+symbolic::symbolic(symptr node) : node(std::move(node)) {}
+
+std::string symbolic::toString() const {
+    return str(node);
+}
+
+size_t symbolic::hash() const {
+    return node->hash();
+}
+
+bool symbolic::equals(const value &other) const {
+    return other.kind() == value_kind::Symbolic && static_cast<const symbolic &>(other).node == node;
+}
+
+valptr_t makeSymbol(const std::string &name) {
+    return std::make_shared<symbolic>(sym_node::symbol(name));
+}
+
+valptr_t symArith(binary_op op, const value &l, const value &r) {
+    // π and e are numbers next to a decimal, so π*1.0 is 3.141593, and
+    // ordering needs them as numbers
+    const bool ordering = op == binary_op::Lt || op == binary_op::Le || op == binary_op::Gt || op == binary_op::Ge;
+    if (ordering || l.kind() == value_kind::Decimal || r.kind() == value_kind::Decimal) {
+        auto approximated = [](const value &v) {
+            return v.kind() == value_kind::Symbolic ? symConstantValue(static_cast<const symbolic &>(v)) : copyNumber(v);
+        };
+        const valptr_t a = approximated(l), b = approximated(r);
+        if (a && b) return applyBinary(op, a, b);
+    }
+    auto operand = [](const value &v) {
+        return v.kind() == value_kind::Symbolic ? static_cast<const symbolic &>(v).getNode() : sym_node::number(copyNumber(v));
+    };
+    const symptr a = operand(l), b = operand(r);
+    switch (op) {
+        case binary_op::Add: return wrap(simplify(sym_node::add({a, b})));
+        case binary_op::Sub: return wrap(simplify(sym_node::add({a, sym_node::mul({lit(-1), b})})));
+        case binary_op::Mul: return wrap(simplify(sym_node::mul({a, b})));
+        case binary_op::Div: return wrap(simplify(sym_node::mul({a, sym_node::pow(b, lit(-1))})));
+        case binary_op::Pow: return wrap(simplify(sym_node::pow(a, b)));
+        // canonical forms are unique, so this is structural equality
+        case binary_op::Eq: return std::make_shared<boolean>(a == b);
+        case binary_op::Ne: return std::make_shared<boolean>(a != b);
+        default: throw std::runtime_error("invalid operand types: " + l.toString() + ", " + r.toString());
+    }
+}
+
+valptr_t symPower(const valptr_t &base, const valptr_t &exp) {
+    auto operand = [](const valptr_t &v) {
+        return v->kind() == value_kind::Symbolic ? static_cast<const symbolic &>(*v).getNode() : sym_node::number(copyNumber(*v));
+    };
+    return wrap(simplify(sym_node::pow(operand(base), operand(exp))));
+}
+
+valptr_t symCall(const std::string &fn, const valptr_t &arg) {
+    if (!arg || arg->kind() != value_kind::Symbolic) throw std::runtime_error(fn + " expects one number");
+    return wrap(simplify(sym_node::call(fn, {static_cast<const symbolic &>(*arg).getNode()})));
+}
+
+valptr_t symApproximate(const symbolic &v) {
+    std::unordered_map<const sym_node*, symptr> done;
+    std::function<symptr(const symptr &)> approx = [&](const symptr &n) -> symptr {
+        auto it = done.find(n.get());
+        if (it != done.end()) return it->second;
+        symptr r;
+        if (isNumber(n)) {
+            r = n->number()->kind() == value_kind::Decimal ? n : sym_node::number(std::make_shared<decimal>(toDouble(*n->number())));
+        } else {
+            std::vector<symptr> args;
+            for (const auto &a : n->args()) args.push_back(approx(a));
+            switch (n->kind()) {
+                case sym_kind::Add: r = sym_node::add(std::move(args)); break;
+                case sym_kind::Mul: r = sym_node::mul(std::move(args)); break;
+                case sym_kind::Pow: r = sym_node::pow(args[0], args[1]); break;
+                case sym_kind::Call: r = sym_node::call(n->name(), std::move(args)); break;
+                default: r = n; break;
+            }
+        }
+        return done[n.get()] = r;
+    };
+    if (valptr_t c = symConstantValue(v)) return c;
+    return wrap(simplify(approx(v.getNode())));
+}
+
+valptr_t symConstantValue(const symbolic &v) {
+    const std::optional<double> x = constantValue(v.getNode());
+    if (!x || std::isnan(*x)) return nullptr;
+    return std::make_shared<decimal>(*x);
+}
+
+void register_symbolic_builtins(runtime_env &env) {
+    // d(expr, var[, order]): expr is evaluated with var undefined, so it
+    // becomes an expression in var even when var has a value
+    auto d = [](const char* form) {
+        return [form](const call_node &c, runtime_env &env) -> valptr_t {
+            if (c.args.size() != 2 && c.args.size() != 3) {
+                throw std::runtime_error(std::string(form) + " expects (expr, var[, order])");
+            }
+            const std::string &name = formVariable(c, 1, form);
+            long long order = 1;
+            if (c.args.size() == 3) {
+                valptr_t o = evaluator(env).run(*c.args[2]);
+                if (!o || o->kind() != value_kind::Integer || static_cast<const integer &>(*o).getValue().sign() < 0) {
+                    throw std::runtime_error(std::string(form) + " order must be a non-negative integer");
+                }
+                order = static_cast<const integer &>(*o).getValue().to_long_long();
+            }
+            valptr_t v;
+            {
+                scoped_variable bound(env, name);
+                env.unsetVariable(name);
+                v = asList(evaluator(env).run(*c.args[0]));
+            }
+            const symptr var = sym_node::symbol(name);
+            auto diff = [&](const valptr_t &x) -> valptr_t {
+                if (!x) throw std::runtime_error(std::string(form) + " expects an expression");
+                if (isNumeric(x->kind())) return order == 0 ? x : std::make_shared<integer>(0);
+                if (x->kind() != value_kind::Symbolic) {
+                    throw std::runtime_error(std::string(form) + " expects an expression, got " + x->toString());
+                }
+                symptr n = static_cast<const symbolic &>(*x).getNode();
+                for (long long i = 0; i < order; ++i) n = derivative(n, var);
+                return wrap(n);
+            };
+            if (v && v->kind() == value_kind::List) return mapList(static_cast<const valuelist &>(*v), diff);
+            return diff(v);
+        };
+    };
+    env.registerForm("d", d("d"));
+    env.registerForm("derivative", d("derivative"));
+}
+
+} // namespace ti
@@ -0,0 +1,180 @@
+#include "../include/threadpool.h"
+#include "../include/budget.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <limits>
+
+namespace ti {
+
+namespace {
+
+size_t hardwareThreads() {
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+} // namespace
+
+struct thread_pool::job {
+    struct range {
+        std::atomic<size_t> next{0};
+        size_t end = 0;
+    };
+
+    const std::function<void(size_t)>* body = nullptr;
+    size_t tasks = 0;
+    size_t slots = 0;
+    std::unique_ptr<range[]> ranges;
+    std::atomic<size_t> joined{0};
+    std::atomic<size_t> finished{0};
+
+    std::mutex errorLock;
+    std::atomic<size_t> firstError{std::numeric_limits<size_t>::max()};
+    std::exception_ptr error;
+
+    std::mutex doneLock;
+    std::condition_variable done;
+
+    void execute(size_t i) {
+        // nothing after a failure can change the outcome
+        if (i < firstError.load(std::memory_order_relaxed)) {
+            try {
+                (*body)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> g(errorLock);
+                if (i < firstError.load()) {
+                    firstError = i;
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (finished.fetch_add(1) + 1 == tasks) {
+            std::lock_guard<std::mutex> g(doneLock);
+            done.notify_all();
+        }
+    }
+};
+
+void thread_pool::participate(job &j) {
+    const size_t slot = j.joined.fetch_add(1);
+    if (slot >= j.slots) return;
+    // own range first, then steal from the others in turn
+    for (size_t k = 0; k < j.slots; ++k) {
+        job::range &r = j.ranges[(slot + k) % j.slots];
+        for (size_t i = r.next.fetch_add(1); i < r.end; i = r.next.fetch_add(1)) j.execute(i);
+    }
+}
+
+thread_pool::thread_pool(size_t threads) : maxThreads(std::max<size_t>(1, threads)) {
+    for (size_t i = 1; i < maxThreads; ++i) workers.emplace_back(&thread_pool::workerLoop, this);
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard<std::mutex> g(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &w : workers) w.join();
+}
+
+thread_pool &thread_pool::shared() {
+    static thread_pool pool(hardwareThreads());
+    return pool;
+}
+
+void thread_pool::setMaxThreads(size_t n) {
+    std::lock_guard<std::mutex> g(lock);
+    maxThreads = n == 0 ? hardwareThreads() : n;
+    while (workers.size() + 1 < maxThreads) workers.emplace_back(&thread_pool::workerLoop, this);
+}
+
+void thread_pool::workerLoop() {
+    for (;;) {
+        std::shared_ptr<job> j;
+        {
+            std::unique_lock<std::mutex> l(lock);
+            wake.wait(l, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            j = jobs.front();
+            if (j->joined.load() >= j->slots) {
+                jobs.pop_front();
+                continue;
+            }
+        }
+        participate(*j);
+    }
+}
+
+void thread_pool::run(size_t tasks, const std::function<void(size_t)> &body) {
+    size_t slots;
+    {
+        std::lock_guard<std::mutex> g(lock);
+        slots = std::min({tasks, maxThreads, workers.size() + 1});
+    }
+    if (slots <= 1) {
+        for (size_t i = 0; i < tasks; ++i) body(i);
+        return;
+    }
+
+    // the caller's deadline and cancellation apply on every thread, so
+    // checkpoint() in a task sees them; its memory limit counts the
+    // caller's thread only
+    const eval_budget* outer = currentBudget();
+    eval_budget shared;
+    if (outer) {
+        shared = *outer;
+        shared.memoryLimit = 0;
+    }
+    const std::thread::id caller = std::this_thread::get_id();
+    const std::function<void(size_t)> budgeted = [&](size_t i) {
+        if (!outer || std::this_thread::get_id() == caller) {
+            body(i);
+            return;
+        }
+        budget_scope scope(&shared);
+        body(i);
+    };
+
+    auto j = std::make_shared<job>();
+    j->body = &budgeted;
+    j->tasks = tasks;
+    j->slots = slots;
+    j->ranges.reset(new job::range[slots]);
+    for (size_t s = 0; s < slots; ++s) {
+        j->ranges[s].next = tasks * s / slots;
+        j->ranges[s].end = tasks * (s + 1) / slots;
+    }
+    {
+        std::lock_guard<std::mutex> g(lock);
+        jobs.push_back(j);
+    }
+    wake.notify_all();
+
+    participate(*j);
+    {
+        std::unique_lock<std::mutex> l(j->doneLock);
+        j->done.wait(l, [&j] { return j->finished.load() == j->tasks; });
+    }
+    {
+        // workers that arrive late find every range empty, so the job
+        // never touches `body` after this returns
+        std::lock_guard<std::mutex> g(lock);
+        auto it = std::find(jobs.begin(), jobs.end(), j);
+        if (it != jobs.end()) jobs.erase(it);
+    }
+    if (j->error) std::rethrow_exception(j->error);
+}
+
+void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)> &body) {
+    if (n == 0) return;
+    grain = std::max<size_t>(1, grain);
+    const size_t chunks = (n + grain - 1) / grain;
+    // the budget is checked between chunks (run carries it to the workers)
+    thread_pool::shared().run(chunks, [&](size_t c) {
+        checkpoint();
+        body(c * grain, std::min(n, (c + 1) * grain));
+    });
+}
+
+} // namespace ti
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <variant>
 #include "../include/colors.h"
+#include "../include/arith.h"
 
 // Type trait to detect if a type is a std::variant
 template<typename T>
@@ -25,14 +26,52 @@ std::string value::toString() const {
     return "<value>";
 }
 
+// unknown value types only compare equal to themselves
+size_t value::hash() const {
+    return std::hash<const void*>()(this);
+}
+
+bool value::equals(const value &other) const {
+    return this == &other;
+}
+
 // === void_t implementation ===
 std::string void_t::toString() const {
     return "Done";
 }
 
+size_t void_t::hash() const {
+    return 0;
+}
+
+bool void_t::equals(const value &other) const {
+    return other.kind() == value_kind::Void;
+}
+
+// === boolean implementation ===
+boolean::boolean(bool value) : value(value) {}
+
+bool boolean::getValue() const {
+    return value;
+}
+
+std::string boolean::toString() const {
+    return value ? "true" : "false";
+}
+
+size_t boolean::hash() const {
+    return value ? 1 : 2;
+}
+
+bool boolean::equals(const ti::value &other) const {
+    return other.kind() == value_kind::Boolean && static_cast<const boolean &>(other).value == value;
+}
+
 // === integer implementation ===
 integer::integer(long long value) : value(value) {}
 
+integer::integer(BigInt value) : value(std::move(value)) {}
+
 BigInt integer::getValue() const {
     return value;
 }
@@ -41,6 +80,14 @@ std::string integer::toString() const {
     return value.to_string();
 }
 
+size_t integer::hash() const {
+    return value.hash();
+}
+
+bool integer::equals(const ti::value &other) const {
+    return other.kind() == value_kind::Integer && static_cast<const integer &>(other).value == value;
+}
+
 // === decimal implementation ===
 decimal::decimal(double value) : value(value) {}
 
@@ -54,6 +101,14 @@ std::string decimal::toString() const {
     return std::to_string(value);
 }
 
+size_t decimal::hash() const {
+    return std::hash<double>()(value);
+}
+
+bool decimal::equals(const ti::value &other) const {
+    return other.kind() == value_kind::Decimal && static_cast<const decimal &>(other).value == value;
+}
+
 // === fraction implementation ===
 fraction::fraction(const integer& numerator, const integer& denominator)
     : numerator(numerator), denominator(denominator) {}
@@ -70,7 +125,7 @@ integer fraction::getDenominator() const {
 }
 
 double fraction::getValue() const {
-    return static_cast<double>(numerator.getValue().to_long_long()) / denominator.getValue().to_long_long();
+    return numerator.getValue().to_double() / denominator.getValue().to_double();
 }
 
 decimal fraction::getDecimalValue() const {
@@ -81,6 +136,28 @@ std::tuple<BigInt, BigInt> fraction::toTuple() const {
     return std::make_tuple(numerator.getValue(), denominator.getValue());
 }
 
+// hash the reduced form so 2/4 and 1/2 collide, matching equals()
+size_t fraction::hash() const {
+    BigInt n = numerator.getValue();
+    BigInt d = denominator.getValue();
+    BigInt g = ti::gcd(n, d);
+    if (!g.is_zero()) {
+        n /= g;
+        d /= g;
+    }
+    if (d.sign() < 0) {
+        n = -n;
+        d = -d;
+    }
+    return n.hash() * 31 + d.hash();
+}
+
+bool fraction::equals(const ti::value &other) const {
+    if (other.kind() != value_kind::Fraction) return false;
+    auto &o = static_cast<const fraction &>(other);
+    return numerator.getValue() * o.denominator.getValue() == o.numerator.getValue() * denominator.getValue();
+}
+
 std::string fraction::toString() const {
     return "(" + numerator.getValue().to_string() + ") / (" + denominator.getValue().to_string() + ")";
 }
@@ -96,6 +173,14 @@ std::string string::toString() const {
     return "\"" + value + "\"";
 }
 
+size_t string::hash() const {
+    return std::hash<std::string>()(value);
+}
+
+bool string::equals(const ti::value &other) const {
+    return other.kind() == value_kind::String && static_cast<const string &>(other).value == value;
+}
+
 // Explicit template instantiation for common types
 template class list<integer>;
 template class list<decimal>;
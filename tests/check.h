@@ -0,0 +1,71 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../include/repl.h"
+
+// Minimal assertions for the behavior tests: a failed check prints where
+// and why, and main's `return check::result();` then exits nonzero.
+namespace check {
+
+inline int failures = 0;
+
+inline void fail(const char* file, int line, const std::string &what) {
+    ++failures;
+    std::cerr << file << ":" << line << ": " << what << std::endl;
+}
+
+inline int result() {
+    if (failures) std::cerr << failures << " check(s) failed" << std::endl;
+    return failures ? 1 : 0;
+}
+
+// code's result in r, which must not be an error
+inline std::string eval(ti::repl &r, const std::string &code, const char* file, int line) {
+    ti::cmdres res = r.expr(code);
+    if (res.exitcode != 0) fail(file, line, code + " failed: " + res.output);
+    return res.output;
+}
+
+} // namespace check
+
+#define CHECK(cond)                                                             \
+    do {                                                                        \
+        if (!(cond)) check::fail(__FILE__, __LINE__, "CHECK(" #cond ")");       \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                          \
+    do {                                                                        \
+        const auto &check_a = (a);                                              \
+        const auto &check_b = (b);                                              \
+        if (!(check_a == check_b)) {                                            \
+            std::ostringstream check_os;                                        \
+            check_os << #a " == " #b ": " << check_a << " != " << check_b;      \
+            check::fail(__FILE__, __LINE__, check_os.str());                    \
+        }                                                                       \
+    } while (0)
+
+#define CHECK_THROWS(expr)                                                      \
+    do {                                                                        \
+        bool check_threw = false;                                               \
+        try {                                                                   \
+            (void)(expr);                                                       \
+        } catch (const std::exception &) {                                      \
+            check_threw = true;                                                 \
+        }                                                                       \
+        if (!check_threw) check::fail(__FILE__, __LINE__, #expr " did not throw"); \
+    } while (0)
+
+// the result of code in repl r, checked to be a success
+#define EVAL(r, code) check::eval(r, code, __FILE__, __LINE__)
+
+// code in repl r must fail with an error
+#define CHECK_ERROR(r, code)                                                    \
+    do {                                                                        \
+        if ((r).expr(code).exitcode == 0) check::fail(__FILE__, __LINE__, std::string(code) + " did not fail"); \
+    } while (0)
+
+#endif // TESTS_CHECK_H
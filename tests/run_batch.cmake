@@ -0,0 +1,13 @@
+# Runs REPL OPTIONS --batch SCRIPT and compares its stdout with EXPECTED
+# and its exit status with STATUS.
+separate_arguments(options UNIX_COMMAND "${OPTIONS}")
+execute_process(COMMAND ${REPL} ${options} --batch ${SCRIPT}
+                OUTPUT_VARIABLE output
+                RESULT_VARIABLE status)
+file(READ ${EXPECTED} expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "output of ${SCRIPT}:\n${output}\nexpected:\n${expected}")
+endif()
+if(NOT status EQUAL STATUS)
+    message(FATAL_ERROR "${SCRIPT} exited with ${status}, expected ${STATUS}")
+endif()
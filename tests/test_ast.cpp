@@ -0,0 +1,41 @@
+// One tree evaluated by several threads, each with its own env and operand
+// kinds, so the call and operator inline caches are shared and rewritten.
+#include "check.h"
+#include "../include/parser.h"
+#include "../include/runtimeenv.h"
+
+#include <atomic>
+#include <thread>
+
+int main() {
+    constexpr int THREADS = 4;
+    const char* xs[THREADS] = {"3", "1.5", "2/3", "4"};
+    const char* fs[THREADS] = {"f(x):=x+1", "f(x):=x+2", "f(x):=x*2", "f(x):=x-1"};
+
+    std::vector<std::unique_ptr<ti::repl>> repls;
+    for (int t = 0; t < THREADS; ++t) {
+        repls.push_back(std::make_unique<ti::repl>());
+        EVAL(*repls[t], std::string("x:=") + xs[t]);
+        EVAL(*repls[t], fs[t]);
+    }
+    std::vector<ti::statement> stmts = ti::parse("x*x+f(x)", repls[0]->environment());
+    ast::exprnode &tree = *stmts.at(0).body;
+
+    std::string expected[THREADS];
+    for (int t = 0; t < THREADS; ++t) expected[t] = tree.eval(repls[t]->environment())->toString();
+    CHECK_EQ(expected[0], "13");
+
+    std::atomic<int> wrong{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 20000; ++i) {
+                if (tree.eval(repls[t]->environment())->toString() != expected[t]) ++wrong;
+            }
+        });
+    }
+    for (auto &th : threads) th.join();
+    CHECK_EQ(wrong.load(), 0);
+
+    return check::result();
+}
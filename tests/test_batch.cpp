@@ -0,0 +1,74 @@
+// Column evaluation: every result equals the interpreter's at the same
+// point, through branches, exact constants, user functions and errors.
+#include "check.h"
+#include "../include/batch.h"
+
+namespace {
+
+// the interpreter's answer for code at each x, or "error"; every x has at
+// most three decimals, so x:= reads back the same double
+std::vector<std::string> pointwise(ti::repl &r, const std::string &code, const std::vector<double> &xs) {
+    std::vector<std::string> out;
+    for (double x : xs) {
+        EVAL(r, "x:=" + std::to_string(x));
+        ti::cmdres res = r.expr(code);
+        out.push_back(res.exitcode == 0 ? res.output : "error");
+    }
+    return out;
+}
+
+std::vector<std::string> batched(ti::repl &r, const std::string &code, const std::vector<double> &xs) {
+    std::vector<ti::statement> stmts = ti::parse(code, r.environment());
+    ti::batch_evaluator batch(*stmts.at(0).body, "x", r.environment());
+    CHECK(batch.supported());
+    std::vector<std::string> out;
+    for (const auto &v : batch.eval(xs.data(), xs.size())) out.push_back(v->toString());
+    return out;
+}
+
+} // namespace
+
+int main() {
+    ti::repl r;
+    EVAL(r, "f(t):=t^2-1/3");
+    EVAL(r, "Define g(t)=Func:If t<1 Then:0-t:Else:sqrt(t):EndIf:EndFunc");
+
+    // enough points for several blocks and the vector kernels' tails
+    std::vector<double> xs;
+    for (int i = 0; i < 3001; ++i) xs.push_back((i - 1500) / 200.0);
+    for (const char* code : {"3*x^2+2*x-1", "x/3+1/3", "f(x)*2", "g(x)", "sin(x)*exp(0-x^2)", "abs(x)<1"}) {
+        CHECK(batched(r, code, xs) == pointwise(r, code, xs));
+    }
+
+    double out[4];
+    const double some[4] = {1, 2, 3, 4};
+    std::vector<ti::statement> stmts = ti::parse("x^2+1", r.environment());
+    ti::batch_evaluator squares(*stmts.at(0).body, "x", r.environment());
+    CHECK(squares.evalNumeric(some, 4, out));
+    CHECK(out[0] == 2 && out[3] == 17);
+
+    // an element the interpreter rejects fails the whole batch
+    stmts = ti::parse("1/(x-2)", r.environment());
+    ti::batch_evaluator pole(*stmts.at(0).body, "x", r.environment());
+    CHECK_THROWS(pole.eval(some, 4));
+
+    // seq runs exact ranges in the interpreter and decimal ones in columns
+    CHECK_EQ(EVAL(r, "seq(i^2,i,1,5)"), "{1, 4, 9, 16, 25}");
+    CHECK_EQ(EVAL(r, "seq(i/2,i,1,3)"), "{(1) / (2), 1, (3) / (2)}");
+    CHECK_EQ(EVAL(r, "seq(g(i),i,0.,4.,2)"), "{0.000000, 1.414214, 2.000000}");
+    CHECK_EQ(EVAL(r, "seq(i,i,5,1,0-2)"), "{5, 3, 1}");
+    CHECK_EQ(EVAL(r, "seq(i,i,1,0)"), "{}");
+    // the index variable is restored afterwards
+    EVAL(r, "i:=\"kept\"");
+    EVAL(r, "seq(i,i,1,3)");
+    CHECK_EQ(EVAL(r, "i"), "\"kept\"");
+    CHECK_ERROR(r, "seq(i,i,1,5,0)");
+    CHECK_ERROR(r, "seq(1/(i-2),i,0.,4.)");
+
+    // lists in braces
+    CHECK_EQ(EVAL(r, "{1,2,x}"), "{1, 2, 7.500000}");
+    CHECK_EQ(EVAL(r, "{}"), "{}");
+    CHECK_ERROR(r, "{1,2");
+
+    return check::result();
+}
@@ -0,0 +1,96 @@
+// Statement budgets: steps, time, cancellation, and their reach into
+// thread-pool tasks and number-theory kernels.
+#include "check.h"
+#include "../include/threadpool.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// code run under b, as repl::evaluate runs a statement; the limit it hit,
+// or -1 if it finished
+int limitHit(ti::repl &r, const std::string &code, const ti::eval_budget &b) {
+    ti::runtime_env &env = r.environment();
+    env.setBudget(b);
+    ti::budget_scope scope(&env.getBudget());
+    int hit = -1;
+    try {
+        r.expr(code);
+    } catch (const ti::limit_exceeded &e) {
+        hit = static_cast<int>(e.kind());
+    }
+    env.setBudget(ti::eval_budget());
+    return hit;
+}
+
+double secondsSince(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+} // namespace
+
+int main() {
+    ti::repl r;
+    const int steps = static_cast<int>(ti::budget_kind::Steps);
+    const int time = static_cast<int>(ti::budget_kind::Time);
+    const int cancelled = static_cast<int>(ti::budget_kind::Cancelled);
+
+    // loops and calls count as steps
+    CHECK_EQ(limitHit(r, "While true:EndWhile", ti::eval_budget::starting(0, 0, 1000)), steps);
+    EVAL(r, "Define down(n)=Func:If n=0 Then:0:Else:down(n-1):EndIf:EndFunc");
+    CHECK_EQ(limitHit(r, "down(5000)", ti::eval_budget::starting(0, 0, 1000)), steps);
+    CHECK_EQ(limitHit(r, "down(500)", ti::eval_budget::starting(0, 0, 1000)), -1);
+    CHECK_EQ(limitHit(r, "seq(k,k,1,100000)", ti::eval_budget::starting(0, 0, 1000)), steps);
+
+    // a deadline
+    auto start = clock_type::now();
+    CHECK_EQ(limitHit(r, "While true:EndWhile", ti::eval_budget::starting(0.2, 0)), time);
+    CHECK(secondsSince(start) < 2);
+
+    // cancellation from another thread, as Ctrl-C does
+    {
+        ti::eval_budget b;
+        b.control = std::make_shared<ti::eval_control>();
+        std::thread canceller([control = b.control] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            control->cancel();
+        });
+        CHECK_EQ(limitHit(r, "While true:EndWhile", b), cancelled);
+        canceller.join();
+        CHECK(b.control->steps.load() > 0);
+    }
+
+    // the session survives and runs unlimited again
+    CHECK_EQ(EVAL(r, "down(20000)"), "0");
+
+    // thread-pool tasks run under the caller's budget, on however many
+    // cores this machine has
+    ti::thread_pool::shared().setMaxThreads(4);
+    {
+        ti::eval_budget b = ti::eval_budget::starting(60, 0);
+        ti::budget_scope scope(&b);
+        std::atomic<int> unbudgeted{0};
+        ti::thread_pool::shared().run(256, [&](size_t) {
+            if (!ti::currentBudget()) ++unbudgeted;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        });
+        CHECK_EQ(unbudgeted.load(), 0);
+
+        b.control = std::make_shared<ti::eval_control>();
+        b.control->cancel();
+        CHECK_THROWS(ti::thread_pool::shared().run(256, [](size_t) { ti::checkpoint(); }));
+    }
+    CHECK(ti::currentBudget() == nullptr);
+
+    // ECM curves on the pool stop at the deadline: (2^89-1)(2^107-1) has
+    // no factor small enough to finish in the time allowed
+    start = clock_type::now();
+    CHECK_EQ(limitHit(r, "factor((2^89-1)*(2^107-1))", ti::eval_budget::starting(0.3, 0)), time);
+    CHECK(secondsSince(start) < 3);
+
+    return check::result();
+}
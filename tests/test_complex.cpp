@@ -0,0 +1,43 @@
+// Complex numbers and packed complex arrays: exactness, powers, division
+// by zero, shapes and the complex format.
+#include "check.h"
+
+int main() {
+    ti::repl r;
+
+    // exact parts stay exact; approximate ones go through doubles
+    CHECK_EQ(EVAL(r, "(1+𝑖)^2"), "2*i");
+    CHECK_EQ(EVAL(r, "real((2+3𝑖)*(2-3𝑖))"), "13");
+    CHECK_EQ(EVAL(r, "conj(1+2𝑖)"), "1-2*i");
+    CHECK_ERROR(r, "(1.+𝑖)/0");
+    // integral exponents multiply instead of going through exp and log,
+    // so (1+i)^2 has no rounding left in its real part
+    CHECK_EQ(EVAL(r, "real((1.+𝑖)^2.)=0"), "true");
+
+    EVAL(r, "a:=complex({1,2,3,4,5},{1,0,1,0,1})");
+    CHECK_EQ(EVAL(r, "sum(abs(real(complex({1,1,1,1,1},1)^2.)))=0"), "true");
+    CHECK_EQ(EVAL(r, "a-a=complex({0,0,0,0,0},0)"), "{true, true, true, true, true}");
+    // a zero divisor anywhere, whether the vector or the scalar loop gets it
+    CHECK_ERROR(r, "a/complex({1,1,1,1,0},0)");
+    CHECK_ERROR(r, "a/complex({0,1,1,1,1},0)");
+    CHECK_ERROR(r, "a/0");
+    CHECK_ERROR(r, "a/complex({1,1},{0,0})");
+
+    // a matrix only combines with one of its shape
+    EVAL(r, "m:=complex({{1,2},{3,4}},0)");
+    CHECK_EQ(EVAL(r, "m+m"), EVAL(r, "2*m"));
+    CHECK_ERROR(r, "m+complex({1,2,3,4},0)");
+
+    // Rectangular and Polar extend sqrt and ln to negatives, and Polar
+    // prints complex results as (r∠θ)
+    CHECK_EQ(EVAL(r, "getMode(\"Real or Complex Format\")"), "\"Real\"");
+    CHECK_EQ(EVAL(r, "setMode(\"Real or Complex Format\",\"Rectangular\")"), "\"Real\"");
+    CHECK_EQ(EVAL(r, "sqrt(0-4)"), "2*i");
+    CHECK_EQ(EVAL(r, "ln(0-1)"), "3.141593*i");
+    EVAL(r, "setMode(\"Real or Complex Format\",\"Polar\")");
+    CHECK_EQ(EVAL(r, "2𝑖"), "(2.000000∠1.570796)");
+    CHECK_EQ(EVAL(r, "getMode(\"Real or Complex Format\")"), "\"Polar\"");
+    CHECK_ERROR(r, "setMode(\"Real or Complex Format\",\"Spherical\")");
+
+    return check::result();
+}
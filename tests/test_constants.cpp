@@ -0,0 +1,82 @@
+// Constants to many digits, against slower independent series computed
+// here with guard digits, and the same at any precision once cached.
+#include "check.h"
+#include "../include/constants.h"
+
+namespace {
+
+constexpr size_t GUARD = 10;
+
+BigInt pow10(size_t n) {
+    BigInt p(1);
+    for (size_t i = 0; i < n; ++i) p *= BigInt(10);
+    return p;
+}
+
+// scale * atan(1/n), truncated term by term
+BigInt atanInv(long long n, const BigInt &scale) {
+    BigInt sum(0), power = scale / BigInt(n);
+    const BigInt n2(n * n);
+    for (long long k = 0; power != BigInt(0); ++k) {
+        const BigInt term = power / BigInt(2 * k + 1);
+        if (k % 2) sum -= term;
+        else sum += term;
+        power /= n2;
+    }
+    return sum;
+}
+
+// floor(c * 10^digits) from x * 10^(digits + GUARD)
+BigInt dropGuard(const BigInt &x) { return x / pow10(GUARD); }
+
+BigInt machinPi(size_t digits) {
+    const BigInt scale = pow10(digits + GUARD);
+    return dropGuard(BigInt(16) * atanInv(5, scale) - BigInt(4) * atanInv(239, scale));
+}
+
+BigInt factorialSeriesE(size_t digits) {
+    BigInt sum(0), term = pow10(digits + GUARD);
+    for (long long k = 1; term != BigInt(0); ++k) {
+        sum += term;
+        term /= BigInt(k);
+    }
+    return dropGuard(sum);
+}
+
+// ln 2 = sum 1 / (k 2^k)
+BigInt halvingSeriesLn2(size_t digits) {
+    BigInt sum(0), power = pow10(digits + GUARD) / BigInt(2);
+    for (long long k = 1; power != BigInt(0); ++k) {
+        sum += power / BigInt(k);
+        power /= BigInt(2);
+    }
+    return dropGuard(sum);
+}
+
+} // namespace
+
+int main() {
+    // the small request first, so the larger one replaces the cache
+    const std::string pi50 = ti::constantString(ti::math_constant::Pi, 50);
+    CHECK_EQ(pi50, "3.14159265358979323846264338327950288419716939937510");
+    CHECK(ti::constantDigits(ti::math_constant::Pi, 1500) == machinPi(1500));
+    CHECK_EQ(ti::constantString(ti::math_constant::Pi, 50), pi50);
+
+    CHECK(ti::constantDigits(ti::math_constant::E, 1500) == factorialSeriesE(1500));
+    CHECK(ti::constantDigits(ti::math_constant::Ln2, 800) == halvingSeriesLn2(800));
+    CHECK_EQ(ti::constantString(ti::math_constant::E, 0), "2");
+
+    // floor(sqrt(2) 10^d) is the integer square root of 2 10^(2d)
+    const BigInt s = ti::constantDigits(ti::math_constant::Sqrt2, 2000);
+    const BigInt target = BigInt(2) * pow10(4000);
+    CHECK(s * s <= target);
+    CHECK((s + BigInt(1)) * (s + BigInt(1)) > target);
+
+    ti::repl r;
+    CHECK_EQ(EVAL(r, "constDigits(\"e\",30)"), "\"2.718281828459045235360287471352\"");
+    CHECK_EQ(EVAL(r, "constDigits(\"ln2\",20)"), "\"0.69314718055994530941\"");
+    CHECK_ERROR(r, "constDigits(\"tau\",10)");
+    CHECK_ERROR(r, "constDigits(\"pi\",0-1)");
+
+    return check::result();
+}
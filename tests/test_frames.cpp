@@ -0,0 +1,62 @@
+// Call frames: parameters and Locals shadow globals and vanish on return,
+// globals stay reachable, and neither tail calls nor deep recursion use
+// the native stack.
+#include "check.h"
+
+int main() {
+    ti::repl r;
+
+    EVAL(r, "x:=100");
+    EVAL(r, "scale:=3");
+    EVAL(r, "f(x):=x*scale");
+    CHECK_EQ(EVAL(r, "f(2)"), "6");
+    CHECK_EQ(EVAL(r, "x"), "100");
+
+    // a Local is assigned in the frame; an undeclared name is the global
+    EVAL(r, "Define g(n)=Func\n"
+            "Local x\n"
+            "x:=n+1\n"
+            "hits:=hits+1\n"
+            "Return x*scale\n"
+            "EndFunc");
+    EVAL(r, "hits:=0");
+    CHECK_EQ(EVAL(r, "g(1)+g(2)"), "15");
+    CHECK_EQ(EVAL(r, "x"), "100");
+    CHECK_EQ(EVAL(r, "hits"), "2");
+    CHECK_EQ(EVAL(r, "n"), "n");
+
+    // each activation has its own slots
+    EVAL(r, "Define fib(n)=Func\n"
+            "Local a, b\n"
+            "If n<2 Then\n"
+            "  n\n"
+            "Else\n"
+            "  a:=fib(n-1)\n"
+            "  b:=fib(n-2)\n"
+            "  a+b\n"
+            "EndIf\n"
+            "EndFunc");
+    CHECK_EQ(EVAL(r, "fib(20)"), "6765");
+    CHECK_EQ(EVAL(r, "a"), "a");
+
+    // a program's value is Done; what it assigns to globals stays
+    EVAL(r, "Define p()=Prgm:Local t:t:=1:out:=t:EndPrgm");
+    CHECK_EQ(EVAL(r, "p()"), "Done");
+    CHECK_EQ(EVAL(r, "out"), "1");
+    CHECK_ERROR(r, "Local q");
+
+    // deep recursion runs on the evaluator's heap stack, not the native one
+    EVAL(r, "Define down(n)=Func:If n=0 Then:0:Else:1+down(n-1):EndIf:EndFunc");
+    CHECK_EQ(EVAL(r, "down(200000)"), "200000");
+    // an error deep down unwinds every frame and the session keeps going
+    CHECK_ERROR(r, "down(\"a\")");
+    CHECK_EQ(EVAL(r, "down(50)"), "50");
+
+    // a call in tail position replaces its caller's frame, so it is not
+    // held to the limit
+    EVAL(r, "Define loop(n,acc)=Func:If n=0 Then:acc:Else:loop(n-1,acc+n):EndIf:EndFunc");
+    CHECK_EQ(EVAL(r, "loop(100000,0)"), "5000050000");
+    CHECK_EQ(EVAL(r, "x"), "100");
+
+    return check::result();
+}
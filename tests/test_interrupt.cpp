@@ -0,0 +1,60 @@
+// Ctrl-C in the interactive REPL interrupts the running statement and
+// returns to the prompt with the session intact. Runs the ti_repl binary
+// given as the argument with its stdin and stdout on pipes.
+#include "check.h"
+
+#include <chrono>
+#include <csignal>
+#include <string>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "usage: test_interrupt PATH_TO_TI_REPL" << std::endl;
+        return 2;
+    }
+    int in[2], out[2];
+    if (::pipe(in) != 0 || ::pipe(out) != 0) return 2;
+    const pid_t pid = ::fork();
+    if (pid < 0) return 2;
+    if (pid == 0) {
+        ::dup2(in[0], STDIN_FILENO);
+        ::dup2(out[1], STDOUT_FILENO);
+        ::close(in[0]);
+        ::close(in[1]);
+        ::close(out[0]);
+        ::close(out[1]);
+        ::execl(argv[1], argv[1], static_cast<char*>(nullptr));
+        ::_exit(127);
+    }
+    ::close(in[0]);
+    ::close(out[1]);
+
+    auto write = [&](const std::string &s) {
+        CHECK_EQ(::write(in[1], s.data(), s.size()), static_cast<ssize_t>(s.size()));
+    };
+    write("x:=7\n");
+    write("While true:EndWhile\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    ::kill(pid, SIGINT);
+    write("x*6\n");
+    write("exit\n");
+    ::close(in[1]);
+
+    std::string output;
+    char block[4096];
+    ssize_t n;
+    while ((n = ::read(out[0], block, sizeof block)) > 0) output.append(block, static_cast<size_t>(n));
+    ::close(out[0]);
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK(output.find("interrupted") != std::string::npos);
+    CHECK(output.find("42") != std::string::npos);
+    if (check::failures) std::cerr << "output:\n" << output << std::endl;
+    return check::result();
+}
@@ -0,0 +1,71 @@
+// Native code for numeric functions: the same answers as the interpreter,
+// and a compilation that stays alive for a caller while another thread
+// replaces it.
+#include "check.h"
+#include "../include/jit.h"
+#include "../include/runtimeenv.h"
+
+#include <atomic>
+#include <thread>
+
+int main() {
+    if (!ti::jitSupported()) return check::result();
+
+    ti::repl plain;
+    ti::repl jit;
+    EVAL(jit, "setMode(\"Compile\",\"On\")");
+    for (ti::repl* r : {&plain, &jit}) {
+        EVAL(*r, "f(x):=x^2+3*x-1");
+        EVAL(*r, "Define g(x)=Func:If x<0 Then:Return 0-x:Else:Return x:EndIf:EndFunc");
+        EVAL(*r, "h(x):={x,x}");
+    }
+    for (const char* code : {"f(1.5)", "f(0.-2)", "g(0.-2.5)", "g(2.5)", "f(1/3)", "1/f(0.)"}) {
+        CHECK_EQ(EVAL(jit, code), EVAL(plain, code));
+    }
+    CHECK_ERROR(jit, "1/(f(0.)+1)");
+    ti::runtime_env &env = jit.environment();
+    CHECK(ti::jitCodeFor(*env.getFunction("f"), env) != nullptr);
+    CHECK(ti::jitCodeFor(*env.getFunction("h"), env) == nullptr);
+
+    // a NaN that is a complex result outside Real format goes to the
+    // interpreter, and compiled code is not reused across formats
+    for (ti::repl* r : {&plain, &jit}) {
+        EVAL(*r, "r(x):=sqrt(x)+0");
+        EVAL(*r, "p(x):=x^0.5");
+        EVAL(*r, "l(x):=ln(x)*2");
+    }
+    for (const char* format : {"Rectangular", "Real", "Polar"}) {
+        const std::string set = std::string("setMode(\"Real or Complex Format\",\"") + format + "\")";
+        EVAL(plain, set);
+        EVAL(jit, set);
+        for (const char* code : {"r(4.)", "r(0.-4)", "p(0.-4)", "l(0.-1)", "r(0.-4)*r(0.-4)"}) {
+            CHECK_EQ(EVAL(jit, code), EVAL(plain, code));
+        }
+    }
+    EVAL(jit, "setMode(\"Real or Complex Format\",\"Rectangular\")");
+    CHECK_EQ(EVAL(jit, "r(0.-4)"), EVAL(jit, "2.*𝑖"));
+    EVAL(jit, "setMode(\"Real or Complex Format\",\"Real\")");
+
+    // threads in two calc modes keep replacing f's cached code while the
+    // others run what they got
+    ti::repl approximate;
+    EVAL(approximate, "setMode(\"Auto or Approx\",\"Approximate\")");
+    const ti::function &f = *env.getFunction("f");
+    std::atomic<int> wrong{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        ti::runtime_env &e = t % 2 ? approximate.environment() : env;
+        threads.emplace_back([&f, &e, &wrong] {
+            for (int i = 0; i < 2000; ++i) {
+                const std::shared_ptr<ti::jit_code> code = ti::jitCodeFor(f, e);
+                const double x = i;
+                ti::valptr_t result;
+                if (!code || !code->invoke(&x, result) || ti::toDouble(*result) != x * x + 3 * x - 1) ++wrong;
+            }
+        });
+    }
+    for (auto &th : threads) th.join();
+    CHECK_EQ(wrong.load(), 0);
+
+    return check::result();
+}
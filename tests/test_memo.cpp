@@ -0,0 +1,78 @@
+// Memoization: the cache is a bounded LRU keyed by argument values, opted
+// into per function or, under the Auto policy, used for every function
+// proven pure (one that touches nothing but its parameters and Locals).
+#include "check.h"
+#include "../include/memo.h"
+
+int main() {
+    ti::repl r;
+
+    // nothing is cached until a function opts in
+    EVAL(r, "Define fib(n)=Func:If n<2 Then:n:Else:fib(n-1)+fib(n-2):EndIf:EndFunc");
+    CHECK_EQ(EVAL(r, "getMode(\"Memoize\")"), "\"Opt-in\"");
+    CHECK_EQ(EVAL(r, "fib(15)"), "610");
+    CHECK_EQ(EVAL(r, "memoStats()"), "{0, 0, 0, 0}");
+    // each fib(k) is computed once, so this finishes
+    EVAL(r, "memoize(fib)");
+    CHECK_EQ(EVAL(r, "fib(90)"), "2880067194370816120");
+    CHECK_EQ(EVAL(r, "memoStats()"), "{88, 91, 0, 91}");
+    CHECK_EQ(EVAL(r, "fib(90)"), "2880067194370816120");
+    CHECK_EQ(EVAL(r, "memoStats()"), "{89, 91, 0, 91}");
+    // a redefinition drops the cached results and the opt-in
+    EVAL(r, "Define fib(n)=Func:If n<2 Then:n:Else:fib(n-1)+fib(n-2):EndIf:EndFunc");
+    CHECK_EQ(EVAL(r, "fib(10)"), "55");
+    CHECK_EQ(EVAL(r, "memoStats()"), "{89, 91, 0, 0}");
+    CHECK_ERROR(r, "memoize(sin)");
+    CHECK_ERROR(r, "memoize(nosuch)");
+    CHECK_ERROR(r, "memoize(fib,1)");
+
+    // under Auto, only functions proven pure are cached
+    EVAL(r, "setMode(\"Memoize\",\"Auto\")");
+    EVAL(r, "Define tri(n)=Func:Local k,s:s:=0:For k,1,n:s:=s+k:EndFor:s:EndFunc");
+    EVAL(r, "c:=1");
+    EVAL(r, "g(x):=x+c");
+    EVAL(r, "Define h(x)=Func:c:=x:x:EndFunc");
+    EVAL(r, "calls(x):=g(x)");
+    const std::string before = EVAL(r, "memoStats()");
+    CHECK_EQ(EVAL(r, "g(1)+h(2)+calls(3)"), "9"); // h sets c first
+    CHECK_EQ(EVAL(r, "memoStats()"), before);
+    CHECK_EQ(EVAL(r, "tri(100)+tri(100)"), "10100");
+    CHECK(EVAL(r, "memoStats()") != before);
+    // a redefinition is seen by the callers' cached verdicts
+    EVAL(r, "g(x):=x+1");
+    CHECK_EQ(EVAL(r, "calls(3)+calls(3)"), "8");
+    CHECK_EQ(EVAL(r, "calls(3)"), "4");
+    // results cached in one mode are not reused in another
+    EVAL(r, "half(x):=x/2");
+    CHECK_EQ(EVAL(r, "half(1)"), "(1) / (2)");
+    EVAL(r, "setMode(\"Auto or Approx\",\"Approximate\")");
+    CHECK_EQ(EVAL(r, "half(1)"), "0.500000");
+    EVAL(r, "setMode(\"Auto or Approx\",\"Auto\")");
+    EVAL(r, "setMode(\"Memoize\",\"Off\")");
+    CHECK_EQ(EVAL(r, "memoize(half):half(3):memoStats()"), EVAL(r, "memoStats()"));
+
+    // equal values are equal keys, whatever object holds them
+    ti::memo_cache memo;
+    const ti::function f, other;
+    auto half = [] { return std::make_shared<ti::fraction>(1, 2); };
+    memo.store(&f, {half()}, std::make_shared<ti::integer>(7));
+    CHECK(memo.lookup(&f, {half()}) != nullptr);
+    CHECK(memo.lookup(&other, {half()}) == nullptr);
+    CHECK(memo.lookup(&f, {std::make_shared<ti::decimal>(0.5)}) == nullptr);
+    CHECK_EQ(memo.getStats().hits, 1u);
+    CHECK_EQ(memo.getStats().misses, 2u);
+
+    // the least recently used entry goes first
+    memo.setCapacity(3);
+    for (long long i = 0; i < 3; ++i) memo.store(&f, {std::make_shared<ti::integer>(i)}, half());
+    CHECK(memo.lookup(&f, {std::make_shared<ti::integer>(0)}) != nullptr);
+    memo.store(&f, {std::make_shared<ti::integer>(3)}, half());
+    CHECK_EQ(memo.getStats().entries, 3u);
+    CHECK(memo.getStats().evictions >= 2);
+    CHECK(memo.lookup(&f, {std::make_shared<ti::integer>(1)}) == nullptr);
+    CHECK(memo.lookup(&f, {std::make_shared<ti::integer>(0)}) != nullptr);
+    memo.clear();
+    CHECK_EQ(memo.getStats().entries, 0u);
+
+    return check::result();
+}
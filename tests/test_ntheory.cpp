@@ -0,0 +1,159 @@
+// Number theory against naive definitions: factorials and binomials,
+// modular powers, primality, factorizations and integer roots.
+#include "check.h"
+#include "../include/ntheory.h"
+
+namespace {
+
+bool trialPrime(uint64_t n) {
+    if (n < 2) return false;
+    for (uint64_t d = 2; d * d <= n; ++d) {
+        if (n % d == 0) return false;
+    }
+    return true;
+}
+
+BigInt mersenne(unsigned p) {
+    BigInt m(1);
+    for (unsigned i = 0; i < p; ++i) m *= BigInt(2);
+    return m - BigInt(1);
+}
+
+} // namespace
+
+int main() {
+    // prime swing against the running product, across small and large n
+    BigInt running(1);
+    bool factorials = true;
+    for (uint64_t n = 0; n <= 2000; ++n) {
+        if (n > 0) running *= BigInt(static_cast<long long>(n));
+        if (n <= 300 || n % 97 == 0) factorials = factorials && ti::factorial(n) == running;
+    }
+    CHECK(factorials);
+
+    // every binomial of row 120 from Pascal's rule
+    std::vector<BigInt> row{BigInt(1)};
+    for (int n = 1; n <= 120; ++n) {
+        std::vector<BigInt> next(n + 1, BigInt(1));
+        for (int k = 1; k < n; ++k) next[k] = row[k - 1] + row[k];
+        row = std::move(next);
+    }
+    bool binomials = true;
+    for (uint64_t k = 0; k <= 120; ++k) binomials = binomials && ti::binomial(120, k) == row[k];
+    CHECK(binomials);
+    CHECK(ti::fallingFactorial(50, 0) == BigInt(1));
+    CHECK(ti::fallingFactorial(50, 50) == ti::factorial(50));
+    CHECK(ti::fallingFactorial(2000, 700) * ti::factorial(1300) == ti::factorial(2000));
+
+    std::vector<uint64_t> big(5000, (uint64_t(1) << 62) + 1);
+    BigInt expected(1);
+    for (uint64_t f : big) expected *= BigInt(static_cast<long long>(f));
+    CHECK(ti::productTree(big) == expected);
+    CHECK(ti::productTree({}) == BigInt(1));
+
+    // b^e mod m by repeated multiplication, odd and even moduli
+    bool powers = true;
+    for (long long m : {1LL, 2LL, 97LL, 1000LL, 4294967311LL, 999999999989LL}) {
+        for (long long b : {0LL, 1LL, 7LL, 123456789LL}) {
+            BigInt naive = BigInt(1) % BigInt(m);
+            for (long long e = 0; e <= 40; ++e) {
+                powers = powers && ti::powMod(BigInt(b), BigInt(e), BigInt(m)) == naive;
+                naive = naive * BigInt(b) % BigInt(m);
+            }
+        }
+    }
+    CHECK(powers);
+    // Fermat for a modulus past one word
+    CHECK(ti::powMod(BigInt(3), mersenne(127) - BigInt(1), mersenne(127)) == BigInt(1));
+
+    bool primes = true;
+    for (uint64_t n = 0; n < 20000; ++n) {
+        primes = primes && ti::isPrime(BigInt(static_cast<long long>(n))) == trialPrime(n);
+    }
+    CHECK(primes);
+    // Carmichael numbers and strong pseudoprimes to the small bases
+    for (long long n : {561LL, 41041LL, 3215031751LL, 3825123056546413051LL}) CHECK(!ti::isPrime(BigInt(n)));
+    CHECK(ti::isPrime(mersenne(61)));
+    CHECK(ti::isPrime(mersenne(89)));
+    CHECK(ti::isPrime(mersenne(127)));
+    CHECK(!ti::isPrime(mersenne(67)));
+    CHECK(!ti::isPrime(mersenne(61) * mersenne(89)));
+
+    // factors multiply back, ascend and are prime; 2^67 - 1 and a prime
+    // past 2^40 times 2^89 - 1 are beyond trial division
+    uint64_t p40 = (uint64_t(1) << 40) + 1;
+    while (!trialPrime(p40)) p40 += 2;
+    for (const BigInt &n : {BigInt(360), BigInt(-12), mersenne(67), mersenne(89) * BigInt(static_cast<long long>(p40)),
+                            BigInt(2147483647) * BigInt(2147483647) * BigInt(1000000007)}) {
+        BigInt product(n < BigInt(0) ? -1 : 1);
+        BigInt previous(1);
+        bool ok = true;
+        for (const auto &[q, e] : ti::factor(n)) {
+            ok = ok && q > previous && ti::isPrime(q);
+            previous = q;
+            for (unsigned i = 0; i < e; ++i) product *= q;
+        }
+        CHECK(ok);
+        CHECK(product == n);
+        if (n == mersenne(67)) CHECK_EQ(ti::factor(n).front().first.to_string(), "193707721");
+    }
+    CHECK_THROWS(ti::factor(BigInt(0)));
+
+    // floor roots bracket n, also at and next to exact powers
+    bool roots = true;
+    for (const BigInt &base : {BigInt(1), BigInt(2), BigInt(999999999), mersenne(89), mersenne(127) * BigInt(12345)}) {
+        for (unsigned k : {1u, 2u, 3u, 5u, 16u}) {
+            BigInt power(1);
+            for (unsigned i = 0; i < k; ++i) power *= base;
+            for (const BigInt &n : {power - BigInt(1), power, power + BigInt(1)}) {
+                const BigInt x = ti::iroot(n, k);
+                BigInt lo(1), hi(1);
+                for (unsigned i = 0; i < k; ++i) {
+                    lo *= x;
+                    hi *= x + BigInt(1);
+                }
+                roots = roots && lo <= n && n < hi;
+            }
+            BigInt root;
+            roots = roots && ti::isPower(power, k, &root) && root == base;
+            roots = roots && (k == 1 || base == BigInt(1) || !ti::isPower(power + BigInt(1), k));
+        }
+    }
+    CHECK(roots);
+    CHECK(ti::isqrt(BigInt(0)) == BigInt(0));
+    CHECK(ti::isqrt(mersenne(127) * mersenne(127)) == mersenne(127));
+    CHECK(ti::isPower(BigInt(-27), 3) && !ti::isPower(BigInt(-4), 2));
+
+    const BigInt cube = mersenne(61) * mersenne(61) * mersenne(61);
+    const auto [base, exp] = ti::perfectPower(cube * cube);
+    CHECK(base == mersenne(61) && exp == 6u);
+    CHECK_EQ(ti::perfectPower(BigInt(1000001)).second, 1u);
+    // 2^5 3^7 = (2 3^2)^3 * (2^2 3)
+    const auto [outside, inside] = ti::extractRoot(BigInt(32 * 2187), 3);
+    CHECK(outside == BigInt(18) && inside == BigInt(12));
+
+    ti::repl r;
+    CHECK_EQ(EVAL(r, "root(27,3)"), "3");
+    CHECK_EQ(EVAL(r, "root(0-8,3)"), "-2");
+    CHECK_EQ(EVAL(r, "root(8/27,3)"), "(2) / (3)");
+    CHECK_EQ(EVAL(r, "root(2^300,100)"), "8");
+    CHECK_EQ(EVAL(r, "root(8,2)"), "2.828427");
+
+    CHECK_EQ(EVAL(r, "factor(360)"), "{{2, 3}, {3, 2}, {5, 1}}");
+    CHECK_EQ(EVAL(r, "factor(0-12)"), "{{-1, 1}, {2, 2}, {3, 1}}");
+    CHECK_EQ(EVAL(r, "isPrime(2^127-1)"), "true");
+    CHECK_EQ(EVAL(r, "powMod(3,200,1000)"), "1");
+    CHECK_ERROR(r, "powMod(3,0-1,7)");
+    CHECK_ERROR(r, "factor(0)");
+    CHECK_EQ(EVAL(r, "factorial(20)"), "2432902008176640000");
+    CHECK_EQ(EVAL(r, "25!"), "15511210043330985984000000");
+    CHECK_EQ(EVAL(r, "3!^2"), "36");
+    CHECK_EQ(EVAL(r, "nCr(52,5)"), "2598960");
+    CHECK_EQ(EVAL(r, "nCr(5,7)"), "0");
+    CHECK_EQ(EVAL(r, "nPr(10,3)"), "720");
+    CHECK_EQ(EVAL(r, "factorial({3,4})"), "{6, 24}");
+    CHECK_ERROR(r, "factorial(0-1)");
+    CHECK_ERROR(r, "nCr(\"5\",2)");
+
+    return check::result();
+}
@@ -0,0 +1,56 @@
+// The numeric solvers on functions with known answers, directly and through
+// nInt, nDeriv, nSolve and fMin, and the report of how they got there.
+#include "check.h"
+#include "../include/numeric.h"
+
+#include <cmath>
+
+namespace {
+
+ti::sampler of(double (*f)(double)) {
+    return [f](const std::vector<double> &xs, std::vector<double> &ys) {
+        ys.resize(xs.size());
+        for (size_t i = 0; i < xs.size(); ++i) ys[i] = f(xs[i]);
+    };
+}
+
+} // namespace
+
+int main() {
+    ti::numeric_report report;
+
+    // roots: to the last bit away from zero, and converging at zero, where
+    // the relative tolerance alone is nothing
+    auto square2 = of([](double x) { return x * x - 2; });
+    CHECK(std::fabs(ti::findRoot(square2, 1, 2, -1, 2, report) - std::sqrt(2.0)) <= 4e-16);
+    CHECK(report.converged);
+    auto cube = of([](double x) { return x * x * x; });
+    const double zero = ti::findRoot(cube, -1, 2, -1, 8, report);
+    CHECK(report.converged);
+    CHECK(std::fabs(zero) < 1e-10);
+
+    CHECK(std::fabs(ti::integrate(of([](double x) { return x * x; }), 0, 1, report) - 1.0 / 3) < 1e-14);
+    CHECK(std::fabs(ti::integrate(of([](double x) { return 1 / std::sqrt(x); }), 0, 1, report) - 2) < 1e-8);
+    CHECK(std::fabs(ti::integrate(of([](double x) { return std::exp(-x * x); }), -INFINITY, INFINITY, report) -
+                    std::sqrt(M_PI)) < 1e-10);
+    CHECK(std::fabs(ti::derivative(of([](double x) { return std::sin(x); }), 0, 0.1, report) - 1) < 1e-10);
+    double fx;
+    const double x = ti::minimize(of([](double x) { return (x - 1) * (x - 1) + 3; }), -2, 5, fx, report);
+    CHECK(std::fabs(x - 1) < 1e-7);
+    CHECK_EQ(fx, 3.0);
+
+    ti::repl r;
+    CHECK_EQ(EVAL(r, "numericReport()"), "\"no numeric calculation yet\"");
+    CHECK_EQ(EVAL(r, "nSolve(x^2=2,x,1)"), "1.414214");
+    CHECK_EQ(EVAL(r, "abs(nSolve(x^3,x,0-1,2))<10^(0-12)"), "true");
+    CHECK_EQ(EVAL(r, "nInt(x^2,x,0,3)"), "9.000000");
+    CHECK_EQ(EVAL(r, "numericReport()"), "\"gauss-kronrod, 15 evaluations, error 1e-13\"");
+    CHECK_EQ(EVAL(r, "nInt(exp(0-x^2),x,0-∞,∞)"), "1.772454");
+    CHECK_EQ(EVAL(r, "nInt(1/x^2,x,1,∞)"), "1.000000");
+    CHECK_EQ(EVAL(r, "1/∞"), "0.000000");
+    CHECK_EQ(EVAL(r, "nDeriv(x^3,x,2)"), "12.000000");
+    CHECK_EQ(EVAL(r, "fMin((x-1)^2,x)"), "1.000000");
+    CHECK_ERROR(r, "nSolve(x^2+1,x,0-1,1)");
+
+    return check::result();
+}
@@ -0,0 +1,81 @@
+// ODE solving: known solutions within tolerance, dense output between
+// steps, both directions, stiff problems, and the odeSolve/odeField forms.
+#include "check.h"
+#include "../include/ode.h"
+
+#include <cmath>
+#include <functional>
+
+namespace {
+
+// f from a per-point function of (t, y, dy)
+class rhs_of : public ti::ode_rhs {
+    size_t n;
+    std::function<void(double, const double*, double*)> f;
+
+public:
+    rhs_of(size_t n, std::function<void(double, const double*, double*)> f) : n(n), f(std::move(f)) {}
+    size_t dim() const override { return n; }
+    void eval(size_t count, const double* t, const double* y, double* dy) override {
+        for (size_t i = 0; i < count; ++i) f(t[i], y + i * n, dy + i * n);
+    }
+};
+
+} // namespace
+
+int main() {
+    ti::ode_options opts;
+    ti::ode_stats stats;
+
+    rhs_of decay(1, [](double, const double* y, double* dy) { dy[0] = -y[0]; });
+    auto sols = ti::solveOde(decay, 0, 2, {1, 3}, opts, stats);
+    CHECK_EQ(sols.size(), 2u);
+    CHECK(std::fabs(sols[0].finalState()[0] - std::exp(-2.0)) < 1e-6);
+    CHECK(std::fabs(sols[1].finalState()[0] - 3 * std::exp(-2.0)) < 1e-6);
+    // backwards from t=2
+    auto back = ti::solveOde(decay, 2, 0, {std::exp(-2.0)}, opts, stats);
+    CHECK(std::fabs(back[0].finalState()[0] - 1) < 1e-6);
+
+    // y'' = -y: cos and -sin, sampled between the accepted steps too
+    rhs_of spring(2, [](double, const double* y, double* dy) {
+        dy[0] = y[1];
+        dy[1] = -y[0];
+    });
+    auto orbit = ti::solveOde(spring, 0, 10, {1, 0}, opts, stats);
+    double worst = 0, y[2];
+    for (int i = 0; i <= 1000; ++i) {
+        const double t = i * 0.01;
+        orbit[0].at(t, y);
+        worst = std::max({worst, std::fabs(y[0] - std::cos(t)), std::fabs(y[1] + std::sin(t))});
+    }
+    CHECK(worst < 1e-4);
+    CHECK(orbit[0].stepCount() < 1000);
+
+    // stiff: the implicit method needs far fewer steps than the explicit one
+    rhs_of stiff(1, [](double t, const double* y, double* dy) { dy[0] = -1e5 * (y[0] - std::cos(t)); });
+    ti::ode_stats explicitStats, implicitStats;
+    auto viaDP = ti::solveOde(stiff, 0, 1, {0}, opts, explicitStats);
+    opts.method = ti::ode_method::Rosenbrock;
+    auto viaRB = ti::solveOde(stiff, 0, 1, {0}, opts, implicitStats);
+    const double exact = std::cos(1.0) + std::sin(1.0) / 1e5; // to O(1e-10)
+    CHECK(std::fabs(viaDP[0].finalState()[0] - exact) < 1e-4);
+    CHECK(std::fabs(viaRB[0].finalState()[0] - exact) < 1e-4);
+    CHECK(viaRB[0].stepCount() * 10 < viaDP[0].stepCount());
+
+    ti::repl r;
+    EVAL(r, "f(t,y):=0-y");
+    // within the default tolerances of e^-t at 0, 1/2 and 1
+    EVAL(r, "e1:=exp(0-1)");
+    CHECK_EQ(EVAL(r, "abs(odeSolve(f,0,1,1)-e1)<10^(0-5)"), "true");
+    CHECK_EQ(EVAL(r, "abs(odeSolve(f,0,1,1,0.5)-{1,exp(0-0.5),e1})<10^(0-5)"), "{true, true, true}");
+    CHECK_EQ(EVAL(r, "abs(odeSolve(f,0,1,1,0.5,\"stiff\")-{1,exp(0-0.5),e1})<10^(0-4)"), "{true, true, true}");
+    CHECK_EQ(EVAL(r, "abs(odeField(f,0,1,{1,2})-{1,2}*e1)<10^(0-5)"), "{true, true}");
+    // a list state for a system: y' = {y2, -y1} from {1, 0} is {cos t, -sin t}
+    EVAL(r, "s(t,y):={sum(y*{0,1}),0-sum(y*{1,0})}");
+    CHECK_EQ(EVAL(r, "abs(odeSolve(s,0,2,{1,0})-{cos(2),0-sin(2)})<10^(0-5)"), "{true, true}");
+    CHECK_ERROR(r, "odeSolve(f,0,1,1,0.5,\"euler\")");
+    CHECK_ERROR(r, "odeSolve(nosuch,0,1,1)");
+    CHECK_ERROR(r, "odeField(s,0,1,{{1,0},2})");
+
+    return check::result();
+}
@@ -0,0 +1,100 @@
+// The optimization pass on parsed statements and function bodies.
+#include "check.h"
+#include "../include/optimizer.h"
+#include "../include/parser.h"
+
+#include <cstdio>
+
+namespace {
+
+// the single statement of code, parsed and optimized
+std::unique_ptr<ast::exprnode> optimized(ti::repl &r, const std::string &code) {
+    std::vector<ti::statement> stmts = ti::parse(code, r.environment());
+    return ti::optimize(std::move(stmts.at(0).body), r.environment());
+}
+
+ast::node_kind kindOf(ti::repl &r, const std::string &code) {
+    return optimized(r, code)->kind();
+}
+
+} // namespace
+
+int main() {
+    using ast::node_kind;
+    ti::repl r;
+
+    // folding
+    CHECK(kindOf(r, "2*3+4") == node_kind::Literal);
+    CHECK_EQ(EVAL(r, "2*3+4"), "10");
+    CHECK(kindOf(r, "If 1<2 Then:x:Else:y:EndIf") == node_kind::Block); // the taken branch
+    CHECK(kindOf(r, "1/0") == node_kind::BinaryOp); // left for the runtime to report
+    CHECK_ERROR(r, "1/0");
+
+    // identities and reassociation only for operands known to be exact
+    CHECK(kindOf(r, "(2/3)+0") == node_kind::Literal);
+    CHECK(kindOf(r, "x+0") == node_kind::BinaryOp);
+    CHECK(kindOf(r, "x*1") == node_kind::BinaryOp);
+    CHECK(kindOf(r, "x^1") == node_kind::BinaryOp);
+    {
+        auto tree = optimized(r, "(x+1)+2");
+        auto &outer = static_cast<ast::binary_op_node &>(*tree);
+        CHECK(outer.left->kind() == node_kind::BinaryOp); // not x+3
+    }
+    EVAL(r, "s:=\"text\"");
+    CHECK_ERROR(r, "s+0");
+    CHECK_ERROR(r, "s*1");
+    EVAL(r, "big:=1.e16");
+    CHECK_EQ(EVAL(r, "(big+1)+2=big+3"), "false"); // decimals round at each step
+    CHECK_EQ(EVAL(r, "(big+1)+2"), EVAL(r, "big+1+2"));
+    EVAL(r, "z:=-0.0");
+    CHECK_EQ(EVAL(r, "z+0"), EVAL(r, "0.0"));
+
+    // common subexpressions and loop invariants become let temps
+    CHECK(kindOf(r, "y:=(a+b)*(a+b)") == node_kind::Let);
+    EVAL(r, "a:=2:b:=3");
+    CHECK_EQ(EVAL(r, "y:=(a+b)*(a+b)"), "25");
+    CHECK(kindOf(r, "For i,1,3:t:=a*b+i:EndFor") == node_kind::Let);
+    CHECK_EQ(EVAL(r, "For i,1,3:t:=a*b+i:EndFor:t"), "9");
+    // a loop calling a user function could change what the invariant reads
+    EVAL(r, "Define bump()=Func:a:=a+1:a:EndFunc");
+    CHECK(kindOf(r, "For i,1,3:t:=a*b+bump():EndFor") == node_kind::For);
+    CHECK_EQ(EVAL(r, "For i,1,3:t:=a*b+bump():EndFor:t"), "17");
+    // and so could a builtin not marked pure: loadSnapshot restores a
+    EVAL(r, "saveSnapshot(\"test_optimizer.tisnap\"):a:=10");
+    CHECK(kindOf(r, "For j,1,2:u:=a*b:loadSnapshot(\"test_optimizer.tisnap\"):EndFor") == node_kind::For);
+    CHECK_EQ(EVAL(r, "For j,1,2:u:=a*b:loadSnapshot(\"test_optimizer.tisnap\"):EndFor:u"), "15");
+    std::remove("test_optimizer.tisnap");
+
+    // definitions are optimized when defined
+    EVAL(r, "Define f(x)=x*(2*3)");
+    {
+        const ti::function* f = r.environment().getFunction("f");
+        CHECK(f != nullptr);
+        auto &body = dynamic_cast<const ast::binary_op_node &>(*f->body);
+        CHECK(body.right->kind() == node_kind::Literal);
+    }
+    CHECK_EQ(EVAL(r, "f(7)"), "42");
+    EVAL(r, "Define sq2(p,q)=Func:Local m:m:=(p+q)*(p+q):m:EndFunc");
+    CHECK_EQ(EVAL(r, "sq2(1,2)"), "9");
+
+    // folding follows the calc mode, which setMode changes
+    CHECK_EQ(EVAL(r, "getMode(\"Auto or Approx\")"), "\"Auto\"");
+    CHECK_EQ(EVAL(r, "1/4+1/4"), "(1) / (2)");
+    CHECK_EQ(EVAL(r, "setMode(\"Auto or Approx\",\"Approximate\")"), "\"Auto\"");
+    CHECK_EQ(EVAL(r, "1/4+1/4"), "0.500000");
+    CHECK_EQ(EVAL(r, "setMode(\"Auto or Approx\",\"Exact\"):1/4+1/4"), "(1) / (2)");
+    CHECK_EQ(EVAL(r, "getMode(\"Auto or Approx\")"), "\"Exact\"");
+    CHECK_EQ(EVAL(r, "sqrt(8)"), "2*sqrt(2)");
+    CHECK_ERROR(r, "setMode(\"Auto or Approx\",\"Fast\")");
+    CHECK_ERROR(r, "getMode(\"Angle\")");
+    EVAL(r, "setMode(\"Auto or Approx\",\"Auto\")");
+    // function bodies are optimized again when the mode changes
+    EVAL(r, "Define half()=1/4+1/4");
+    CHECK_EQ(EVAL(r, "half()"), "(1) / (2)");
+    EVAL(r, "setMode(\"Auto or Approx\",\"Approximate\")");
+    CHECK_EQ(EVAL(r, "half()"), "0.500000");
+    EVAL(r, "setMode(\"Auto or Approx\",\"Auto\")");
+    CHECK_EQ(EVAL(r, "half()"), "(1) / (2)");
+
+    return check::result();
+}
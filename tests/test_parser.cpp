@@ -0,0 +1,112 @@
+// Parsing and the statement path of repl::expr.
+#include "check.h"
+
+int main() {
+    ti::repl r;
+
+    // precedence: ^ binds tighter than unary minus, which binds tighter than *
+    CHECK_EQ(EVAL(r, "1+2*3"), "7");
+    CHECK_EQ(EVAL(r, "-2^2"), "-4");
+    CHECK_EQ(EVAL(r, "2^3^2"), "512");
+    CHECK_EQ(EVAL(r, "2^-1"), "(1) / (2)");
+    CHECK_EQ(EVAL(r, "(1+2)(3+4)"), "21");
+    CHECK_EQ(EVAL(r, "1<2 and not 3=4"), "true");
+    CHECK_EQ(EVAL(r, "1>2 or 2/=2 xor true"), "true");
+    CHECK_EQ(EVAL(r, "2≤2 and 3≥4"), "false");
+
+    // literals and strings
+    CHECK_EQ(EVAL(r, "42"), "42");
+    CHECK_EQ(EVAL(r, "-7"), "-7");
+    CHECK_EQ(EVAL(r, "123456789012345678901234567890"), "123456789012345678901234567890");
+    CHECK_EQ(EVAL(r, "1.5e1"), EVAL(r, "15.0"));
+    CHECK_EQ(EVAL(r, "\"a:b\""), "\"a:b\"");
+    CHECK_EQ(EVAL(r, "𝑖^2"), "-1");
+    CHECK_EQ(EVAL(r, "(1+2𝑖)(3-𝑖)"), "5+5*i");
+
+    // assignment, with := and ->
+    CHECK_EQ(EVAL(r, "x:=3"), "3");
+    CHECK_EQ(EVAL(r, "10→y"), "10");
+    CHECK_EQ(EVAL(r, "Define z=y"), "10");
+    CHECK_EQ(EVAL(r, "z"), "10");
+
+    CHECK_EQ(EVAL(r, "2x^2"), "18");
+    CHECK_EQ(EVAL(r, "x+y"), "13");
+
+    // ':' and newlines separate statements; the last one is the result
+    CHECK_EQ(EVAL(r, "a:=1:b:=a:b"), "1");
+    CHECK_EQ(EVAL(r, "c:=\"one\"\n\nc"), "\"one\"");
+    CHECK_EQ(EVAL(r, "© a comment\nx"), "3");
+
+    // names are case-insensitive
+    CHECK_EQ(EVAL(r, "X"), "3");
+    CHECK_EQ(EVAL(r, "CUMSUM({1,2})"), "{1, 3}");
+
+    // definitions
+    CHECK_EQ(EVAL(r, "Define first(p,q)=p"), "Done");
+    CHECK_EQ(EVAL(r, "first(5,6)"), "5");
+    CHECK_EQ(EVAL(r, "second(p,q):=q"), "Done");
+    CHECK_EQ(EVAL(r, "second(\"s\",first(x,y))"), "3");
+    CHECK_EQ(EVAL(r, "FIRST(y,x)"), "10");
+    CHECK_EQ(EVAL(r, "Define sq(t)=t^2"), "Done");
+    CHECK_EQ(EVAL(r, "sq(12)"), "144");
+    EVAL(r, "Define fact(n)=Func\n"
+            "If n<=1 Then\n"
+            "  Return 1\n"
+            "Else\n"
+            "  Return n*fact(n-1)\n"
+            "EndIf\n"
+            "EndFunc");
+    CHECK_EQ(EVAL(r, "fact(25)"), "15511210043330985984000000");
+    EVAL(r, "Define sign(n)=Func\n"
+            "If n<0 Then\n"
+            "  -1\n"
+            "ElseIf n=0 Then\n"
+            "  0\n"
+            "Else\n"
+            "  1\n"
+            "EndIf\n"
+            "EndFunc");
+    CHECK_EQ(EVAL(r, "sign(-5)"), "-1");
+    CHECK_EQ(EVAL(r, "sign(0)"), "0");
+    CHECK_EQ(EVAL(r, "sign(5)"), "1");
+    // If cond alone guards the next statement
+    EVAL(r, "Define clamp(n)=Func:Local m:m:=n:If n>9:m:=9:m:EndFunc");
+    CHECK_EQ(EVAL(r, "clamp(12)+clamp(4)"), "13");
+    EVAL(r, "Define count(n)=Prgm\n"
+            "Local k, s\n"
+            "s:=0\n"
+            "For k,1,n\n"
+            "  s:=s+k\n"
+            "EndFor\n"
+            "While s>100\n"
+            "  s:=s-100\n"
+            "EndWhile\n"
+            "total:=s\n"
+            "EndPrgm");
+    CHECK_EQ(EVAL(r, "count(20)"), "Done");
+    CHECK_EQ(EVAL(r, "total"), "10");
+    CHECK_EQ(EVAL(r, "k"), "k"); // the Local stayed local
+    // Disp is a command; it prints its own output and its value is Done
+    CHECK_EQ(EVAL(r, "Disp"), "Done");
+
+    // errors are results with exit code 1, and leave the session usable
+    CHECK_ERROR(r, "2+");
+    CHECK_ERROR(r, "(1");
+    CHECK_ERROR(r, "first(1,");
+    CHECK_ERROR(r, "\"open");
+    CHECK_ERROR(r, "1 $ 2");
+    CHECK_ERROR(r, "1 2");
+    CHECK_ERROR(r, "Define 3=4");
+    CHECK_ERROR(r, "Define disp(x)=x");
+    CHECK_ERROR(r, "Return 1");
+    CHECK_ERROR(r, "Define f(x)=Func\nReturn 1\nx\nEndFunc");
+    CHECK_ERROR(r, "If 1 Then\n2\nEndIf");
+    CHECK_ERROR(r, "If true Then\n2");
+    CHECK_ERROR(r, "1/0");
+    CHECK_ERROR(r, "undefinedfn(1)");
+    CHECK(r.expr("(1").output.find("syntax error") != std::string::npos);
+    CHECK(r.expr("a:=1\n(").output.find("line 2") != std::string::npos);
+    CHECK_EQ(EVAL(r, "first(9,0)"), "9");
+
+    return check::result();
+}
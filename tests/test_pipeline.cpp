@@ -0,0 +1,107 @@
+// Streamed seq pipelines: a reducer over a fused pipeline gives what it
+// gives over the materialized list, and pipelines with effects are not
+// reordered. A stored seq stays lazy until something needs its elements.
+#include "check.h"
+#include "../include/lists.h"
+
+#include <cstdio>
+
+namespace {
+
+// code's result with every seq(...) in it stored to a variable first, as a
+// real list, so nothing is fused
+std::string materialized(ti::repl &r, const std::string &reducer, const std::vector<std::string> &seqs,
+                         const std::string &pipeline) {
+    std::string code = pipeline;
+    for (size_t i = 0; i < seqs.size(); ++i) {
+        const std::string name = "l" + std::to_string(i);
+        EVAL(r, name + ":=" + seqs[i]);
+        r.environment().setVariable(name, ti::asList(r.environment().getVariable(name)));
+        code.replace(code.find(seqs[i]), seqs[i].size(), name);
+    }
+    return EVAL(r, reducer + "(" + code + ")");
+}
+
+} // namespace
+
+int main() {
+    ti::repl r;
+
+    struct pipeline {
+        const char* reducer;
+        std::vector<std::string> seqs;
+        const char* body;
+    };
+    const pipeline cases[] = {
+        {"sum", {"seq(k,k,1,1000)"}, "seq(k,k,1,1000)^2+1"},
+        {"sum", {"seq(k/3,k,1,500)"}, "seq(k/3,k,1,500)"},
+        {"sum", {"seq(k,k,1,300)"}, "sqrt(seq(k,k,1,300))"},
+        {"prod", {"seq(1+1/k,k,1,200)"}, "seq(1+1/k,k,1,200)"},
+        {"max", {"seq(sin(k),k,1,2000)", "seq(cos(k),k,1,2000)"}, "seq(sin(k),k,1,2000)-seq(cos(k),k,1,2000)"},
+        {"min", {"seq(k,k,10,0-10,0-3)"}, "seq(k,k,10,0-10,0-3)*2"},
+        {"cumSum", {"seq(k,k,1,6)"}, "seq(k,k,1,6)*2"},
+        {"sum", {"seq(k,k,0.5,100,0.25)"}, "seq(k,k,0.5,100,0.25)"},
+        {"sum", {"seq(k^3-7*k,k,0-300,300)"}, "seq(k^3-7*k,k,0-300,300)*2"},
+        {"prod", {"seq(k,k,1,40)"}, "seq(k,k,1,40)"},
+        {"sum", {"seq(k/3.,k,1,900)"}, "filter(k>100,k,seq(k/3.,k,1,900))"},
+        {"cumSum", {"seq(k/4,k,1,12)"}, "filter(k>=1/2,k,seq(k/4,k,1,12))"},
+        {"max", {"seq(k^2,k,0-9,9)"}, "filter(k<50,k,seq(k^2,k,0-9,9))+1"},
+    };
+    for (const pipeline &p : cases) {
+        CHECK_EQ(EVAL(r, std::string(p.reducer) + "(" + p.body + ")"), materialized(r, p.reducer, p.seqs, p.body));
+    }
+    CHECK_EQ(EVAL(r, "cumSum(seq(k,k,1,4)*2)"), "{2, 6, 12, 20}");
+    CHECK_ERROR(r, "sum(seq(k,k,1,3)+seq(k,k,1,4))");
+
+    // exact integer ranges fold in long long arithmetic, and exactly, in
+    // boxed arithmetic, where that would overflow
+    CHECK_EQ(EVAL(r, "sum(seq(k^2,k,1,10^6))"), "333333833333500000");
+    CHECK_EQ(EVAL(r, "sum(seq(k^3,k,1,10^5))"), "25000500002500000000");
+    CHECK_EQ(EVAL(r, "sum(seq(2^k,k,0,70))"), "2361183241434822606847");
+    CHECK_EQ(EVAL(r, "prod(seq(k,k,1,25))"), "15511210043330985984000000");
+    CHECK_EQ(EVAL(r, "sum(seq(k,k,9223372036854775800,9223372036854775807))"), "73786976294838206428");
+    CHECK_EQ(EVAL(r, "sum(2*seq(k,k,1,10^6)-1)"), "1000000000000");
+    EVAL(r, "t:=0:For k,1,200:t:=t+k/3+k^2:EndFor");
+    CHECK_EQ(EVAL(r, "sum(seq(k/3+k^2,k,1,200))"), EVAL(r, "t"));
+
+    // a stored seq is lazy: reducers stream it, anything else sees its list
+    CHECK_EQ(EVAL(r, "l:=seq(k^2,k,1,5)"), "{1, 4, 9, 16, 25}");
+    CHECK(r.environment().getVariable("l")->kind() == ti::value_kind::LazySeq);
+    CHECK_EQ(EVAL(r, "sum(l)"), "55");
+    CHECK_EQ(EVAL(r, "sum(l,2,3)"), "13");
+    CHECK_EQ(EVAL(r, "l+1"), "{2, 5, 10, 17, 26}");
+    CHECK_EQ(EVAL(r, "l={1,4,9,16,25}"), "{true, true, true, true, true}");
+    CHECK_EQ(EVAL(r, "when(l>10,1,0)"), "{0, 0, 0, 1, 1}");
+    // variables are read when seq runs, as for a list built then
+    EVAL(r, "a:=2:m:=seq(a*k,k,1,3):a:=10");
+    CHECK_EQ(EVAL(r, "m"), "{2, 4, 6}");
+    // only expressions that cannot fail are put off
+    CHECK_ERROR(r, "bad:=seq(1/(k-2),k,1,3)");
+    EVAL(r, "saveSnapshot(\"test_pipeline.tisnap\"):l:=0:loadSnapshot(\"test_pipeline.tisnap\")");
+    CHECK_EQ(EVAL(r, "l"), "{1, 4, 9, 16, 25}");
+    std::remove("test_pipeline.tisnap");
+
+    // filter, alone and as a pipeline stage
+    CHECK_EQ(EVAL(r, "filter(k>2,k,{1,5,2,7})"), "{5, 7}");
+    CHECK_EQ(EVAL(r, "filter(k>2,k,seq(k,k,1,0))"), "{}");
+    CHECK_EQ(EVAL(r, "sum(filter(k^2<10^10,k,seq(k,k,1,10^6)))"), "4999950000");
+    CHECK_EQ(EVAL(r, "sum(filter(k<3 or k>8,k,seq(k,k,1,10)))"), "22");
+    CHECK_EQ(EVAL(r, "sum(filter(k>2,k,seq(k,k,1,10)),2,3)"), "9");
+    CHECK_EQ(EVAL(r, "sum(filter(k>5,k,seq(k,k,1,10))+seq(k,k,1,5))"), "55");
+    CHECK_ERROR(r, "sum(filter(k>5,k,seq(k,k,1,10))+seq(k,k,1,4))");
+    CHECK_ERROR(r, "max(filter(k>100,k,seq(k,k,1,10)))");
+    CHECK_ERROR(r, "filter(k,k,{1,2})");
+    CHECK_ERROR(r, "filter(k>1,k,5)");
+
+    // a stage that writes runs its elements in order, one at a time
+    EVAL(r, "Define note(k)=Func:trace:=trace+1:last:=k:k:EndFunc");
+    EVAL(r, "trace:=0");
+    CHECK_EQ(EVAL(r, "sum(seq(note(k),k,1,10)*2)"), "110");
+    CHECK_EQ(EVAL(r, "trace"), "10");
+    CHECK_EQ(EVAL(r, "last"), "10");
+    EVAL(r, "trace:=0");
+    CHECK_EQ(EVAL(r, "sum(filter(note(k)>5,k,seq(k,k,1,10)))"), "40");
+    CHECK_EQ(EVAL(r, "trace"), "10");
+
+    return check::result();
+}
@@ -0,0 +1,55 @@
+// Polynomials: exact arithmetic, division, gcd, square-free parts and real
+// roots to full precision.
+#include "check.h"
+#include "../include/lists.h"
+#include "../include/parser.h"
+
+#include <cmath>
+
+namespace {
+
+// the elements of the list code evaluates to, as doubles
+std::vector<double> roots(ti::repl &r, const std::string &code) {
+    std::vector<ti::statement> stmts = ti::parse(code, r.environment());
+    const ti::valptr_t v = ti::asList(stmts.at(0).body->eval(r.environment()));
+    std::vector<double> out;
+    for (const auto &x : static_cast<const ti::valuelist &>(*v).elements()) out.push_back(ti::toDouble(*x));
+    return out;
+}
+
+// the largest distance from xs to expected, in units of the last place
+double ulps(const std::vector<double> &xs, const std::vector<double> &expected) {
+    if (xs.size() != expected.size()) return INFINITY;
+    double worst = 0;
+    for (size_t i = 0; i < xs.size(); ++i) {
+        worst = std::max(worst, std::fabs(xs[i] - expected[i]) / std::nextafter(std::fabs(expected[i]), INFINITY) /
+                                    std::numeric_limits<double>::epsilon());
+    }
+    return worst;
+}
+
+} // namespace
+
+int main() {
+    ti::repl r;
+
+    CHECK_EQ(EVAL(r, "expand((x+1)^3,x)"), "x^3+3*x^2+3*x+1");
+    CHECK_EQ(EVAL(r, "polyQuotient(x^3-1,x-1,x)"), "x^2+x+1");
+    CHECK_EQ(EVAL(r, "polyRemainder(x^3+2,x-1,x)"), "3");
+    CHECK_EQ(EVAL(r, "polyGcd(x^2-1,x^2+2*x+1,x)"), "x+1");
+    CHECK_EQ(EVAL(r, "polyDegree(x^5-x,x)"), "5");
+    CHECK_EQ(EVAL(r, "polyEval({1,0,0-2},3)"), "7");
+
+    const double s = std::sqrt(2.0);
+    CHECK(ulps(roots(r, "polyRoots(x^2-2,x)"), {-s, s}) <= 1);
+    CHECK(ulps(roots(r, "polyRoots((x-1)^2*(x-3),x)"), {1, 1, 3}) <= 1);
+    // past the bisection degree the roots get an exact Newton step, and the
+    // complex pairs around -1 do not pass for real ones
+    CHECK(ulps(roots(r, "polyRoots((x^2-2)*(x^301+1),x)"), {-s, -1, s}) <= 1);
+    // decimal coefficients: Newton on the polynomial as given
+    std::vector<double> ks;
+    for (int k = 1; k <= 8; ++k) ks.push_back(k);
+    CHECK(ulps(roots(r, "polyRoots((x-1.)*(x-2.)*(x-3.)*(x-4.)*(x-5.)*(x-6.)*(x-7.)*(x-8.),x)"), ks) <= 1e4);
+
+    return check::result();
+}
@@ -0,0 +1,83 @@
+// Random variates: a pure function of seed and position, so replayable and
+// independent of batch size, with the right ranges and moments.
+#include "check.h"
+#include "../include/random.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+int main() {
+    constexpr size_t N = 1 << 20;
+    std::vector<double> whole(N), pieces(N);
+
+    // one call or many small ones, the stream is the same
+    ti::random_state a{42, 0}, b{42, 0};
+    ti::randomUniform(a, whole.data(), N);
+    for (size_t at = 0, step = 1; at < N; at += step, step = step % 37 + 1) {
+        ti::randomUniform(b, pieces.data() + at, std::min(step, N - at));
+    }
+    CHECK(whole == pieces);
+    CHECK_EQ(a.position, N);
+    CHECK_EQ(b.position, N);
+    ti::random_state other{43, 0};
+    ti::randomUniform(other, pieces.data(), N);
+    CHECK(whole != pieces);
+
+    double sum = 0, sumSq = 0;
+    bool open = true;
+    for (double x : whole) {
+        open = open && x > 0 && x < 1;
+        sum += x;
+        sumSq += x * x;
+    }
+    CHECK(open);
+    CHECK(std::fabs(sum / N - 0.5) < 0.002);
+    CHECK(std::fabs(sumSq / N - sum * sum / N / N - 1.0 / 12) < 0.001);
+
+    ti::random_state n{7, 0}, m{7, 0};
+    ti::randomNormal(n, whole.data(), N);
+    ti::randomNormal(m, pieces.data(), 1000);
+    ti::randomNormal(m, pieces.data() + 1000, N - 1000);
+    CHECK(whole == pieces);
+    sum = sumSq = 0;
+    size_t tail = 0;
+    for (double x : whole) {
+        sum += x;
+        sumSq += x * x;
+        if (std::fabs(x) > 3) ++tail;
+    }
+    CHECK(std::fabs(sum / N) < 0.005);
+    CHECK(std::fabs(sumSq / N - 1) < 0.01);
+    // P(|x| > 3) = 0.0027
+    CHECK(std::fabs(static_cast<double>(tail) / N - 0.0027) < 0.0005);
+
+    std::vector<int64_t> ints(60000);
+    ti::random_state d{1, 0};
+    ti::randomIntegers(d, 1, 6, ints.data(), ints.size());
+    size_t faces[7] = {};
+    bool inRange = true;
+    for (int64_t x : ints) {
+        inRange = inRange && x >= 1 && x <= 6;
+        if (x >= 1 && x <= 6) ++faces[x];
+    }
+    CHECK(inRange);
+    for (int f = 1; f <= 6; ++f) CHECK(faces[f] > 9400 && faces[f] < 10600);
+    // the full range has no room for an off-by-one
+    ti::randomIntegers(d, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(), ints.data(), 1000);
+
+    ti::repl r;
+    EVAL(r, "RandSeed 42");
+    const std::string first = EVAL(r, "{rand(),randInt(1,6,5),randNorm(0,1),randSamp({1,2,3},4)}");
+    EVAL(r, "RandSeed 42");
+    CHECK_EQ(EVAL(r, "{rand(),randInt(1,6,5),randNorm(0,1),randSamp({1,2,3},4)}"), first);
+    CHECK_EQ(EVAL(r, "max(randInt(3,5,1000))"), "5");
+    CHECK_EQ(EVAL(r, "min(randInt(3,5,1000))"), "3");
+    // without replacement every element is picked once
+    CHECK_EQ(EVAL(r, "sum(randSamp({1,2,4,8,16},5,1))"), "31");
+    CHECK_ERROR(r, "randSamp({1,2,3},5,1)");
+    CHECK_ERROR(r, "randSamp({},2)");
+    CHECK_ERROR(r, "rand(0-1)");
+
+    return check::result();
+}
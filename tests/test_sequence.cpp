@@ -0,0 +1,32 @@
+// Sequences: term tables, linear-recurrence jumps, seqGen, and the purity
+// that decides whether calls may be folded or cached.
+#include "check.h"
+#include "../include/runtimeenv.h"
+
+int main() {
+    ti::repl r;
+
+    EVAL(r, "seqDefine(u,n,u(n-1)+u(n-2),{0,1},0)");
+    CHECK_EQ(EVAL(r, "u(10)"), "55");
+    CHECK_EQ(EVAL(r, "u(100)"), "354224848179261915075");
+    CHECK_EQ(EVAL(r, "u({5,6})"), "{5, 8}");
+    // far past the table: the jump, not a million rule evaluations
+    CHECK_EQ(EVAL(r, "powMod(u(1000000),1,1000000007)"), "918091266");
+    CHECK_ERROR(r, "u(0-1)");
+    CHECK_EQ(EVAL(r, "seqGen(n^2,n,w,{1,5})"), "{1, 4, 9, 16, 25}");
+    CHECK(r.environment().getFunction("w") == nullptr);
+
+    // a rule reading only n and earlier terms is pure; one reading a global
+    // is not, so its calls are neither folded nor kept across statements
+    CHECK(r.environment().getFunction("u")->pure);
+    EVAL(r, "k:=1");
+    EVAL(r, "seqDefine(v,n,n+k,{0})");
+    CHECK(!r.environment().getFunction("v")->pure);
+    CHECK_EQ(EVAL(r, "v(3)"), "4");
+    EVAL(r, "k:=2");
+    CHECK_EQ(EVAL(r, "v(3)"), "5");
+    EVAL(r, "Define g()=Func:k:=5:Return v(3):EndFunc");
+    CHECK_EQ(EVAL(r, "g()"), "8");
+
+    return check::result();
+}
@@ -0,0 +1,155 @@
+// The evaluation server: framing, ordering, session isolation, limits, and
+// a client that stops reading.
+#include "check.h"
+#include "../include/server.h"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+struct response {
+    char type = 0;
+    std::string text;
+};
+
+class client {
+private:
+    int fd = -1;
+
+    bool readExactly(char* out, size_t n, int timeoutMs) {
+        while (n > 0) {
+            pollfd p{fd, POLLIN, 0};
+            if (::poll(&p, 1, timeoutMs) <= 0) return false;
+            const ssize_t got = ::read(fd, out, n);
+            if (got <= 0) return false;
+            out += got;
+            n -= static_cast<size_t>(got);
+        }
+        return true;
+    }
+
+public:
+    explicit client(const std::string &path) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof addr.sun_path - 1);
+        // the server may still be starting
+        for (int attempt = 0; attempt < 200; ++attempt) {
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == 0) return;
+            ::close(fd);
+            fd = -1;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    ~client() {
+        if (fd >= 0) ::close(fd);
+    }
+    client(const client&) = delete;
+    client& operator=(const client&) = delete;
+
+    bool connected() const { return fd >= 0; }
+
+    void send(const std::string &request) {
+        std::string frame(5, '\0');
+        for (int i = 0; i < 4; ++i) frame[i] = static_cast<char>(request.size() >> (8 * i));
+        frame[4] = 'E';
+        frame += request;
+        CHECK_EQ(::write(fd, frame.data(), frame.size()), static_cast<ssize_t>(frame.size()));
+    }
+
+    // the next response, or type 0 after timeoutMs without one
+    response receive(int timeoutMs = 10000) {
+        response r;
+        char header[5];
+        if (!readExactly(header, 5, timeoutMs)) return r;
+        size_t n = 0;
+        for (int i = 0; i < 4; ++i) n |= static_cast<size_t>(static_cast<unsigned char>(header[i])) << (8 * i);
+        r.text.resize(n);
+        if (!readExactly(r.text.data(), n, timeoutMs)) return r;
+        r.type = header[4];
+        return r;
+    }
+};
+
+} // namespace
+
+int main() {
+    const std::string path = "/tmp/ti_server_test_" + std::to_string(::getpid());
+    ti::server_options options;
+    options.socketPath = path;
+    options.workers = 1; // one worker: a blocked worker would stall everyone
+    options.timeLimit = 1;
+    options.memoryLimit = 16 << 20;
+    ti::server srv(options);
+    std::thread serving([&srv] { srv.run(); });
+
+    {
+        client a(path), b(path);
+        CHECK(a.connected() && b.connected());
+
+        // pipelined requests are answered in order
+        a.send("x:=2");
+        a.send("x^10");
+        a.send("2+");
+        a.send("x+1");
+        response r = a.receive();
+        CHECK_EQ(r.type, 'R');
+        CHECK_EQ(r.text, "2");
+        r = a.receive();
+        CHECK_EQ(r.text, "1024");
+        r = a.receive();
+        CHECK_EQ(r.type, 'X');
+        r = a.receive();
+        CHECK_EQ(r.text, "3");
+
+        // sessions have their own variables
+        b.send("x");
+        r = b.receive();
+        CHECK_EQ(r.type, 'R');
+        CHECK_EQ(r.text, "x");
+
+        // limits end a request, not the session
+        a.send("While true:EndWhile");
+        r = a.receive();
+        CHECK_EQ(r.type, 'T');
+        a.send("seq(k,k,1,2000000)");
+        r = a.receive();
+        CHECK_EQ(r.type, 'M');
+        a.send("x");
+        r = a.receive();
+        CHECK_EQ(r.text.substr(0, 20), "2");
+    }
+
+    {
+        // a client that never reads its large responses must not keep the
+        // only worker from serving someone else
+        client slow(path), other(path);
+        CHECK(slow.connected() && other.connected());
+        for (int i = 0; i < 20; ++i) slow.send("rand(20000)");
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        other.send("6*7");
+        response r = other.receive(5000);
+        CHECK_EQ(r.type, 'R');
+        CHECK_EQ(r.text, "42");
+        // and its responses still arrive, complete and in order
+        for (int i = 0; i < 20; ++i) {
+            r = slow.receive();
+            CHECK_EQ(r.type, 'R');
+            if (r.type != 'R') break;
+            CHECK_EQ(r.text.substr(0, 3), "{0.");
+            CHECK_EQ(r.text.back(), '}');
+        }
+    }
+
+    srv.stop();
+    serving.join();
+    return check::result();
+}
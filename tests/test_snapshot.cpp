@@ -0,0 +1,174 @@
+// Session snapshots: round trips, sequences, decimal lists, and files
+// damaged in ways a reader must refuse without crashing.
+#include "check.h"
+#include "../include/snapshot.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+const std::string PATH = "test_snapshot.tisnap";
+
+// a snapshot file assembled by hand: header, records, string table
+class image {
+private:
+    std::string records;
+    std::vector<std::string> strings;
+
+public:
+    image() {
+        u8(0); // mode
+        u8(0); // complex format
+        u64(0); // random seed
+        u64(0); // random position
+    }
+
+    template<typename T> image &put(T v) {
+        records.append(reinterpret_cast<const char*>(&v), sizeof v);
+        return *this;
+    }
+    image &u8(uint8_t v) { return put(v); }
+    image &u32(uint32_t v) { return put(v); }
+    image &u64(uint64_t v) { return put(v); }
+    image &str(const std::string &s) {
+        strings.push_back(s);
+        return u32(static_cast<uint32_t>(strings.size() - 1));
+    }
+
+    // node records (ast::node_kind order)
+    image &decimalLiteral(double d) { return u8(0).u8(5).put(d); }
+    image &let(uint32_t temps) { return u8(9).u32(temps); }
+    image &temp(uint32_t owner, uint64_t index, uint64_t depth) { return u8(10).u32(owner).u64(index).u64(depth); }
+    image &block(uint32_t n) { return u8(5).u32(n); }
+
+    // a function f() whose body follows
+    image &function() { return u64(0).u64(1).str("f").u32(0).u8(0).u8(1); }
+    // after the body: no sequences
+    image &done() { return u64(0); }
+
+    void write(const std::string &path) const {
+        std::string table;
+        for (const auto &s : strings) {
+            const auto n = static_cast<uint32_t>(s.size());
+            table.append(reinterpret_cast<const char*>(&n), sizeof n);
+            table += s;
+        }
+        const uint64_t stringsOffset = 64 + records.size();
+        const uint64_t stringCount = strings.size();
+        const uint64_t fileSize = stringsOffset + table.size();
+        const uint32_t version = 2;
+        const uint32_t byteOrder = 0x01020304;
+        char head[64] = {};
+        std::memcpy(head, "TISNAP\r\n", 8);
+        std::memcpy(head + 8, &version, 4);
+        std::memcpy(head + 12, &byteOrder, 4);
+        std::memcpy(head + 16, &stringsOffset, 8);
+        std::memcpy(head + 24, &stringCount, 8);
+        std::memcpy(head + 32, &fileSize, 8);
+        std::ofstream out(path, std::ios::binary);
+        out.write(head, sizeof head);
+        out << records << table;
+    }
+};
+
+// whether a fresh repl can load img
+bool loads(const image &img) {
+    img.write(PATH);
+    ti::repl r;
+    try {
+        ti::loadSnapshot(r.environment(), PATH);
+        return true;
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+}
+
+} // namespace
+
+int main() {
+    {
+        ti::repl r;
+        EVAL(r, "a:=2/3");
+        EVAL(r, "b:={1.5,2.25,-3.}");
+        EVAL(r, "c:={1,2.5}");
+        EVAL(r, "f(x):=(x*x+1)*(x*x+1)+x*x");
+        EVAL(r, "seqDefine(u,n,u(n-1)+u(n-2),{1,1})");
+        const std::string b = EVAL(r, "b");
+        const std::string c = EVAL(r, "c");
+        const std::string f = EVAL(r, "f(3)");
+        CHECK_EQ(f, "109");
+        CHECK_EQ(EVAL(r, "u(30)"), "832040");
+        const ti::snapshot_stats saved = ti::saveSnapshot(r.environment(), PATH);
+        CHECK_EQ(saved.variables, 3u);
+        CHECK_EQ(saved.functions, 1u);
+        CHECK_EQ(saved.sequences, 1u);
+
+        ti::repl fresh;
+        const ti::snapshot_stats loaded = ti::loadSnapshot(fresh.environment(), PATH);
+        CHECK_EQ(loaded.sequences, 1u);
+        CHECK_EQ(EVAL(fresh, "a"), "(2) / (3)");
+        CHECK_EQ(EVAL(fresh, "b"), b);
+        CHECK_EQ(EVAL(fresh, "c"), c);
+        CHECK_EQ(EVAL(fresh, "f(3)"), f);
+        CHECK_EQ(EVAL(fresh, "u(30)"), "832040");
+        CHECK_EQ(EVAL(fresh, "u({3,4})"), "{2, 3}");
+    }
+
+    // lists nest as deep as the cap allows, and deeper ones fail to save
+    {
+        ti::repl r;
+        EVAL(r, "l:={}");
+        EVAL(r, "For i,1,900:l:={l}:EndFor");
+        CHECK_EQ(ti::saveSnapshot(r.environment(), PATH).variables, 2u);
+        ti::repl fresh;
+        ti::loadSnapshot(fresh.environment(), PATH);
+        EVAL(r, "For i,1,200:l:={l}:EndFor");
+        CHECK_THROWS(ti::saveSnapshot(r.environment(), PATH));
+    }
+
+    // a million nested lists are refused, not recursed into
+    {
+        image img;
+        img.u64(1).str("x");
+        for (int i = 0; i < 1000000; ++i) img.u8(8).u64(1);
+        img.u8(0).u64(0).done();
+        CHECK(!loads(img));
+    }
+
+    // temps must name an enclosing let at its depth
+    {
+        image ok;
+        ok.function().let(1).decimalLiteral(2).temp(0, 0, 0).done();
+        CHECK(loads(ok));
+
+        image nested;
+        nested.function().let(1).decimalLiteral(2).let(1).decimalLiteral(3).temp(0, 0, 0).done();
+        CHECK(loads(nested));
+
+        image inner;
+        inner.function().let(1).decimalLiteral(2).let(1).decimalLiteral(3).temp(1, 0, 1).done();
+        CHECK(loads(inner));
+
+        image wrongDepth;
+        wrongDepth.function().let(1).decimalLiteral(2).temp(0, 0, 1).done();
+        CHECK(!loads(wrongDepth));
+
+        image swapped;
+        swapped.function().let(1).decimalLiteral(2).let(1).decimalLiteral(3).temp(0, 0, 1).done();
+        CHECK(!loads(swapped));
+
+        image closed;
+        closed.function().block(2).let(1).decimalLiteral(2).decimalLiteral(0).temp(0, 0, 0).done();
+        CHECK(!loads(closed));
+
+        image badIndex;
+        badIndex.function().let(1).decimalLiteral(2).temp(0, 1, 0).done();
+        CHECK(!loads(badIndex));
+    }
+
+    std::remove(PATH.c_str());
+    return check::result();
+}
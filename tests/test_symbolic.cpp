@@ -0,0 +1,62 @@
+// Symbolic expressions: canonical forms, hash-consing, derivatives, and
+// values substituted once variables are defined.
+#include "check.h"
+#include "../include/symbolic.h"
+
+int main() {
+    using ti::sym_node;
+
+    // structurally equal means the same node
+    const ti::symptr x = sym_node::symbol("x");
+    const ti::symptr two = sym_node::number(std::make_shared<ti::integer>(2));
+    const ti::symptr a = sym_node::add({sym_node::mul({two, x}), x});
+    const ti::symptr b = sym_node::add({sym_node::mul({two, sym_node::symbol("x")}), sym_node::symbol("x")});
+    CHECK(a == b);
+    // x + 2x and 3x simplify to one node
+    const ti::symptr three = sym_node::number(std::make_shared<ti::integer>(3));
+    CHECK(ti::simplify(a) == ti::simplify(sym_node::mul({x, three})));
+    CHECK(ti::simplify(ti::simplify(a)) == ti::simplify(a));
+    CHECK(ti::derivative(sym_node::pow(x, three), x) == ti::simplify(sym_node::mul({three, sym_node::pow(x, two)})));
+
+    // nodes die with their last user
+    const size_t before = sym_node::liveCount();
+    {
+        const ti::symptr big = sym_node::add({sym_node::symbol("q1"), sym_node::symbol("q2"), sym_node::symbol("q3")});
+        CHECK(sym_node::liveCount() > before);
+    }
+    CHECK_EQ(sym_node::liveCount(), before);
+
+    ti::repl r;
+    CHECK_EQ(EVAL(r, "x+x"), "2*x");
+    CHECK_EQ(EVAL(r, "x*x*2"), "2*x^2");
+    CHECK_EQ(EVAL(r, "(x+1)^2-(x+1)^2"), "0");
+    CHECK_EQ(EVAL(r, "x+y-x"), "y");
+    CHECK_EQ(EVAL(r, "d(x^3,x)"), "3*x^2");
+    CHECK_EQ(EVAL(r, "d(sin(x)*x,x)"), "x*cos(x)+sin(x)");
+    CHECK_EQ(EVAL(r, "(x+y)=(y+x)"), "true");
+
+    // π and e stay exact until a decimal, a numeric function or an ordering
+    // needs their value
+    CHECK_EQ(EVAL(r, "2*π"), "2*π");
+    CHECK_EQ(EVAL(r, "π*1.0"), "3.141593");
+    CHECK_EQ(EVAL(r, "2.*π+e"), "9.001467");
+    CHECK_EQ(EVAL(r, "sin(π/2)"), "1.000000");
+    CHECK_EQ(EVAL(r, "sqrt(π)"), "1.772454");
+    CHECK_EQ(EVAL(r, "nInt(sin(t),t,0,π)"), "2.000000");
+    CHECK_EQ(EVAL(r, "π>3 and π<e+1"), "true");
+    CHECK_EQ(EVAL(r, "sin(w*π)"), "sin(w*π)");
+    CHECK_ERROR(r, "w<π");
+    EVAL(r, "setMode(\"Auto or Approx\",\"Approximate\")");
+    CHECK_EQ(EVAL(r, "π/4"), "0.785398");
+    EVAL(r, "setMode(\"Auto or Approx\",\"Exact\")");
+    CHECK_EQ(EVAL(r, "sin(π)"), "sin(π)");
+    EVAL(r, "setMode(\"Auto or Approx\",\"Auto\")");
+
+    // defining a variable substitutes it from then on
+    EVAL(r, "x:=3");
+    CHECK_EQ(EVAL(r, "x+y"), "y+3");
+    EVAL(r, "y:=2");
+    CHECK_EQ(EVAL(r, "x+y"), "5");
+
+    return check::result();
+}
@@ -0,0 +1,61 @@
+// The work-stealing pool: every task runs once, the lowest failure wins,
+// nested calls finish, and parallel builtins match a single thread.
+#include "check.h"
+#include "../include/threadpool.h"
+
+#include <atomic>
+#include <stdexcept>
+
+int main() {
+    ti::thread_pool pool(4);
+
+    std::vector<std::atomic<int>> runs(10000);
+    pool.run(runs.size(), [&runs](size_t i) { ++runs[i]; });
+    bool once = true;
+    for (const auto &n : runs) once = once && n.load() == 1;
+    CHECK(once);
+
+    // as a serial loop would report it, whichever thread hits which first
+    try {
+        pool.run(1000, [](size_t i) {
+            if (i % 100 == 37) throw std::runtime_error(std::to_string(i));
+        });
+        CHECK(false);
+    } catch (const std::runtime_error &e) {
+        CHECK_EQ(std::string(e.what()), "37");
+    }
+
+    // a task that starts its own parallel call does not wait on the pool
+    std::atomic<long> total{0};
+    pool.run(8, [&pool, &total](size_t) {
+        pool.run(100, [&total](size_t j) { total += static_cast<long>(j); });
+    });
+    CHECK_EQ(total.load(), 8 * 4950L);
+
+    // chunks depend on n and grain only
+    std::vector<std::pair<size_t, size_t>> chunks(4);
+    std::atomic<size_t> seen{0};
+    ti::parallelFor(1000, 300, [&](size_t begin, size_t end) {
+        chunks[begin / 300] = {begin, end};
+        ++seen;
+    });
+    CHECK_EQ(seen.load(), 4u);
+    CHECK(chunks[3].first == 900 && chunks[3].second == 1000);
+
+    // the builtins give the same answers, exact or not, on one thread
+    ti::repl r;
+    EVAL(r, "f(k):=k^3-k/7");
+    const char* codes[] = {"sum(seq(1/k,k,1,300))", "prod(seq(1+1/k,k,1,3000))", "sum(seq(f(k/10.),k,1,50000))",
+                           "sum(abs(seq(f(k/10.),k,0-500,500)))", "seq(k,k,1,3000)*2.5+seq(k,k,1,3000)",
+                           "max(seq(f(k),k,0-500,500))", "seq(k^2,k,1,6)"};
+    std::vector<std::string> parallel;
+    for (const char* code : codes) parallel.push_back(EVAL(r, code));
+    ti::thread_pool &shared = ti::thread_pool::shared();
+    const size_t threads = shared.getMaxThreads();
+    shared.setMaxThreads(1);
+    for (size_t i = 0; i < parallel.size(); ++i) CHECK_EQ(EVAL(r, codes[i]), parallel[i]);
+    shared.setMaxThreads(threads);
+    CHECK_EQ(parallel[1], "3001");
+
+    return check::result();
+}